@@ -33,6 +33,8 @@
 #include <getopt.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <pthread.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <dirent.h>
@@ -45,6 +47,15 @@
 #include "netlink_logs.h"
 #include "netlink_devices.h"
 #include "uevent_devices.h"
+#include "netlink_loop.h"
+#include "netlink_threads.h"
+#include "netlink_shm.h"
+#include "netlink_broker.h"
+#include "netlink_netns.h"
+#include "netlink_stats.h"
+#include "netlink_metrics.h"
+#include "netlink_capture.h"
+#include "netlink_output.h"
 
 int running_daemon = 0;
 int netlinklogs_level = NLLOG_INFO;
@@ -53,11 +64,48 @@ int netlinklogs_detailed = 0;
 static int start_as_daemon = 0;
 static int running = 1;
 static int logsopen=0;
+static int uevent_batch = 1;
+static int link_debounce = 0;
+static int event_queue = 0;
+static int event_workers = 0;
+static int netlink_engine = NETLINKDEV_ENGINE_LIBNL;
+static int netlink_rcvbuf = 0;
+static int netlink_fast = 0;
+static int netlink_routes = 0;
+static int netlink_neighs = 0;
+static int stats_interval = 0;
+static int metrics_enabled = 0;
+static volatile sig_atomic_t metrics_dump = 0;
+static volatile sig_atomic_t signal_caught = 0;
+static sigset_t main_sigs;
+static sigset_t loop_sigs;
+static const char *record_path = NULL;
+static const char *replay_path = NULL;
+static int replay_asap = 0;
+static int log_async = 0;
+static int output_format = 0;
+static int output_fd = -1;
+static const char *state_name = NULL;
+static const char *broker_path = NULL;
+static struct ueventdev_match uevent_rules[8];
+static int uevent_nrules = 0;
+static const char *netns_paths[8];
+static int netns_npaths = 0;
 
 static struct ueventdev_info uevent_device_info;
 static struct netlinkdev_info netlink_device_info;
+static struct netlinkdev_loop event_loop;
+static struct netlinkdev_threads event_threads;
+static struct netlinkdev_metrics event_metrics;
+static struct netlinkdev_shm state_table;
+static struct netlinkdev_broker event_broker;
+static struct netlinkdev_netns event_netns;
+static struct netlinkdev_capture event_capture;
+static struct netlinkdev_output event_output;
 static char interface_poll_name[80];
 
+static void signal_handler(int sig);
+
 #define LOG_FATAL(fmt, args...)	{ \
 	if (!logsopen) { NL_LOG_OPEN(NLLOG_FATAL); logsopen=1; } \
 	NL_LOG(NLLOG_FATAL, fmt, ## args); \
@@ -76,6 +124,15 @@ static void netevent(int event, struct netlinkdev_data *devdata, void *arg)
 
 	(void)nl;  /* possible use in future */
 
+	if (output_format) {
+		/* written out with the rest of the poll instead of logged */
+		netlinkdev_output_netlink(&event_output, event, devdata);
+		if (broker_path)
+			netlinkdev_broker_netlink(&event_broker, event, devdata);
+		return;
+	}
+	if (devdata->nsid >= 0)
+		NL_LOG(NLLOG_INFO, "interface %s event in namespace %d", devdata->if_name, devdata->nsid);
 	if (event == NETLINKDEV_EVENT_ADDR)
 	{
 		if (devdata->net_len == 0) {
@@ -92,10 +149,49 @@ static void netevent(int event, struct netlinkdev_data *devdata, void *arg)
 				devdata->status & IFF_LOWER_UP && devdata->status & IFF_UP ? "UP": "DOWN",
 				devdata->link_addr[0], devdata->link_addr[1], devdata->link_addr[2],
 				devdata->link_addr[3], devdata->link_addr[4], devdata->link_addr[5]);
+		if (devdata->collapsed)
+			NL_LOG(NLLOG_INFO, "interface LINK event collapsed %d flaps", devdata->collapsed);
+	}
+	else if (event == NETLINKDEV_EVENT_ROUTE) {
+		char gw[128] = "direct";
+		inet_ntop(devdata->net_family, devdata->net_addr, addr, sizeof(addr));
+		if (devdata->route_gwlen)
+			inet_ntop(devdata->net_family, devdata->route_gw, gw, sizeof(gw));
+		NL_LOG(NLLOG_INFO, "route %s event %s/%d table %u via %s dev %s",
+				devdata->route_action == NETLINKDEV_ROUTE_ADD ? "ADD" :
+				devdata->route_action == NETLINKDEV_ROUTE_DEL ? "DEL" : "CHANGE",
+				addr, devdata->route_dstlen, devdata->route_table, gw,
+				devdata->if_name[0] ? devdata->if_name : "none");
+	}
+	else if (event == NETLINKDEV_EVENT_NEIGH) {
+		inet_ntop(devdata->net_family, devdata->net_addr, addr, sizeof(addr));
+		NL_LOG(NLLOG_INFO, "neighbour event %s dev %s state:%#x->%#x lladdr:%02x:%02x:%02x:%02x:%02x:%02x",
+				addr, devdata->if_name[0] ? devdata->if_name : "none",
+				devdata->neigh_prevstate, devdata->neigh_state,
+				devdata->link_addr[0], devdata->link_addr[1], devdata->link_addr[2],
+				devdata->link_addr[3], devdata->link_addr[4], devdata->link_addr[5]);
 	}
 	else {
 		NL_LOG(NLLOG_ERROR, "unknown event: %d", event);
+		return;
 	}
+	if (broker_path)
+		netlinkdev_broker_netlink(&event_broker, event, devdata);
+}
+
+/**
+ * @brief	interface counters callback, once per interface and interval
+ * @param[in]	st		delta and rates over the interval
+ * @param[in] 	arg		context pointer to netlink info
+ * @return	None
+ */
+static void statsevent(const struct netlinkdev_ifstats *st, void *arg)
+{
+	NL_LOG(NLLOG_INFO, "stats %s: rx %llu B/s %llu pkt/s tx %llu B/s %llu pkt/s errors %llu/%llu drops %llu/%llu over %llu us",
+			st->if_name[0] ? st->if_name : "?", st->rx_bps, st->rx_pps, st->tx_bps, st->tx_pps,
+			(unsigned long long)st->delta.rx_errors, (unsigned long long)st->delta.tx_errors,
+			(unsigned long long)st->delta.rx_dropped, (unsigned long long)st->delta.tx_dropped,
+			st->interval_us);
 }
 
 /**
@@ -107,11 +203,29 @@ static void netevent(int event, struct netlinkdev_data *devdata, void *arg)
 static void hotplugevent(struct ueventdev_data *devdata, void *arg)
 {
 	struct ueventdev_info *ul = (struct ueventdev_info *)arg;
+	const char *subsystem = ueventdev_getprop(devdata, "SUBSYSTEM");
+	const char *action = ueventdev_getprop(devdata, "ACTION");
+	int i;
 
 	(void)ul;  /* possible use in future */
 
-	NL_LOG(NLLOG_INFO, "hotplug event: '%s' was %s", 
-		devdata->devname, devdata->action==UEVENTDEV_ACTION_ADD ? "ADDED" : "REMOVED" );
+	if (output_format) {
+		netlinkdev_output_uevent(&event_output, devdata);
+		if (broker_path)
+			netlinkdev_broker_uevent(&event_broker, devdata);
+		return;
+	}
+	NL_LOG(NLLOG_INFO, "hotplug event: '%s' was %s (action: %s, subsystem: %s)", 
+		devdata->devname, devdata->action == UEVENTDEV_ACTION_ADD ? "ADDED" :
+		devdata->action == UEVENTDEV_ACTION_REMOVE ? "REMOVED" : "OTHER",
+		action ? action : "none", subsystem ? subsystem : "none" );
+	if (LOG_DETAILS) {
+		for (i = 0; i < devdata->nprops; i++)
+			NL_LOG(NLLOG_DEBUG, "  %.*s=%s", devdata->props[i].keylen, devdata->props[i].key,
+				devdata->props[i].value);
+	}
+	if (broker_path)
+		netlinkdev_broker_uevent(&event_broker, devdata);
 }
 
 
@@ -122,12 +236,126 @@ static void hotplugevent(struct ueventdev_data *devdata, void *arg)
  */
 static int init(void)
 {
-	int stat;
+	int stat, i;
 
-	stat = netlinkdev_start( &netlink_device_info, netevent, &netlink_device_info);
+	if (output_format) {
+		/* before the contexts start, the fast start reports events */
+		stat = netlinkdev_output_start( &event_output, output_fd, output_format );
+		if (stat)
+			return stat;
+	}
+	if (replay_path) {
+		/* the datagrams come from the capture instead of the sockets */
+		stat = netlinkdev_capture_open( &event_capture, replay_path );
+		if (!stat)
+			stat = netlinkdev_startengine( &netlink_device_info,
+						       netlink_engine | NETLINKDEV_START_OFFLINE,
+						       netevent, &netlink_device_info);
+	}
+	else
+		stat = netlinkdev_startengine( &netlink_device_info, netlink_engine | netlink_fast,
+					       netevent, &netlink_device_info);
+	if (!stat && record_path) {
+		/* before the fast start and the route and neighbour dumps, so they are recorded */
+		stat = netlinkdev_capture_create( &event_capture, record_path );
+		if (!stat)
+			stat = netlinkdev_setcapture( &netlink_device_info, &event_capture );
+	}
+	if (!stat && metrics_enabled) {
+		/* both sockets count into the same place */
+		stat = netlinkdev_setmetrics( &netlink_device_info, &event_metrics );
+	}
+	if (!stat && link_debounce) {
+		stat = netlinkdev_setdebounce( &netlink_device_info, link_debounce );
+	}
+	if (!stat && netlink_rcvbuf) {
+		stat = netlinkdev_setrcvbuf( &netlink_device_info, netlink_rcvbuf );
+	}
+	if (!stat && event_queue) {
+		/* events are read back after each poll instead of the callback */
+		stat = netlinkdev_setqueue( &netlink_device_info, event_queue );
+	}
+	if (!stat && state_name) {
+		/* other processes read the interface state from shared memory */
+		stat = netlinkdev_shm_create( &state_table, state_name, 0 );
+		if (!stat)
+			stat = netlinkdev_setshm( &netlink_device_info, &state_table );
+	}
+	if (!stat && strlen(interface_poll_name) > 0) {
+		/* have the kernel drop events for every other interface */
+		stat = netlinkdev_watchname( &netlink_device_info, interface_poll_name );
+	}
+	if (!stat && netlink_fast && !replay_path) {
+		/* only the watched interfaces are dumped once the watch is set */
+		stat = netlinkdev_boot( &netlink_device_info );
+	}
 	if (!stat) {
+		NL_LOG(NLLOG_INFO, "netlink state loaded in %lu us", netlink_device_info.startup_us);
+	}
+	if (!stat && netlink_routes) {
+		/* routes are looked up locally instead of asking the kernel */
+		stat = netlinkdev_setroutes( &netlink_device_info );
+	}
+	if (!stat && netlink_neighs) {
+		/* after the watch, only the neighbours of watched interfaces are kept */
+		stat = netlinkdev_setneighs( &netlink_device_info );
+	}
+	if (!stat && stats_interval) {
+		/* sampled from the same loop as the events */
+		stat = netlinkdev_setstats( &netlink_device_info, stats_interval, statsevent,
+					    &netlink_device_info );
+	}
+	if (!stat && replay_path) {
+		stat = ueventdev_startoffline( &uevent_device_info, hotplugevent, &uevent_device_info);
+	}
+	else if (!stat) {
 		stat = ueventdev_start( &uevent_device_info, hotplugevent, &uevent_device_info);
 	}
+	if (!stat && record_path) {
+		stat = ueventdev_setcapture( &uevent_device_info, &event_capture );
+	}
+	if (!stat) {
+		stat = ueventdev_setbatch( &uevent_device_info, uevent_batch );
+	}
+	if (!stat && metrics_enabled) {
+		stat = ueventdev_setmetrics( &uevent_device_info, &event_metrics );
+	}
+	if (!stat && uevent_nrules) {
+		stat = ueventdev_setfilter( &uevent_device_info, uevent_rules, uevent_nrules );
+	}
+	if (!stat) {
+		stat = netlinkdev_loop_init( &event_loop );
+	}
+	if (!stat && replay_path) {
+		/* nothing to wait on, replay() drives the contexts */
+		return 0;
+	}
+	if (!stat && event_workers) {
+		/* a receiver thread owns the sockets, the callbacks run on the workers */
+		return netlinkdev_threads_start( &event_threads, &netlink_device_info,
+						 &uevent_device_info, event_workers, 0 );
+	}
+	if (!stat) {
+		stat = netlinkdev_loop_add_netlink( &event_loop, &netlink_device_info );
+	}
+	if (!stat) {
+		stat = netlinkdev_loop_add_uevent( &event_loop, &uevent_device_info );
+	}
+	if (!stat && broker_path) {
+		/* fan the events out to local clients */
+		stat = netlinkdev_broker_start( &event_broker, &event_loop, broker_path );
+	}
+	if (!stat && netns_npaths) {
+		/* the other namespaces share the loop, listening on one socket */
+		stat = netlinkdev_netns_init( &event_netns, &event_loop, netlink_engine | netlink_fast,
+					      1, netevent, NULL );
+		for (i = 0; !stat && i < netns_npaths; i++) {
+			if ((stat = netlinkdev_netns_attachpath( &event_netns, netns_paths[i] )) >= 0) {
+				NL_LOG(NLLOG_INFO, "namespace %s has id %d", netns_paths[i], stat);
+				stat = 0;
+			}
+		}
+	}
 	return stat;
 }
 
@@ -137,28 +365,74 @@ static int init(void)
  */
 static void deinit(void)
 {
+	if (event_workers)
+		netlinkdev_threads_stop( &event_threads );
+	netlinkdev_broker_stop( &event_broker );
+	if (netns_npaths)
+		netlinkdev_netns_free( &event_netns );
+	netlinkdev_loop_free( &event_loop );
 	ueventdev_stop( &uevent_device_info );
 	netlinkdev_stop( &netlink_device_info );
+	netlinkdev_shm_close( &state_table );
+	if (output_format)
+		netlinkdev_output_stop( &event_output );
+	if (record_path || replay_path) {
+		/* what is still buffered is written out */
+		netlinkdev_capture_close( &event_capture );
+	}
 }
 
 /**
- * @brief	deinitiialize test
- * @return	None
+ * @brief	wait for netlink and uevent events and process them
+ * @param[in]	timeout		milliseconds to wait, -1 to wait forever
+ * @return	result of the loop poll
  */
-static void poll(void)
+static int poll(int timeout)
 {
-	/* poll netlink events */
-	netlinkdev_poll( &netlink_device_info );
-	ueventdev_poll( &uevent_device_info );
+	struct netlinkdev_data events[32];
+	struct timespec ts;
+	int stat, n, i;
+
+	if (event_workers) {
+		/* the receiver thread owns the sockets and nothing is added to
+		 * the loop, only the signals and the interval wake this thread */
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = (timeout % 1000) * 1000000L;
+		if ((n = sigtimedwait(&main_sigs, NULL, timeout < 0 ? NULL : &ts)) > 0)
+			signal_handler(n);
+		return 0;
+	}
+	/* the signals of main_sigs are only let in while waiting */
+	stat = netlinkdev_loop_pwait( &event_loop, timeout, &loop_sigs );
+	if (stat > 0 && event_queue) {
+		while ((n = netlinkdev_read_events( &netlink_device_info, events, 32 )) > 0) {
+			for (i = 0; i < n; i++)
+				netevent(events[i].event, &events[i], &netlink_device_info);
+		}
+	}
+	if (stat > 0 && broker_path) {
+		/* one write per client for everything this cycle produced */
+		netlinkdev_broker_flush( &event_broker );
+	}
+	if (stat > 0 && output_format && (n = netlinkdev_output_flush( &event_output )) < 0) {
+		NL_LOG(NLLOG_ERROR, "output: write failed (%d)", n);
+		return n;
+	}
+	return stat;
 }
 
 static void interfacestatus(char *ifc_name)
 {
 	int stat;
 	struct netlinkdev_data ifc_data;
-	stat = netlinkdev_getnet(&netlink_device_info, ifc_name, &ifc_data);
 	char addr[128];
 
+	if (event_workers)
+		netlinkdev_threads_lock(&event_threads);
+	stat = netlinkdev_getnet(&netlink_device_info, ifc_name, &ifc_data);
+	if (event_workers)
+		netlinkdev_threads_unlock(&event_threads);
+
 	if (stat < 0) {
 		NL_LOG(NLLOG_INFO, "check status: Interface '%s' not available.", ifc_name);
 		return;
@@ -179,6 +453,120 @@ static void interfacestatus(char *ifc_name)
 			addr);
 }
 
+/**
+ * @brief	log one histogram of the instrumentation
+ * @param[in]	name		what was recorded
+ * @param[in]	h		histogram
+ * @return	None
+ */
+static void metricshist(const char *name, const struct netlinkdev_hist *h)
+{
+	NL_LOG(NLLOG_INFO, "metrics %s: count:%llu min:%llu p50:%llu p90:%llu p99:%llu p99.9:%llu max:%llu mean:%llu",
+			name, h->count, h->min,
+			netlinkdev_hist_percentile(h, 50), netlinkdev_hist_percentile(h, 90),
+			netlinkdev_hist_percentile(h, 99), netlinkdev_hist_percentile(h, 99.9),
+			h->max, h->count ? h->sum / h->count : 0);
+}
+
+/**
+ * @brief	log the instrumentation counters, histograms and cache sizes
+ * @return	None
+ */
+static void metricsdump(void)
+{
+	struct netlinkdev_metrics *mt;
+	int stat;
+
+	mt = malloc(sizeof(struct netlinkdev_metrics));
+	if (!mt)
+		return;
+	if (event_workers)
+		netlinkdev_threads_lock(&event_threads);
+	stat = netlinkdev_get_stats(&netlink_device_info, mt);
+	if (event_workers)
+		netlinkdev_threads_unlock(&event_threads);
+
+	if (stat < 0) {
+		NL_LOG(NLLOG_INFO, "metrics: not enabled, start with --metrics");
+		free(mt);
+		return;
+	}
+	NL_LOG(NLLOG_INFO, "metrics netlink: polls:%lu msgs:%lu events:%lu overflows:%lu resyncs:%lu collapsed:%lu",
+			mt->nl_polls, mt->nl_msgs, mt->nl_events, mt->overflows, mt->resyncs, mt->collapsed);
+	NL_LOG(NLLOG_INFO, "metrics uevent: polls:%lu msgs:%lu truncated:%lu discarded:%lu events:%lu",
+			mt->ue_polls, mt->ue_msgs, mt->ue_truncated, mt->ue_discarded, mt->ue_events);
+	NL_LOG(NLLOG_INFO, "metrics caches: links:%u addrs:%u routes:%u neighs:%u queued:%u dropped:%lu",
+			mt->links, mt->addrs, mt->routes, mt->neighs, mt->queued, mt->dropped);
+	metricshist("netlink latency ns", &mt->nl_latency);
+	metricshist("netlink callback ns", &mt->nl_callback);
+	metricshist("netlink events/poll", &mt->nl_batch);
+	metricshist("uevent latency ns", &mt->ue_latency);
+	metricshist("uevent callback ns", &mt->ue_callback);
+	metricshist("uevent events/poll", &mt->ue_batch);
+	free(mt);
+}
+
+/**
+ * @brief	read back the events queued while replaying a datagram
+ * @return	None
+ */
+static void replayqueue(void)
+{
+	struct netlinkdev_data events[32];
+	int n, i;
+
+	while ((n = netlinkdev_read_events( &netlink_device_info, events, 32 )) > 0) {
+		for (i = 0; i < n; i++)
+			netevent(events[i].event, &events[i], &netlink_device_info);
+	}
+}
+
+/**
+ * @brief	feed the datagrams of the capture to the offline contexts, spaced
+ * 		as they were received unless replaying as fast as possible
+ * @return	number of datagrams replayed
+ */
+static unsigned long replay(void)
+{
+	const struct netlinkdev_caprec *rec;
+	const void *data;
+	struct timespec now, due;
+	unsigned long long start, first = 0, t, us;
+	unsigned long n = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	start = (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+	while (running && (rec = netlinkdev_capture_next( &event_capture, &data )) != NULL) {
+		if (!n)
+			first = rec->ts_ns;
+		if (!replay_asap) {
+			t = start + (rec->ts_ns - first);
+			due.tv_sec = t / 1000000000ULL;
+			due.tv_nsec = t % 1000000000ULL;
+			/* SIGUSR1 interrupts the wait to dump the metrics */
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR && running) {
+				if (metrics_dump) {
+					metrics_dump = 0;
+					metricsdump();
+				}
+			}
+		}
+		if (rec->source == NETLINKDEV_CAPTURE_ROUTE)
+			netlinkdev_feed( &netlink_device_info, data, rec->len );
+		else if (rec->source == NETLINKDEV_CAPTURE_UEVENT)
+			ueventdev_feed( &uevent_device_info, data, rec->len );
+		if (event_queue)
+			replayqueue();
+		if (output_format && netlinkdev_output_flush( &event_output ) < 0)
+			break;
+		n++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	us = ((unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec - start) / 1000;
+	NL_LOG(NLLOG_INFO, "replayed %lu datagrams in %llu us", n, us);
+	return n;
+}
+
 /**
  * @brief	signal handler
  * @param[in]	sig		signal caught
@@ -189,20 +577,20 @@ static void signal_handler(int sig)
 {
 	switch(sig){
 		case SIGCHLD:
-			/* child */
-			NL_LOG(NLLOG_INFO, "Child signal catched.");
-			break;		
 		case SIGHUP:
-			/* rehash the server */
-			NL_LOG(NLLOG_INFO, "Hangup signal catched.");
-			break;		
+			/* logged from the main loop, a log entry made here could
+			 * land in the middle of one the main thread is making */
+			signal_caught = sig;
+			break;
+		case SIGUSR1:
+			/* dumped from the main loop, not from here */
+			metrics_dump = 1;
+			break;
+		case SIGINT:
 		case SIGTERM:
-			/* finalize the server */
-			NL_LOG(NLLOG_ALERT, "Terminate signal catched. Killing daemon.");
+			/* finalized by main() once the loop is left, nothing
+			 * is torn down under the code this interrupted */
 			running = 0;
-			deinit();
-			NL_LOG_CLOSE();
-			exit(EXIT_SUCCESS);
 			break;
 	}
 }
@@ -349,6 +737,7 @@ static void daemonize_me(const char *name)
  */
 static void parse_options(int argc, char *argv[])
 {
+	const char *levelname = NULL;
 	int c;
 
 	while (1)
@@ -357,13 +746,33 @@ static void parse_options(int argc, char *argv[])
 		{
 			{"daemon",	no_argument,		0,	'd'},
 			{"loglevel",	required_argument,	0,	'l'},
+			{"batch",	required_argument,	0,	'b'},
+			{"match",	required_argument,	0,	'm'},
+			{"debounce",	required_argument,	0,	'D'},
+			{"queue",	required_argument,	0,	'q'},
+			{"workers",	required_argument,	0,	'w'},
+			{"native",	no_argument,		0,	'N'},
+			{"rcvbuf",	required_argument,	0,	'R'},
+			{"fast",	no_argument,		0,	'F'},
+			{"shm",		required_argument,	0,	'S'},
+			{"broker",	required_argument,	0,	'B'},
+			{"netns",	required_argument,	0,	'n'},
+			{"routes",	no_argument,		0,	'r'},
+			{"neigh",	no_argument,		0,	'e'},
+			{"stats",	required_argument,	0,	's'},
+			{"metrics",	no_argument,		0,	'M'},
+			{"record",	required_argument,	0,	'c'},
+			{"replay",	required_argument,	0,	'p'},
+			{"asap",	no_argument,		0,	'a'},
+			{"asynclog",	required_argument,	0,	'A'},
+			{"output",	required_argument,	0,	'o'},
 			{"help",	no_argument,		0,	'h'},
 			{0, 0, 0, 0}
 		};
 		
 		int option_index = 0;	/* getopt_long stores the option index here. */
 
-		c = getopt_long (argc, argv, "dl:h", long_options, &option_index);
+		c = getopt_long (argc, argv, "dl:b:m:D:q:w:NR:FS:B:n:res:Mc:p:aA:o:h", long_options, &option_index);
 
 		if (c == -1)	/* end of options. */
 			break;
@@ -373,9 +782,114 @@ static void parse_options(int argc, char *argv[])
 			case 'd':
 				start_as_daemon = 1;
 				break;
+			case 'N':
+				netlink_engine = NETLINKDEV_ENGINE_NATIVE;
+				break;
+			case 'B':
+				broker_path = optarg;
+				break;
+			case 'S':
+				state_name = optarg;
+				break;
+			case 'r':
+				netlink_routes = 1;
+				break;
+			case 'e':
+				netlink_neighs = 1;
+				break;
+			case 'M':
+				metrics_enabled = 1;
+				break;
+			case 'c':
+				record_path = optarg;
+				break;
+			case 'p':
+				replay_path = optarg;
+				break;
+			case 'a':
+				replay_asap = 1;
+				break;
+			case 'A':
+				log_async = atoi(optarg);
+				if (log_async > 0)
+					break;
+				fprintf(stderr, "ERROR: Invalid log ring size: %s\n", optarg);
+				exit(EXIT_FAILURE);
+			case 'o':
+				if (!strcmp(optarg, "json"))
+					output_format = NETLINKDEV_OUTPUT_JSON;
+				else if (!strcmp(optarg, "binary"))
+					output_format = NETLINKDEV_OUTPUT_BINARY;
+				else if (!strcmp(optarg, "text"))
+					output_format = 0;
+				else {
+					fprintf(stderr, "ERROR: Invalid output format: %s (text, json or binary)\n", optarg);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 's':
+				stats_interval = atoi(optarg);
+				if (stats_interval > 0)
+					break;
+				fprintf(stderr, "ERROR: Invalid stats interval: %s\n", optarg);
+				exit(EXIT_FAILURE);
+			case 'n':
+				if (netns_npaths < sizeof(netns_paths)/sizeof(netns_paths[0])) {
+					netns_paths[netns_npaths++] = optarg;
+					break;
+				}
+				fprintf(stderr, "ERROR: Too many network namespaces\n");
+				exit(EXIT_FAILURE);
+			case 'F':
+				netlink_engine = NETLINKDEV_ENGINE_NATIVE;
+				netlink_fast = NETLINKDEV_START_FAST;
+				break;
+			case 'R':
+				netlink_rcvbuf = atoi(optarg);
+				if (netlink_rcvbuf > 0)
+					break;
+				fprintf(stderr, "ERROR: Invalid receive buffer size: %s\n", optarg);
+				exit(EXIT_FAILURE);
+			case 'b':
+				uevent_batch = atoi(optarg);
+				if ((uevent_batch >= 1) && (uevent_batch <= UEVENTDEV_RING_SLOTS))
+					break;
+				fprintf(stderr, "ERROR: Invalid uevent batch size: %s (1-%d)\n", optarg, UEVENTDEV_RING_SLOTS);
+				exit(EXIT_FAILURE);
+			case 'm':
+				/* [action][:subsystem] */
+				if (uevent_nrules < sizeof(uevent_rules)/sizeof(uevent_rules[0])) {
+					char *subsystem = strchr(optarg, ':');
+					if (subsystem) {
+						*subsystem++ = '\0';
+						uevent_rules[uevent_nrules].subsystem = *subsystem ? subsystem : NULL;
+					}
+					uevent_rules[uevent_nrules].action = *optarg ? optarg : NULL;
+					uevent_nrules++;
+					break;
+				}
+				fprintf(stderr, "ERROR: Too many uevent match rules\n");
+				exit(EXIT_FAILURE);
+			case 'D':
+				link_debounce = atoi(optarg);
+				if (link_debounce >= 0)
+					break;
+				fprintf(stderr, "ERROR: Invalid debounce window: %s\n", optarg);
+				exit(EXIT_FAILURE);
+			case 'q':
+				event_queue = atoi(optarg);
+				if (event_queue > 0)
+					break;
+				fprintf(stderr, "ERROR: Invalid event queue size: %s\n", optarg);
+				exit(EXIT_FAILURE);
+			case 'w':
+				event_workers = atoi(optarg);
+				if ((event_workers >= 1) && (event_workers <= NETLINKDEV_THREADS_MAXWORKERS))
+					break;
+				fprintf(stderr, "ERROR: Invalid number of workers: %s (1-%d)\n", optarg, NETLINKDEV_THREADS_MAXWORKERS);
+				exit(EXIT_FAILURE);
 			case 'l':
 				if ((strlen(optarg)==1) && (optarg[0] >= '0') && (optarg[0] <=  '6')) {
-					const char *levelname;
 					switch (optarg[0])
 					{
 						case '0': netlinklogs_level = NLLOG_FATAL; levelname="FATAL"; break;
@@ -386,18 +900,49 @@ static void parse_options(int argc, char *argv[])
 						case '6': netlinklogs_detailed = 1;
 						case '5': netlinklogs_level = NLLOG_DEBUG; levelname="DEBUG"; break;
 					}
-					fprintf(stdout, "Log level set to %s\n", levelname);
 					break;
 				}
 				fprintf(stderr, "ERROR: Invalid log level: %s\n", optarg);
 			case 'h':
 			case '?':
 				/* getopt_long already printed an error message. */
-				fprintf(stderr, "Usage:	%s [--daemon|-d] [--loglevel|-l <level>] [--help|-h] [interface-name]\n", argv[0]);
+				fprintf(stderr, "Usage:	%s [--daemon|-d] [--loglevel|-l <level>] [--batch|-b <n>] [--match|-m <action>:<subsystem>] [--debounce|-D <ms>] [--queue|-q <n>] [--workers|-w <n>] [--native|-N] [--rcvbuf|-R <bytes>] [--fast|-F] [--shm|-S <name>] [--broker|-B <path>] [--netns|-n <path>] [--routes|-r] [--neigh|-e] [--stats|-s <ms>] [--metrics|-M] [--record|-c <file>] [--replay|-p <file>] [--asap|-a] [--asynclog|-A <n>] [--output|-o text|json|binary] [--help|-h] [interface-name]\n", argv[0]);
 			default:
 				exit(EXIT_FAILURE);
 		}
 	}
+	if (broker_path && event_workers) {
+		fprintf(stderr, "ERROR: The broker can't be used with workers\n");
+		exit(EXIT_FAILURE);
+	}
+	if (netns_npaths && event_workers) {
+		fprintf(stderr, "ERROR: Network namespaces can't be used with workers\n");
+		exit(EXIT_FAILURE);
+	}
+	if (netns_npaths && record_path) {
+		fprintf(stderr, "ERROR: Network namespaces can't be recorded\n");
+		exit(EXIT_FAILURE);
+	}
+	if (replay_path && (record_path || start_as_daemon || event_workers || netns_npaths || broker_path ||
+			    link_debounce || stats_interval || netlink_rcvbuf)) {
+		fprintf(stderr, "ERROR: A replay can't be used with --record, --daemon, --workers, --netns, --broker, --debounce, --stats or --rcvbuf\n");
+		exit(EXIT_FAILURE);
+	}
+	if (output_format && (start_as_daemon || event_workers)) {
+		fprintf(stderr, "ERROR: --output can't be used with --daemon or --workers\n");
+		exit(EXIT_FAILURE);
+	}
+	if (output_format) {
+		/* the records get stdout to themselves, everything else goes to stderr */
+		fflush(stdout);
+		output_fd = dup(STDOUT_FILENO);
+		if (output_fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+			fprintf(stderr, "ERROR: Could not redirect stdout\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (levelname)
+		fprintf(stdout, "Log level set to %s\n", levelname);
 	interface_poll_name[0] = '\0';
 	if (optind < argc) {
 		strncpy(interface_poll_name, argv[optind], sizeof(interface_poll_name));
@@ -415,39 +960,102 @@ static void parse_options(int argc, char *argv[])
  */
 int main(int argc, char *argv[])
 {
-
 	parse_options(argc, argv);
 
 	if (start_as_daemon) {
 		fprintf(stdout, "Starting Netlink Test as daemon...\n");
 		running_daemon = 1;
+		if (!state_name)
+			state_name = NETLINKDEV_SHM_NAME;
+		if (!broker_path && !event_workers)
+			broker_path = NETLINKDEV_BROKER_PATH;
 		daemonize_me(argv[0]);
 	}
 
 	NL_LOG_OPEN(netlinklogs_level);
+	/* entries are formatted into a ring written out by a thread */
+	if (log_async && netlinklogs_async_start(log_async) < 0) {
+		fprintf(stderr, "ERROR: Could not start the log writer\n");
+		exit(EXIT_FAILURE);
+	}
 
 	NL_LOG(NLLOG_INFO, "Netlink Test Started.");
 
+	/* threads started by init inherit the mask, so the signals are
+	 * handled by the main thread only, and only while it waits in the
+	 * loop: one arriving between the check of running and the wait
+	 * interrupts the wait instead of going unnoticed */
+	sigemptyset(&main_sigs);
+	sigaddset(&main_sigs, SIGUSR1);
+	sigaddset(&main_sigs, SIGINT);
+	sigaddset(&main_sigs, SIGTERM);
+	if (running_daemon) {
+		/* handlers installed by daemonize_me() */
+		sigaddset(&main_sigs, SIGCHLD);
+		sigaddset(&main_sigs, SIGHUP);
+	}
+	signal(SIGUSR1, signal_handler);
+	signal(SIGINT, signal_handler);
+	signal(SIGTERM, signal_handler);
+	if (output_format) {
+		/* a reader going away fails the writev, which ends the loop */
+		signal(SIGPIPE, SIG_IGN);
+	}
+	pthread_sigmask(SIG_BLOCK, &main_sigs, &loop_sigs);
+
 	if (init() < 0) {
 		NL_LOG(NLLOG_FATAL, "Failure during init.");
 		NL_LOG_CLOSE();
 		exit(EXIT_FAILURE);
 	}
+	if (output_format) {
+		/* the events reported while loading the state */
+		netlinkdev_output_flush( &event_output );
+	}
+
+	if (replay_path) {
+		/* the waits between datagrams are interrupted by the signals,
+		 * running is checked after each */
+		pthread_sigmask(SIG_SETMASK, &loop_sigs, NULL);
+		/* the contexts end up as they were when the capture stopped */
+		replay();
+		if (strlen(interface_poll_name) > 0)
+			interfacestatus(interface_poll_name);
+		if (metrics_enabled)
+			metricsdump();
+		running = 0;
+	}
 
 	while (running) {
 
-		/* Process any netlink events */
-		poll();
+		/* Process netlink events as they arrive, only wake up
+		 * periodically when an interface is being monitored */
+		if (poll(strlen(interface_poll_name) > 0 ? 1000 : -1) < 0)
+			break;
 
 		if (strlen(interface_poll_name) > 0)
 			interfacestatus(interface_poll_name);
 
-		sleep(1);
+		if (metrics_dump) {
+			metrics_dump = 0;
+			metricsdump();
+		}
+
+		if (signal_caught) {
+			NL_LOG(NLLOG_INFO, "%s signal catched.", signal_caught == SIGHUP ? "Hangup" : "Child");
+			signal_caught = 0;
+		}
 	}
 
 	NL_LOG(NLLOG_INFO, "Netlink Test Stopping.");
+	NL_LOG(NLLOG_INFO, "netlink overflows:%lu resyncs:%lu",
+	       netlink_device_info.overflows, netlink_device_info.resyncs);
 
 	deinit();
+	if (output_format)
+		NL_LOG(NLLOG_INFO, "output records:%lu writes:%lu", event_output.records, event_output.writes);
+	if (log_async)
+		NL_LOG(NLLOG_INFO, "log entries dropped:%lu", netlinklogs_async_dropped());
 
 	NL_LOG_CLOSE();
 
@@ -0,0 +1,679 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Benchmark of the netlink and uevent processing driven from capture files
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_bench.c
+ * @brief	Feeds captured route and uevent datagrams straight into the
+ * 		decode and diff paths, without sockets, and reports the cost
+ * 		per message.  Also generates the corpora it is run on.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <net/if_arp.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if.h>
+#include <linux/if_link.h>
+#include <linux/if_addr.h>
+
+#include "netlink_logs.h"
+#include "netlink_devices.h"
+#include "uevent_devices.h"
+#include "netlink_capture.h"
+
+int running_daemon = 0;
+int netlinklogs_level = NLLOG_ERROR;
+int netlinklogs_detailed = 0;
+
+/**
+ * @brief	default number of passes over a corpus
+ */
+#define BENCH_ITERATIONS	50
+
+/**
+ * @brief	links toggled by the flap storm corpus
+ */
+#define BENCH_FLAP_LINKS	8
+
+/**
+ * @brief	up/down flaps of each link in the flap storm corpus
+ */
+#define BENCH_FLAP_ROUNDS	250
+
+/**
+ * @brief	virtual functions created by the VF corpus
+ */
+#define BENCH_VFS		64
+
+/**
+ * @brief	temporary addresses rotated by the privacy address corpus
+ */
+#define BENCH_PRIVACY_ROUNDS	1000
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static unsigned long bench_allocs;
+
+/**
+ * @brief	counting malloc, also seen by libnl
+ * @param[in]	size		bytes to allocate
+ * @return	allocated memory, NULL if none
+ */
+void *malloc(size_t size)
+{
+	bench_allocs++;
+	return __libc_malloc(size);
+}
+
+/**
+ * @brief	counting calloc, also seen by libnl
+ * @param[in]	nmemb		number of elements
+ * @param[in]	size		size of an element
+ * @return	zeroed memory, NULL if none
+ */
+void *calloc(size_t nmemb, size_t size)
+{
+	bench_allocs++;
+	return __libc_calloc(nmemb, size);
+}
+
+/**
+ * @brief	counting realloc, also seen by libnl
+ * @param[in]	ptr		memory to resize, may be NULL
+ * @param[in]	size		new size
+ * @return	resized memory, NULL if none
+ */
+void *realloc(void *ptr, size_t size)
+{
+	bench_allocs++;
+	return __libc_realloc(ptr, size);
+}
+
+/**
+ * @brief	one message being built
+*/
+struct bench_msg {
+	unsigned char		buf[2048];	/**< message */
+	struct nlmsghdr		*h;		/**< header at the start of buf */
+};
+
+/**
+ * @brief	corpus being generated
+*/
+struct bench_corpus {
+	struct netlinkdev_capture	cap;	/**< capture file written */
+	uint64_t			ts_ns;	/**< time of the next datagram */
+	unsigned int			seq;	/**< uevent sequence number */
+};
+
+/**
+ * @brief	current monotonic time
+ * @return	time in nanoseconds
+ */
+static unsigned long long bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief	starts a message with its family header
+ * @param[in]	b		message
+ * @param[in]	type		RTM_* type
+ * @param[in]	hdr		family header
+ * @param[in]	hdrlen		length of the family header
+ * @return	nothing
+ */
+static void bench_begin(struct bench_msg *b, int type, const void *hdr, size_t hdrlen)
+{
+	memset(b->buf, 0, sizeof(b->buf));
+	b->h = (struct nlmsghdr *)b->buf;
+	b->h->nlmsg_type = type;
+	b->h->nlmsg_len = NLMSG_LENGTH(hdrlen);
+	memcpy(NLMSG_DATA(b->h), hdr, hdrlen);
+}
+
+/**
+ * @brief	appends an attribute
+ * @param[in]	b		message
+ * @param[in]	type		attribute type
+ * @param[in]	data		payload
+ * @param[in]	len		length of the payload
+ * @return	nothing
+ */
+static void bench_attr(struct bench_msg *b, int type, const void *data, size_t len)
+{
+	struct rtattr *rta = (struct rtattr *)(b->buf + NLMSG_ALIGN(b->h->nlmsg_len));
+
+	rta->rta_type = type;
+	rta->rta_len = RTA_LENGTH(len);
+	memcpy(RTA_DATA(rta), data, len);
+	b->h->nlmsg_len = NLMSG_ALIGN(b->h->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+/**
+ * @brief	appends a 32 bit attribute
+ * @param[in]	b		message being built
+ * @param[in]	type		attribute type
+ * @param[in]	value		attribute value
+ * @return	nothing
+ */
+static void bench_attr32(struct bench_msg *b, int type, uint32_t value)
+{
+	bench_attr(b, type, &value, sizeof(value));
+}
+
+/**
+ * @brief	appends an 8 bit attribute
+ * @param[in]	b		message being built
+ * @param[in]	type		attribute type
+ * @param[in]	value		attribute value
+ * @return	nothing
+ */
+static void bench_attr8(struct bench_msg *b, int type, uint8_t value)
+{
+	bench_attr(b, type, &value, sizeof(value));
+}
+
+/**
+ * @brief	writes a route socket datagram of one message to the corpus
+ * @param[in]	c		corpus
+ * @param[in]	b		message
+ * @return	nothing
+ */
+static void bench_route(struct bench_corpus *c, struct bench_msg *b)
+{
+	netlinkdev_capture_write(&c->cap, NETLINKDEV_CAPTURE_ROUTE, -1, c->ts_ns, b->buf, b->h->nlmsg_len);
+	c->ts_ns += 50000;
+}
+
+/**
+ * @brief	writes a link notification with the attributes the kernel sends
+ * @param[in]	c		corpus
+ * @param[in]	type		RTM_NEWLINK or RTM_DELLINK
+ * @param[in]	if_index	interface index
+ * @param[in]	name		interface name
+ * @param[in]	up		link administratively up with carrier
+ * @return	nothing
+ */
+static void bench_link(struct bench_corpus *c, int type, int if_index, const char *name, int up)
+{
+	static const unsigned char brd[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+	struct rtnl_link_stats64 stats64;
+	struct rtnl_link_stats stats;
+	unsigned char mac[6] = { 0x02, 0x00, 0x5e, 0x10, (if_index >> 8) & 0xff, if_index & 0xff };
+	struct ifinfomsg ifi;
+	struct bench_msg b;
+
+	memset(&ifi, 0, sizeof(ifi));
+	ifi.ifi_family = AF_UNSPEC;
+	ifi.ifi_type = ARPHRD_ETHER;
+	ifi.ifi_index = if_index;
+	ifi.ifi_flags = IFF_BROADCAST | IFF_MULTICAST | (up ? IFF_UP | IFF_RUNNING | IFF_LOWER_UP : 0);
+	ifi.ifi_change = 0xffffffff;
+	memset(&stats64, 0, sizeof(stats64));
+	memset(&stats, 0, sizeof(stats));
+	bench_begin(&b, type, &ifi, sizeof(ifi));
+	bench_attr(&b, IFLA_IFNAME, name, strlen(name) + 1);
+	bench_attr32(&b, IFLA_TXQLEN, 1000);
+	bench_attr8(&b, IFLA_OPERSTATE, up ? IF_OPER_UP : IF_OPER_DOWN);
+	bench_attr8(&b, IFLA_LINKMODE, 0);
+	bench_attr32(&b, IFLA_MTU, 1500);
+	bench_attr32(&b, IFLA_GROUP, 0);
+	bench_attr32(&b, IFLA_PROMISCUITY, 0);
+	bench_attr32(&b, IFLA_NUM_TX_QUEUES, 8);
+	bench_attr32(&b, IFLA_NUM_RX_QUEUES, 8);
+	bench_attr8(&b, IFLA_CARRIER, up);
+	bench_attr(&b, IFLA_QDISC, "mq", 3);
+	bench_attr32(&b, IFLA_CARRIER_CHANGES, 1);
+	bench_attr(&b, IFLA_ADDRESS, mac, sizeof(mac));
+	bench_attr(&b, IFLA_BROADCAST, brd, sizeof(brd));
+	bench_attr(&b, IFLA_STATS64, &stats64, sizeof(stats64));
+	bench_attr(&b, IFLA_STATS, &stats, sizeof(stats));
+	bench_route(c, &b);
+}
+
+/**
+ * @brief	writes an address notification with the attributes the kernel sends
+ * @param[in]	c		corpus
+ * @param[in]	type		RTM_NEWADDR or RTM_DELADDR
+ * @param[in]	if_index	interface index
+ * @param[in]	family		AF_INET or AF_INET6
+ * @param[in]	addr		binary address
+ * @param[in]	prefixlen	prefix length
+ * @param[in]	flags		IFA_F_* flags
+ * @return	nothing
+ */
+static void bench_addr(struct bench_corpus *c, int type, int if_index, int family,
+		       const void *addr, int prefixlen, uint32_t flags)
+{
+	struct ifa_cacheinfo ci;
+	struct ifaddrmsg ifa;
+	struct bench_msg b;
+	int len = family == AF_INET ? 4 : 16;
+
+	memset(&ifa, 0, sizeof(ifa));
+	ifa.ifa_family = family;
+	ifa.ifa_prefixlen = prefixlen;
+	ifa.ifa_flags = flags & 0xff;
+	ifa.ifa_scope = RT_SCOPE_UNIVERSE;
+	ifa.ifa_index = if_index;
+	memset(&ci, 0, sizeof(ci));
+	ci.ifa_prefered = flags & IFA_F_DEPRECATED ? 0 : 86400;
+	ci.ifa_valid = 604800;
+	bench_begin(&b, type, &ifa, sizeof(ifa));
+	bench_attr(&b, IFA_ADDRESS, addr, len);
+	if (family == AF_INET)
+		bench_attr(&b, IFA_LOCAL, addr, len);
+	bench_attr(&b, IFA_CACHEINFO, &ci, sizeof(ci));
+	bench_attr32(&b, IFA_FLAGS, flags);
+	bench_route(c, &b);
+}
+
+/**
+ * @brief	writes a uevent datagram
+ * @param[in]	c		corpus
+ * @param[in]	action		ACTION of the uevent
+ * @param[in]	devpath		DEVPATH of the uevent
+ * @param[in]	subsystem	SUBSYSTEM of the uevent
+ * @param[in]	extra		further KEY=value properties separated by '|', may be NULL
+ * @return	nothing
+ */
+static void bench_uevent(struct bench_corpus *c, const char *action, const char *devpath,
+			 const char *subsystem, const char *extra)
+{
+	char buf[2048], *p;
+	int len;
+
+	len = snprintf(buf, sizeof(buf), "%s@%s|ACTION=%s|DEVPATH=%s|SUBSYSTEM=%s|%s%sSEQNUM=%u|",
+		       action, devpath, action, devpath, subsystem,
+		       extra ? extra : "", extra ? "|" : "", ++c->seq);
+	for (p = buf; p < buf + len; p++)
+		if (*p == '|')
+			*p = '\0';
+	netlinkdev_capture_write(&c->cap, NETLINKDEV_CAPTURE_UEVENT, -1, c->ts_ns, buf, len);
+	c->ts_ns += 50000;
+}
+
+/**
+ * @brief	links flapping up and down in a storm, every link ends where it started
+ * @param[in]	c		corpus
+ * @return	nothing
+ */
+static void bench_genflap(struct bench_corpus *c)
+{
+	unsigned char addr[4] = { 10, 0, 0, 1 };
+	char name[IFNAMSIZ];
+	int i, r;
+
+	for (i = 0; i < BENCH_FLAP_LINKS; i++) {
+		snprintf(name, sizeof(name), "eth%d", i);
+		bench_link(c, RTM_NEWLINK, 10 + i, name, 1);
+		addr[2] = i;
+		bench_addr(c, RTM_NEWADDR, 10 + i, AF_INET, addr, 24, IFA_F_PERMANENT);
+	}
+	for (r = 0; r < BENCH_FLAP_ROUNDS; r++) {
+		for (i = 0; i < BENCH_FLAP_LINKS; i++) {
+			snprintf(name, sizeof(name), "eth%d", i);
+			bench_link(c, RTM_NEWLINK, 10 + i, name, 0);
+			bench_link(c, RTM_NEWLINK, 10 + i, name, 1);
+		}
+	}
+	for (i = 0; i < BENCH_FLAP_LINKS; i++) {
+		snprintf(name, sizeof(name), "eth%d", i);
+		addr[2] = i;
+		bench_addr(c, RTM_DELADDR, 10 + i, AF_INET, addr, 24, IFA_F_PERMANENT);
+		bench_link(c, RTM_DELLINK, 10 + i, name, 0);
+	}
+}
+
+/**
+ * @brief	virtual functions created then removed, with the uevents of the
+ * 		PCI function, the net device and its queues
+ * @param[in]	c		corpus
+ * @return	nothing
+ */
+static void bench_genvf(struct bench_corpus *c)
+{
+	unsigned char ll[16] = { 0xfe, 0x80, 0, 0, 0, 0, 0, 0, 0x00, 0x00, 0x5e, 0xff, 0xfe, 0x10 };
+	char name[IFNAMSIZ], pci[128], dev[160], queue[192], extra[256];
+	int v;
+
+	for (v = 0; v < BENCH_VFS; v++) {
+		snprintf(name, sizeof(name), "enp1s0v%d", v);
+		snprintf(pci, sizeof(pci), "/devices/pci0000:00/0000:00:03.0/0000:01:%02x.%d", 0x10 + v / 8, v % 8);
+		snprintf(dev, sizeof(dev), "%s/net/%s", pci, name);
+		snprintf(extra, sizeof(extra), "PCI_CLASS=20000|PCI_ID=8086:154C|PCI_SUBSYS_ID=8086:0000|"
+			 "PCI_SLOT_NAME=0000:01:%02x.%d|MODALIAS=pci:v00008086d0000154Csv00008086sd00000000bc02sc00i00",
+			 0x10 + v / 8, v % 8);
+		bench_uevent(c, "add", pci, "pci", extra);
+		snprintf(extra, sizeof(extra), "INTERFACE=%s|IFINDEX=%d", name, 100 + v);
+		bench_uevent(c, "add", dev, "net", extra);
+		snprintf(queue, sizeof(queue), "%s/queues/rx-0", dev);
+		bench_uevent(c, "add", queue, "queues", NULL);
+		snprintf(queue, sizeof(queue), "%s/queues/tx-0", dev);
+		bench_uevent(c, "add", queue, "queues", NULL);
+		bench_link(c, RTM_NEWLINK, 100 + v, name, 0);
+		bench_uevent(c, "bind", pci, "pci", "DRIVER=iavf");
+		bench_link(c, RTM_NEWLINK, 100 + v, name, 1);
+		ll[14] = (100 + v) >> 8;
+		ll[15] = (100 + v) & 0xff;
+		bench_addr(c, RTM_NEWADDR, 100 + v, AF_INET6, ll, 64, IFA_F_PERMANENT);
+	}
+	for (v = 0; v < BENCH_VFS; v++) {
+		snprintf(name, sizeof(name), "enp1s0v%d", v);
+		snprintf(pci, sizeof(pci), "/devices/pci0000:00/0000:00:03.0/0000:01:%02x.%d", 0x10 + v / 8, v % 8);
+		snprintf(dev, sizeof(dev), "%s/net/%s", pci, name);
+		ll[14] = (100 + v) >> 8;
+		ll[15] = (100 + v) & 0xff;
+		bench_addr(c, RTM_DELADDR, 100 + v, AF_INET6, ll, 64, IFA_F_PERMANENT);
+		bench_link(c, RTM_NEWLINK, 100 + v, name, 0);
+		bench_link(c, RTM_DELLINK, 100 + v, name, 0);
+		snprintf(extra, sizeof(extra), "INTERFACE=%s|IFINDEX=%d", name, 100 + v);
+		bench_uevent(c, "remove", dev, "net", extra);
+		bench_uevent(c, "unbind", pci, "pci", NULL);
+		bench_uevent(c, "remove", pci, "pci", NULL);
+	}
+}
+
+/**
+ * @brief	IPv6 temporary addresses rotated on one link, each one added,
+ * 		deprecated when the next one comes and removed later
+ * @param[in]	c		corpus
+ * @return	nothing
+ */
+static void bench_genprivacy(struct bench_corpus *c)
+{
+	unsigned char global[16] = { 0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+	unsigned char tmp[16];
+	int r, old;
+
+	bench_link(c, RTM_NEWLINK, 2, "eth0", 1);
+	bench_addr(c, RTM_NEWADDR, 2, AF_INET6, global, 64, IFA_F_PERMANENT | IFA_F_MANAGETEMPADDR);
+	memcpy(tmp, global, sizeof(tmp));
+	for (r = 0; r < BENCH_PRIVACY_ROUNDS; r++) {
+		tmp[12] = r >> 8;
+		tmp[13] = r;
+		tmp[15] = 0x77;
+		bench_addr(c, RTM_NEWADDR, 2, AF_INET6, tmp, 64, IFA_F_TEMPORARY);
+		if (r >= 1) {
+			tmp[12] = (r - 1) >> 8;
+			tmp[13] = r - 1;
+			bench_addr(c, RTM_NEWADDR, 2, AF_INET6, tmp, 64, IFA_F_TEMPORARY | IFA_F_DEPRECATED);
+		}
+		if (r >= 3) {
+			tmp[12] = (r - 3) >> 8;
+			tmp[13] = r - 3;
+			bench_addr(c, RTM_DELADDR, 2, AF_INET6, tmp, 64, IFA_F_TEMPORARY | IFA_F_DEPRECATED);
+		}
+	}
+	for (old = r - 3; old < r; old++) {
+		tmp[12] = old >> 8;
+		tmp[13] = old;
+		bench_addr(c, RTM_DELADDR, 2, AF_INET6, tmp, 64, IFA_F_TEMPORARY | IFA_F_DEPRECATED);
+	}
+	bench_addr(c, RTM_DELADDR, 2, AF_INET6, global, 64, IFA_F_PERMANENT | IFA_F_MANAGETEMPADDR);
+	bench_link(c, RTM_DELLINK, 2, "eth0", 0);
+}
+
+/**
+ * @brief	writes the built-in corpora to a directory
+ * @param[in]	dir		directory, created if needed
+ * @return	0 on success, negative errno on error
+ */
+static int bench_generate(const char *dir)
+{
+	static const struct {
+		const char	*name;
+		void		(*gen)(struct bench_corpus *);
+	} corpora[] = {
+		{ "flap.nlcap",		bench_genflap },
+		{ "vf.nlcap",		bench_genvf },
+		{ "privacy.nlcap",	bench_genprivacy },
+	};
+	struct bench_corpus c;
+	char path[512];
+	unsigned int i;
+	int stat;
+
+	if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+		fprintf(stderr, "ERROR: can't create %s (%d)\n", dir, errno);
+		return -errno;
+	}
+	for (i = 0; i < sizeof(corpora) / sizeof(corpora[0]); i++) {
+		snprintf(path, sizeof(path), "%s/%s", dir, corpora[i].name);
+		memset(&c, 0, sizeof(c));
+		if ((stat = netlinkdev_capture_create(&c.cap, path)) < 0)
+			return stat;
+		corpora[i].gen(&c);
+		fprintf(stdout, "%s: %lu datagrams\n", path, c.cap.records);
+		if ((stat = netlinkdev_capture_close(&c.cap)) < 0)
+			return stat;
+	}
+	return 0;
+}
+
+/**
+ * @brief	counts the events reported
+ * @param[in]	event		event identifier
+ * @param[in]	nd		event data
+ * @param[in]	arg		event counter
+ * @return	None
+ */
+static void bench_netevent(int event, struct netlinkdev_data *nd, void *arg)
+{
+	(*(unsigned long *)arg)++;
+}
+
+/**
+ * @brief	counts the uevents reported and looks up the properties a
+ * 		consumer of network device uevents reads
+ * @param[in]	ud		uevent data
+ * @param[in]	arg		event counter
+ * @return	None
+ */
+static void bench_hotplugevent(struct ueventdev_data *ud, void *arg)
+{
+	if (ueventdev_getprop(ud, "SUBSYSTEM") && (ueventdev_getprop(ud, "INTERFACE") ||
+						  ueventdev_getprop(ud, "PCI_SLOT_NAME")))
+		(*(unsigned long *)arg)++;
+}
+
+/**
+ * @brief	prints one result line
+ * @param[in]	corpus		corpus file
+ * @param[in]	path		path measured
+ * @param[in]	msgs		messages handled
+ * @param[in]	ns		time taken
+ * @param[in]	allocs		allocations made
+ * @param[in]	events		events reported
+ * @return	None
+ */
+static void bench_report(const char *corpus, const char *path, unsigned long msgs,
+			 unsigned long long ns, unsigned long allocs, unsigned long events)
+{
+	if (!msgs)
+		return;
+	fprintf(stdout, "%-24s %-7s %10lu %12.0f %9.1f %11.2f %11.3f\n", corpus, path, msgs,
+		ns ? msgs * 1e9 / ns : 0.0, (double)ns / msgs, (double)allocs / msgs, (double)events / msgs);
+}
+
+/**
+ * @brief	feeds the route socket datagrams of a corpus to one engine
+ * @param[in]	cap		corpus
+ * @param[in]	name		corpus name for the report
+ * @param[in]	engine		NETLINKDEV_ENGINE_LIBNL or NETLINKDEV_ENGINE_NATIVE
+ * @param[in]	iterations	passes over the corpus measured
+ * @return	0 on success, negative errno on error
+ */
+static int bench_route_engine(struct netlinkdev_capture *cap, const char *name, int engine, int iterations)
+{
+	const struct netlinkdev_caprec *rec;
+	struct netlinkdev_info nl;
+	unsigned long events = 0, msgs = 0, allocs = 0;
+	unsigned long long start = 0, ns;
+	const void *data;
+	int i, n, stat;
+
+	if ((stat = netlinkdev_startengine(&nl, engine | NETLINKDEV_START_OFFLINE, bench_netevent, &events)) < 0) {
+		fprintf(stderr, "ERROR: can't start the %s engine (%d)\n",
+			engine == NETLINKDEV_ENGINE_NATIVE ? "native" : "libnl", stat);
+		return stat;
+	}
+	/* one pass to warm the caches and size the buffers */
+	for (i = -1; i < iterations; i++) {
+		if (i == 0) {
+			events = 0;
+			allocs = bench_allocs;
+			start = bench_now();
+		}
+		netlinkdev_capture_rewind(cap);
+		while ((rec = netlinkdev_capture_next(cap, &data)) != NULL) {
+			if (rec->source != NETLINKDEV_CAPTURE_ROUTE)
+				continue;
+			n = netlinkdev_feed(&nl, data, rec->len);
+			if (i >= 0 && n > 0)
+				msgs += n;
+		}
+	}
+	ns = bench_now() - start;
+	allocs = bench_allocs - allocs;
+	netlinkdev_stop(&nl);
+	bench_report(name, engine == NETLINKDEV_ENGINE_NATIVE ? "native" : "libnl", msgs, ns, allocs, events);
+	return 0;
+}
+
+/**
+ * @brief	feeds the uevent datagrams of a corpus to the uevent parser
+ * @param[in]	cap		corpus
+ * @param[in]	name		corpus name for the report
+ * @param[in]	iterations	passes over the corpus measured
+ * @return	0 on success, negative errno on error
+ */
+static int bench_uevents(struct netlinkdev_capture *cap, const char *name, int iterations)
+{
+	static const struct ueventdev_match rules[] = {
+		{ NULL,	"net" },
+		{ NULL,	"pci" },
+	};
+	const struct netlinkdev_caprec *rec;
+	struct ueventdev_info ul;
+	unsigned long events = 0, msgs = 0, allocs = 0;
+	unsigned long long start = 0, ns;
+	const void *data;
+	int i, stat;
+
+	if ((stat = ueventdev_startoffline(&ul, bench_hotplugevent, &events)) < 0 ||
+	    (stat = ueventdev_setfilter(&ul, rules, sizeof(rules) / sizeof(rules[0]))) < 0) {
+		fprintf(stderr, "ERROR: can't start the uevent parser (%d)\n", stat);
+		ueventdev_stop(&ul);
+		return stat;
+	}
+	for (i = -1; i < iterations; i++) {
+		if (i == 0) {
+			events = 0;
+			allocs = bench_allocs;
+			start = bench_now();
+		}
+		netlinkdev_capture_rewind(cap);
+		while ((rec = netlinkdev_capture_next(cap, &data)) != NULL) {
+			if (rec->source != NETLINKDEV_CAPTURE_UEVENT)
+				continue;
+			if (ueventdev_feed(&ul, data, rec->len) == 0 && i >= 0)
+				msgs++;
+		}
+	}
+	ns = bench_now() - start;
+	allocs = bench_allocs - allocs;
+	ueventdev_stop(&ul);
+	bench_report(name, "uevent", msgs, ns, allocs, events);
+	return 0;
+}
+
+/**
+ * @brief	netlink benchmark
+ * @param[in]	argc		argument count
+ * @param[in]	argv		arguments array of string pointers
+ * @return	EXIT_SUCCESS	Normal exit
+ * @return	EXIT_FAILURE	Failure occurred
+ */
+int main(int argc, char *argv[])
+{
+	static struct option long_options[] =
+	{
+		{"generate",	required_argument,	0,	'g'},
+		{"iterations",	required_argument,	0,	'i'},
+		{"help",	no_argument,		0,	'h'},
+		{0, 0, 0, 0}
+	};
+	struct netlinkdev_capture cap;
+	int iterations = BENCH_ITERATIONS;
+	int c, failed = 0;
+
+	while ((c = getopt_long(argc, argv, "g:i:h", long_options, NULL)) != -1) {
+		switch (c) {
+			case 'g':
+				return bench_generate(optarg) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+			case 'i':
+				iterations = atoi(optarg);
+				if (iterations > 0)
+					break;
+				fprintf(stderr, "ERROR: Invalid number of iterations: %s\n", optarg);
+				exit(EXIT_FAILURE);
+			default:
+				fprintf(stderr, "Usage:	%s [--iterations|-i <n>] <capture>...\n"
+					"	%s --generate|-g <directory>\n", argv[0], argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "ERROR: No capture given\n");
+		exit(EXIT_FAILURE);
+	}
+
+	fprintf(stdout, "%-24s %-7s %10s %12s %9s %11s %11s\n",
+		"corpus", "path", "msgs", "msgs/s", "ns/msg", "allocs/msg", "events/msg");
+	for (; optind < argc; optind++) {
+		if (netlinkdev_capture_open(&cap, argv[optind]) < 0) {
+			failed = 1;
+			continue;
+		}
+		if (bench_route_engine(&cap, argv[optind], NETLINKDEV_ENGINE_NATIVE, iterations) < 0 ||
+		    bench_route_engine(&cap, argv[optind], NETLINKDEV_ENGINE_LIBNL, iterations) < 0 ||
+		    bench_uevents(&cap, argv[optind], iterations) < 0)
+			failed = 1;
+		netlinkdev_capture_close(&cap);
+	}
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
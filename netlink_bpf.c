@@ -0,0 +1,228 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * classic BPF program builder for netlink socket filters
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_bpf.c
+ * @brief	Builds classic BPF socket filters so unwanted netlink messages
+ * 		are dropped in the kernel.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+
+#include "netlink_logs.h"
+#include "netlink_bpf.h"
+
+/**
+ * @brief	Start an empty BPF program
+ * @param[in]	b		program being built
+ * @return	always 0 as success
+ */
+int netlinkdev_bpf_init(struct netlinkdev_bpf *b)
+{
+	memset(b, 0, sizeof(struct netlinkdev_bpf));
+	return 0;
+}
+
+/**
+ * @brief	Release a BPF program
+ * @param[in]	b		program being built
+ * @return	nothing
+ */
+void netlinkdev_bpf_free(struct netlinkdev_bpf *b)
+{
+	free(b->insns);
+	free(b->fails);
+	memset(b, 0, sizeof(struct netlinkdev_bpf));
+}
+
+/**
+ * @brief	Append a conditional jump instruction
+ * @param[in]	b		program being built
+ * @param[in]	code		BPF opcode
+ * @param[in]	k		constant operand
+ * @param[in]	jt		instructions to skip when true
+ * @param[in]	jf		instructions to skip when false
+ * @return	nothing, errors are kept in b->err
+ */
+void netlinkdev_bpf_jump(struct netlinkdev_bpf *b, unsigned short code, unsigned int k,
+			 unsigned char jt, unsigned char jf)
+{
+	if (b->err)
+		return;
+	if (b->len >= BPF_MAXINSNS) {
+		b->err = -E2BIG;
+		return;
+	}
+	if (b->len == b->size) {
+		unsigned int size = b->size ? b->size * 2 : 64;
+		struct sock_filter *insns = realloc(b->insns, size * sizeof(struct sock_filter));
+		if (!insns) {
+			b->err = -ENOMEM;
+			return;
+		}
+		b->insns = insns;
+		b->size = size;
+	}
+	b->insns[b->len].code = code;
+	b->insns[b->len].jt = jt;
+	b->insns[b->len].jf = jf;
+	b->insns[b->len].k = k;
+	b->len++;
+}
+
+/**
+ * @brief	Append a statement instruction
+ * @param[in]	b		program being built
+ * @param[in]	code		BPF opcode
+ * @param[in]	k		constant operand
+ * @return	nothing, errors are kept in b->err
+ */
+void netlinkdev_bpf_stmt(struct netlinkdev_bpf *b, unsigned short code, unsigned int k)
+{
+	netlinkdev_bpf_jump(b, code, k, 0, 0);
+}
+
+/**
+ * @brief	Append a jump to the failure target of the current block, which
+ * 		is set later by netlinkdev_bpf_failhere()
+ * @param[in]	b		program being built
+ * @return	nothing, errors are kept in b->err
+ */
+void netlinkdev_bpf_jfail(struct netlinkdev_bpf *b)
+{
+	if (b->err)
+		return;
+	if (b->nfails == b->failsize) {
+		unsigned int size = b->failsize ? b->failsize * 2 : 32;
+		unsigned int *fails = realloc(b->fails, size * sizeof(unsigned int));
+		if (!fails) {
+			b->err = -ENOMEM;
+			return;
+		}
+		b->fails = fails;
+		b->failsize = size;
+	}
+	b->fails[b->nfails++] = b->len;
+	netlinkdev_bpf_stmt(b, BPF_JMP | BPF_JA, 0);
+}
+
+/**
+ * @brief	Point every pending failure jump at the next instruction
+ * @param[in]	b		program being built
+ * @return	nothing
+ */
+void netlinkdev_bpf_failhere(struct netlinkdev_bpf *b)
+{
+	unsigned int i;
+
+	if (b->err)
+		return;
+	for (i = 0; i < b->nfails; i++)
+		b->insns[b->fails[i]].k = b->len - b->fails[i] - 1;
+	b->nfails = 0;
+}
+
+/**
+ * @brief	Compare packet bytes against a constant, jumping to the failure
+ * 		target on any difference.  Loads are in network byte order.
+ * @param[in]	b		program being built
+ * @param[in]	indirect	non-zero if off is relative to the X register
+ * @param[in]	off		offset of the first byte
+ * @param[in]	data		bytes expected
+ * @param[in]	len		number of bytes to compare
+ * @return	nothing, errors are kept in b->err
+ */
+void netlinkdev_bpf_cmpbytes(struct netlinkdev_bpf *b, int indirect, unsigned int off,
+			     const void *data, int len)
+{
+	const unsigned char *p = data;
+	unsigned short mode = indirect ? BPF_IND : BPF_ABS;
+
+	while (len > 0) {
+		unsigned int k;
+		int n;
+
+		if (len >= 4) {
+			k = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+			netlinkdev_bpf_stmt(b, BPF_LD | BPF_W | mode, off);
+			n = 4;
+		}
+		else if (len >= 2) {
+			k = (p[0] << 8) | p[1];
+			netlinkdev_bpf_stmt(b, BPF_LD | BPF_H | mode, off);
+			n = 2;
+		}
+		else {
+			k = p[0];
+			netlinkdev_bpf_stmt(b, BPF_LD | BPF_B | mode, off);
+			n = 1;
+		}
+		netlinkdev_bpf_jump(b, BPF_JMP | BPF_JEQ | BPF_K, k, 1, 0);
+		netlinkdev_bpf_jfail(b);
+		p += n;
+		off += n;
+		len -= n;
+	}
+}
+
+/**
+ * @brief	Attach the program to a socket, replacing any previous filter
+ * @param[in]	b		program being built
+ * @param[in]	fd		socket file descriptor
+ * @return	result of attach
+ */
+int netlinkdev_bpf_attach(struct netlinkdev_bpf *b, int fd)
+{
+	struct sock_fprog prog;
+
+	if (b->err)
+		return b->err;
+	prog.len = b->len;
+	prog.filter = b->insns;
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0) {
+		NL_LOG(NLLOG_WARN, "bpf: can't attach socket filter (%d)", errno);
+		return -errno;
+	}
+	return 0;
+}
+
+/**
+ * @brief	Remove the filter attached to a socket
+ * @param[in]	fd		socket file descriptor
+ * @return	result of detach
+ */
+int netlinkdev_bpf_detach(int fd)
+{
+	int dummy = 0;
+
+	if (setsockopt(fd, SOL_SOCKET, SO_DETACH_FILTER, &dummy, sizeof(dummy)) < 0 && errno != ENOENT)
+		return -errno;
+	return 0;
+}
+
@@ -0,0 +1,60 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * classic BPF program builder for netlink socket filters
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_bpf.h
+ * @brief	Builds classic BPF socket filters so unwanted netlink messages
+ * 		are dropped in the kernel.
+ *
+ */
+
+
+#ifndef NETLINK_BPF_H_
+#define NETLINK_BPF_H_
+
+/**
+ * @brief	BPF program being built
+*/
+struct netlinkdev_bpf {
+	struct sock_filter	*insns;		/**< instructions emitted so far */
+	unsigned int		len;		/**< number of instructions */
+	unsigned int		size;		/**< allocated instructions */
+	unsigned int		*fails;		/**< jumps waiting for the failure target */
+	unsigned int		nfails;		/**< number of pending failure jumps */
+	unsigned int		failsize;	/**< allocated pending jumps */
+	int			err;		/**< first error hit while building */
+};
+
+int netlinkdev_bpf_init(struct netlinkdev_bpf *b);
+void netlinkdev_bpf_free(struct netlinkdev_bpf *b);
+void netlinkdev_bpf_stmt(struct netlinkdev_bpf *b, unsigned short code, unsigned int k);
+void netlinkdev_bpf_jump(struct netlinkdev_bpf *b, unsigned short code, unsigned int k,
+			 unsigned char jt, unsigned char jf);
+void netlinkdev_bpf_jfail(struct netlinkdev_bpf *b);
+void netlinkdev_bpf_failhere(struct netlinkdev_bpf *b);
+void netlinkdev_bpf_cmpbytes(struct netlinkdev_bpf *b, int indirect, unsigned int off,
+			     const void *data, int len);
+int netlinkdev_bpf_attach(struct netlinkdev_bpf *b, int fd);
+int netlinkdev_bpf_detach(int fd);
+
+#endif
+
@@ -0,0 +1,430 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink and uevent events fanned out to local clients over a unix socket
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_broker.c
+ * @brief	Unix socket broker sending the netlink and uevent events to
+ * 		subscribed clients as a binary stream.
+ *
+ */
+
+
+#define _GNU_SOURCE	/* accept4 */
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fnmatch.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+
+#include "netlink_logs.h"
+#include "netlink_devices.h"
+#include "uevent_devices.h"
+#include "netlink_loop.h"
+#include "netlink_broker.h"
+
+/**
+ * @brief	largest uevent record.  A uevent datagram is the action@devpath
+ * 		header followed by an environment of up to 2048 bytes, so a
+ * 		receive buffer's worth holds the record header and all the
+ * 		properties; properties past it are left out of the record.
+ */
+#define NETLINKDEV_BROKER_UEVENTMAX	UEVENTDEV_BUFSIZE
+
+/**
+ * @brief	disconnect a client and release it
+ * @param[in]	b		broker context
+ * @param[in]	c		client
+ * @return	nothing
+ */
+static void netlinkdev_broker_drop(struct netlinkdev_broker *b, struct netlinkdev_brokerclient *c)
+{
+	struct netlinkdev_brokerclient **pp;
+
+	for (pp = &b->clients; *pp; pp = &(*pp)->next) {
+		if (*pp == c) {
+			*pp = c->next;
+			break;
+		}
+	}
+	netlinkdev_loop_del(b->loop, c->fd);
+	close(c->fd);
+	free(c->out);
+	free(c);
+	b->nclients--;
+}
+
+/**
+ * @brief	write as much of the pending output of a client as the socket
+ * 		takes, the rest is written when it becomes writable
+ * @param[in]	c		client
+ * @return	nothing, a failed client is marked dead
+ */
+static void netlinkdev_broker_write(struct netlinkdev_brokerclient *c)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < c->outlen) {
+		n = send(c->fd, c->out + done, c->outlen - done, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				c->dead = 1;
+			break;
+		}
+		done += n;
+	}
+	if (done) {
+		memmove(c->out, c->out + done, c->outlen - done);
+		c->outlen -= done;
+	}
+	if (!c->dead && c->writing != (c->outlen > 0)) {
+		c->writing = c->outlen > 0;
+		netlinkdev_loop_setout(c->b->loop, c->fd, c->writing);
+	}
+}
+
+/**
+ * @brief	loop handler of a client connection, reads its subscriptions and
+ * 		writes pending output
+ * @param[in]	fd		client socket
+ * @param[in]	events		epoll events
+ * @param[in]	arg		client
+ * @return	0
+ */
+static int netlinkdev_broker_clientcb(int fd, unsigned int events, void *arg)
+{
+	struct netlinkdev_brokerclient *c = arg;
+	ssize_t n;
+
+	if (events & EPOLLOUT)
+		netlinkdev_broker_write(c);
+	if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+		for (;;) {
+			n = recv(fd, (char *)&c->subin + c->sublen, sizeof(c->subin) - c->sublen, MSG_DONTWAIT);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				break;
+			if (n <= 0) {
+				/* gone, nothing else can be done for it */
+				netlinkdev_broker_drop(c->b, c);
+				return 0;
+			}
+			c->sublen += n;
+			if (c->sublen == sizeof(c->subin)) {
+				c->subin.name[sizeof(c->subin.name) - 1] = '\0';
+				c->subin.subsystem[sizeof(c->subin.subsystem) - 1] = '\0';
+				c->sub = c->subin;
+				c->sublen = 0;
+			}
+		}
+	}
+	if (c->dead)
+		netlinkdev_broker_drop(c->b, c);
+	return 0;
+}
+
+/**
+ * @brief	loop handler of the listening socket, accepts new clients
+ * @param[in]	fd		listening socket
+ * @param[in]	events		epoll events
+ * @param[in]	arg		broker context
+ * @return	0
+ */
+static int netlinkdev_broker_listencb(int fd, unsigned int events, void *arg)
+{
+	struct netlinkdev_broker *b = arg;
+	struct netlinkdev_brokerclient *c;
+	int cfd;
+
+	while ((cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+		if (b->nclients >= NETLINKDEV_BROKER_MAXCLIENTS) {
+			NL_LOG(NLLOG_WARN, "broker: too many clients, connection refused");
+			close(cfd);
+			continue;
+		}
+		c = calloc(1, sizeof(struct netlinkdev_brokerclient));
+		if (!c) {
+			close(cfd);
+			continue;
+		}
+		c->fd = cfd;
+		c->b = b;
+		if (netlinkdev_loop_add(b->loop, cfd, netlinkdev_broker_clientcb, c) < 0) {
+			close(cfd);
+			free(c);
+			continue;
+		}
+		c->next = b->clients;
+		b->clients = c;
+		b->nclients++;
+		NL_LOG(NLLOG_DEBUG, "broker: client connected (%u)", b->nclients);
+	}
+	return 0;
+}
+
+/**
+ * @brief	queue a record for a client until the next flush
+ * @param[in]	c		client
+ * @param[in]	rec		encoded record
+ * @param[in]	len		record length
+ * @return	nothing, a client too far behind is marked dead
+ */
+static void netlinkdev_broker_append(struct netlinkdev_brokerclient *c, const void *rec, size_t len)
+{
+	if (c->dead)
+		return;
+	if (c->outlen + len > NETLINKDEV_BROKER_MAXPENDING) {
+		NL_LOG(NLLOG_WARN, "broker: client not reading, disconnected");
+		c->b->slow++;
+		c->dead = 1;
+		return;
+	}
+	if (c->outlen + len > c->outsize) {
+		size_t size = c->outsize ? c->outsize : 4096;
+		unsigned char *out;
+
+		while (size < c->outlen + len)
+			size *= 2;
+		out = realloc(c->out, size);
+		if (!out) {
+			c->dead = 1;
+			return;
+		}
+		c->out = out;
+		c->outsize = size;
+	}
+	memcpy(c->out + c->outlen, rec, len);
+	c->outlen += len;
+}
+
+/**
+ * @brief	Queue a netlink event for the clients subscribed to it
+ * @param[in]	b		broker context
+ * @param[in]	event		NETLINKDEV_EVENT_LINK or NETLINKDEV_EVENT_ADDR
+ * @param[in]	nd		event data
+ * @return	nothing
+ */
+void netlinkdev_broker_netlink(struct netlinkdev_broker *b, int event, const struct netlinkdev_data *nd)
+{
+	struct netlinkdev_brokernet rec;
+	struct netlinkdev_brokerclient *c;
+
+	/* only links and addresses have a record */
+	if (!b->clients || (event != NETLINKDEV_EVENT_LINK && event != NETLINKDEV_EVENT_ADDR))
+		return;
+	memset(&rec, 0, sizeof(rec));
+	rec.hdr.type = event == NETLINKDEV_EVENT_LINK ? NETLINKDEV_BROKER_LINK : NETLINKDEV_BROKER_ADDR;
+	rec.hdr.len = sizeof(rec);
+	rec.if_index = nd->if_index;
+	rec.status = nd->status;
+	rec.collapsed = nd->collapsed;
+	memcpy(rec.if_name, nd->if_name, sizeof(rec.if_name));
+	rec.if_name[sizeof(rec.if_name) - 1] = '\0';
+	if (event == NETLINKDEV_EVENT_LINK)
+		memcpy(rec.link_addr, nd->link_addr, sizeof(rec.link_addr));
+	else if (nd->net_len <= (int)sizeof(rec.addr)) {
+		rec.family = nd->net_family;
+		rec.addr_len = nd->net_len;
+		memcpy(rec.addr, nd->net_addr, nd->net_len);
+	}
+
+	for (c = b->clients; c; c = c->next) {
+		if (c->sub.events && !(c->sub.events & (1u << rec.hdr.type)))
+			continue;
+		if (c->sub.if_index && c->sub.if_index != rec.if_index)
+			continue;
+		if (c->sub.name[0] && fnmatch(c->sub.name, rec.if_name, 0) != 0)
+			continue;
+		netlinkdev_broker_append(c, &rec, sizeof(rec));
+	}
+}
+
+/**
+ * @brief	Queue a uevent for the clients subscribed to it
+ * @param[in]	b		broker context
+ * @param[in]	ud		uevent data
+ * @return	nothing
+ */
+void netlinkdev_broker_uevent(struct netlinkdev_broker *b, const struct ueventdev_data *ud)
+{
+	unsigned char buf[NETLINKDEV_BROKER_UEVENTMAX];
+	struct netlinkdev_brokeruevent *rec = (struct netlinkdev_brokeruevent *)buf;
+	struct netlinkdev_brokerclient *c;
+	const char *subsystem;
+	size_t len = sizeof(*rec);
+	int i;
+
+	if (!b->clients)
+		return;
+	memset(rec, 0, sizeof(*rec));
+	rec->hdr.type = NETLINKDEV_BROKER_UEVENT;
+	rec->action = ud->action;
+	for (i = 0; i < ud->nprops; i++) {
+		const struct ueventdev_prop *p = &ud->props[i];
+		size_t plen = p->keylen + 1 + p->valuelen + 1;
+
+		if (len + plen > sizeof(buf))
+			break;
+		memcpy(buf + len, p->key, p->keylen);
+		buf[len + p->keylen] = '=';
+		memcpy(buf + len + p->keylen + 1, p->value, p->valuelen);
+		buf[len + plen - 1] = '\0';
+		len += plen;
+		rec->nprops++;
+	}
+	rec->hdr.len = len;
+	subsystem = ueventdev_getprop(ud, "SUBSYSTEM");
+
+	for (c = b->clients; c; c = c->next) {
+		if (c->sub.events && !(c->sub.events & (1u << NETLINKDEV_BROKER_UEVENT)))
+			continue;
+		if (c->sub.subsystem[0] && (!subsystem || strcmp(c->sub.subsystem, subsystem) != 0))
+			continue;
+		netlinkdev_broker_append(c, rec, len);
+	}
+}
+
+/**
+ * @brief	Write out everything queued for the clients, once per poll so
+ * 		all the events of a cycle go out in one write per client
+ * @param[in]	b		broker context
+ * @return	number of clients still connected
+ */
+int netlinkdev_broker_flush(struct netlinkdev_broker *b)
+{
+	struct netlinkdev_brokerclient *c, *next;
+
+	for (c = b->clients; c; c = next) {
+		next = c->next;
+		if (!c->dead && c->outlen && !c->writing)
+			netlinkdev_broker_write(c);
+		if (c->dead)
+			netlinkdev_broker_drop(b, c);
+	}
+	return b->nclients;
+}
+
+/**
+ * @brief	Listen for clients on a unix socket, registered with an event loop
+ * @param[in]	b		broker context
+ * @param[in]	loop		event loop the sockets are added to
+ * @param[in]	path		socket path, replaced if it exists
+ * @return	result of start
+ */
+int netlinkdev_broker_start(struct netlinkdev_broker *b, struct netlinkdev_loop *loop, const char *path)
+{
+	struct sockaddr_un sun;
+	int stat;
+
+	memset(b, 0, sizeof(struct netlinkdev_broker));
+	b->fd = -1;
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(sun.sun_path))
+		return -ENAMETOOLONG;
+	strcpy(sun.sun_path, path);
+
+	b->path = strdup(path);
+	if (!b->path)
+		return -ENOMEM;
+	b->loop = loop;
+	b->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (b->fd < 0) {
+		stat = -errno;
+		goto fail;
+	}
+	unlink(path);
+	if (bind(b->fd, (struct sockaddr *)&sun, sizeof(sun)) < 0 || listen(b->fd, 16) < 0) {
+		stat = -errno;
+		NL_LOG(NLLOG_ERROR, "broker: can't listen on %s (%d)", path, stat);
+		goto fail;
+	}
+	if ((stat = netlinkdev_loop_add(loop, b->fd, netlinkdev_broker_listencb, b)) < 0) {
+		unlink(path);
+		goto fail;
+	}
+	return 0;
+
+fail:
+	if (b->fd >= 0)
+		close(b->fd);
+	free(b->path);
+	memset(b, 0, sizeof(struct netlinkdev_broker));
+	b->fd = -1;
+	return stat;
+}
+
+/**
+ * @brief	Disconnect every client and stop listening
+ * @param[in]	b		broker context
+ * @return	0
+ */
+int netlinkdev_broker_stop(struct netlinkdev_broker *b)
+{
+	if (!b->path)
+		return 0;
+	while (b->clients)
+		netlinkdev_broker_drop(b, b->clients);
+	netlinkdev_loop_del(b->loop, b->fd);
+	close(b->fd);
+	unlink(b->path);
+	free(b->path);
+	memset(b, 0, sizeof(struct netlinkdev_broker));
+	b->fd = -1;
+	return 0;
+}
+
+/**
+ * @brief	Connect to a broker as a client
+ * @param[in]	path		socket path of the broker
+ * @param[in]	sub		subscription, NULL to receive every event
+ * @return	connected socket to read the records from, negative on error
+ */
+int netlinkdev_broker_connect(const char *path, const struct netlinkdev_brokersub *sub)
+{
+	struct sockaddr_un sun;
+	int fd, stat;
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(sun.sun_path))
+		return -ENAMETOOLONG;
+	strcpy(sun.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -errno;
+	if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0 ||
+	    (sub && send(fd, sub, sizeof(*sub), MSG_NOSIGNAL) != sizeof(*sub))) {
+		stat = -errno;
+		close(fd);
+		return stat;
+	}
+	return fd;
+}
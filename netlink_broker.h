@@ -0,0 +1,147 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink and uevent events fanned out to local clients over a unix socket
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_broker.h
+ * @brief	Unix socket broker sending the netlink and uevent events to
+ * 		subscribed clients as a binary stream.
+ *
+ */
+
+
+#ifndef NETLINK_BROKER_H_
+#define NETLINK_BROKER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct netlinkdev_loop;
+struct netlinkdev_data;
+struct ueventdev_data;
+
+/**
+ * @brief	default socket path of the broker run by nltest
+ */
+#define NETLINKDEV_BROKER_PATH		"/run/netlink-devices.sock"
+
+/**
+ * @brief	maximum number of connected clients
+ */
+#define NETLINKDEV_BROKER_MAXCLIENTS	128
+
+/**
+ * @brief	output a client may fall behind by before it is disconnected
+ */
+#define NETLINKDEV_BROKER_MAXPENDING	(1024 * 1024)
+
+/**
+ * @brief	record types of the event stream
+ */
+enum {
+	NETLINKDEV_BROKER_LINK = 1,	/**< struct netlinkdev_brokernet, link event */
+	NETLINKDEV_BROKER_ADDR,		/**< struct netlinkdev_brokernet, address event */
+	NETLINKDEV_BROKER_UEVENT	/**< struct netlinkdev_brokeruevent */
+};
+
+/**
+ * @brief	header of every record, in host byte order
+*/
+struct netlinkdev_brokerhdr {
+	uint16_t			type;		/**< record type */
+	uint16_t			len;		/**< length of the record including this header */
+};
+
+/**
+ * @brief	link or address event record
+*/
+struct netlinkdev_brokernet {
+	struct netlinkdev_brokerhdr	hdr;		/**< NETLINKDEV_BROKER_LINK or NETLINKDEV_BROKER_ADDR */
+	int32_t				if_index;	/**< interface index */
+	int32_t				status;		/**< interface flags */
+	int32_t				collapsed;	/**< link transitions collapsed into the event */
+	char				if_name[16];	/**< interface name */
+	uint8_t				link_addr[6];	/**< link address of a link event */
+	uint8_t				family;		/**< address family of an address event */
+	uint8_t				addr_len;	/**< address length */
+	uint8_t				addr[16];	/**< address of an address event */
+};
+
+/**
+ * @brief	uevent record, followed by nprops "KEY=value" strings each
+ * 		terminated by a NUL like the kernel sends them
+*/
+struct netlinkdev_brokeruevent {
+	struct netlinkdev_brokerhdr	hdr;		/**< NETLINKDEV_BROKER_UEVENT */
+	uint8_t				action;		/**< UEVENTDEV_ACTION_ADD, _REMOVE or _OTHER */
+	uint8_t				pad;
+	uint16_t			nprops;		/**< number of properties following */
+};
+
+/**
+ * @brief	subscription written by a client, replacing the previous one.
+ * 		Until a client subscribes it receives every event.
+*/
+struct netlinkdev_brokersub {
+	uint32_t			events;		/**< (1 << record type) bits, 0 for all */
+	int32_t				if_index;	/**< only netlink events of this index, 0 for all */
+	char				name[16];	/**< only netlink events of interfaces matching this
+							     shell pattern, empty for all */
+	char				subsystem[32];	/**< only uevents of this subsystem, empty for all */
+};
+
+/**
+ * @brief	one connected client
+*/
+struct netlinkdev_brokerclient {
+	int				fd;		/**< connection */
+	int				dead;		/**< closed at the next flush */
+	struct netlinkdev_brokersub	sub;		/**< current subscription */
+	size_t				sublen;		/**< bytes of a subscription being received */
+	struct netlinkdev_brokersub	subin;		/**< subscription being received */
+	unsigned char			*out;		/**< output waiting to be written */
+	size_t				outlen;		/**< bytes waiting */
+	size_t				outsize;	/**< size of out */
+	int				writing;	/**< waiting for the socket to be writable */
+	struct netlinkdev_brokerclient	*next;		/**< next client */
+	struct netlinkdev_broker	*b;		/**< owning broker */
+};
+
+/**
+ * @brief	broker context structure
+*/
+struct netlinkdev_broker {
+	int				fd;		/**< listening socket, -1 if not started */
+	char				*path;		/**< socket path */
+	struct netlinkdev_loop		*loop;		/**< loop the sockets are registered with */
+	struct netlinkdev_brokerclient	*clients;	/**< connected clients */
+	unsigned int			nclients;	/**< number of connected clients */
+	unsigned long			slow;		/**< clients disconnected for falling behind */
+};
+
+int netlinkdev_broker_start(struct netlinkdev_broker *b, struct netlinkdev_loop *loop, const char *path);
+int netlinkdev_broker_stop(struct netlinkdev_broker *b);
+void netlinkdev_broker_netlink(struct netlinkdev_broker *b, int event, const struct netlinkdev_data *nd);
+void netlinkdev_broker_uevent(struct netlinkdev_broker *b, const struct ueventdev_data *ud);
+int netlinkdev_broker_flush(struct netlinkdev_broker *b);
+int netlinkdev_broker_connect(const char *path, const struct netlinkdev_brokersub *sub);
+
+#endif
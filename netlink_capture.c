@@ -0,0 +1,298 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink and uevent datagrams stored in capture files
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_capture.c
+ * @brief	Append-only files of raw route and uevent socket datagrams with
+ * 		their receive times, written through a buffer and read back
+ * 		from a mapping.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "netlink_logs.h"
+#include "netlink_capture.h"
+
+/**
+ * @brief	length of a record with its datagram padded to 8 bytes
+ */
+#define NETLINKDEV_CAPTURE_RECLEN(len)	(sizeof(struct netlinkdev_caprec) + (((len) + 7) & ~(size_t)7))
+
+/**
+ * @brief	writes a whole buffer, retrying short writes
+ * @param[in]	fd		file
+ * @param[in]	data		bytes to write
+ * @param[in]	len		number of bytes
+ * @return	0 on success, negative errno on error
+ */
+static int netlinkdev_capture_writeall(int fd, const unsigned char *data, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		n = write(fd, data, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		data += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/**
+ * @brief	Create a capture file, an existing file is truncated
+ * @param[in]	cap		capture context
+ * @param[in]	path		file to create
+ * @return	result of create
+ */
+int netlinkdev_capture_create(struct netlinkdev_capture *cap, const char *path)
+{
+	struct netlinkdev_caphdr hdr;
+	struct timespec ts;
+	int stat;
+
+	memset(cap, 0, sizeof(struct netlinkdev_capture));
+	cap->writing = 1;
+	cap->buf = malloc(NETLINKDEV_CAPTURE_BUFSIZE);
+	if (!cap->buf)
+		return -ENOMEM;
+	cap->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+	if (cap->fd < 0) {
+		stat = -errno;
+		NL_LOG(NLLOG_ERROR, "capture: can't create %s (%d)", path, errno);
+		free(cap->buf);
+		cap->buf = NULL;
+		return stat;
+	}
+	clock_gettime(CLOCK_REALTIME, &ts);
+	cap->start_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	cap->base_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, NETLINKDEV_CAPTURE_MAGIC, sizeof(hdr.magic));
+	hdr.version = NETLINKDEV_CAPTURE_VERSION;
+	hdr.start_ns = cap->start_ns;
+	memcpy(cap->buf, &hdr, sizeof(hdr));
+	cap->buflen = sizeof(hdr);
+	return 0;
+}
+
+/**
+ * @brief	Append one datagram.  It is copied to the write buffer, which is
+ * 		written out when full.
+ * @param[in]	cap		capture context
+ * @param[in]	source		NETLINKDEV_CAPTURE_ROUTE or NETLINKDEV_CAPTURE_UEVENT
+ * @param[in]	nsid		namespace id of the datagram, -1 if not known
+ * @param[in]	ts_ns		receive time since the capture started in ns
+ * @param[in]	data		datagram
+ * @param[in]	len		length of the datagram
+ * @return	0 on success, negative errno on error
+ */
+int netlinkdev_capture_write(struct netlinkdev_capture *cap, int source, int nsid,
+			     uint64_t ts_ns, const void *data, size_t len)
+{
+	static const unsigned char pad[8];
+	struct netlinkdev_caprec rec;
+	size_t reclen = NETLINKDEV_CAPTURE_RECLEN(len);
+	int stat;
+
+	if (!cap->writing || len > UINT32_MAX)
+		return -EINVAL;
+	if (cap->buflen + reclen > NETLINKDEV_CAPTURE_BUFSIZE && (stat = netlinkdev_capture_flush(cap)) < 0)
+		return stat;
+	memset(&rec, 0, sizeof(rec));
+	rec.ts_ns = ts_ns;
+	rec.len = len;
+	rec.source = source;
+	rec.nsid = nsid;
+	if (reclen > NETLINKDEV_CAPTURE_BUFSIZE) {
+		/* larger than the whole buffer, goes straight out */
+		if ((stat = netlinkdev_capture_writeall(cap->fd, (const unsigned char *)&rec, sizeof(rec))) < 0 ||
+		    (stat = netlinkdev_capture_writeall(cap->fd, data, len)) < 0 ||
+		    (stat = netlinkdev_capture_writeall(cap->fd, pad, reclen - sizeof(rec) - len)) < 0)
+			return stat;
+	}
+	else {
+		memcpy(cap->buf + cap->buflen, &rec, sizeof(rec));
+		memcpy(cap->buf + cap->buflen + sizeof(rec), data, len);
+		memset(cap->buf + cap->buflen + sizeof(rec) + len, 0, reclen - sizeof(rec) - len);
+		cap->buflen += reclen;
+	}
+	cap->records++;
+	return 0;
+}
+
+/**
+ * @brief	Append one datagram just received, stamped with the time since
+ * 		the capture started
+ * @param[in]	cap		capture context
+ * @param[in]	source		NETLINKDEV_CAPTURE_ROUTE or NETLINKDEV_CAPTURE_UEVENT
+ * @param[in]	nsid		namespace id of the datagram, -1 if not known
+ * @param[in]	data		datagram
+ * @param[in]	len		length of the datagram
+ * @return	0 on success, negative errno on error
+ */
+int netlinkdev_capture_record(struct netlinkdev_capture *cap, int source, int nsid,
+			      const void *data, size_t len)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return netlinkdev_capture_write(cap, source, nsid,
+					(uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec - cap->base_ns,
+					data, len);
+}
+
+/**
+ * @brief	Write out the records waiting in the buffer
+ * @param[in]	cap		capture context
+ * @return	0 on success, negative errno on error
+ */
+int netlinkdev_capture_flush(struct netlinkdev_capture *cap)
+{
+	int stat;
+
+	if (!cap->writing || !cap->buflen)
+		return 0;
+	stat = netlinkdev_capture_writeall(cap->fd, cap->buf, cap->buflen);
+	if (stat < 0) {
+		NL_LOG(NLLOG_ERROR, "capture: write failed (%d)", -stat);
+		return stat;
+	}
+	cap->buflen = 0;
+	return 0;
+}
+
+/**
+ * @brief	Open a capture file for reading, the whole file is mapped
+ * @param[in]	cap		capture context
+ * @param[in]	path		file to read
+ * @return	result of open
+ */
+int netlinkdev_capture_open(struct netlinkdev_capture *cap, const char *path)
+{
+	struct netlinkdev_caphdr hdr;
+	struct stat st;
+	void *map;
+	int stat;
+
+	memset(cap, 0, sizeof(struct netlinkdev_capture));
+	cap->fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (cap->fd < 0) {
+		stat = -errno;
+		NL_LOG(NLLOG_ERROR, "capture: can't open %s (%d)", path, errno);
+		return stat;
+	}
+	if (fstat(cap->fd, &st) < 0 || st.st_size < (off_t)sizeof(hdr)) {
+		NL_LOG(NLLOG_ERROR, "capture: %s is not a capture file", path);
+		close(cap->fd);
+		return -EINVAL;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, cap->fd, 0);
+	if (map == MAP_FAILED) {
+		stat = -errno;
+		NL_LOG(NLLOG_ERROR, "capture: can't map %s (%d)", path, errno);
+		close(cap->fd);
+		return stat;
+	}
+	memcpy(&hdr, map, sizeof(hdr));
+	if (memcmp(hdr.magic, NETLINKDEV_CAPTURE_MAGIC, sizeof(hdr.magic)) ||
+	    hdr.version != NETLINKDEV_CAPTURE_VERSION) {
+		NL_LOG(NLLOG_ERROR, "capture: %s is not a capture file", path);
+		munmap(map, st.st_size);
+		close(cap->fd);
+		return -EINVAL;
+	}
+	cap->map = map;
+	cap->maplen = st.st_size;
+	cap->start_ns = hdr.start_ns;
+	cap->pos = sizeof(hdr);
+	return 0;
+}
+
+/**
+ * @brief	Read the next record of a capture opened for reading
+ * @param[in]	cap		capture context
+ * @param[out]	data		datagram of the record, in the mapping
+ * @return	record header, NULL at the end of the file or at a record cut
+ * 		short by a capture that did not finish
+ */
+const struct netlinkdev_caprec *netlinkdev_capture_next(struct netlinkdev_capture *cap,
+							const void **data)
+{
+	const struct netlinkdev_caprec *rec;
+
+	if (!cap->map || cap->maplen - cap->pos < sizeof(struct netlinkdev_caprec))
+		return NULL;
+	rec = (const struct netlinkdev_caprec *)(cap->map + cap->pos);
+	if (cap->maplen - cap->pos < NETLINKDEV_CAPTURE_RECLEN(rec->len))
+		return NULL;
+	*data = rec + 1;
+	cap->pos += NETLINKDEV_CAPTURE_RECLEN(rec->len);
+	cap->records++;
+	return rec;
+}
+
+/**
+ * @brief	Go back to the first record of a capture opened for reading
+ * @param[in]	cap		capture context
+ * @return	nothing
+ */
+void netlinkdev_capture_rewind(struct netlinkdev_capture *cap)
+{
+	cap->pos = sizeof(struct netlinkdev_caphdr);
+	cap->records = 0;
+}
+
+/**
+ * @brief	Close a capture, what is left in the write buffer is written out
+ * @param[in]	cap		capture context
+ * @return	result of the last write, 0 for a capture being read
+ */
+int netlinkdev_capture_close(struct netlinkdev_capture *cap)
+{
+	int stat = 0;
+
+	if (cap->writing)
+		stat = netlinkdev_capture_flush(cap);
+	if (cap->map)
+		munmap((void *)cap->map, cap->maplen);
+	if (cap->fd >= 0)
+		close(cap->fd);
+	free(cap->buf);
+	memset(cap, 0, sizeof(struct netlinkdev_capture));
+	cap->fd = -1;
+	return stat;
+}
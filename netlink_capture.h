@@ -0,0 +1,109 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink and uevent datagrams stored in capture files
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_capture.h
+ * @brief	Append-only files of raw route and uevent socket datagrams with
+ * 		their receive times, written through a buffer and read back
+ * 		from a mapping.
+ *
+ */
+
+
+#ifndef NETLINK_CAPTURE_H_
+#define NETLINK_CAPTURE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief	first bytes of a capture file
+ */
+#define NETLINKDEV_CAPTURE_MAGIC	"NLCP"
+
+/**
+ * @brief	version of the capture format
+ */
+#define NETLINKDEV_CAPTURE_VERSION	1
+
+/**
+ * @brief	size of the write buffer, records are written when it fills up
+ */
+#define NETLINKDEV_CAPTURE_BUFSIZE	65536
+
+/**
+ * @brief	socket a datagram was received on
+*/
+enum {
+	NETLINKDEV_CAPTURE_ROUTE = 1,	/**< route socket */
+	NETLINKDEV_CAPTURE_UEVENT	/**< uevent socket */
+};
+
+/**
+ * @brief	header at the start of a capture file, host byte order
+*/
+struct netlinkdev_caphdr {
+	char		magic[4];	/**< NETLINKDEV_CAPTURE_MAGIC */
+	uint16_t	version;	/**< NETLINKDEV_CAPTURE_VERSION */
+	uint16_t	reserved;	/**< 0 */
+	uint64_t	start_ns;	/**< wall clock time the capture started in ns */
+};
+
+/**
+ * @brief	header of one datagram, the datagram follows padded to 8 bytes
+*/
+struct netlinkdev_caprec {
+	uint64_t	ts_ns;		/**< receive time since the capture started in ns */
+	uint32_t	len;		/**< length of the datagram */
+	uint16_t	source;		/**< NETLINKDEV_CAPTURE_ROUTE or NETLINKDEV_CAPTURE_UEVENT */
+	int16_t		nsid;		/**< namespace id of the datagram, -1 if not known */
+};
+
+/**
+ * @brief	capture file context structure
+*/
+struct netlinkdev_capture {
+	int			fd;		/**< capture file */
+	int			writing;	/**< opened for writing */
+	uint64_t		start_ns;	/**< wall clock time the capture started in ns */
+	uint64_t		base_ns;	/**< monotonic time the capture started in ns */
+	unsigned char		*buf;		/**< write buffer */
+	size_t			buflen;		/**< bytes waiting in the write buffer */
+	const unsigned char	*map;		/**< mapping of a capture being read */
+	size_t			maplen;		/**< length of the mapping */
+	size_t			pos;		/**< offset of the next record to read */
+	unsigned long		records;	/**< records written or read */
+};
+
+int netlinkdev_capture_create(struct netlinkdev_capture *cap, const char *path);
+int netlinkdev_capture_write(struct netlinkdev_capture *cap, int source, int nsid,
+			     uint64_t ts_ns, const void *data, size_t len);
+int netlinkdev_capture_record(struct netlinkdev_capture *cap, int source, int nsid,
+			      const void *data, size_t len);
+int netlinkdev_capture_flush(struct netlinkdev_capture *cap);
+int netlinkdev_capture_open(struct netlinkdev_capture *cap, const char *path);
+const struct netlinkdev_caprec *netlinkdev_capture_next(struct netlinkdev_capture *cap,
+							const void **data);
+void netlinkdev_capture_rewind(struct netlinkdev_capture *cap);
+int netlinkdev_capture_close(struct netlinkdev_capture *cap);
+
+#endif
@@ -40,29 +40,49 @@
 #include <linux/rtnetlink.h>
 #include <linux/if.h>
 #include <sys/param.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <limits.h>
+#include <poll.h>
+#include <fcntl.h>
 
 #include <netlink/netlink.h>
 #include <netlink/socket.h>
 #include <netlink/cache.h>
 #include <netlink/route/addr.h>
 #include <netlink/route/link.h>
+#include <netlink/route/route.h>
+#include <netlink/route/neighbour.h>
 #include <netlink/msg.h>
 #include <netlink/object-api.h>
 
 #include "netlink_logs.h"
 #include "netlink_devices.h"
+#include "netlink_index.h"
+#include "netlink_watch.h"
+#include "netlink_queue.h"
+#include "netlink_native.h"
+#include "netlink_shm.h"
+#include "netlink_netns.h"
+#include "netlink_routes.h"
+#include "netlink_neigh.h"
+#include "netlink_stats.h"
+#include "netlink_metrics.h"
+#include "netlink_capture.h"
 
 /* Need this to access struct nl_msgtype and struct nl_object */
 #include <netlink-private/cache-api.h>
 #include <netlink-private/object-api.h>
 
 /**
- * @brief	Used for callback during interface address status searches.
+ * @brief	milliseconds to wait for each part of an initial dump
  */
-struct netlinkdev_findaddrinfo {
-	int index;
-	struct rtnl_addr *myaddr;
-};
+#define NETLINKDEV_DUMP_TIMEOUT	5000
+
+/**
+ * @brief	dumps tried in a row while the socket keeps overflowing
+ */
+#define NETLINKDEV_RESYNC_TRIES	3
 
 /**
  * @brief	The callback pointer, takes nl_objects as args so we can spot the difference on changes.
@@ -72,6 +92,7 @@ typedef void (*diff_func_t)(struct nl_cache *, struct nl_object *, struct nl_obj
  
 static void netlinkdev_changecb(struct nl_cache *cache, struct nl_object *old,
 				  struct nl_object *obj, int action, void *arg);
+static void netlinkdev_overflow(struct netlinkdev_info *nl);
 
 /**
  * @brief	The function formaly known as libnl change_include 
@@ -151,82 +172,243 @@ static int netlinkdev_nlcacheinclude(struct nl_cache *cache, struct nl_object *o
 	return -NLE_MSGTYPE_NOSUPPORT;
 }
 
+/**
+ * @brief	hands an event to the caller, queued when a queue is installed
+ * 		so no application code runs inside the libnl cache update
+ * @param[in]	nl		pointer to netlink context
+ * @param[in]	event		event identifier
+ * @param[in]	nd		event data
+ * @return	nothing
+ */
+static void netlinkdev_emit(struct netlinkdev_info *nl, int event, struct netlinkdev_data *nd)
+{
+	struct netlinkdev_metrics *mt = nl->metrics;
+
+	nd->event = event;
+	nd->nsid = nl->nsid;
+	if (mt) {
+		mt->nl_events++;
+		/* events out of the debounce timer were not read just now */
+		if (mt->nl_rxstamp)
+			netlinkdev_hist_record(&mt->nl_latency, netlinkdev_metrics_now() - mt->nl_rxstamp);
+	}
+	if (nl->queue)
+		netlinkdev_queue_push(nl->queue, nd);
+	else if (nl->event)
+		nl->event (event, nd, nl->context);
+}
+
 /**
  * @brief	executes the event callback for the interface address changes
- * @param[in]	obj		object data of netlink interface that had the change
- * @param[in]	arg		pointer to netlink context
+ * @param[in]	nl		pointer to netlink context
+ * @param[in]	iface		interface entry the address belongs to
+ * @param[in]	status		flags of the interface reported with the address
+ * @param[in]	family		address family
+ * @param[in]	addr		binary address
+ * @param[in]	len		address length
  * @return	nothing
  */
-static void netlinkdev_actionaddrcb(struct nl_object *obj, void *arg)
+static void netlinkdev_actionaddr(struct netlinkdev_info *nl, struct netlinkdev_iface *iface, int status,
+				  int family, const void *addr, int len)
 {
-	struct netlinkdev_info *nl = (struct netlinkdev_info *)arg;
-	struct rtnl_addr *addr = (struct rtnl_addr *)obj;
 	struct netlinkdev_data nd;
-	struct rtnl_link *link;
 
 	memset(&nd, 0, sizeof(nd));
+	nd.if_index = iface->if_index;
+	memcpy(nd.if_name, iface->name, sizeof(nd.if_name));
+	nd.status = status;
+	nd.net_family = family;
+	nd.net_len = MIN(len, sizeof(nd.net_addr));
+	memcpy(nd.net_addr, addr, nd.net_len);
 
-	if (addr) {
-		nd.if_index = rtnl_addr_get_ifindex(addr);
-	        link = rtnl_link_get(nl->links, nd.if_index);
-		if (link)
-			nd.status = rtnl_link_get_flags(link);
-		nd.net_family = nl_addr_get_family(rtnl_addr_get_local(addr));
-		nd.net_len = nl_addr_get_len(rtnl_addr_get_local(addr));
-		if (nd.net_len > sizeof(nd.net_addr))
-			nd.net_len = sizeof(nd.net_addr);
-		memcpy(nd.net_addr, nl_addr_get_binary_addr(rtnl_addr_get_local(addr)),  nd.net_len);
-	}
+	if (nl)
+		netlinkdev_emit(nl, NETLINKDEV_EVENT_ADDR, &nd);
+}
+
+/**
+ * @brief	executes the address event callback for every address of an interface
+ * @param[in]	nl		pointer to netlink context
+ * @param[in]	iface		interface entry holding the address list
+ * @param[in]	status		flags of the interface reported with each address
+ * @return	nothing
+ */
+static void netlinkdev_actionifaddrs(struct netlinkdev_info *nl, struct netlinkdev_iface *iface, int status)
+{
+	struct netlinkdev_ifaddr *a;
 
-	if (nl && nl->event)
-		nl->event (NETLINKDEV_EVENT_ADDR, &nd, nl->context);
+	for (a = iface->addrs; a; a = a->next)
+		netlinkdev_actionaddr(nl, iface, status, a->family, a->addr, a->len);
 }
 
 /**
  * @brief	executes the event callback for the link change event
- * @param[in]	obj		object data of netlink interface that had the change
- * @param[in]	arg		pointer to netlink context
+ * @param[in]	nl		pointer to netlink context
+ * @param[in]	iface		interface entry that had the change
+ * @param[in]	collapsed	transitions collapsed into this event
  * @return	nothing
  */
-static void netlinkdev_actionlinkcb(struct nl_object *obj, void *arg)
+static void netlinkdev_actionlink(struct netlinkdev_info *nl, struct netlinkdev_iface *iface, int collapsed)
 {
-	struct netlinkdev_info *nl = (struct netlinkdev_info *)arg;
-	struct rtnl_link *link = (struct rtnl_link *)obj;
-	struct nl_addr *linkaddr;
 	struct netlinkdev_data nd;
 
 	memset(&nd, 0, sizeof(nd));
-	if (link) {
-		linkaddr=rtnl_link_get_addr(link);
-		if (linkaddr) {
-			memset(nd.link_addr, 0, sizeof(nd.link_addr));
-			memcpy(nd.link_addr, nl_addr_get_binary_addr(linkaddr), MIN(nl_addr_get_len(linkaddr),sizeof(nd.link_addr)));
-		}
-		nd.status = rtnl_link_get_flags(link);
-		nd.if_index = rtnl_link_get_ifindex(link);
-	}
+	memcpy(nd.link_addr, iface->link_addr, sizeof(nd.link_addr));
+	nd.status = iface->status;
+	nd.if_index = iface->if_index;
+	memcpy(nd.if_name, iface->name, sizeof(nd.if_name));
+	nd.collapsed = collapsed;
+	iface->reported = iface->status;
 
-	if (nl && nl->event)
-		nl->event (NETLINKDEV_EVENT_LINK, &nd, nl->context);
+	if (nl)
+		netlinkdev_emit(nl, NETLINKDEV_EVENT_LINK, &nd);
 }
 
 
 /**
- * @brief	Called when link has changed from up/down to down/up 
- * @param[in]	nl		pointer to netlink context
- * @param[in]	old		old object to compare
- * @param[in]	obj		object being udpated
+ * @brief	update the interface index with the latest state of a link
+ * @param[in]	nl		netlink context
+ * @param[in]	obj		link object being updated
+ * @return	interface entry, NULL if out of memory
+ */
+static struct netlinkdev_iface *netlinkdev_indexlink(struct netlinkdev_info *nl, struct nl_object *obj)
+{
+	struct rtnl_link *link = (struct rtnl_link *)obj;
+	struct nl_addr *linkaddr;
+
+	linkaddr = rtnl_link_get_addr(link);
+	return netlinkdev_index_link(nl->index, rtnl_link_get_ifindex(link), rtnl_link_get_name(link),
+				     rtnl_link_get_flags(link),
+				     linkaddr ? nl_addr_get_binary_addr(linkaddr) : NULL,
+				     linkaddr ? nl_addr_get_len(linkaddr) : 0);
+}
+
+/**
+ * @brief	keep the interface index in step with an address change
+ * @param[in]	nl		netlink context
+ * @param[in]	obj		address object being updated
  * @param[in]	action		action being commited
  * @return	nothing
  */
-static void netlinkdev_changelinkcb(struct netlinkdev_info *nl, struct nl_object *_old, struct nl_object *obj, int action)
+static void netlinkdev_indexaddr(struct netlinkdev_info *nl, struct nl_object *obj, int action)
 {
-	struct rtnl_link *link = (struct rtnl_link *)obj;
-	struct rtnl_link *old = (struct rtnl_link *)_old;
-	struct rtnl_addr *filter = rtnl_addr_alloc();
+	struct rtnl_addr *addr = (struct rtnl_addr *)obj;
+	struct nl_addr *local = rtnl_addr_get_local(addr);
+
+	if (!local)
+		return;
+	if (action == NL_ACT_DEL)
+		netlinkdev_index_deladdr(nl->index, rtnl_addr_get_ifindex(addr),
+					 nl_addr_get_family(local), nl_addr_get_binary_addr(local),
+					 nl_addr_get_len(local), rtnl_addr_get_prefixlen(addr));
+	else
+		netlinkdev_index_addr(nl->index, rtnl_addr_get_ifindex(addr),
+				      nl_addr_get_family(local), nl_addr_get_binary_addr(local),
+				      nl_addr_get_len(local), rtnl_addr_get_prefixlen(addr));
+}
+
+/**
+ * @brief	current monotonic time
+ * @return	time in milliseconds
+ */
+static unsigned long long netlinkdev_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief	current monotonic time
+ * @return	time in microseconds
+ */
+static unsigned long long netlinkdev_nowus(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief	arms the timer for the first debounce window still open
+ * @param[in]	nl		pointer to netlink context
+ * @return	nothing
+ */
+static void netlinkdev_debouncearm(struct netlinkdev_info *nl)
+{
+	struct itimerspec its;
+
+	if (nl->timerfd < 0)
+		return;
+	memset(&its, 0, sizeof(its));
+	if (nl->index->pending) {
+		/* absolute time, 0 would disarm it */
+		its.it_value.tv_sec = nl->index->pending->deadline / 1000;
+		its.it_value.tv_nsec = (nl->index->pending->deadline % 1000) * 1000000 + 1;
+	}
+	timerfd_settime(nl->timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/**
+ * @brief	records a link up/down transition, opening a debounce window on
+ * 		the first one.  Nothing is reported until the window ends.
+ * @param[in]	nl		pointer to netlink context
+ * @param[in]	iface		interface that changed
+ * @return	nothing
+ */
+static void netlinkdev_debounce(struct netlinkdev_info *nl, struct netlinkdev_iface *iface)
+{
+	iface->transitions++;
+	if (iface->deadline)
+		return;
+	iface->deadline = netlinkdev_now() + nl->debounce;
+	netlinkdev_index_pend(nl->index, iface);
+	if (nl->index->pending == iface)
+		netlinkdev_debouncearm(nl);
+}
 
-	if (filter) rtnl_addr_set_ifindex(filter, rtnl_link_get_ifindex(link));
+/**
+ * @brief	reports the interfaces whose debounce window has ended.  One
+ * 		event carries the final state, nothing is reported if the link
+ * 		ended up where it was.
+ * @param[in]	nl		pointer to netlink context
+ * @return	nothing
+ */
+static void netlinkdev_debounceexpire(struct netlinkdev_info *nl)
+{
+	unsigned long long now = netlinkdev_now();
+	struct netlinkdev_iface *iface;
+
+	while (nl->index->pending && nl->index->pending->deadline <= now) {
+		int collapsed;
+
+		iface = netlinkdev_index_unpend(nl->index);
+		iface->deadline = 0;
+		collapsed = iface->transitions;
+		iface->transitions = 0;
+		if ((iface->status & IFF_UP) != (iface->reported & IFF_UP)) {
+			collapsed--;
+			if (LOG_DETAILS) NL_LOG(NLLOG_DEBUG, "link: %d transitions collapsed", collapsed);
+			netlinkdev_actionifaddrs(nl, iface, iface->status);
+			netlinkdev_actionlink(nl, iface, collapsed);
+		}
+		nl->collapsed += collapsed;
+	}
+	netlinkdev_debouncearm(nl);
+}
 
+/**
+ * @brief	Called when link has changed from up/down to down/up, the
+ * 		interface index already holds the new state
+ * @param[in]	nl		pointer to netlink context
+ * @param[in]	iface		interface entry that changed
+ * @param[in]	oldflags	flags before the change, 0 for a new link
+ * @param[in]	action		action being commited
+ * @return	nothing
+ */
+static void netlinkdev_linkevent(struct netlinkdev_info *nl, struct netlinkdev_iface *iface, int oldflags, int action)
+{
 	switch( action )
 	{
 		case NL_ACT_NEW:
@@ -235,262 +417,2309 @@ static void netlinkdev_changelinkcb(struct netlinkdev_info *nl, struct nl_object
 		case NL_ACT_CHANGE:
 			if (LOG_DETAILS) if (action == NL_ACT_CHANGE) NL_LOG(NLLOG_DEBUG, "link: CHG");
 
-			if ( (rtnl_link_get_flags(link) & IFF_UP) != (old?(rtnl_link_get_flags(old) & IFF_UP):0) )
+			if ( (iface->status & IFF_UP) != (oldflags & IFF_UP) )
 			{
-				nl_cache_foreach_filter(nl->addrs, (struct nl_object *)filter, netlinkdev_actionaddrcb, nl);
-				netlinkdev_actionlinkcb(obj, nl);
+				if (nl->debounce) {
+					netlinkdev_debounce(nl, iface);
+					break;
+				}
+				netlinkdev_actionifaddrs(nl, iface, iface->status);
+				netlinkdev_actionlink(nl, iface, 0);
 			}
 			break;
 		case NL_ACT_DEL:
 			if (LOG_DETAILS) NL_LOG(NLLOG_DEBUG, "link: DEL");
-			nl_cache_foreach_filter(nl->addrs, (struct nl_object *)filter, netlinkdev_actionaddrcb, nl);
-			netlinkdev_actionlinkcb(obj, nl);
+			/* the link is already gone so its addresses are reported without status */
+			netlinkdev_actionifaddrs(nl, iface, 0);
+			netlinkdev_actionlink(nl, iface, 0);
+			netlinkdev_index_dellink(nl->index, iface->if_index);
 			break;
 	}
-	if (filter) rtnl_addr_put(filter);
 }
 
-
 /**
- * @brief	Called from callback when address changes
- * @param[in]	nl		netlink context
+ * @brief	Called from callback when a link object changes
+ * @param[in]	nl		pointer to netlink context
  * @param[in]	old		old object to compare
  * @param[in]	obj		object being udpated
  * @param[in]	action		action being commited
  * @return	nothing
  */
-static void netlinkdev_changeaddrcb(struct netlinkdev_info *nl, struct nl_object *old, struct nl_object *obj, int action)
+static void netlinkdev_changelinkcb(struct netlinkdev_info *nl, struct nl_object *_old, struct nl_object *obj, int action)
+{
+	struct rtnl_link *old = (struct rtnl_link *)_old;
+	struct netlinkdev_iface *iface = netlinkdev_indexlink(nl, obj);
+
+	if (!iface)
+		return;
+	netlinkdev_linkevent(nl, iface, old ? rtnl_link_get_flags(old) : 0, action);
+}
+
+
+/**
+ * @brief	Called when an address changes
+ * @param[in]	nl		netlink context
+ * @param[in]	if_index	interface the address belongs to
+ * @param[in]	family		address family
+ * @param[in]	addr		binary address
+ * @param[in]	len		address length
+ * @param[in]	action		action being commited
+ * @return	nothing
+ */
+static void netlinkdev_addrevent(struct netlinkdev_info *nl, int if_index, int family,
+				 const void *addr, int len, int action)
 {
 	/* if the interface associated with the address is down, we got nothing to do */
-	struct rtnl_link *link = rtnl_link_get(nl->links, rtnl_addr_get_ifindex((struct rtnl_addr *)obj));
+	struct netlinkdev_iface *iface = netlinkdev_index_byindex(nl->index, if_index);
 
-	if (!link)
+	/* an entry without a name was only created for its addresses, the link is not known yet */
+	if (!iface || iface->name[0] == '\0')
 		return;
 
-	if ((rtnl_link_get_flags(link) & IFF_UP) != 0)
+	if ((iface->status & IFF_UP) != 0)
 	{ 
 		switch( action )
 		{
 			case NL_ACT_NEW:
 				if (LOG_DETAILS) NL_LOG(NLLOG_DEBUG, "addr: NEW");
-				netlinkdev_actionaddrcb(obj, nl);
 				break;
 			case NL_ACT_CHANGE:
 				if (LOG_DETAILS) NL_LOG(NLLOG_DEBUG, "addr: CHG");
-				netlinkdev_actionaddrcb(obj, nl);
 				break;
 			case NL_ACT_DEL:
 				if (LOG_DETAILS) NL_LOG(NLLOG_DEBUG, "addr: DEL");
-				netlinkdev_actionaddrcb(obj, nl);
 				break;
 		}
+		netlinkdev_actionaddr(nl, iface, iface->status, family, addr, len);
 	}
-	rtnl_link_put(link);
 }
 
-
 /**
- * @brief	This is the callback called by the nl_cache_mngr which
- * 		dispatches the call to the appropriate function depending on 
- * 		the type of obj.
- * @param[in]	cache		netlink cache
+ * @brief	Called from callback when address changes
+ * @param[in]	nl		netlink context
  * @param[in]	old		old object to compare
  * @param[in]	obj		object being udpated
- * @param[in]	arg		change context passed onto approriate callback
+ * @param[in]	action		action being commited
  * @return	nothing
  */
-static void netlinkdev_changecb(struct nl_cache *cache, struct nl_object *old,
-				  struct nl_object *obj, int action, void *arg)
+static void netlinkdev_changeaddrcb(struct netlinkdev_info *nl, struct nl_object *old, struct nl_object *obj, int action)
 {
-	struct netlinkdev_info *nl = (struct netlinkdev_info *)arg;
+	struct rtnl_addr *addr = (struct rtnl_addr *)obj;
+	struct nl_addr *local = rtnl_addr_get_local(addr);
 
-	if( strcmp("route/link", nl_object_get_type(obj)) == 0 )
-		netlinkdev_changelinkcb(nl, old, obj, action);
-	else if( strcmp("route/addr", nl_object_get_type(obj)) == 0 )
-		netlinkdev_changeaddrcb(nl, old, obj, action);
+	if (!local)
+		return;
+	netlinkdev_addrevent(nl, rtnl_addr_get_ifindex(addr), nl_addr_get_family(local),
+			     nl_addr_get_binary_addr(local), nl_addr_get_len(local), action);
 }
 
-/** 
- * @brief	utlity calls change_addr_cb to claim an address as new
- * @param[in]	object		data which represents the netlink object
- * @param[out]	arg		pointer to the netlink find address info structure
- * @return	nothing
- */
-static void netlinkdev_bootcache(struct nl_object *obj, void *arg)
-{
-	struct netlinkdev_info *nl = arg;
-	netlinkdev_changeaddrcb(nl, NULL, obj, NL_ACT_NEW);
-}
 
 /**
- * @brief	initialize the operations with the netlink library
- * @param[in]	nl		netlink context
+ * @brief	executes the event callback for a route change
+ * @param[in]	nl		pointer to netlink context
+ * @param[in]	action		NETLINKDEV_ROUTE_ADD, _DEL or _CHANGE
+ * @param[in]	r		route as it is now, or as it was when removed
  * @return	nothing
  */
-static void netlinkdev_opsinit(struct netlinkdev_info *nl)
+static void netlinkdev_routeevent(struct netlinkdev_info *nl, int action, const struct netlinkdev_route *r)
 {
-	/* overwrite the co_include_event so we can have both -old and 
-	 * new- objects in the change_cb */
-	if (nl->links) nl_cache_get_ops(nl->links)->co_include_event = netlinkdev_nlcacheinclude;
-	if (nl->addrs) nl_cache_get_ops(nl->addrs)->co_include_event = netlinkdev_nlcacheinclude;
-
-	/* the initial set of addrs is not propagated by the 
-	 * nl_cache_mngr, iterate the cache */
-	if (nl->addrs) nl_cache_foreach(nl->addrs, netlinkdev_bootcache, nl);
+	struct netlinkdev_iface *iface = netlinkdev_index_byindex(nl->index, r->if_index);
+	struct netlinkdev_data nd;
 
-	/* allow sharing of info */
-	if (nl->addrs) nl_cache_mngt_provide(nl->addrs);
+	memset(&nd, 0, sizeof(nd));
+	nd.if_index = r->if_index;
+	if (iface) {
+		memcpy(nd.if_name, iface->name, sizeof(nd.if_name));
+		nd.status = iface->status;
+	}
+	nd.net_family = r->family;
+	nd.net_len = r->family == AF_INET6 ? 16 : 4;
+	memcpy(nd.net_addr, r->dst, nd.net_len);
+	nd.route_action = action;
+	nd.route_table = r->table;
+	nd.route_dstlen = r->dst_len;
+	nd.route_gwlen = r->gw_len;
+	memcpy(nd.route_gw, r->gateway, r->gw_len);
+	if (LOG_DETAILS) NL_LOG(NLLOG_DEBUG, "route: %s table %u", action == NETLINKDEV_ROUTE_ADD ? "NEW" :
+				action == NETLINKDEV_ROUTE_DEL ? "DEL" : "CHG", r->table);
+	netlinkdev_emit(nl, NETLINKDEV_EVENT_ROUTE, &nd);
 }
 
 /**
- * @brief	find netlink object address and fill in address
- * @param[in]	object		object data which represents the netlink interface
- * @param[out]	arg		pointer to the netlink find address info structure
+ * @brief	applies a route to the route tables and reports the difference
+ * @param[in]	nl		netlink context
+ * @param[in]	r		route
+ * @param[in]	del		route was removed
+ * @param[in]	boot		only index the route, like the initial dump
  * @return	nothing
  */
-static void netlinkdev_getifaddr(struct nl_object *object, void *arg)
+static void netlinkdev_routestate(struct netlinkdev_info *nl, const struct netlinkdev_route *r, int del, int boot)
 {
-	struct netlinkdev_findaddrinfo *ptr_find = (struct netlinkdev_findaddrinfo *)arg;
-	struct rtnl_addr *addr = (struct rtnl_addr *)object;
-	int family, index;
+	struct netlinkdev_route old;
+	int action;
 
-	if (ptr_find->myaddr != NULL)
+	if (del) {
+		if (netlinkdev_routes_delete(nl->routes, r, &old) == 0 && !boot)
+			netlinkdev_routeevent(nl, NETLINKDEV_ROUTE_DEL, &old);
 		return;
-	family = rtnl_addr_get_family(addr);
-	index = rtnl_addr_get_ifindex(addr);
-	if ((index == ptr_find->index) && (family == AF_INET)) {
-		ptr_find->myaddr = addr;
 	}
+	action = netlinkdev_routes_update(nl->routes, r, &old);
+	if (action < 0) {
+		NL_LOG(NLLOG_ERROR, "route: could not index route (%d)", action);
+	}
+	else if (action && !boot)
+		netlinkdev_routeevent(nl, action, r);
 }
 
 /**
- * @brief	utility for finding a interface index within the cache
- * @param[in]	c		netlink cache being searched
- * @param[in]	index		interface index
- * @return	pointer to found netlink address structure, NULL if not found
+ * @brief	reports a route a resync found gone
+ * @param[in]	r		route being removed
+ * @param[in]	arg		pointer to the netlink context
+ * @return	nothing
  */
-static struct rtnl_addr *netlinkdev_findaddr(struct nl_cache *c, int index)
+static void netlinkdev_routegone(const struct netlinkdev_route *r, void *arg)
 {
-	struct netlinkdev_findaddrinfo find;
-	find.myaddr = NULL;
-	find.index = index;
-	nl_cache_foreach(c, netlinkdev_getifaddr, &find);
-	return find.myaddr;
+	netlinkdev_routeevent(arg, NETLINKDEV_ROUTE_DEL, r);
 }
 
 /**
- * @brief	Get the status of a specified network interface
- * @param[in]	nl		netlink context
- * @param[in]	if_name		name of the interface
- * @param[out]	nd		netlink data filled in by this function
- * @return	result of get network status
+ * @brief	converts a libnl route object, only the first nexthop of a
+ * 		multipath route is kept
+ * @param[in]	obj		route object
+ * @param[out]	r		route
+ * @return	0 if converted, -EINVAL if the route is not tracked
  */
-int netlinkdev_getnet(struct netlinkdev_info *nl, char *if_name, 
-		      struct netlinkdev_data *nd)
+static int netlinkdev_libnlroute(struct nl_object *obj, struct netlinkdev_route *r)
 {
-	struct rtnl_link *link;
-	struct nl_addr *linkaddr;
-	struct rtnl_addr *addr;
-	int index;
+	struct rtnl_route *route = (struct rtnl_route *)obj;
+	struct rtnl_nexthop *nh;
+	struct nl_addr *dst, *gw;
 
-	link = rtnl_link_get_by_name(nl->links, if_name);
-	if (!link) 
-		return -ENODEV;
-
-	memset(nd, 0, sizeof(struct netlinkdev_data));
-
-	index = rtnl_link_get_ifindex(link);
-	nd->if_index = index;
-	nd->status = rtnl_link_get_flags(link);
-	NL_LOG(NLLOG_DEBUG, "netlink: ifindex:%d status:%s\n", index, nd->status & IFF_UP ? "UP": "DOWN");
-	linkaddr=rtnl_link_get_addr(link);
-	if (linkaddr) {
-		memset(nd->link_addr, 0, sizeof(nd->link_addr));
-		memcpy(nd->link_addr, nl_addr_get_binary_addr(linkaddr), MIN(nl_addr_get_len(linkaddr),sizeof(nd->link_addr)));
-	 	addr = netlinkdev_findaddr(nl->addrs, index);
-		if (addr) {
-			nd->net_family = nl_addr_get_family(rtnl_addr_get_local(addr));
-			nd->net_len = nl_addr_get_len(rtnl_addr_get_local(addr));
-			if (nd->net_len > sizeof(nd->net_addr))
-				nd->net_len = sizeof(nd->net_addr);
-			memcpy(nd->net_addr, nl_addr_get_binary_addr(rtnl_addr_get_local(addr)),  nd->net_len);
+	memset(r, 0, sizeof(struct netlinkdev_route));
+	r->family = rtnl_route_get_family(route);
+	if ((r->family != AF_INET && r->family != AF_INET6) || (rtnl_route_get_flags(route) & RTM_F_CLONED))
+		return -EINVAL;
+	r->table = rtnl_route_get_table(route);
+	r->tos = rtnl_route_get_tos(route);
+	r->priority = rtnl_route_get_priority(route);
+	r->type = rtnl_route_get_type(route);
+	if ((dst = rtnl_route_get_dst(route))) {
+		r->dst_len = nl_addr_get_prefixlen(dst);
+		memcpy(r->dst, nl_addr_get_binary_addr(dst), MIN(nl_addr_get_len(dst), sizeof(r->dst)));
+	}
+	if (rtnl_route_get_nnexthops(route) > 0 && (nh = rtnl_route_nexthop_n(route, 0))) {
+		r->if_index = rtnl_route_nh_get_ifindex(nh);
+		if ((gw = rtnl_route_nh_get_gateway(nh))) {
+			r->gw_len = MIN(nl_addr_get_len(gw), sizeof(r->gateway));
+			memcpy(r->gateway, nl_addr_get_binary_addr(gw), r->gw_len);
 		}
 	}
-	rtnl_link_put(link);
-
 	return 0;
 }
 
 /**
- * @brief	Poll the netlink connection and process any netlink events
- * @param[in]	nl		netlink context
- * @return	always 0 as success
+ * @brief	converts a route decoded by the native engine
+ * @param[in]	m		decoded message
+ * @param[out]	r		route
+ * @return	0 if converted, -EINVAL if the route is not tracked
  */
-int netlinkdev_poll(struct netlinkdev_info *nl)
+static int netlinkdev_nativeroute(const struct netlinkdev_rtmsg *m, struct netlinkdev_route *r)
 {
-	nl_cache_mngr_poll(nl->mngr, 1000);
+	memset(r, 0, sizeof(struct netlinkdev_route));
+	if ((m->family != AF_INET && m->family != AF_INET6) || (m->flags & RTM_F_CLONED))
+		return -EINVAL;
+	r->family = m->family;
+	r->table = m->table;
+	r->tos = m->tos;
+	r->priority = m->priority;
+	r->type = m->rtype;
+	r->dst_len = m->prefixlen;
+	if (m->addr)
+		memcpy(r->dst, m->addr, MIN(m->addr_len, sizeof(r->dst)));
+	r->if_index = m->if_index;
+	if (m->gateway) {
+		r->gw_len = MIN(m->gw_len, sizeof(r->gateway));
+		memcpy(r->gateway, m->gateway, r->gw_len);
+	}
 	return 0;
 }
 
 /**
- * @brief	Start a connection to netlink interface
- * @param[in]	nl			netlink context
- * @param[in]	netlink_event_cb	callback to report netlink events
- * @param[in]	caller_context		callers context to pass into callback
- * @return	result of start
+ * @brief	executes the event callback for a neighbour change
+ * @param[in]	nl		pointer to netlink context
+ * @param[in]	n		neighbour as it is now, or as it was when removed
+ * @param[in]	state		state now, 0 if removed
+ * @param[in]	prevstate	state before, 0 if new
+ * @return	nothing
  */
-int netlinkdev_start(struct netlinkdev_info *nl, 
-		     void (*netlink_event_cb)(int, struct netlinkdev_data *, void *), 
-		     void *caller_context)
+static void netlinkdev_neighevent(struct netlinkdev_info *nl, const struct netlinkdev_neigh *n,
+				  int state, int prevstate)
 {
-	int stat;
+	struct netlinkdev_iface *iface = netlinkdev_index_byindex(nl->index, n->if_index);
+	struct netlinkdev_data nd;
 
-	memset(nl, 0, sizeof(struct netlinkdev_info));
-	nl->socket = nl_socket_alloc();
-	if (!nl->socket) {
-		NL_LOG(NLLOG_ERROR, "Could not open netlink socket");
-		return -ENOMEM;
+	memset(&nd, 0, sizeof(nd));
+	nd.if_index = n->if_index;
+	if (iface) {
+		memcpy(nd.if_name, iface->name, sizeof(nd.if_name));
+		nd.status = iface->status;
 	}
-	nl->event = netlink_event_cb;
-	nl->context = caller_context;
+	nd.net_family = n->family;
+	nd.net_len = n->len;
+	memcpy(nd.net_addr, n->addr, n->len);
+	memcpy(nd.link_addr, n->lladdr, sizeof(nd.link_addr));
+	nd.neigh_state = state;
+	nd.neigh_prevstate = prevstate;
+	if (LOG_DETAILS) NL_LOG(NLLOG_DEBUG, "neigh: state %#x -> %#x", prevstate, state);
+	netlinkdev_emit(nl, NETLINKDEV_EVENT_NEIGH, &nd);
+}
 
-	stat = nl_cache_mngr_alloc(nl->socket, NETLINK_ROUTE, 0, &nl->mngr);
-	if (stat < 0) {
-		nl_socket_free(nl->socket);
-		nl->socket = 0;
-		NL_LOG(NLLOG_ERROR, "Could not allocate netlink mgr");
-		return stat;
-	}
-	stat = nl_cache_mngr_add(nl->mngr, "route/link", (change_func_t)&netlinkdev_changecb, nl, &nl->links);
-	if (stat < 0) {
-		NL_LOG(NLLOG_WARN, "Could not add route/link to netlink cache mgr");
+/**
+ * @brief	applies a neighbour to the neighbour index and reports a change
+ * 		of state or link address
+ * @param[in]	nl		netlink context
+ * @param[in]	n		neighbour
+ * @param[in]	del		neighbour was removed
+ * @param[in]	boot		only index the neighbour, like the initial dump
+ * @return	nothing
+ */
+static void netlinkdev_neighstate(struct netlinkdev_info *nl, const struct netlinkdev_neigh *n, int del, int boot)
+{
+	struct netlinkdev_neigh old;
+	int stat;
+
+	if (nl->watch && !netlinkdev_watch_hasindex(nl->watch, n->if_index))
+		return;
+	if (del) {
+		if (netlinkdev_neighs_delete(nl->neighs, n, &old) == 0 && !boot)
+			netlinkdev_neighevent(nl, &old, 0, old.state);
+		return;
 	}
-	stat = nl_cache_mngr_add(nl->mngr, "route/addr", (change_func_t)&netlinkdev_changecb, nl, &nl->addrs);
+	stat = netlinkdev_neighs_update(nl->neighs, n, &old);
 	if (stat < 0) {
-		NL_LOG(NLLOG_WARN, "Could not add route/addr to netlink cache mgr");
+		NL_LOG(NLLOG_ERROR, "neigh: could not index neighbour (%d)", stat);
 	}
+	else if (stat && !boot)
+		netlinkdev_neighevent(nl, n, n->state, stat == NETLINKDEV_NEIGH_ADDED ? 0 : old.state);
+}
 
-	netlinkdev_opsinit(nl);
+/**
+ * @brief	reports a neighbour a resync found gone
+ * @param[in]	n		neighbour being removed
+ * @param[in]	arg		pointer to the netlink context
+ * @return	nothing
+ */
+static void netlinkdev_neighgone(const struct netlinkdev_neigh *n, void *arg)
+{
+	netlinkdev_neighevent(arg, n, 0, n->state);
+}
 
-	NL_LOG(NLLOG_DEBUG, "netlink caches ready");
+/**
+ * @brief	converts a libnl neighbour object
+ * @param[in]	obj		neighbour object
+ * @param[out]	n		neighbour
+ * @return	0 if converted, -EINVAL if the neighbour is not tracked
+ */
+static int netlinkdev_libnlneigh(struct nl_object *obj, struct netlinkdev_neigh *n)
+{
+	struct rtnl_neigh *neigh = (struct rtnl_neigh *)obj;
+	struct nl_addr *dst, *lladdr;
 
+	memset(n, 0, sizeof(struct netlinkdev_neigh));
+	n->family = rtnl_neigh_get_family(neigh);
+	n->flags = rtnl_neigh_get_flags(neigh);
+	dst = rtnl_neigh_get_dst(neigh);
+	if ((n->family != AF_INET && n->family != AF_INET6) || (n->flags & NTF_PROXY) || !dst ||
+	    nl_addr_get_len(dst) > sizeof(n->addr))
+		return -EINVAL;
+	n->if_index = rtnl_neigh_get_ifindex(neigh);
+	n->len = nl_addr_get_len(dst);
+	memcpy(n->addr, nl_addr_get_binary_addr(dst), n->len);
+	n->state = rtnl_neigh_get_state(neigh);
+	if ((lladdr = rtnl_neigh_get_lladdr(neigh)))
+		memcpy(n->lladdr, nl_addr_get_binary_addr(lladdr), MIN(nl_addr_get_len(lladdr), sizeof(n->lladdr)));
 	return 0;
 }
 
+/**
+ * @brief	converts a neighbour decoded by the native engine
+ * @param[in]	m		decoded message
+ * @param[out]	n		neighbour
+ * @return	0 if converted, -EINVAL if the neighbour is not tracked
+ */
+static int netlinkdev_nativeneigh(const struct netlinkdev_rtmsg *m, struct netlinkdev_neigh *n)
+{
+	memset(n, 0, sizeof(struct netlinkdev_neigh));
+	if ((m->family != AF_INET && m->family != AF_INET6) || (m->flags & NTF_PROXY) || !m->addr ||
+	    m->addr_len > sizeof(n->addr))
+		return -EINVAL;
+	n->if_index = m->if_index;
+	n->family = m->family;
+	n->len = m->addr_len;
+	memcpy(n->addr, m->addr, n->len);
+	n->state = m->state;
+	n->flags = m->flags;
+	if (m->link_addr)
+		memcpy(n->lladdr, m->link_addr, MIN(m->link_len, sizeof(n->lladdr)));
+	return 0;
+}
 
 /**
- * @brief	Remove connections to netlink interface
+ * @brief	rebuilds the route socket filter after the watch list changed
  * @param[in]	nl		netlink context
- * @return	result of stop
+ * @return	nothing
  */
-int netlinkdev_stop(struct netlinkdev_info *nl)
+static void netlinkdev_watchupdate(struct netlinkdev_info *nl)
 {
-	if (nl->mngr)
-		nl_cache_mngr_free(nl->mngr);
-	nl->mngr = 0;
-	if (nl->socket)
-		nl_socket_free(nl->socket);
-	nl->socket = 0;
+	if (netlinkdev_getfd(nl) >= 0)
+		netlinkdev_watch_attach(nl->watch, netlinkdev_getfd(nl));
+}
+
+/**
+ * @brief	checks if a link is watched.  A link whose name matches a watched
+ * 		pattern gets its index watched as well, and loses it again when it
+ * 		goes away.
+ * @param[in]	nl		netlink context
+ * @param[in]	if_index	interface index of the link
+ * @param[in]	name		name of the link, may be NULL
+ * @param[in]	action		action being commited
+ * @return	non-zero if the interface is watched
+ */
+static int netlinkdev_watchedlink(struct netlinkdev_info *nl, int if_index, const char *name, int action)
+{
+	if (!nl->watch)
+		return 1;
+	if (action == NL_ACT_DEL) {
+		if (!netlinkdev_watch_hasindex(nl->watch, if_index))
+			return 0;
+		if (netlinkdev_watch_delindex(nl->watch, if_index))
+			netlinkdev_watchupdate(nl);
+		return 1;
+	}
+	if (netlinkdev_watch_hasindex(nl->watch, if_index))
+		return 1;
+	if (!name || !netlinkdev_watch_matchname(nl->watch, name))
+		return 0;
+	if (netlinkdev_watch_addindex(nl->watch, if_index, 0) > 0)
+		netlinkdev_watchupdate(nl);
+	return 1;
+}
+
+/**
+ * @brief	checks if an object belongs to a watched interface
+ * @param[in]	nl		netlink context
+ * @param[in]	obj		link or address object
+ * @param[in]	action		action being commited
+ * @return	non-zero if the interface is watched
+ */
+static int netlinkdev_watched(struct netlinkdev_info *nl, struct nl_object *obj, int action)
+{
+	if (!nl->watch)
+		return 1;
+	if( strcmp("route/addr", nl_object_get_type(obj)) == 0 )
+		return netlinkdev_watch_hasindex(nl->watch, rtnl_addr_get_ifindex((struct rtnl_addr *)obj));
+	return netlinkdev_watchedlink(nl, rtnl_link_get_ifindex((struct rtnl_link *)obj),
+				      rtnl_link_get_name((struct rtnl_link *)obj), action);
+}
+
+/**
+ * @brief	Dispatches a change reported by the nl_cache_mngr to the
+ * 		appropriate function depending on the type of obj.
+ * @param[in]	cache		netlink cache
+ * @param[in]	old		old object to compare
+ * @param[in]	obj		object being udpated
+ * @param[in]	arg		change context passed onto approriate callback
+ * @return	nothing
+ */
+static void netlinkdev_changeobj(struct nl_cache *cache, struct nl_object *old,
+				 struct nl_object *obj, int action, void *arg)
+{
+	struct netlinkdev_info *nl = (struct netlinkdev_info *)arg;
+	struct netlinkdev_route r;
+	struct netlinkdev_neigh n;
+
+	if( strcmp("route/neigh", nl_object_get_type(obj)) == 0 ) {
+		if (nl->neighs && netlinkdev_libnlneigh(obj, &n) == 0)
+			netlinkdev_neighstate(nl, &n, action == NL_ACT_DEL, 0);
+		return;
+	}
+	/* routes are tracked for every interface */
+	if( strcmp("route/route", nl_object_get_type(obj)) == 0 ) {
+		if (nl->routes && netlinkdev_libnlroute(obj, &r) == 0)
+			netlinkdev_routestate(nl, &r, action == NL_ACT_DEL, 0);
+		return;
+	}
+	if (!netlinkdev_watched(nl, obj, action))
+		return;
+
+	if( strcmp("route/link", nl_object_get_type(obj)) == 0 )
+		netlinkdev_changelinkcb(nl, old, obj, action);
+	else if( strcmp("route/addr", nl_object_get_type(obj)) == 0 ) {
+		netlinkdev_indexaddr(nl, obj, action);
+		netlinkdev_changeaddrcb(nl, old, obj, action);
+	}
+}
+
+/**
+ * @brief	This is the callback called by the nl_cache_mngr, it times the
+ * 		handling of each object when instrumentation is enabled.
+ * @param[in]	cache		netlink cache
+ * @param[in]	old		old object to compare
+ * @param[in]	obj		object being udpated
+ * @param[in]	action		action being commited
+ * @param[in]	arg		change context passed onto approriate callback
+ * @return	nothing
+ */
+static void netlinkdev_changecb(struct nl_cache *cache, struct nl_object *old,
+				  struct nl_object *obj, int action, void *arg)
+{
+	struct netlinkdev_metrics *mt = ((struct netlinkdev_info *)arg)->metrics;
+	unsigned long long start;
+
+	if (!mt) {
+		netlinkdev_changeobj(cache, old, obj, action, arg);
+		return;
+	}
+	start = netlinkdev_metrics_now();
+	netlinkdev_changeobj(cache, old, obj, action, arg);
+	netlinkdev_hist_record(&mt->nl_callback, netlinkdev_metrics_now() - start);
+}
+
+/** 
+ * @brief	utlity calls change_addr_cb to claim an address as new
+ * @param[in]	object		data which represents the netlink object
+ * @param[out]	arg		pointer to the netlink find address info structure
+ * @return	nothing
+ */
+static void netlinkdev_bootcache(struct nl_object *obj, void *arg)
+{
+	struct netlinkdev_info *nl = arg;
+	if (!netlinkdev_watched(nl, obj, NL_ACT_NEW))
+		return;
+	netlinkdev_indexaddr(nl, obj, NL_ACT_NEW);
+	netlinkdev_changeaddrcb(nl, NULL, obj, NL_ACT_NEW);
+}
+
+/** 
+ * @brief	utlity adds a link from the initial dump to the interface index
+ * @param[in]	object		data which represents the netlink object
+ * @param[out]	arg		pointer to the netlink context
+ * @return	nothing
+ */
+static void netlinkdev_bootlink(struct nl_object *obj, void *arg)
+{
+	struct netlinkdev_info *nl = arg;
+	struct netlinkdev_iface *iface;
+
+	if (!netlinkdev_watched(nl, obj, NL_ACT_NEW))
+		return;
+	iface = netlinkdev_indexlink(nl, obj);
+	if (iface)
+		iface->reported = iface->status;
+}
+
+/**
+ * @brief	applies the current state of a link to the interface index.
+ * 		The link is compared with the index instead of an old libnl
+ * 		object, so only a change of state is reported.
+ * @param[in]	nl		netlink context
+ * @param[in]	if_index	interface index
+ * @param[in]	name		interface name, may be NULL
+ * @param[in]	flags		interface flags
+ * @param[in]	link_addr	link layer address, may be NULL
+ * @param[in]	link_len	length of the link layer address
+ * @param[in]	boot		only index the link, like the initial dump
+ * @return	nothing
+ */
+static void netlinkdev_linkstate(struct netlinkdev_info *nl, int if_index, const char *name, int flags,
+				 const unsigned char *link_addr, int link_len, int boot)
+{
+	struct netlinkdev_iface *iface;
+	int oldflags = 0, action = NL_ACT_NEW;
+
+	if (!netlinkdev_watchedlink(nl, if_index, name, NL_ACT_NEW))
+		return;
+	iface = netlinkdev_index_byindex(nl->index, if_index);
+	if (iface && iface->name[0] != '\0') {
+		oldflags = iface->status;
+		action = NL_ACT_CHANGE;
+	}
+	iface = netlinkdev_index_link(nl->index, if_index, name, flags, link_addr, link_len);
+	if (!iface)
+		return;
+	if (boot)
+		iface->reported = iface->status;
+	else
+		netlinkdev_linkevent(nl, iface, oldflags, action);
+}
+
+/**
+ * @brief	applies an address that is present to the interface index
+ * @param[in]	nl		netlink context
+ * @param[in]	if_index	interface index
+ * @param[in]	family		address family
+ * @param[in]	addr		binary address
+ * @param[in]	len		address length
+ * @param[in]	prefixlen	prefix length
+ * @param[in]	resync		only report the address if it was not known
+ * @return	nothing
+ */
+static void netlinkdev_addrstate(struct netlinkdev_info *nl, int if_index, int family,
+				 const void *addr, int len, int prefixlen, int resync)
+{
+	struct netlinkdev_ifaddr *a;
+
+	if (nl->watch && !netlinkdev_watch_hasindex(nl->watch, if_index))
+		return;
+	a = netlinkdev_index_addr(nl->index, if_index, family, addr, len, prefixlen);
+	if (!a)
+		return;
+	if (resync && a->stale) {
+		a->stale = 0;
+		return;
+	}
+	a->stale = 0;
+	netlinkdev_addrevent(nl, if_index, family, addr, len, NL_ACT_NEW);
+}
+
+/**
+ * @brief	handles a link, address, route or neighbour message decoded by
+ * 		the native engine.  Dumped links, routes and neighbours are only
+ * 		indexed like at boot, unless resyncing.
+ * @param[in]	m		decoded message
+ * @param[in]	arg		pointer to the netlink context
+ * @return	nothing
+ */
+static void netlinkdev_nativemsg(const struct netlinkdev_rtmsg *m, void *arg)
+{
+	struct netlinkdev_info *nl = arg;
+	struct netlinkdev_iface *iface;
+	struct netlinkdev_route r;
+	struct netlinkdev_neigh n;
+
+	switch (m->type) {
+		case RTM_NEWLINK:
+			netlinkdev_linkstate(nl, m->if_index, m->name, m->flags, m->link_addr, m->link_len,
+					     m->multi && !nl->resyncing);
+			break;
+		case RTM_DELLINK:
+			if (!netlinkdev_watchedlink(nl, m->if_index, m->name, NL_ACT_DEL))
+				return;
+			iface = netlinkdev_index_byindex(nl->index, m->if_index);
+			if (iface)
+				netlinkdev_linkevent(nl, iface, iface->status, NL_ACT_DEL);
+			break;
+		case RTM_NEWADDR:
+			if (m->addr)
+				netlinkdev_addrstate(nl, m->if_index, m->family, m->addr, m->addr_len,
+						     m->prefixlen, m->multi && nl->resyncing);
+			break;
+		case RTM_DELADDR:
+			if (!m->addr)
+				return;
+			if (nl->watch && !netlinkdev_watch_hasindex(nl->watch, m->if_index))
+				return;
+			netlinkdev_index_deladdr(nl->index, m->if_index, m->family,
+						 m->addr, m->addr_len, m->prefixlen);
+			netlinkdev_addrevent(nl, m->if_index, m->family, m->addr, m->addr_len, NL_ACT_DEL);
+			break;
+		case RTM_NEWROUTE:
+		case RTM_DELROUTE:
+			if (nl->routes && netlinkdev_nativeroute(m, &r) == 0)
+				netlinkdev_routestate(nl, &r, m->type == RTM_DELROUTE,
+						      m->multi && !nl->resyncing);
+			break;
+		case RTM_NEWNEIGH:
+		case RTM_DELNEIGH:
+			if (nl->neighs && netlinkdev_nativeneigh(m, &n) == 0)
+				netlinkdev_neighstate(nl, &n, m->type == RTM_DELNEIGH,
+						      m->multi && !nl->resyncing);
+			break;
+		case NLMSG_ERROR:
+			if (m->error)
+				NL_LOG(NLLOG_WARN, "native: request failed (%d)", m->error);
+			/* fall through */
+		case NLMSG_DONE:
+			nl->dumping = 0;
+			break;
+	}
+}
+
+/**
+ * @brief	handles a message decoded by the native engine like
+ * 		netlinkdev_nativemsg(), timing it for the instrumentation
+ * @param[in]	m		decoded message
+ * @param[in]	arg		pointer to the netlink context
+ * @return	nothing
+ */
+static void netlinkdev_nativetimed(const struct netlinkdev_rtmsg *m, void *arg)
+{
+	struct netlinkdev_metrics *mt = ((struct netlinkdev_info *)arg)->metrics;
+	unsigned long long start = netlinkdev_metrics_now();
+
+	netlinkdev_nativemsg(m, arg);
+	netlinkdev_hist_record(&mt->nl_callback, netlinkdev_metrics_now() - start);
+}
+
+/**
+ * @brief	Hand in a notification received for this context on another
+ * 		socket, for contexts started with NETLINKDEV_START_NOLISTEN
+ * @param[in]	nl		netlink context
+ * @param[in]	m		decoded message
+ * @return	nothing
+ */
+void netlinkdev_deliver(struct netlinkdev_info *nl, const struct netlinkdev_rtmsg *m)
+{
+	if (nl->booted)
+		netlinkdev_nativemsg(m, nl);
+}
+
+/**
+ * @brief	hands an object parsed out of a fed datagram to its cache, the
+ * 		way the cache manager does
+ * @param[in]	obj		parsed object
+ * @param[in]	arg		pointer to the netlink context
+ * @return	nothing
+ */
+static void netlinkdev_feedobj(struct nl_object *obj, void *arg)
+{
+	struct netlinkdev_info *nl = (struct netlinkdev_info *)arg;
+	const char *type = nl_object_get_type(obj);
+	struct nl_cache *cache = NULL;
+
+	if (!strcmp(type, "route/link"))
+		cache = nl->links;
+	else if (!strcmp(type, "route/addr"))
+		cache = nl->addrs;
+	else if (!strcmp(type, "route/route"))
+		cache = nl->routecache;
+	else if (!strcmp(type, "route/neigh"))
+		cache = nl->neighcache;
+	if (cache)
+		netlinkdev_nlcacheinclude(cache, obj, (change_func_t)&netlinkdev_changecb, nl);
+}
+
+/**
+ * @brief	Hand in a raw route socket datagram, for contexts started with
+ * 		NETLINKDEV_START_OFFLINE.  The messages go through the decoder of
+ * 		the engine and the same cache, index and event path as if they
+ * 		had been read from the socket.
+ * @param[in]	nl		netlink context
+ * @param[in]	buf		datagram
+ * @param[in]	len		length of the datagram
+ * @return	number of messages, negative errno on error
+ */
+int netlinkdev_feed(struct netlinkdev_info *nl, const void *buf, int len)
+{
+	const struct nlmsghdr *h;
+	struct nl_msg *msg;
+	int n = 0;
+
+	if (!nl->offline)
+		return -EINVAL;
+	if (nl->metrics)
+		nl->metrics->nl_rxstamp = netlinkdev_metrics_now();
+	if (nl->engine == NETLINKDEV_ENGINE_NATIVE)
+		n = netlinkdev_native_parse(buf, len, nl->nsid,
+					    nl->metrics ? netlinkdev_nativetimed : netlinkdev_nativemsg, nl);
+	else {
+		for (h = buf; NLMSG_OK(h, len); h = NLMSG_NEXT(h, len)) {
+			/* libnl parses every message out of a copy of its own */
+			msg = nlmsg_convert((struct nlmsghdr *)h);
+			if (!msg) {
+				n = -ENOMEM;
+				break;
+			}
+			nlmsg_set_proto(msg, NETLINK_ROUTE);
+			nl_msg_parse(msg, netlinkdev_feedobj, nl);
+			nlmsg_free(msg);
+			n++;
+		}
+	}
+	if (nl->metrics)
+		nl->metrics->nl_rxstamp = 0;
+	return n;
+}
+
+/**
+ * @brief	receives one datagram on a route socket of the native engine,
+ * 		records it when capturing and decodes its messages
+ * @param[in]	nl		netlink context
+ * @param[in]	fd		route socket
+ * @param[in]	cb		called for each decoded message
+ * @param[in]	arg		passed to cb
+ * @return	number of messages, 0 if nothing is pending, negative errno on error
+ */
+static int netlinkdev_recv(struct netlinkdev_info *nl, int fd, netlinkdev_native_cb_t cb, void *arg)
+{
+	int n, nsid;
+
+	if (!nl->capture)
+		return netlinkdev_native_recv(fd, nl->rxbuf, NETLINKDEV_NATIVE_BUFSIZE, cb, arg);
+	if ((n = netlinkdev_native_read(fd, nl->rxbuf, NETLINKDEV_NATIVE_BUFSIZE, &nsid)) <= 0)
+		return n;
+	netlinkdev_capture_record(nl->capture, NETLINKDEV_CAPTURE_ROUTE, nsid >= 0 ? nsid : nl->nsid,
+				  nl->rxbuf, n);
+	return netlinkdev_native_parse(nl->rxbuf, n, nsid, cb, arg);
+}
+
+/**
+ * @brief	records each message the cache manager reads, libnl hands them
+ * 		over one at a time rather than as the datagram they came in
+ * @param[in]	msg		message received
+ * @param[in]	arg		pointer to the netlink context
+ * @return	NL_OK to go on with the message
+ */
+static int netlinkdev_capturemsg(struct nl_msg *msg, void *arg)
+{
+	struct netlinkdev_info *nl = arg;
+	struct nlmsghdr *h = nlmsg_hdr(msg);
+
+	if (nl->capture)
+		netlinkdev_capture_record(nl->capture, NETLINKDEV_CAPTURE_ROUTE, nl->nsid, h, h->nlmsg_len);
+	return NL_OK;
+}
+
+/**
+ * @brief	dumps links or addresses through the native engine and waits
+ * 		until the whole dump has been handled
+ * @param[in]	nl		netlink context
+ * @param[in]	type		RTM_GETLINK, RTM_GETADDR, RTM_GETROUTE or RTM_GETNEIGH
+ * @return	0 on success, negative errno on error
+ */
+static int netlinkdev_nativedump(struct netlinkdev_info *nl, int type)
+{
+	struct pollfd pfd;
+	int stat;
+
+	if ((stat = netlinkdev_native_request(nl->fd, type, AF_UNSPEC, 0, ++nl->seq)) < 0)
+		return stat;
+	pfd.fd = nl->fd;
+	pfd.events = POLLIN;
+	nl->dumping = 1;
+	while (nl->dumping) {
+		if (poll(&pfd, 1, NETLINKDEV_DUMP_TIMEOUT) <= 0) {
+			NL_LOG(NLLOG_ERROR, "native: dump %d did not complete", type);
+			nl->dumping = 0;
+			return -ETIMEDOUT;
+		}
+		stat = netlinkdev_recv(nl, nl->fd, netlinkdev_nativemsg, nl);
+		if (stat == -ENOBUFS) {
+			/* notifications were lost, the dump itself goes on */
+			netlinkdev_overflow(nl);
+		}
+		else if (stat < 0) {
+			nl->dumping = 0;
+			return stat;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief	reports what a resync found gone: links that were not dumped
+ * 		again, and addresses of the remaining links
+ * @param[in]	iface		interface entry
+ * @param[in]	arg		pointer to the netlink context
+ * @return	nothing
+ */
+static void netlinkdev_resyncsweep(struct netlinkdev_iface *iface, void *arg)
+{
+	struct netlinkdev_info *nl = arg;
+	struct netlinkdev_ifaddr *a, *next, gone;
+
+	if (iface->stale) {
+		if (iface->name[0] != '\0') {
+			netlinkdev_watchedlink(nl, iface->if_index, iface->name, NL_ACT_DEL);
+			netlinkdev_linkevent(nl, iface, iface->status, NL_ACT_DEL);
+		}
+		else
+			netlinkdev_index_dellink(nl->index, iface->if_index);
+		return;
+	}
+	for (a = iface->addrs; a; a = next) {
+		next = a->next;
+		if (!a->stale)
+			continue;
+		gone = *a;
+		netlinkdev_index_deladdr(nl->index, iface->if_index, gone.family,
+					 gone.addr, gone.len, gone.prefixlen);
+		netlinkdev_addrevent(nl, iface->if_index, gone.family, gone.addr, gone.len, NL_ACT_DEL);
+	}
+}
+
+/**
+ * @brief	feeds a link of a refilled libnl cache to the resync
+ * @param[in]	obj		link object
+ * @param[in]	arg		pointer to the netlink context
+ * @return	nothing
+ */
+static void netlinkdev_resynclink(struct nl_object *obj, void *arg)
+{
+	struct rtnl_link *link = (struct rtnl_link *)obj;
+	struct nl_addr *linkaddr = rtnl_link_get_addr(link);
+
+	netlinkdev_linkstate(arg, rtnl_link_get_ifindex(link), rtnl_link_get_name(link),
+			     rtnl_link_get_flags(link),
+			     linkaddr ? nl_addr_get_binary_addr(linkaddr) : NULL,
+			     linkaddr ? nl_addr_get_len(linkaddr) : 0, 0);
+}
+
+/**
+ * @brief	feeds an address of a refilled libnl cache to the resync
+ * @param[in]	obj		address object
+ * @param[in]	arg		pointer to the netlink context
+ * @return	nothing
+ */
+static void netlinkdev_resyncaddr(struct nl_object *obj, void *arg)
+{
+	struct rtnl_addr *addr = (struct rtnl_addr *)obj;
+	struct nl_addr *local = rtnl_addr_get_local(addr);
+
+	if (local)
+		netlinkdev_addrstate(arg, rtnl_addr_get_ifindex(addr), nl_addr_get_family(local),
+				     nl_addr_get_binary_addr(local), nl_addr_get_len(local),
+				     rtnl_addr_get_prefixlen(addr), 1);
+}
+
+/**
+ * @brief	feeds a route of a refilled libnl cache to the resync
+ * @param[in]	obj		route object
+ * @param[in]	arg		pointer to the netlink context
+ * @return	nothing
+ */
+static void netlinkdev_resyncroute(struct nl_object *obj, void *arg)
+{
+	struct netlinkdev_route r;
+
+	if (netlinkdev_libnlroute(obj, &r) == 0)
+		netlinkdev_routestate(arg, &r, 0, 0);
+}
+
+/**
+ * @brief	indexes a route of the initial libnl dump
+ * @param[in]	obj		route object
+ * @param[in]	arg		pointer to the netlink context
+ * @return	nothing
+ */
+static void netlinkdev_bootroute(struct nl_object *obj, void *arg)
+{
+	struct netlinkdev_route r;
+
+	if (netlinkdev_libnlroute(obj, &r) == 0)
+		netlinkdev_routestate(arg, &r, 0, 1);
+}
+
+/**
+ * @brief	feeds a neighbour of a refilled libnl cache to the resync
+ * @param[in]	obj		neighbour object
+ * @param[in]	arg		pointer to the netlink context
+ * @return	nothing
+ */
+static void netlinkdev_resyncneigh(struct nl_object *obj, void *arg)
+{
+	struct netlinkdev_neigh n;
+
+	if (netlinkdev_libnlneigh(obj, &n) == 0)
+		netlinkdev_neighstate(arg, &n, 0, 0);
+}
+
+/**
+ * @brief	indexes a neighbour of the initial libnl dump
+ * @param[in]	obj		neighbour object
+ * @param[in]	arg		pointer to the netlink context
+ * @return	nothing
+ */
+static void netlinkdev_bootneigh(struct nl_object *obj, void *arg)
+{
+	struct netlinkdev_neigh n;
+
+	if (netlinkdev_libnlneigh(obj, &n) == 0)
+		netlinkdev_neighstate(arg, &n, 0, 1);
+}
+
+/**
+ * @brief	switches to the namespace of the context before opening sockets
+ * @param[in]	nl		netlink context
+ * @param[out]	saved		namespace to switch back to, -1 if not switched
+ * @return	0 on success, negative on error
+ */
+static int netlinkdev_netnsin(struct netlinkdev_info *nl, int *saved)
+{
+	*saved = -1;
+	if (nl->netns < 0)
+		return 0;
+	*saved = netlinkdev_netns_enter(nl->netns);
+	return *saved < 0 ? *saved : 0;
+}
+
+/**
+ * @brief	switches back after netlinkdev_netnsin()
+ * @param[in]	saved		namespace to switch back to, -1 if not switched
+ * @return	nothing
+ */
+static void netlinkdev_netnsout(int saved)
+{
+	if (saved >= 0)
+		netlinkdev_netns_leave(saved);
+}
+
+/**
+ * @brief	dumps links, addresses and tracked routes and neighbours once
+ * 		and reports the difference with what is indexed.  libnl caches
+ * 		are refilled on a separate socket, the native engine dumps on
+ * 		the notification socket with notifications interleaved.
+ * @param[in]	nl		netlink context
+ * @return	0 on success, negative on error
+ */
+static int netlinkdev_resynconce(struct netlinkdev_info *nl)
+{
+	struct nl_sock *sock;
+	int stat, saved;
+
+	netlinkdev_index_mark(nl->index);
+	if (nl->routes)
+		netlinkdev_routes_mark(nl->routes);
+	if (nl->neighs)
+		netlinkdev_neighs_mark(nl->neighs);
+	if (nl->engine == NETLINKDEV_ENGINE_NATIVE) {
+		stat = netlinkdev_nativedump(nl, RTM_GETLINK);
+		if (!stat)
+			stat = netlinkdev_nativedump(nl, RTM_GETADDR);
+		if (!stat && nl->routes)
+			stat = netlinkdev_nativedump(nl, RTM_GETROUTE);
+		if (!stat && nl->neighs)
+			stat = netlinkdev_nativedump(nl, RTM_GETNEIGH);
+	}
+	else {
+		sock = nl_socket_alloc();
+		if (!sock)
+			return -ENOMEM;
+		if (!(stat = netlinkdev_netnsin(nl, &saved))) {
+			stat = nl_connect(sock, NETLINK_ROUTE);
+			netlinkdev_netnsout(saved);
+		}
+		if (!stat && nl->links && (stat = nl_cache_refill(sock, nl->links)) == 0)
+			nl_cache_foreach(nl->links, netlinkdev_resynclink, nl);
+		if (!stat && nl->addrs && (stat = nl_cache_refill(sock, nl->addrs)) == 0)
+			nl_cache_foreach(nl->addrs, netlinkdev_resyncaddr, nl);
+		if (!stat && nl->routecache && (stat = nl_cache_refill(sock, nl->routecache)) == 0)
+			nl_cache_foreach(nl->routecache, netlinkdev_resyncroute, nl);
+		if (!stat && nl->neighcache && (stat = nl_cache_refill(sock, nl->neighcache)) == 0)
+			nl_cache_foreach(nl->neighcache, netlinkdev_resyncneigh, nl);
+		nl_socket_free(sock);
+	}
+	if (stat < 0) {
+		/* a partial dump would make everything not dumped yet look gone */
+		NL_LOG(NLLOG_ERROR, "netlink: resync dump failed (%d)", stat);
+		return stat;
+	}
+	netlinkdev_index_foreach(nl->index, netlinkdev_resyncsweep, nl);
+	if (nl->routes)
+		netlinkdev_routes_sweep(nl->routes, netlinkdev_routegone, nl);
+	if (nl->neighs)
+		netlinkdev_neighs_sweep(nl->neighs, netlinkdev_neighgone, nl);
+	return 0;
+}
+
+/**
+ * @brief	Bring the interface index back in step with the kernel after
+ * 		notifications were lost.  Only what changed is reported.
+ * @param[in]	nl		netlink context
+ * @return	result of the resync
+ */
+int netlinkdev_resync(struct netlinkdev_info *nl)
+{
+	int stat, tries = 0;
+
+	if (nl->resyncing || !nl->index)
+		return -EBUSY;
+	nl->resyncing = 1;
+	do {
+		nl->overflowed = 0;
+		nl->resyncs++;
+		stat = netlinkdev_resynconce(nl);
+		/* the socket overflowed again while dumping, what was dumped first may be stale */
+	} while (!stat && nl->overflowed && ++tries < NETLINKDEV_RESYNC_TRIES);
+	nl->resyncing = 0;
+	NL_LOG(NLLOG_INFO, "netlink: resync %s (%lu overflows, %lu resyncs)",
+	       stat ? "failed" : "done", nl->overflows, nl->resyncs);
+	return stat;
+}
+
+/**
+ * @brief	counts a socket overflow and resyncs, or has the running resync
+ * 		go round again
+ * @param[in]	nl		netlink context
+ * @return	nothing
+ */
+static void netlinkdev_overflow(struct netlinkdev_info *nl)
+{
+	nl->overflows++;
+	NL_LOG(NLLOG_WARN, "netlink: socket overflow, notifications lost");
+	if (nl->resyncing)
+		nl->overflowed = 1;
+	else
+		netlinkdev_resync(nl);
+}
+
+/**
+ * @brief	opens the route socket of the native engine and loads the
+ * 		links and addresses already present
+ * @param[in]	nl		netlink context
+ * @return	result of start
+ */
+static int netlinkdev_nativestart(struct netlinkdev_info *nl)
+{
+	int stat;
+
+	nl->rxbuf = malloc(NETLINKDEV_NATIVE_BUFSIZE);
+	if (!nl->rxbuf)
+		return -ENOMEM;
+	nl->fd = netlinkdev_native_open(nl->nolisten ? 0 :
+					RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR);
+	if (nl->fd < 0)
+		return nl->fd;
+	if (!nl->booted)
+		/* netlinkdev_boot() does the dumps once the watch list is set */
+		return 0;
+	/* links first so the addresses find their interface */
+	if ((stat = netlinkdev_nativedump(nl, RTM_GETLINK)) < 0)
+		return stat;
+	return netlinkdev_nativedump(nl, RTM_GETADDR);
+}
+
+/**
+ * @brief	state of a fast start
+*/
+struct netlinkdev_bootctx {
+	struct netlinkdev_info	*nl;		/**< netlink context */
+	int			strict;		/**< one request per watched interface */
+	int			links;		/**< link replies still expected */
+	int			addrbusy;	/**< address dump in progress */
+	int			*addrq;		/**< interfaces whose addresses are still to be dumped */
+	int			naddrq;		/**< entries in addrq */
+	int			addrnext;	/**< next entry of addrq to dump */
+	int			onlink;		/**< message came from the link socket */
+};
+
+/**
+ * @brief	handles a message of a fast start dump.  Links are indexed, the
+ * 		addresses only collected, they are reported once everything is in.
+ * @param[in]	m		decoded message
+ * @param[in]	arg		fast start state
+ * @return	nothing
+ */
+static void netlinkdev_bootmsg(const struct netlinkdev_rtmsg *m, void *arg)
+{
+	struct netlinkdev_bootctx *ctx = arg;
+	struct netlinkdev_info *nl = ctx->nl;
+
+	switch (m->type) {
+		case RTM_NEWLINK:
+			netlinkdev_linkstate(nl, m->if_index, m->name, m->flags, m->link_addr, m->link_len, 1);
+			if (m->multi)
+				break;
+			/* reply to a single link request, its addresses come next */
+			ctx->links--;
+			if (ctx->strict && netlinkdev_index_byindex(nl->index, m->if_index))
+				ctx->addrq[ctx->naddrq++] = m->if_index;
+			break;
+		case RTM_NEWADDR:
+			if (m->addr)
+				netlinkdev_index_addr(nl->index, m->if_index, m->family,
+						      m->addr, m->addr_len, m->prefixlen);
+			break;
+		case NLMSG_ERROR:
+			if (m->error && m->error != -ENODEV)
+				NL_LOG(NLLOG_WARN, "native: boot request failed (%d)", m->error);
+			/* fall through */
+		case NLMSG_DONE:
+			if (!ctx->onlink)
+				ctx->addrbusy = 0;
+			else if (m->type == NLMSG_DONE)
+				ctx->links = 0;
+			else
+				ctx->links--;
+			break;
+	}
+}
+
+/**
+ * @brief	one pass over the interface index when everything is in:
+ * 		addresses of links that were not indexed are dropped, the others
+ * 		are reported like at boot
+ * @param[in]	iface		interface entry
+ * @param[in]	arg		pointer to the netlink context
+ * @return	nothing
+ */
+static void netlinkdev_bootsnapshot(struct netlinkdev_iface *iface, void *arg)
+{
+	struct netlinkdev_info *nl = arg;
+	struct netlinkdev_ifaddr *a;
+
+	if (iface->name[0] == '\0') {
+		netlinkdev_index_dellink(nl->index, iface->if_index);
+		return;
+	}
+	for (a = iface->addrs; a; a = a->next)
+		netlinkdev_addrevent(nl, iface->if_index, a->family, a->addr, a->len, NL_ACT_NEW);
+}
+
+/**
+ * @brief	sends the link requests of a fast start.  With a strictly
+ * 		checked socket and a watch list of indexes and plain names, only
+ * 		the watched links are asked for, otherwise all links are dumped.
+ * @param[in]	ctx		fast start state
+ * @param[in]	fd		link socket
+ * @return	0 on success, negative errno on error
+ */
+static int netlinkdev_bootrequest(struct netlinkdev_bootctx *ctx, int fd)
+{
+	struct netlinkdev_info *nl = ctx->nl;
+	struct netlinkdev_watch *w = nl->watch;
+	unsigned int i;
+	int stat;
+
+	ctx->strict = w && !netlinkdev_watch_empty(w);
+	for (i = 0; ctx->strict && i < w->npatterns; i++)
+		if (strpbrk(w->patterns[i], "*?["))
+			ctx->strict = 0;
+	if (ctx->strict && netlinkdev_native_strict(fd) < 0)
+		ctx->strict = 0;
+	if (!ctx->strict) {
+		ctx->links = 1;
+		return netlinkdev_native_request(fd, RTM_GETLINK, AF_UNSPEC, 0, ++nl->seq);
+	}
+
+	ctx->addrq = calloc(w->nindexes + w->npatterns, sizeof(int));
+	if (!ctx->addrq)
+		return -ENOMEM;
+	for (i = 0; i < w->nindexes; i++) {
+		if ((stat = netlinkdev_native_request(fd, RTM_GETLINK, AF_UNSPEC,
+						      w->indexes[i].if_index, ++nl->seq)) < 0)
+			return stat;
+		ctx->links++;
+	}
+	for (i = 0; i < w->npatterns; i++) {
+		if ((stat = netlinkdev_native_getlink(fd, w->patterns[i], ++nl->seq)) < 0)
+			return stat;
+		ctx->links++;
+	}
+	return 0;
+}
+
+/**
+ * @brief	Load the links and addresses present when started with
+ * 		NETLINKDEV_START_FAST, after the watch list has been set.  The
+ * 		link and address dumps run at the same time on two sockets, and
+ * 		are limited to the watched interfaces by the kernel when it can.
+ * 		Called by netlinkdev_dispatch() until it has succeeded.
+ * @param[in]	nl		netlink context
+ * @return	result of boot
+ */
+int netlinkdev_boot(struct netlinkdev_info *nl)
+{
+	struct netlinkdev_bootctx ctx;
+	struct pollfd pfd[2];
+	int stat, saved, i;
+
+	if (nl->booted)
+		return 0;
+	if (nl->engine != NETLINKDEV_ENGINE_NATIVE || nl->fd < 0)
+		return -ENOTCONN;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.nl = nl;
+	pfd[0].fd = pfd[1].fd = -1;
+	if (!(stat = netlinkdev_netnsin(nl, &saved))) {
+		pfd[0].fd = netlinkdev_native_open(0);
+		pfd[1].fd = netlinkdev_native_open(0);
+		netlinkdev_netnsout(saved);
+		stat = pfd[0].fd < 0 ? pfd[0].fd : pfd[1].fd < 0 ? pfd[1].fd : 0;
+	}
+	pfd[0].events = pfd[1].events = POLLIN;
+	if (!stat)
+		stat = netlinkdev_bootrequest(&ctx, pfd[0].fd);
+	if (!stat && ctx.strict && netlinkdev_native_strict(pfd[1].fd) < 0)
+		stat = -EOPNOTSUPP;
+	if (!stat && !ctx.strict) {
+		stat = netlinkdev_native_request(pfd[1].fd, RTM_GETADDR, AF_UNSPEC, 0, ++nl->seq);
+		ctx.addrbusy = 1;
+	}
+
+	while (!stat && (ctx.links > 0 || ctx.addrbusy || ctx.addrnext < ctx.naddrq)) {
+		if (!ctx.addrbusy && ctx.addrnext < ctx.naddrq) {
+			/* one dump at a time per socket */
+			stat = netlinkdev_native_request(pfd[1].fd, RTM_GETADDR, AF_UNSPEC,
+							 ctx.addrq[ctx.addrnext++], ++nl->seq);
+			ctx.addrbusy = 1;
+			continue;
+		}
+		if (poll(pfd, 2, NETLINKDEV_DUMP_TIMEOUT) <= 0) {
+			NL_LOG(NLLOG_ERROR, "native: boot dumps did not complete");
+			stat = -ETIMEDOUT;
+			break;
+		}
+		for (i = 0; i < 2 && stat >= 0; i++) {
+			if (!(pfd[i].revents & POLLIN))
+				continue;
+			ctx.onlink = (i == 0);
+			stat = netlinkdev_recv(nl, pfd[i].fd, netlinkdev_bootmsg, &ctx);
+		}
+		if (stat > 0)
+			stat = 0;
+	}
+
+	for (i = 0; i < 2; i++)
+		if (pfd[i].fd >= 0)
+			close(pfd[i].fd);
+	free(ctx.addrq);
+	if (stat < 0) {
+		/* not booted, the next netlinkdev_dispatch() tries again */
+		NL_LOG(NLLOG_ERROR, "native: fast start failed (%d)", stat);
+		return stat;
+	}
+	nl->booted = 1;
+	netlinkdev_index_foreach(nl->index, netlinkdev_bootsnapshot, nl);
+	nl->startup_us = netlinkdev_nowus() - nl->started_us;
+	NL_LOG(NLLOG_DEBUG, "netlink: fast start %s took %lu us",
+	       ctx.strict ? "(filtered)" : "", nl->startup_us);
+	return 0;
+}
+
+/**
+ * @brief	initialize the operations with the netlink library
+ * @param[in]	nl		netlink context
+ * @return	nothing
+ */
+static void netlinkdev_opsinit(struct netlinkdev_info *nl)
+{
+	/* overwrite the co_include_event so we can have both -old and 
+	 * new- objects in the change_cb */
+	if (nl->links) nl_cache_get_ops(nl->links)->co_include_event = netlinkdev_nlcacheinclude;
+	if (nl->addrs) nl_cache_get_ops(nl->addrs)->co_include_event = netlinkdev_nlcacheinclude;
+
+	/* the initial set of links and addrs is not propagated by the 
+	 * nl_cache_mngr, iterate the caches */
+	if (nl->links) nl_cache_foreach(nl->links, netlinkdev_bootlink, nl);
+	if (nl->addrs) nl_cache_foreach(nl->addrs, netlinkdev_bootcache, nl);
+
+	/* allow sharing of info */
+	if (nl->addrs) nl_cache_mngt_provide(nl->addrs);
+}
+
+/**
+ * @brief	sorts a known link into watched or not watched
+ * @param[in]	nl		netlink context
+ * @param[in]	if_index	interface index of the link
+ * @param[in]	name		name of the link
+ * @return	nothing
+ */
+static void netlinkdev_watchsort(struct netlinkdev_info *nl, int if_index, const char *name)
+{
+	if (netlinkdev_watch_hasindex(nl->watch, if_index))
+		return;
+	if (netlinkdev_watch_matchname(nl->watch, name))
+		netlinkdev_watch_addindex(nl->watch, if_index, 0);
+	else
+		/* no longer tracked, don't keep stale state around */
+		netlinkdev_index_dellink(nl->index, if_index);
+}
+
+/**
+ * @brief	sorts a link from the cache into watched or not watched
+ * @param[in]	obj		link object
+ * @param[in]	arg		pointer to the netlink context
+ * @return	nothing
+ */
+static void netlinkdev_watchlink(struct nl_object *obj, void *arg)
+{
+	struct rtnl_link *link = (struct rtnl_link *)obj;
+
+	netlinkdev_watchsort(arg, rtnl_link_get_ifindex(link), rtnl_link_get_name(link));
+}
+
+/**
+ * @brief	sorts a link from the interface index into watched or not watched
+ * @param[in]	iface		interface entry
+ * @param[in]	arg		pointer to the netlink context
+ * @return	nothing
+ */
+static void netlinkdev_watchiface(struct netlinkdev_iface *iface, void *arg)
+{
+	if (iface->name[0] != '\0')
+		netlinkdev_watchsort(arg, iface->if_index, iface->name);
+}
+
+/**
+ * @brief	applies a changed watch list to the known links and the kernel filter
+ * @param[in]	nl		netlink context
+ * @return	result of the filter update
+ */
+static int netlinkdev_watchrefresh(struct netlinkdev_info *nl)
+{
+	if (nl->links)
+		nl_cache_foreach(nl->links, netlinkdev_watchlink, nl);
+	else if (nl->engine == NETLINKDEV_ENGINE_NATIVE)
+		netlinkdev_index_foreach(nl->index, netlinkdev_watchiface, nl);
+	if (netlinkdev_getfd(nl) < 0)
+		return 0;
+	return netlinkdev_watch_attach(nl->watch, netlinkdev_getfd(nl));
+}
+
+/**
+ * @brief	allocates the watch list on first use
+ * @param[in]	nl		netlink context
+ * @return	0 on success, -ENOMEM otherwise
+ */
+static int netlinkdev_watchalloc(struct netlinkdev_info *nl)
+{
+	if (!nl->watch)
+		nl->watch = calloc(1, sizeof(struct netlinkdev_watch));
+	return nl->watch ? 0 : -ENOMEM;
+}
+
+/**
+ * @brief	Queue events instead of calling the event callback.  They are
+ * 		read in batches with netlinkdev_read_events() once the socket has
+ * 		been processed.  If the caller falls behind, the oldest events are
+ * 		dropped and counted in the queue.
+ * @param[in]	nl		netlink context
+ * @param[in]	size		events held, rounded up to a power of 2, 0 to go back to the callback
+ * @return	result of set
+ */
+int netlinkdev_setqueue(struct netlinkdev_info *nl, unsigned int size)
+{
+	struct netlinkdev_queue *q = NULL;
+	int stat;
+
+	if (size) {
+		q = malloc(sizeof(struct netlinkdev_queue));
+		if (!q)
+			return -ENOMEM;
+		if ((stat = netlinkdev_queue_init(q, size)) < 0) {
+			free(q);
+			return stat;
+		}
+	}
+	if (nl->queue) {
+		/* keep whatever has not been read yet */
+		struct netlinkdev_data nd;
+		while (netlinkdev_queue_pop(nl->queue, &nd, 1)) {
+			if (q)
+				netlinkdev_queue_push(q, &nd);
+			else if (nl->event)
+				nl->event (nd.event, &nd, nl->context);
+		}
+		netlinkdev_queue_free(nl->queue);
+		free(nl->queue);
+	}
+	nl->queue = q;
+	return 0;
+}
+
+/**
+ * @brief	publish an interface already in the index
+ * @param[in]	iface		interface
+ * @param[in]	arg		shared memory table
+ * @return	nothing
+ */
+static void netlinkdev_shmiface(struct netlinkdev_iface *iface, void *arg)
+{
+	netlinkdev_shm_publish((struct netlinkdev_shm *)arg, iface);
+}
+
+/**
+ * @brief	Publish the interface state to a shared memory table created with
+ * 		netlinkdev_shm_create().  Every change of the index is written to
+ * 		the table from then on, so other processes can read it instead of
+ * 		keeping their own sockets and caches.
+ * @param[in]	nl		netlink context
+ * @param[in]	shm		table, NULL to stop publishing
+ * @return	result of set
+ */
+int netlinkdev_setshm(struct netlinkdev_info *nl, struct netlinkdev_shm *shm)
+{
+	if (!nl->index)
+		return -ENOTCONN;
+	nl->index->shm = shm;
+	if (shm)
+		netlinkdev_index_foreach(nl->index, netlinkdev_shmiface, shm);
+	return 0;
+}
+
+/**
+ * @brief	Track the routing tables.  The routes present are indexed without
+ * 		events, every later add, remove or change of a route is reported
+ * 		with NETLINKDEV_EVENT_ROUTE, whichever interface it uses.
+ * @param[in]	nl		netlink context
+ * @return	result of set
+ */
+int netlinkdev_setroutes(struct netlinkdev_info *nl)
+{
+	int stat;
+
+	if (!nl->index)
+		return -ENOTCONN;
+	if (nl->routes)
+		return 0;
+	/* the notifications of a context that does not listen come from elsewhere */
+	if (nl->nolisten && !nl->offline)
+		return -EOPNOTSUPP;
+	nl->routes = malloc(sizeof(struct netlinkdev_routes));
+	if (!nl->routes)
+		return -ENOMEM;
+	netlinkdev_routes_init(nl->routes);
+
+	if (nl->offline) {
+		/* fed datagrams only, nothing to join or dump */
+		stat = 0;
+		if (nl->engine == NETLINKDEV_ENGINE_LIBNL)
+			stat = nl_cache_alloc_name("route/route", &nl->routecache);
+	}
+	else if (nl->engine == NETLINKDEV_ENGINE_NATIVE) {
+		stat = netlinkdev_native_join(nl->fd, RTNLGRP_IPV4_ROUTE);
+		if (!stat)
+			stat = netlinkdev_native_join(nl->fd, RTNLGRP_IPV6_ROUTE);
+		if (!stat)
+			stat = netlinkdev_nativedump(nl, RTM_GETROUTE);
+	}
+	else {
+		stat = nl_cache_mngr_add(nl->mngr, "route/route", (change_func_t)&netlinkdev_changecb,
+					 nl, &nl->routecache);
+		if (!stat) {
+			nl_cache_get_ops(nl->routecache)->co_include_event = netlinkdev_nlcacheinclude;
+			nl_cache_foreach(nl->routecache, netlinkdev_bootroute, nl);
+		}
+	}
+	if (stat < 0) {
+		NL_LOG(NLLOG_ERROR, "Could not track the routing tables");
+		netlinkdev_routes_free(nl->routes);
+		free(nl->routes);
+		nl->routes = NULL;
+		return stat;
+	}
+	NL_LOG(NLLOG_DEBUG, "netlink: %u routes tracked", nl->routes->count);
+	return 0;
+}
+
+/**
+ * @brief	Get the route an address is sent by, from the tracked routing
+ * 		tables without asking the kernel
+ * @param[in]	nl		netlink context
+ * @param[in]	table		routing table, 0 for the main table
+ * @param[in]	family		AF_INET or AF_INET6
+ * @param[in]	addr		binary address
+ * @param[out]	route		route of the longest matching prefix
+ * @return	0 on success, -ENOENT if no route matches, -ENOTCONN if the
+ * 		routes are not tracked
+ */
+int netlinkdev_getroute(struct netlinkdev_info *nl, unsigned int table, int family,
+			const void *addr, struct netlinkdev_route *route)
+{
+	const struct netlinkdev_route *r;
+
+	if (!nl->routes)
+		return -ENOTCONN;
+	r = netlinkdev_routes_lookup(nl->routes, table ? table : RT_TABLE_MAIN, family, addr);
+	if (!r)
+		return -ENOENT;
+	*route = *r;
+	route->next = NULL;
+	return 0;
+}
+
+/**
+ * @brief	Track the neighbour (ARP/NDP) tables of the watched interfaces.
+ * 		The entries present are indexed without events, every later
+ * 		change of state or link address of an entry is reported with
+ * 		NETLINKDEV_EVENT_NEIGH.
+ * @param[in]	nl		netlink context
+ * @return	result of set
+ */
+int netlinkdev_setneighs(struct netlinkdev_info *nl)
+{
+	int stat;
+
+	if (!nl->index)
+		return -ENOTCONN;
+	if (nl->neighs)
+		return 0;
+	/* the notifications of a context that does not listen come from elsewhere */
+	if (nl->nolisten && !nl->offline)
+		return -EOPNOTSUPP;
+	nl->neighs = malloc(sizeof(struct netlinkdev_neighs));
+	if (!nl->neighs || netlinkdev_neighs_init(nl->neighs) < 0) {
+		free(nl->neighs);
+		nl->neighs = NULL;
+		return -ENOMEM;
+	}
+
+	if (nl->offline) {
+		/* fed datagrams only, nothing to join or dump */
+		stat = 0;
+		if (nl->engine == NETLINKDEV_ENGINE_LIBNL)
+			stat = nl_cache_alloc_name("route/neigh", &nl->neighcache);
+	}
+	else if (nl->engine == NETLINKDEV_ENGINE_NATIVE) {
+		stat = netlinkdev_native_join(nl->fd, RTNLGRP_NEIGH);
+		if (!stat)
+			stat = netlinkdev_nativedump(nl, RTM_GETNEIGH);
+	}
+	else {
+		stat = nl_cache_mngr_add(nl->mngr, "route/neigh", (change_func_t)&netlinkdev_changecb,
+					 nl, &nl->neighcache);
+		if (!stat) {
+			nl_cache_get_ops(nl->neighcache)->co_include_event = netlinkdev_nlcacheinclude;
+			nl_cache_foreach(nl->neighcache, netlinkdev_bootneigh, nl);
+		}
+	}
+	if (stat < 0) {
+		NL_LOG(NLLOG_ERROR, "Could not track the neighbour tables");
+		netlinkdev_neighs_free(nl->neighs);
+		free(nl->neighs);
+		nl->neighs = NULL;
+		return stat;
+	}
+	NL_LOG(NLLOG_DEBUG, "netlink: %u neighbours tracked", nl->neighs->count);
+	return 0;
+}
+
+/**
+ * @brief	Get the neighbour entry of an address on an interface, from the
+ * 		tracked neighbour tables without asking the kernel
+ * @param[in]	nl		netlink context
+ * @param[in]	if_index	interface index
+ * @param[in]	family		AF_INET or AF_INET6
+ * @param[in]	addr		binary address
+ * @param[out]	neigh		neighbour entry
+ * @return	0 on success, -ENOENT if not known, -ENOTCONN if the
+ * 		neighbours are not tracked
+ */
+int netlinkdev_getneigh(struct netlinkdev_info *nl, int if_index, int family,
+			const void *addr, struct netlinkdev_neigh *neigh)
+{
+	const struct netlinkdev_neigh *n;
+
+	if (!nl->neighs)
+		return -ENOTCONN;
+	n = netlinkdev_neighs_lookup(nl->neighs, if_index, family, addr, family == AF_INET6 ? 16 : 4);
+	if (!n)
+		return -ENOENT;
+	*neigh = *n;
+	neigh->next = NULL;
+	return 0;
+}
+
+/**
+ * @brief	decides if the sample of an interface is reported, only watched
+ * 		interfaces are, and names it from the interface index
+ * @param[in]	s		sample of the interface
+ * @param[in]	arg		netlink context
+ * @return	non-zero if the sample is reported
+ */
+static int netlinkdev_statsfilter(struct netlinkdev_ifstats *s, void *arg)
+{
+	struct netlinkdev_info *nl = (struct netlinkdev_info *)arg;
+	struct netlinkdev_iface *iface;
+
+	if (nl->watch && !netlinkdev_watch_hasindex(nl->watch, s->if_index))
+		return 0;
+	iface = nl->index ? netlinkdev_index_byindex(nl->index, s->if_index) : NULL;
+	if (iface)
+		strncpy(s->if_name, iface->name, sizeof(s->if_name) - 1);
+	return 1;
+}
+
+/**
+ * @brief	Sample the counters of the watched interfaces every interval.
+ * 		One RTM_GETSTATS dump of the 64 bit counters is asked for per
+ * 		tick, its socket and timer are serviced by netlinkdev_poll() or
+ * 		the event loop next to the route socket, a dump is read a few
+ * 		datagrams at a time so events are not held up behind it.
+ * @param[in]	nl		netlink context
+ * @param[in]	interval_ms	sampling interval in milliseconds
+ * @param[in]	stats_cb	called with the delta and rates of each interface
+ * 				every interval, NULL to only pull them with
+ * 				netlinkdev_getifstats()
+ * @param[in]	caller_context	callers context to pass into callback
+ * @return	result of set
+ */
+int netlinkdev_setstats(struct netlinkdev_info *nl, unsigned int interval_ms,
+			void (*stats_cb)(const struct netlinkdev_ifstats *, void *),
+			void *caller_context)
+{
+	int stat, saved;
+
+	if (!nl->index)
+		return -ENOTCONN;
+	if (nl->stats)
+		return -EBUSY;
+	nl->stats = malloc(sizeof(struct netlinkdev_stats));
+	if (!nl->stats)
+		return -ENOMEM;
+	if (!(stat = netlinkdev_netnsin(nl, &saved))) {
+		stat = netlinkdev_stats_start(nl->stats, interval_ms, stats_cb, caller_context);
+		netlinkdev_netnsout(saved);
+	}
+	if (stat < 0) {
+		NL_LOG(NLLOG_ERROR, "Could not sample the interface counters");
+		free(nl->stats);
+		nl->stats = NULL;
+		return stat;
+	}
+	nl->stats->filter = netlinkdev_statsfilter;
+	nl->stats->filterarg = nl;
+	return 0;
+}
+
+/**
+ * @brief	Get the counters gained by an interface over the last sampling
+ * 		interval, and its rates
+ * @param[in]	nl		netlink context
+ * @param[in]	if_index	interface index
+ * @param[out]	out		latest sample
+ * @return	0 on success, -ENOENT if not sampled yet, -ENOTCONN if the
+ * 		counters are not sampled
+ */
+int netlinkdev_getifstats(struct netlinkdev_info *nl, int if_index, struct netlinkdev_ifstats *out)
+{
+	int stat;
+
+	if (!nl->stats)
+		return -ENOTCONN;
+	if ((stat = netlinkdev_stats_get(nl->stats, if_index, out)) < 0)
+		return stat;
+	netlinkdev_statsfilter(out, nl);
+	return 0;
+}
+
+/**
+ * @brief	Enable the instrumentation of the route socket.  Messages and
+ * 		events are counted, the time from reading a datagram to the event
+ * 		callback, the time handling each message and the events per
+ * 		dispatch are recorded in histograms.  The same context can be
+ * 		given to ueventdev_setmetrics() to have both sockets in one place.
+ * @param[in]	nl		netlink context
+ * @param[in]	mt		instrumentation context, NULL to disable
+ * @return	always 0 as success
+ */
+int netlinkdev_setmetrics(struct netlinkdev_info *nl, struct netlinkdev_metrics *mt)
+{
+	nl->metrics = mt;
+	return 0;
+}
+
+/**
+ * @brief	Record every datagram read on the route socket into a capture,
+ * 		with the time it was read, so the sequence can be replayed with
+ * 		netlinkdev_feed().  The native engine records whole datagrams,
+ * 		dumps included.  The libnl engine records the messages of the
+ * 		notifications, libnl loads the caches on a socket of its own.
+ * @param[in]	nl		netlink context
+ * @param[in]	cap		capture opened for writing, NULL to stop recording
+ * @return	0 on success, -EINVAL for an offline context, -ENOTCONN if not started
+ */
+int netlinkdev_setcapture(struct netlinkdev_info *nl, struct netlinkdev_capture *cap)
+{
+	/* fed datagrams were not read here */
+	if (nl->offline)
+		return -EINVAL;
+	if (nl->engine == NETLINKDEV_ENGINE_LIBNL) {
+		if (!nl->socket)
+			return -ENOTCONN;
+		nl_socket_modify_cb(nl->socket, NL_CB_MSG_IN, NL_CB_CUSTOM,
+				    cap ? netlinkdev_capturemsg : NULL, nl);
+	}
+	nl->capture = cap;
+	return 0;
+}
+
+/**
+ * @brief	counts the addresses of an interface
+ * @param[in]	iface		interface
+ * @param[in]	arg		address counter
+ * @return	nothing
+ */
+static void netlinkdev_countaddrs(struct netlinkdev_iface *iface, void *arg)
+{
+	*(unsigned int *)arg += iface->naddrs;
+}
+
+/**
+ * @brief	Get a copy of the instrumentation with the current cache sizes
+ * @param[in]	nl		netlink context
+ * @param[out]	out		counters, histograms and cache sizes
+ * @return	0 on success, -ENOTCONN if instrumentation is not enabled
+ */
+int netlinkdev_get_stats(struct netlinkdev_info *nl, struct netlinkdev_metrics *out)
+{
+	if (!nl->metrics)
+		return -ENOTCONN;
+	memcpy(out, nl->metrics, sizeof(struct netlinkdev_metrics));
+	out->links = nl->index ? nl->index->count : 0;
+	out->addrs = 0;
+	if (nl->index)
+		netlinkdev_index_foreach(nl->index, netlinkdev_countaddrs, &out->addrs);
+	out->routes = nl->routes ? nl->routes->count : 0;
+	out->neighs = nl->neighs ? nl->neighs->count : 0;
+	out->queued = nl->queue ? nl->queue->count : 0;
+	out->dropped = nl->queue ? nl->queue->dropped : 0;
+	out->overflows = nl->overflows;
+	out->resyncs = nl->resyncs;
+	out->collapsed = nl->collapsed;
+	return 0;
+}
+
+/**
+ * @brief	Read the queued events, oldest first
+ * @param[in]	nl		netlink context
+ * @param[out]	buf		array filled with events, the event identifier is in the event member
+ * @param[in]	max		number of entries in buf
+ * @return	number of events read, negative if no queue is installed
+ */
+int netlinkdev_read_events(struct netlinkdev_info *nl, struct netlinkdev_data *buf, size_t max)
+{
+	if (!nl->queue)
+		return -EINVAL;
+	return netlinkdev_queue_pop(nl->queue, buf, max > INT_MAX ? INT_MAX : max);
+}
+
+/**
+ * @brief	Only monitor the given interface index (in addition to any
+ * 		other watched interfaces).  Messages for interfaces not watched
+ * 		are dropped by a filter on the netlink socket.
+ * @param[in]	nl		netlink context
+ * @param[in]	if_index	interface index
+ * @return	result of watch
+ */
+int netlinkdev_watchindex(struct netlinkdev_info *nl, int if_index)
+{
+	int stat;
+
+	if ((stat = netlinkdev_watchalloc(nl)) < 0)
+		return stat;
+	if ((stat = netlinkdev_watch_addindex(nl->watch, if_index, 1)) < 0)
+		return stat;
+	netlinkdev_watchrefresh(nl);
+	return 0;
+}
+
+/**
+ * @brief	Only monitor interfaces whose name matches the pattern (in
+ * 		addition to any other watched interfaces).  Interfaces appearing
+ * 		later with a matching name are picked up as they are created.
+ * @param[in]	nl		netlink context
+ * @param[in]	pattern		shell wildcard pattern such as "eth*"
+ * @return	result of watch
+ */
+int netlinkdev_watchname(struct netlinkdev_info *nl, const char *pattern)
+{
+	int stat;
+
+	if ((stat = netlinkdev_watchalloc(nl)) < 0)
+		return stat;
+	if ((stat = netlinkdev_watch_addpattern(nl->watch, pattern)) < 0)
+		return stat;
+	netlinkdev_watchrefresh(nl);
+	return 0;
+}
+
+/**
+ * @brief	Get the status of a specified network interface
+ * @param[in]	nl		netlink context
+ * @param[in]	if_name		name of the interface
+ * @param[out]	nd		netlink data filled in by this function
+ * @return	result of get network status
+ */
+int netlinkdev_getnet(struct netlinkdev_info *nl, char *if_name, 
+		      struct netlinkdev_data *nd)
+{
+	struct netlinkdev_iface *iface;
+	struct netlinkdev_ifaddr *addr;
+
+	if (!nl->index)
+		return -ENODEV;
+	iface = netlinkdev_index_byname(nl->index, if_name);
+	if (!iface) 
+		return -ENODEV;
+
+	memset(nd, 0, sizeof(struct netlinkdev_data));
+
+	nd->if_index = iface->if_index;
+	nd->status = iface->status;
+	NL_LOG(NLLOG_DEBUG, "netlink: ifindex:%d status:%s\n", nd->if_index, nd->status & IFF_UP ? "UP": "DOWN");
+	memcpy(nd->link_addr, iface->link_addr, sizeof(nd->link_addr));
+
+	/* report the first IPv4 address of the interface */
+	for (addr = iface->addrs; addr; addr = addr->next) {
+		if (addr->family == AF_INET) {
+			nd->net_family = addr->family;
+			nd->net_len = MIN(addr->len, sizeof(nd->net_addr));
+			memcpy(nd->net_addr, addr->addr, nd->net_len);
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief	Poll the netlink connection and process any netlink events
+ * @param[in]	nl		netlink context
+ * @return	always 0 as success
+ */
+int netlinkdev_poll(struct netlinkdev_info *nl)
+{
+	if (nl->engine == NETLINKDEV_ENGINE_NATIVE) {
+		struct pollfd pfd = { nl->fd, POLLIN, 0 };
+		if (poll(&pfd, 1, 1000) > 0)
+			netlinkdev_dispatch(nl);
+	}
+	else if (nl_cache_mngr_poll(nl->mngr, 1000) == -NLE_NOMEM)
+		/* libnl reports ENOBUFS as out of memory */
+		netlinkdev_overflow(nl);
+	if (nl->debounce)
+		netlinkdev_debounceexpire(nl);
+	if (nl->stats) {
+		netlinkdev_stats_timer(nl->stats);
+		netlinkdev_stats_dispatch(nl->stats);
+	}
+	return 0;
+}
+
+/**
+ * @brief	Get the file descriptor of the cache manager socket so it can
+ * 		be waited on by an event loop
+ * @param[in]	nl		netlink context
+ * @return	file descriptor, negative if not started
+ */
+int netlinkdev_getfd(struct netlinkdev_info *nl)
+{
+	if (nl->engine == NETLINKDEV_ENGINE_NATIVE)
+		return nl->fd >= 0 ? nl->fd : -ENOTCONN;
+	if (!nl->mngr)
+		return -ENOTCONN;
+	return nl_cache_mngr_get_fd(nl->mngr);
+}
+
+/**
+ * @brief	netlinkdev_dispatch() with instrumentation, each datagram is
+ * 		stamped when read so its events can be timed
+ * @param[in]	nl		netlink context
+ * @return	number of messages processed, negative on error
+ */
+static int netlinkdev_dispatchtimed(struct netlinkdev_info *nl)
+{
+	struct netlinkdev_metrics *mt = nl->metrics;
+	unsigned long events = mt->nl_events;
+	int n, total = 0;
+
+	if (nl->engine == NETLINKDEV_ENGINE_NATIVE) {
+		for (;;) {
+			mt->nl_rxstamp = netlinkdev_metrics_now();
+			n = netlinkdev_recv(nl, nl->fd, netlinkdev_nativetimed, nl);
+			if (!n)
+				break;
+			if (n == -ENOBUFS)
+				netlinkdev_overflow(nl);
+			else if (n < 0) {
+				total = n;
+				break;
+			}
+			else
+				total += n;
+		}
+	}
+	else {
+		/* libnl reads every datagram pending in one go */
+		mt->nl_rxstamp = netlinkdev_metrics_now();
+		if ((total = nl_cache_mngr_data_ready(nl->mngr)) == -NLE_NOMEM) {
+			netlinkdev_overflow(nl);
+			total = 0;
+		}
+	}
+	mt->nl_rxstamp = 0;
+	if (total > 0) {
+		mt->nl_polls++;
+		mt->nl_msgs += total;
+		netlinkdev_hist_record(&mt->nl_batch, mt->nl_events - events);
+	}
+	return total;
+}
+
+/**
+ * @brief	Process the netlink events already queued on the socket without blocking
+ * @param[in]	nl		netlink context
+ * @return	number of messages processed, negative on error
+ */
+int netlinkdev_dispatch(struct netlinkdev_info *nl)
+{
+	int n, total = 0;
+
+	if (nl->engine == NETLINKDEV_ENGINE_NATIVE) {
+		if (nl->fd < 0)
+			return -ENOTCONN;
+		if (!nl->booted && (n = netlinkdev_boot(nl)) < 0)
+			return n;
+		if (nl->metrics)
+			return netlinkdev_dispatchtimed(nl);
+		while ((n = netlinkdev_recv(nl, nl->fd, netlinkdev_nativemsg, nl)) != 0) {
+			if (n == -ENOBUFS)
+				netlinkdev_overflow(nl);
+			else if (n < 0)
+				return n;
+			else
+				total += n;
+		}
+		return total;
+	}
+	if (!nl->mngr)
+		return -ENOTCONN;
+	if (nl->metrics)
+		return netlinkdev_dispatchtimed(nl);
+	if ((n = nl_cache_mngr_data_ready(nl->mngr)) == -NLE_NOMEM) {
+		/* libnl reports ENOBUFS as out of memory */
+		netlinkdev_overflow(nl);
+		return 0;
+	}
+	return n;
+}
+
+/**
+ * @brief	Set the receive buffer of the route socket, a larger buffer rides
+ * 		out bigger event storms before the kernel drops notifications
+ * @param[in]	nl		netlink context
+ * @param[in]	bytes		buffer size, the kernel doubles it for its bookkeeping
+ * @return	result of set
+ */
+int netlinkdev_setrcvbuf(struct netlinkdev_info *nl, int bytes)
+{
+	int fd = netlinkdev_getfd(nl);
+	int stat;
+
+	if (fd < 0)
+		return fd;
+	if (bytes <= 0)
+		return -EINVAL;
+	/* FORCE goes past rmem_max but needs CAP_NET_ADMIN */
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &bytes, sizeof(bytes)) < 0 &&
+	    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes)) < 0) {
+		stat = -errno;
+		NL_LOG(NLLOG_ERROR, "Could not set netlink receive buffer (%d)", -stat);
+		return stat;
+	}
+	return 0;
+}
+
+/**
+ * @brief	Coalesce link flaps.  The first up/down transition of an interface
+ * 		opens a window, the state at the end of the window is reported as
+ * 		one event and the transitions in between are counted as collapsed.
+ * @param[in]	nl		netlink context
+ * @param[in]	window_ms	debounce window in milliseconds, 0 to report every transition
+ * @return	result of set
+ */
+int netlinkdev_setdebounce(struct netlinkdev_info *nl, int window_ms)
+{
+	if (window_ms < 0)
+		return -EINVAL;
+	if (window_ms && nl->timerfd < 0) {
+		nl->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (nl->timerfd < 0) {
+			NL_LOG(NLLOG_ERROR, "Could not create debounce timer (%d)", errno);
+			return -errno;
+		}
+	}
+	nl->debounce = window_ms;
+	if (!window_ms && nl->index) {
+		/* flush whatever is waiting */
+		struct netlinkdev_iface *iface;
+		for (iface = nl->index->pending; iface; iface = iface->next_pending)
+			iface->deadline = 1;
+		netlinkdev_debounceexpire(nl);
+	}
+	return 0;
+}
+
+/**
+ * @brief	Get the file descriptor of the debounce timer so it can be
+ * 		waited on by an event loop
+ * @param[in]	nl		netlink context
+ * @return	file descriptor, negative if debouncing was never enabled
+ */
+int netlinkdev_gettimerfd(struct netlinkdev_info *nl)
+{
+	return nl->timerfd;
+}
+
+/**
+ * @brief	Report the links whose debounce window has ended, called when
+ * 		the timer file descriptor is readable
+ * @param[in]	nl		netlink context
+ * @return	always 0 as success
+ */
+int netlinkdev_timer(struct netlinkdev_info *nl)
+{
+	unsigned long long expirations;
+
+	if (nl->timerfd >= 0 && read(nl->timerfd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+		NL_LOG(NLLOG_WARN, "debounce timer read failed (%d)", errno);
+	if (nl->index)
+		netlinkdev_debounceexpire(nl);
+	return 0;
+}
+
+/**
+ * @brief	Start a connection to netlink interface
+ * @param[in]	nl			netlink context
+ * @param[in]	netlink_event_cb	callback to report netlink events
+ * @param[in]	caller_context		callers context to pass into callback
+ * @return	result of start
+ */
+int netlinkdev_start(struct netlinkdev_info *nl, 
+		     void (*netlink_event_cb)(int, struct netlinkdev_data *, void *), 
+		     void *caller_context)
+{
+	return netlinkdev_startengine(nl, NETLINKDEV_ENGINE_LIBNL, netlink_event_cb, caller_context);
+}
+
+/**
+ * @brief	Start a connection to netlink interface with the given engine.
+ * 		The native engine reads the route socket itself and decodes the
+ * 		messages in place, no libnl objects are allocated per message.
+ * @param[in]	nl			netlink context
+ * @param[in]	engine			NETLINKDEV_ENGINE_LIBNL or NETLINKDEV_ENGINE_NATIVE
+ * @param[in]	netlink_event_cb	callback to report netlink events
+ * @param[in]	caller_context		callers context to pass into callback
+ * @return	result of start
+ */
+int netlinkdev_startengine(struct netlinkdev_info *nl, int engine,
+			   void (*netlink_event_cb)(int, struct netlinkdev_data *, void *),
+			   void *caller_context)
+{
+	return netlinkdev_startnetns(nl, -1, -1, engine, netlink_event_cb, caller_context);
+}
+
+/**
+ * @brief	opens the libnl cache manager and its caches
+ * @param[in]	nl		netlink context
+ * @return	0 on success, negative on error
+ */
+static int netlinkdev_libnlstart(struct netlinkdev_info *nl)
+{
+	int stat;
+
+	nl->socket = nl_socket_alloc();
+	if (!nl->socket) {
+		NL_LOG(NLLOG_ERROR, "Could not open netlink socket");
+		return -ENOMEM;
+	}
+
+	stat = nl_cache_mngr_alloc(nl->socket, NETLINK_ROUTE, 0, &nl->mngr);
+	if (stat < 0) {
+		nl_socket_free(nl->socket);
+		nl->socket = 0;
+		NL_LOG(NLLOG_ERROR, "Could not allocate netlink mgr");
+		return stat;
+	}
+	stat = nl_cache_mngr_add(nl->mngr, "route/link", (change_func_t)&netlinkdev_changecb, nl, &nl->links);
+	if (stat < 0) {
+		NL_LOG(NLLOG_WARN, "Could not add route/link to netlink cache mgr");
+	}
+	stat = nl_cache_mngr_add(nl->mngr, "route/addr", (change_func_t)&netlinkdev_changecb, nl, &nl->addrs);
+	if (stat < 0) {
+		NL_LOG(NLLOG_WARN, "Could not add route/addr to netlink cache mgr");
+	}
+	return 0;
+}
+
+/**
+ * @brief	starts a context without sockets.  The libnl engine gets empty
+ * 		caches of its own in place of the ones of the cache manager.
+ * @param[in]	nl		netlink context
+ * @return	result of start
+ */
+static int netlinkdev_offlinestart(struct netlinkdev_info *nl)
+{
+	int stat;
+
+	if (nl->engine == NETLINKDEV_ENGINE_NATIVE)
+		return 0;
+	if ((stat = nl_cache_alloc_name("route/link", &nl->links)) < 0 ||
+	    (stat = nl_cache_alloc_name("route/addr", &nl->addrs)) < 0) {
+		NL_LOG(NLLOG_ERROR, "Could not allocate netlink caches");
+		return stat;
+	}
+	return 0;
+}
+
+/**
+ * @brief	Start a connection to netlink interface in a network namespace.
+ * 		The sockets are opened inside the namespace, events are tagged
+ * 		with the namespace id.
+ * @param[in]	nl			netlink context
+ * @param[in]	nsfd			namespace file descriptor, -1 for the caller's namespace
+ * @param[in]	nsid			namespace id to tag the events with
+ * @param[in]	engine			NETLINKDEV_ENGINE_LIBNL or NETLINKDEV_ENGINE_NATIVE
+ * @param[in]	netlink_event_cb	callback to report netlink events
+ * @param[in]	caller_context		callers context to pass into callback
+ * @return	result of start
+ */
+int netlinkdev_startnetns(struct netlinkdev_info *nl, int nsfd, int nsid, int engine,
+			  void (*netlink_event_cb)(int, struct netlinkdev_data *, void *),
+			  void *caller_context)
+{
+	unsigned long long started = netlinkdev_nowus();
+	int fast = engine & NETLINKDEV_START_FAST;
+	int nolisten = engine & NETLINKDEV_START_NOLISTEN;
+	int offline = engine & NETLINKDEV_START_OFFLINE;
+	int stat, saved;
+
+	engine &= ~(NETLINKDEV_START_FAST | NETLINKDEV_START_NOLISTEN | NETLINKDEV_START_OFFLINE);
+	if (engine != NETLINKDEV_ENGINE_NATIVE && (engine != NETLINKDEV_ENGINE_LIBNL || fast || nolisten))
+		return -EINVAL;
+	if (offline && (fast || nolisten))
+		return -EINVAL;
+	memset(nl, 0, sizeof(struct netlinkdev_info));
+	nl->engine = engine;
+	nl->started_us = started;
+	nl->booted = !fast;
+	/* an offline context is handed everything, like one that does not listen */
+	nl->nolisten = nolisten || offline;
+	nl->offline = !!offline;
+	nl->fd = -1;
+	nl->timerfd = -1;
+	nl->netns = -1;
+	nl->nsid = nsid;
+	if (nsfd >= 0 && (nl->netns = fcntl(nsfd, F_DUPFD_CLOEXEC, 0)) < 0) {
+		stat = -errno;
+		NL_LOG(NLLOG_ERROR, "Could not duplicate namespace descriptor");
+		return stat;
+	}
+	nl->index = malloc(sizeof(struct netlinkdev_index));
+	if (!nl->index || netlinkdev_index_init(nl->index) < 0) {
+		free(nl->index);
+		nl->index = NULL;
+		NL_LOG(NLLOG_ERROR, "Could not allocate interface index");
+		netlinkdev_stop(nl);
+		return -ENOMEM;
+	}
+	nl->event = netlink_event_cb;
+	nl->context = caller_context;
+
+	if ((stat = netlinkdev_netnsin(nl, &saved)) < 0) {
+		NL_LOG(NLLOG_ERROR, "Could not enter network namespace");
+		netlinkdev_stop(nl);
+		return stat;
+	}
+	if (offline)
+		stat = netlinkdev_offlinestart(nl);
+	else if (engine == NETLINKDEV_ENGINE_NATIVE)
+		stat = netlinkdev_nativestart(nl);
+	else
+		stat = netlinkdev_libnlstart(nl);
+	netlinkdev_netnsout(saved);
+
+	if (engine == NETLINKDEV_ENGINE_NATIVE) {
+		if (stat < 0) {
+			NL_LOG(NLLOG_ERROR, "Could not start native netlink engine");
+			netlinkdev_stop(nl);
+			return stat;
+		}
+		if (nl->booted)
+			nl->startup_us = netlinkdev_nowus() - nl->started_us;
+		NL_LOG(NLLOG_DEBUG, "netlink native engine ready");
+		return 0;
+	}
+	if (stat < 0) {
+		netlinkdev_stop(nl);
+		return stat;
+	}
+
+	netlinkdev_opsinit(nl);
+	nl->startup_us = netlinkdev_nowus() - nl->started_us;
+
+	NL_LOG(NLLOG_DEBUG, "netlink caches ready");
+
+	return 0;
+}
+
+
+/**
+ * @brief	Remove connections to netlink interface
+ * @param[in]	nl		netlink context
+ * @return	result of stop
+ */
+int netlinkdev_stop(struct netlinkdev_info *nl)
+{
+	if (nl->mngr)
+		nl_cache_mngr_free(nl->mngr);
+	else {
+		/* no cache manager owns the caches of an offline context */
+		if (nl->links)
+			nl_cache_free(nl->links);
+		if (nl->addrs) {
+			nl_cache_mngt_unprovide(nl->addrs);
+			nl_cache_free(nl->addrs);
+		}
+		if (nl->routecache)
+			nl_cache_free(nl->routecache);
+		if (nl->neighcache)
+			nl_cache_free(nl->neighcache);
+	}
+	nl->mngr = 0;
+	nl->links = NULL;
+	nl->addrs = NULL;
+	if (nl->socket)
+		nl_socket_free(nl->socket);
+	nl->socket = 0;
+	nl->capture = NULL;
+	nl->routecache = NULL;
+	if (nl->routes) {
+		netlinkdev_routes_free(nl->routes);
+		free(nl->routes);
+	}
+	nl->routes = NULL;
+	nl->neighcache = NULL;
+	if (nl->neighs) {
+		netlinkdev_neighs_free(nl->neighs);
+		free(nl->neighs);
+	}
+	nl->neighs = NULL;
+	if (nl->stats) {
+		netlinkdev_stats_stop(nl->stats);
+		free(nl->stats);
+	}
+	nl->stats = NULL;
+	if (nl->fd >= 0)
+		close(nl->fd);
+	nl->fd = -1;
+	free(nl->rxbuf);
+	nl->rxbuf = NULL;
+	if (nl->index) {
+		netlinkdev_index_free(nl->index);
+		free(nl->index);
+	}
+	nl->index = NULL;
+	if (nl->watch) {
+		netlinkdev_watch_free(nl->watch);
+		free(nl->watch);
+	}
+	nl->watch = NULL;
+	if (nl->queue) {
+		netlinkdev_queue_free(nl->queue);
+		free(nl->queue);
+	}
+	nl->queue = NULL;
+	if (nl->timerfd >= 0)
+		close(nl->timerfd);
+	nl->timerfd = -1;
+	if (nl->netns >= 0)
+		close(nl->netns);
+	nl->netns = -1;
+	nl->debounce = 0;
 	nl->event = NULL;
 	nl->context = NULL;
 	NL_LOG(NLLOG_DEBUG, "netlink caches stopped");
@@ -35,38 +35,164 @@
 */
 enum {
 	NETLINKDEV_EVENT_ADDR,		/**< interface address change event */
-	NETLINKDEV_EVENT_LINK		/**< interface link status change event */
+	NETLINKDEV_EVENT_LINK,		/**< interface link status change event */
+	NETLINKDEV_EVENT_ROUTE,		/**< route added, removed or changed */
+	NETLINKDEV_EVENT_NEIGH		/**< neighbour added, removed, changed state or link address */
 };
 
+/**
+ * @brief	route event actions
+*/
+enum {
+	NETLINKDEV_ROUTE_ADD = 1,	/**< route added */
+	NETLINKDEV_ROUTE_DEL,		/**< route removed */
+	NETLINKDEV_ROUTE_CHANGE		/**< output interface or gateway of a route changed */
+};
+
+/**
+ * @brief	engines reading the route socket
+*/
+enum {
+	NETLINKDEV_ENGINE_LIBNL,	/**< libnl cache manager */
+	NETLINKDEV_ENGINE_NATIVE	/**< socket read and decoded directly */
+};
+
+/**
+ * @brief	start flag or'ed into the engine: the native engine loads the
+ * 		present links and addresses in netlinkdev_boot(), after the
+ * 		watch list is set, with the dumps running concurrently
+ */
+#define NETLINKDEV_START_FAST	0x100
+
+/**
+ * @brief	start flag or'ed into the native engine: the socket only dumps,
+ * 		notifications are received elsewhere and handed in with
+ * 		netlinkdev_deliver()
+ */
+#define NETLINKDEV_START_NOLISTEN	0x200
+
+/**
+ * @brief	start flag or'ed into the engine: no socket is opened and nothing
+ * 		is dumped, raw route socket datagrams are handed in with
+ * 		netlinkdev_feed()
+ */
+#define NETLINKDEV_START_OFFLINE	0x400
+
 /**
  * @brief	network interface data
 */
 struct netlinkdev_data {
 	int		status;		/**< status of the interface reported as IFF_UP or IFF_DOWN */
 	int		if_index;	/**< interface index */
+	char		if_name[16];	/**< interface name (IFNAMSIZ) */
 	unsigned char	link_addr[6];	/**< interface link address */
 	int		net_family;	/**< network family of the interface as AF_INET or AF_INET6 */
 	int		net_len;	/**< network address length */
 	char 		net_addr[128];	/**< network address */
+	int		collapsed;	/**< link transitions collapsed into this event by debouncing */
+	int		event;		/**< event identifier, NETLINKDEV_EVENT_ADDR or NETLINKDEV_EVENT_LINK */
+	int		nsid;		/**< id of the namespace of the interface, -1 for the caller's */
+	int		route_action;	/**< NETLINKDEV_ROUTE_ADD, _DEL or _CHANGE of a route event,
+					     the destination is in net_addr and the output interface
+					     in if_index */
+	unsigned int	route_table;	/**< routing table of a route event */
+	int		route_dstlen;	/**< destination prefix length of a route event */
+	int		route_gwlen;	/**< gateway length of a route event, 0 if directly connected */
+	unsigned char	route_gw[16];	/**< gateway of a route event */
+	int		neigh_state;	/**< NUD_* state of a neighbour event, 0 once removed, the
+					     address is in net_addr and the link address in link_addr */
+	int		neigh_prevstate;	/**< NUD_* state before a neighbour event, 0 if new */
 };
 
 /**
  * @brief	netlink context structure
 */
 struct netlinkdev_info {
+	int			engine;		/**< NETLINKDEV_ENGINE_LIBNL or NETLINKDEV_ENGINE_NATIVE */
+	int			fd;		/**< route socket of the native engine, -1 if none */
+	void			*rxbuf;		/**< receive buffer of the native engine */
+	unsigned int		seq;		/**< sequence number of the last native request */
+	int			dumping;	/**< native dump in progress */
+	int			nolisten;	/**< notifications handed in by netlinkdev_deliver() */
+	int			offline;	/**< no sockets, datagrams handed in by netlinkdev_feed() */
+	int			netns;		/**< namespace the sockets are opened in, -1 for the caller's */
+	int			nsid;		/**< namespace id tagged on the events, -1 for the caller's */
+	int			booted;		/**< present links and addresses loaded */
+	unsigned long long	started_us;	/**< monotonic time start was called in us */
+	unsigned long		startup_us;	/**< time it took until the state was loaded in us */
+	int			resyncing;	/**< resync in progress */
+	int			overflowed;	/**< socket overflowed during the resync */
+	unsigned long		overflows;	/**< route socket overflows (ENOBUFS) */
+	unsigned long		resyncs;	/**< resyncs done after overflows */
 	struct nl_sock		*socket;	/**< cache managment netlink socket  */
 	struct nl_cache_mngr	*mngr;		/**< cache manager context */
 	struct nl_cache		*links;		/**< link cache */
 	struct nl_cache		*addrs;		/**< address cache info */
+	struct nl_cache		*routecache;	/**< route cache, when routes are tracked */
+	struct netlinkdev_routes *routes;	/**< routes by table and family, NULL if not tracked */
+	struct nl_cache		*neighcache;	/**< neighbour cache, when neighbours are tracked */
+	struct netlinkdev_neighs *neighs;	/**< neighbours by ifindex and address, NULL if not tracked */
+	struct netlinkdev_stats	*stats;		/**< interface counter sampler, NULL if not sampling */
+	struct netlinkdev_metrics *metrics;	/**< instrumentation, NULL when disabled */
+	struct netlinkdev_capture *capture;	/**< datagrams read are recorded here, NULL if not recording */
+	struct netlinkdev_index	*index;		/**< interfaces keyed by ifindex and name */
+	struct netlinkdev_watch	*watch;		/**< watched interfaces, NULL watches all */
+	int			debounce;	/**< link flap debounce window in ms, 0 disables */
+	int			timerfd;	/**< timer for the end of debounce windows, -1 if none */
+	unsigned long		collapsed;	/**< link transitions collapsed by debouncing */
+	struct netlinkdev_queue	*queue;		/**< events waiting for netlinkdev_read_events(), NULL reports through the callback */
 	void 			(*event)(int, struct netlinkdev_data *, void *);	/**< installed event callback */
 	void			*context;	/**< caller context reported back to caller */
 };
 
+struct netlinkdev_shm;
+struct netlinkdev_rtmsg;
+struct netlinkdev_route;
+struct netlinkdev_neigh;
+struct netlinkdev_stats;
+struct netlinkdev_ifstats;
+struct netlinkdev_metrics;
+struct netlinkdev_capture;
+
 int netlinkdev_start(struct netlinkdev_info *nl,
 		     void (*netlink_event_cb)(int, struct netlinkdev_data *, void *),
 		     void *caller_context);
+int netlinkdev_startengine(struct netlinkdev_info *nl, int engine,
+			   void (*netlink_event_cb)(int, struct netlinkdev_data *, void *),
+			   void *caller_context);
+int netlinkdev_startnetns(struct netlinkdev_info *nl, int nsfd, int nsid, int engine,
+			  void (*netlink_event_cb)(int, struct netlinkdev_data *, void *),
+			  void *caller_context);
+int netlinkdev_boot(struct netlinkdev_info *nl);
+void netlinkdev_deliver(struct netlinkdev_info *nl, const struct netlinkdev_rtmsg *m);
+int netlinkdev_feed(struct netlinkdev_info *nl, const void *buf, int len);
 int netlinkdev_stop(struct netlinkdev_info *nl);
 int netlinkdev_poll(struct netlinkdev_info *nl);
+int netlinkdev_getfd(struct netlinkdev_info *nl);
+int netlinkdev_dispatch(struct netlinkdev_info *nl);
+int netlinkdev_setrcvbuf(struct netlinkdev_info *nl, int bytes);
+int netlinkdev_resync(struct netlinkdev_info *nl);
+int netlinkdev_setdebounce(struct netlinkdev_info *nl, int window_ms);
+int netlinkdev_gettimerfd(struct netlinkdev_info *nl);
+int netlinkdev_timer(struct netlinkdev_info *nl);
+int netlinkdev_setqueue(struct netlinkdev_info *nl, unsigned int size);
+int netlinkdev_read_events(struct netlinkdev_info *nl, struct netlinkdev_data *buf, size_t max);
+int netlinkdev_setshm(struct netlinkdev_info *nl, struct netlinkdev_shm *shm);
+int netlinkdev_setroutes(struct netlinkdev_info *nl);
+int netlinkdev_getroute(struct netlinkdev_info *nl, unsigned int table, int family,
+			const void *addr, struct netlinkdev_route *route);
+int netlinkdev_setneighs(struct netlinkdev_info *nl);
+int netlinkdev_getneigh(struct netlinkdev_info *nl, int if_index, int family,
+			const void *addr, struct netlinkdev_neigh *neigh);
+int netlinkdev_setstats(struct netlinkdev_info *nl, unsigned int interval_ms,
+			void (*stats_cb)(const struct netlinkdev_ifstats *, void *),
+			void *caller_context);
+int netlinkdev_getifstats(struct netlinkdev_info *nl, int if_index, struct netlinkdev_ifstats *out);
+int netlinkdev_setmetrics(struct netlinkdev_info *nl, struct netlinkdev_metrics *mt);
+int netlinkdev_setcapture(struct netlinkdev_info *nl, struct netlinkdev_capture *cap);
+int netlinkdev_get_stats(struct netlinkdev_info *nl, struct netlinkdev_metrics *out);
+int netlinkdev_watchindex(struct netlinkdev_info *nl, int if_index);
+int netlinkdev_watchname(struct netlinkdev_info *nl, const char *pattern);
 int netlinkdev_getnet(struct netlinkdev_info *nl,
 		      char *if_name, 
 		      struct netlinkdev_data *nd);
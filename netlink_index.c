@@ -0,0 +1,489 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink interface index keyed by interface index and name
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_index.c
+ * @brief	Hash indices of interface state keyed by ifindex and ifname.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "netlink_index.h"
+#include "netlink_shm.h"
+
+/**
+ * @brief	initial number of hash buckets, grows as interfaces are added
+ */
+#define NETLINKDEV_INDEX_MINSIZE	64
+
+/**
+ * @brief	hash an interface index into a bucket
+ * @param[in]	ix		interface index context
+ * @param[in]	if_index	interface index
+ * @return	bucket number
+ */
+static unsigned int netlinkdev_index_hashindex(struct netlinkdev_index *ix, int if_index)
+{
+	return ((unsigned int)if_index * 2654435761u) & (ix->size - 1);
+}
+
+/**
+ * @brief	hash an interface name into a bucket (FNV-1a)
+ * @param[in]	ix		interface index context
+ * @param[in]	name		interface name
+ * @return	bucket number
+ */
+static unsigned int netlinkdev_index_hashname(struct netlinkdev_index *ix, const char *name)
+{
+	unsigned int h = 2166136261u;
+
+	while (*name) {
+		h ^= (unsigned char)*name++;
+		h *= 16777619u;
+	}
+	return h & (ix->size - 1);
+}
+
+/**
+ * @brief	unlink an interface from its name bucket
+ * @param[in]	ix		interface index context
+ * @param[in]	iface		interface being unlinked
+ * @return	nothing
+ */
+static void netlinkdev_index_unname(struct netlinkdev_index *ix, struct netlinkdev_iface *iface)
+{
+	struct netlinkdev_iface **pp;
+
+	if (iface->name[0] == '\0')
+		return;
+	for (pp = &ix->byname[netlinkdev_index_hashname(ix, iface->name)]; *pp; pp = &(*pp)->next_name) {
+		if (*pp == iface) {
+			*pp = iface->next_name;
+			break;
+		}
+	}
+	iface->next_name = NULL;
+}
+
+/**
+ * @brief	link an interface into its name bucket
+ * @param[in]	ix		interface index context
+ * @param[in]	iface		interface being linked
+ * @return	nothing
+ */
+static void netlinkdev_index_name(struct netlinkdev_index *ix, struct netlinkdev_iface *iface)
+{
+	unsigned int h;
+
+	if (iface->name[0] == '\0')
+		return;
+	h = netlinkdev_index_hashname(ix, iface->name);
+	iface->next_name = ix->byname[h];
+	ix->byname[h] = iface;
+}
+
+/**
+ * @brief	double the number of buckets and rehash every interface
+ * @param[in]	ix		interface index context
+ * @return	0 on success, -ENOMEM if the tables could not grow
+ */
+static int netlinkdev_index_grow(struct netlinkdev_index *ix)
+{
+	struct netlinkdev_iface **oldindex = ix->byindex;
+	unsigned int oldsize = ix->size, i;
+	struct netlinkdev_iface **byindex, **byname;
+
+	byindex = calloc(oldsize * 2, sizeof(*byindex));
+	byname = calloc(oldsize * 2, sizeof(*byname));
+	if (!byindex || !byname) {
+		free(byindex);
+		free(byname);
+		return -ENOMEM;
+	}
+	free(ix->byname);
+	ix->byindex = byindex;
+	ix->byname = byname;
+	ix->size = oldsize * 2;
+
+	for (i = 0; i < oldsize; i++) {
+		struct netlinkdev_iface *iface = oldindex[i], *next;
+		for (; iface; iface = next) {
+			unsigned int h = netlinkdev_index_hashindex(ix, iface->if_index);
+			next = iface->next_index;
+			iface->next_index = ix->byindex[h];
+			ix->byindex[h] = iface;
+			netlinkdev_index_name(ix, iface);
+		}
+	}
+	free(oldindex);
+	return 0;
+}
+
+/**
+ * @brief	Initialize an empty interface index
+ * @param[in]	ix		interface index context
+ * @return	result of init
+ */
+int netlinkdev_index_init(struct netlinkdev_index *ix)
+{
+	memset(ix, 0, sizeof(struct netlinkdev_index));
+	ix->size = NETLINKDEV_INDEX_MINSIZE;
+	ix->byindex = calloc(ix->size, sizeof(*ix->byindex));
+	ix->byname = calloc(ix->size, sizeof(*ix->byname));
+	if (!ix->byindex || !ix->byname) {
+		netlinkdev_index_free(ix);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+/**
+ * @brief	Release every interface and address held in the index
+ * @param[in]	ix		interface index context
+ * @return	nothing
+ */
+void netlinkdev_index_free(struct netlinkdev_index *ix)
+{
+	unsigned int i;
+
+	for (i = 0; ix->byindex && i < ix->size; i++) {
+		struct netlinkdev_iface *iface = ix->byindex[i], *next;
+		for (; iface; iface = next) {
+			struct netlinkdev_ifaddr *a = iface->addrs, *anext;
+			for (; a; a = anext) {
+				anext = a->next;
+				free(a);
+			}
+			next = iface->next_index;
+			free(iface);
+		}
+	}
+	free(ix->byindex);
+	free(ix->byname);
+	memset(ix, 0, sizeof(struct netlinkdev_index));
+}
+
+/**
+ * @brief	Call a function for every interface, which may remove the
+ * 		interface it is called for
+ * @param[in]	ix		interface index context
+ * @param[in]	fn		called with each interface
+ * @param[in]	arg		passed to fn
+ * @return	nothing
+ */
+void netlinkdev_index_foreach(struct netlinkdev_index *ix,
+			      void (*fn)(struct netlinkdev_iface *, void *), void *arg)
+{
+	struct netlinkdev_iface *iface, *next;
+	unsigned int i;
+
+	for (i = 0; i < ix->size; i++) {
+		for (iface = ix->byindex[i]; iface; iface = next) {
+			next = iface->next_index;
+			fn(iface, arg);
+		}
+	}
+}
+
+/**
+ * @brief	Look up an interface by index
+ * @param[in]	ix		interface index context
+ * @param[in]	if_index	interface index
+ * @return	interface entry, NULL if not known
+ */
+struct netlinkdev_iface *netlinkdev_index_byindex(struct netlinkdev_index *ix, int if_index)
+{
+	struct netlinkdev_iface *iface;
+
+	for (iface = ix->byindex[netlinkdev_index_hashindex(ix, if_index)]; iface; iface = iface->next_index)
+		if (iface->if_index == if_index)
+			return iface;
+	return NULL;
+}
+
+/**
+ * @brief	Look up an interface by name
+ * @param[in]	ix		interface index context
+ * @param[in]	name		interface name
+ * @return	interface entry, NULL if not known
+ */
+struct netlinkdev_iface *netlinkdev_index_byname(struct netlinkdev_index *ix, const char *name)
+{
+	struct netlinkdev_iface *iface;
+
+	for (iface = ix->byname[netlinkdev_index_hashname(ix, name)]; iface; iface = iface->next_name)
+		if (strncmp(iface->name, name, sizeof(iface->name)) == 0)
+			return iface;
+	return NULL;
+}
+
+/**
+ * @brief	find or create the entry for an interface index
+ * @param[in]	ix		interface index context
+ * @param[in]	if_index	interface index
+ * @return	interface entry, NULL if out of memory
+ */
+static struct netlinkdev_iface *netlinkdev_index_get(struct netlinkdev_index *ix, int if_index)
+{
+	struct netlinkdev_iface *iface = netlinkdev_index_byindex(ix, if_index);
+	unsigned int h;
+
+	if (iface)
+		return iface;
+	if (ix->count >= ix->size)
+		netlinkdev_index_grow(ix);
+	iface = calloc(1, sizeof(struct netlinkdev_iface));
+	if (!iface)
+		return NULL;
+	iface->if_index = if_index;
+	h = netlinkdev_index_hashindex(ix, if_index);
+	iface->next_index = ix->byindex[h];
+	ix->byindex[h] = iface;
+	ix->count++;
+	return iface;
+}
+
+/**
+ * @brief	Add or update the link state of an interface
+ * @param[in]	ix		interface index context
+ * @param[in]	if_index	interface index
+ * @param[in]	name		interface name, NULL to leave unchanged
+ * @param[in]	status		interface flags
+ * @param[in]	link_addr	link layer address, may be NULL
+ * @param[in]	link_len	length of the link layer address
+ * @return	interface entry, NULL if out of memory
+ */
+struct netlinkdev_iface *netlinkdev_index_link(struct netlinkdev_index *ix, int if_index,
+					       const char *name, int status,
+					       const unsigned char *link_addr, int link_len)
+{
+	struct netlinkdev_iface *iface = netlinkdev_index_get(ix, if_index);
+
+	if (!iface)
+		return NULL;
+	if (name && strncmp(iface->name, name, sizeof(iface->name)) != 0) {
+		/* new link or rename */
+		netlinkdev_index_unname(ix, iface);
+		strncpy(iface->name, name, sizeof(iface->name));
+		iface->name[sizeof(iface->name)-1] = '\0';
+		netlinkdev_index_name(ix, iface);
+	}
+	iface->status = status;
+	iface->stale = 0;
+	memset(iface->link_addr, 0, sizeof(iface->link_addr));
+	if (link_addr)
+		memcpy(iface->link_addr, link_addr, MIN(link_len, sizeof(iface->link_addr)));
+	if (ix->shm)
+		netlinkdev_shm_publish(ix->shm, iface);
+	return iface;
+}
+
+/**
+ * @brief	Mark every interface and address stale before a resync.  Links
+ * 		clear the mark when they are updated, addresses have to be
+ * 		cleared by the caller so it can tell new ones from known ones.
+ * @param[in]	ix		interface index context
+ * @return	nothing
+ */
+void netlinkdev_index_mark(struct netlinkdev_index *ix)
+{
+	struct netlinkdev_iface *iface;
+	struct netlinkdev_ifaddr *a;
+	unsigned int i;
+
+	for (i = 0; i < ix->size; i++) {
+		for (iface = ix->byindex[i]; iface; iface = iface->next_index) {
+			iface->stale = 1;
+			for (a = iface->addrs; a; a = a->next)
+				a->stale = 1;
+		}
+	}
+}
+
+/**
+ * @brief	Remove an interface and all of its addresses
+ * @param[in]	ix		interface index context
+ * @param[in]	if_index	interface index
+ * @return	nothing
+ */
+void netlinkdev_index_dellink(struct netlinkdev_index *ix, int if_index)
+{
+	struct netlinkdev_iface **pp, *iface;
+	struct netlinkdev_ifaddr *a, *anext;
+
+	for (pp = &ix->byindex[netlinkdev_index_hashindex(ix, if_index)]; (iface = *pp); pp = &iface->next_index) {
+		if (iface->if_index == if_index)
+			break;
+	}
+	if (!iface)
+		return;
+	if (ix->shm)
+		netlinkdev_shm_remove(ix->shm, if_index);
+	*pp = iface->next_index;
+	netlinkdev_index_unname(ix, iface);
+	if (iface->deadline) {
+		for (pp = &ix->pending; *pp; pp = &(*pp)->next_pending) {
+			if (*pp == iface) {
+				*pp = iface->next_pending;
+				break;
+			}
+		}
+		if (ix->pending_tail == iface) {
+			struct netlinkdev_iface *tail = ix->pending;
+			while (tail && tail->next_pending)
+				tail = tail->next_pending;
+			ix->pending_tail = tail;
+		}
+	}
+	for (a = iface->addrs; a; a = anext) {
+		anext = a->next;
+		free(a);
+	}
+	free(iface);
+	ix->count--;
+}
+
+/**
+ * @brief	Queue an interface whose debounce window just started.  Windows
+ * 		all have the same length so the queue stays in deadline order.
+ * @param[in]	ix		interface index context
+ * @param[in]	iface		interface with its deadline set
+ * @return	nothing
+ */
+void netlinkdev_index_pend(struct netlinkdev_index *ix, struct netlinkdev_iface *iface)
+{
+	iface->next_pending = NULL;
+	if (ix->pending_tail)
+		ix->pending_tail->next_pending = iface;
+	else
+		ix->pending = iface;
+	ix->pending_tail = iface;
+}
+
+/**
+ * @brief	Take the interface whose debounce window ends first off the queue
+ * @param[in]	ix		interface index context
+ * @return	interface entry, NULL if nothing is pending
+ */
+struct netlinkdev_iface *netlinkdev_index_unpend(struct netlinkdev_index *ix)
+{
+	struct netlinkdev_iface *iface = ix->pending;
+
+	if (!iface)
+		return NULL;
+	ix->pending = iface->next_pending;
+	if (!ix->pending)
+		ix->pending_tail = NULL;
+	iface->next_pending = NULL;
+	return iface;
+}
+
+/**
+ * @brief	compare an address entry against an address
+ * @param[in]	a		address entry
+ * @param[in]	family		address family
+ * @param[in]	addr		binary address
+ * @param[in]	len		address length
+ * @param[in]	prefixlen	prefix length
+ * @return	non-zero if it is the same address
+ */
+static int netlinkdev_index_addrmatch(struct netlinkdev_ifaddr *a, int family,
+				      const void *addr, int len, int prefixlen)
+{
+	return a->family == family && a->len == len && a->prefixlen == prefixlen &&
+	       memcmp(a->addr, addr, len) == 0;
+}
+
+/**
+ * @brief	Add an address to an interface if it is not already present
+ * @param[in]	ix		interface index context
+ * @param[in]	if_index	interface index
+ * @param[in]	family		address family
+ * @param[in]	addr		binary address
+ * @param[in]	len		address length
+ * @param[in]	prefixlen	prefix length
+ * @return	address entry, NULL if out of memory
+ */
+struct netlinkdev_ifaddr *netlinkdev_index_addr(struct netlinkdev_index *ix, int if_index,
+						int family, const void *addr, int len, int prefixlen)
+{
+	struct netlinkdev_iface *iface = netlinkdev_index_get(ix, if_index);
+	struct netlinkdev_ifaddr **pp, *a;
+
+	if (!iface)
+		return NULL;
+	len = MIN(len, sizeof(a->addr));
+	for (pp = &iface->addrs; (a = *pp); pp = &a->next) {
+		if (netlinkdev_index_addrmatch(a, family, addr, len, prefixlen))
+			return a;
+	}
+	a = calloc(1, sizeof(struct netlinkdev_ifaddr));
+	if (!a)
+		return NULL;
+	a->family = family;
+	a->len = len;
+	a->prefixlen = prefixlen;
+	memcpy(a->addr, addr, len);
+	*pp = a;
+	iface->naddrs++;
+	if (ix->shm)
+		netlinkdev_shm_publish(ix->shm, iface);
+	return a;
+}
+
+/**
+ * @brief	Remove an address from an interface
+ * @param[in]	ix		interface index context
+ * @param[in]	if_index	interface index
+ * @param[in]	family		address family
+ * @param[in]	addr		binary address
+ * @param[in]	len		address length
+ * @param[in]	prefixlen	prefix length
+ * @return	nothing
+ */
+void netlinkdev_index_deladdr(struct netlinkdev_index *ix, int if_index,
+			      int family, const void *addr, int len, int prefixlen)
+{
+	struct netlinkdev_iface *iface = netlinkdev_index_byindex(ix, if_index);
+	struct netlinkdev_ifaddr **pp, *a;
+
+	if (!iface)
+		return;
+	len = MIN(len, sizeof(a->addr));
+	for (pp = &iface->addrs; (a = *pp); pp = &a->next) {
+		if (netlinkdev_index_addrmatch(a, family, addr, len, prefixlen)) {
+			*pp = a->next;
+			free(a);
+			iface->naddrs--;
+			if (ix->shm)
+				netlinkdev_shm_publish(ix->shm, iface);
+			return;
+		}
+	}
+}
+
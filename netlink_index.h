@@ -0,0 +1,103 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink interface index keyed by interface index and name
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_index.h
+ * @brief	Hash indices of interface state keyed by ifindex and ifname.
+ *
+ */
+
+
+#ifndef NETLINK_INDEX_H_
+#define NETLINK_INDEX_H_
+
+/**
+ * @brief	maximum interface name length including terminator (IFNAMSIZ)
+ */
+#define NETLINKDEV_IFNAMSIZ	16
+
+struct netlinkdev_shm;
+
+/**
+ * @brief	one address assigned to an interface
+*/
+struct netlinkdev_ifaddr {
+	struct netlinkdev_ifaddr	*next;		/**< next address of the same interface */
+	int				family;		/**< AF_INET or AF_INET6 */
+	int				len;		/**< address length */
+	int				prefixlen;	/**< prefix length */
+	unsigned char			addr[16];	/**< local address */
+	int				stale;		/**< not seen again since the resync started */
+};
+
+/**
+ * @brief	state of one interface held in the index
+*/
+struct netlinkdev_iface {
+	struct netlinkdev_iface		*next_index;	/**< hash chain keyed by ifindex */
+	struct netlinkdev_iface		*next_name;	/**< hash chain keyed by name */
+	int				if_index;	/**< interface index */
+	char				name[NETLINKDEV_IFNAMSIZ];	/**< interface name, empty until the link is known */
+	int				status;		/**< interface flags */
+	unsigned char			link_addr[6];	/**< interface link address */
+	struct netlinkdev_ifaddr	*addrs;		/**< addresses in the order they were added */
+	int				naddrs;		/**< number of addresses */
+	int				reported;	/**< flags last reported to the caller */
+	unsigned long long		deadline;	/**< end of the debounce window in ms, 0 if none */
+	unsigned int			transitions;	/**< up/down transitions seen in the window */
+	struct netlinkdev_iface		*next_pending;	/**< next interface waiting for its window to end */
+	int				stale;		/**< not seen again since the resync started */
+};
+
+/**
+ * @brief	interface index context
+*/
+struct netlinkdev_index {
+	struct netlinkdev_iface		**byindex;	/**< buckets keyed by ifindex */
+	struct netlinkdev_iface		**byname;	/**< buckets keyed by name */
+	unsigned int			size;		/**< number of buckets, power of 2 */
+	unsigned int			count;		/**< number of interfaces */
+	struct netlinkdev_iface		*pending;	/**< debounce windows in order of their end */
+	struct netlinkdev_iface		*pending_tail;	/**< last pending interface */
+	struct netlinkdev_shm		*shm;		/**< table every change is published to, may be NULL */
+};
+
+int netlinkdev_index_init(struct netlinkdev_index *ix);
+void netlinkdev_index_free(struct netlinkdev_index *ix);
+void netlinkdev_index_foreach(struct netlinkdev_index *ix,
+			      void (*fn)(struct netlinkdev_iface *, void *), void *arg);
+struct netlinkdev_iface *netlinkdev_index_byindex(struct netlinkdev_index *ix, int if_index);
+struct netlinkdev_iface *netlinkdev_index_byname(struct netlinkdev_index *ix, const char *name);
+struct netlinkdev_iface *netlinkdev_index_link(struct netlinkdev_index *ix, int if_index,
+					       const char *name, int status,
+					       const unsigned char *link_addr, int link_len);
+void netlinkdev_index_mark(struct netlinkdev_index *ix);
+void netlinkdev_index_dellink(struct netlinkdev_index *ix, int if_index);
+void netlinkdev_index_pend(struct netlinkdev_index *ix, struct netlinkdev_iface *iface);
+struct netlinkdev_iface *netlinkdev_index_unpend(struct netlinkdev_index *ix);
+struct netlinkdev_ifaddr *netlinkdev_index_addr(struct netlinkdev_index *ix, int if_index,
+						int family, const void *addr, int len, int prefixlen);
+void netlinkdev_index_deladdr(struct netlinkdev_index *ix, int if_index,
+			      int family, const void *addr, int len, int prefixlen);
+
+#endif
+
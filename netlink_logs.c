@@ -0,0 +1,277 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink log utils
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_logs.c
+ * @brief	Asynchronous log backend.  Log entries are formatted into a
+ * 		lock-free ring by the threads logging and written out by a
+ * 		thread of their own, so logging never waits on syslog or stdout.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/prctl.h>
+
+#include "netlink_logs.h"
+
+/**
+ * @brief	one log entry waiting in the ring
+*/
+struct netlinklogs_record {
+	unsigned long		seq;		/**< position the slot is ready for, see netlinklogs_push() */
+	int			level;		/**< NLLOG_* level of the entry */
+	int			len;		/**< length of the text */
+	char			text[NETLINKLOGS_TEXTSIZE];	/**< formatted entry, longer entries are cut */
+};
+
+/**
+ * @brief	asynchronous log backend context
+*/
+struct netlinklogs_async {
+	struct netlinklogs_record	*records;	/**< ring of entries */
+	unsigned int			size;		/**< number of entries, power of 2 */
+	unsigned long			tail;		/**< next position claimed by a thread logging */
+	unsigned long			head;		/**< next position written out, writer only */
+	unsigned long			dropped;	/**< entries lost because the ring was full */
+	unsigned long			reported;	/**< dropped entries already reported, writer only */
+	int				stopping;	/**< writer drains the ring and exits */
+	sem_t				items;		/**< posted for each entry and to stop */
+	pthread_t			writer;		/**< thread writing the entries out */
+};
+
+/**
+ * @brief	installed asynchronous backend, NULL logs synchronously
+ */
+struct netlinklogs_async *netlinklogs_async = NULL;
+
+/**
+ * @brief	writes one entry to syslog or stdout, on the writer thread
+ * @param[in]	level		NLLOG_* level of the entry
+ * @param[in]	text		formatted entry
+ * @param[in]	len		length of the entry
+ * @return	nothing
+ */
+static void netlinklogs_write(int level, const char *text, int len)
+{
+	if (running_daemon) {
+		syslog(level, "%.*s", len, text);
+		return;
+	}
+	fwrite(text, 1, len, stdout);
+	fputc('\n', stdout);
+}
+
+/**
+ * @brief	writes out every entry that is ready, in order
+ * @param[in]	lg		asynchronous backend context
+ * @return	number of entries written
+ */
+static int netlinklogs_drain(struct netlinklogs_async *lg)
+{
+	struct netlinklogs_record *r;
+	unsigned long dropped;
+	char text[64];
+	int n = 0;
+
+	for (;;) {
+		r = &lg->records[lg->head & (lg->size - 1)];
+		/* a slot claimed but still being formatted stops the drain */
+		if (__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) != lg->head + 1)
+			break;
+		netlinklogs_write(r->level, r->text, r->len);
+		__atomic_store_n(&r->seq, lg->head + lg->size, __ATOMIC_RELEASE);
+		lg->head++;
+		n++;
+	}
+	dropped = __atomic_load_n(&lg->dropped, __ATOMIC_RELAXED);
+	if (dropped != lg->reported) {
+		netlinklogs_write(NLLOG_WARN, text, snprintf(text, sizeof(text), "log: %lu entries dropped",
+							      dropped - lg->reported));
+		lg->reported = dropped;
+		n++;
+	}
+	if (n && !running_daemon)
+		fflush(stdout);
+	return n;
+}
+
+/**
+ * @brief	writer thread, sleeps until entries are posted
+ * @param[in]	arg		asynchronous backend context
+ * @return	NULL
+ */
+static void *netlinklogs_writer(void *arg)
+{
+	struct netlinklogs_async *lg = arg;
+
+	prctl(PR_SET_NAME, "nllogger");
+	while (1) {
+		while (sem_wait(&lg->items) < 0 && errno == EINTR)
+			;
+		netlinklogs_drain(lg);
+		if (__atomic_load_n(&lg->stopping, __ATOMIC_ACQUIRE)) {
+			/* whatever was logged before stop was called */
+			netlinklogs_drain(lg);
+			break;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief	Format a log entry into the ring of the asynchronous backend.
+ * 		Called by NL_LOG() once the level passed, from any thread.  A
+ * 		slot is claimed with a compare and swap, so threads logging
+ * 		never wait on each other or on the writer.
+ * @param[in]	level		NLLOG_* level of the entry
+ * @param[in]	fmt		printf format of the entry
+ * @return	nothing, the entry is counted as dropped if the ring is full
+ */
+void netlinklogs_push(int level, const char *fmt, ...)
+{
+	struct netlinklogs_async *lg = __atomic_load_n(&netlinklogs_async, __ATOMIC_ACQUIRE);
+	struct netlinklogs_record *r;
+	unsigned long pos, seq;
+	va_list ap;
+	int len;
+
+	if (!lg)
+		return;
+	pos = __atomic_load_n(&lg->tail, __ATOMIC_RELAXED);
+	for (;;) {
+		r = &lg->records[pos & (lg->size - 1)];
+		seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+		if (seq == pos) {
+			/* free for this position, claim it */
+			if (__atomic_compare_exchange_n(&lg->tail, &pos, pos + 1, 1,
+							__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if ((long)(seq - pos) < 0) {
+			/* still holds the entry of the previous lap, the writer is behind */
+			__atomic_add_fetch(&lg->dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+		else
+			pos = __atomic_load_n(&lg->tail, __ATOMIC_RELAXED);
+	}
+	va_start(ap, fmt);
+	len = vsnprintf(r->text, sizeof(r->text), fmt, ap);
+	va_end(ap);
+	if (len < 0)
+		len = 0;
+	else if (len >= (int)sizeof(r->text))
+		len = sizeof(r->text) - 1;
+	r->level = level;
+	r->len = len;
+	__atomic_store_n(&r->seq, pos + 1, __ATOMIC_RELEASE);
+	sem_post(&lg->items);
+}
+
+/**
+ * @brief	Start the asynchronous backend, NL_LOG() formats into a ring
+ * 		written out by a thread from then on
+ * @param[in]	size		entries in the ring, rounded up to a power of 2
+ * @return	result of start
+ */
+int netlinklogs_async_start(unsigned int size)
+{
+	struct netlinklogs_async *lg;
+	sigset_t all, saved;
+	unsigned int n = 2, i;
+	int stat;
+
+	if (netlinklogs_async)
+		return -EBUSY;
+	if (size == 0 || size > (1u << 20))
+		return -EINVAL;
+	while (n < size)
+		n <<= 1;
+	lg = calloc(1, sizeof(struct netlinklogs_async));
+	if (!lg)
+		return -ENOMEM;
+	lg->records = malloc(n * sizeof(struct netlinklogs_record));
+	if (!lg->records) {
+		free(lg);
+		return -ENOMEM;
+	}
+	lg->size = n;
+	for (i = 0; i < n; i++)
+		lg->records[i].seq = i;
+	sem_init(&lg->items, 0, 0);
+
+	/* signals are left to the threads of the application */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &saved);
+	stat = pthread_create(&lg->writer, NULL, netlinklogs_writer, lg);
+	pthread_sigmask(SIG_SETMASK, &saved, NULL);
+	if (stat != 0) {
+		NL_LOG(NLLOG_ERROR, "log: could not create writer (%d)", stat);
+		sem_destroy(&lg->items);
+		free(lg->records);
+		free(lg);
+		return -stat;
+	}
+	__atomic_store_n(&netlinklogs_async, lg, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/**
+ * @brief	Stop the asynchronous backend, the entries in the ring are
+ * 		written out first.  Other threads must no longer be logging,
+ * 		and the thread stopping it must not be interrupted in a log
+ * 		call, so it is never called from a signal handler.
+ * @return	nothing
+ */
+void netlinklogs_async_stop(void)
+{
+	struct netlinklogs_async *lg = netlinklogs_async;
+
+	if (!lg)
+		return;
+	__atomic_store_n(&netlinklogs_async, NULL, __ATOMIC_RELEASE);
+	__atomic_store_n(&lg->stopping, 1, __ATOMIC_RELEASE);
+	sem_post(&lg->items);
+	pthread_join(lg->writer, NULL);
+	sem_destroy(&lg->items);
+	free(lg->records);
+	free(lg);
+}
+
+/**
+ * @brief	Number of log entries lost because the ring was full
+ * @return	entries dropped since the backend started, 0 if not started
+ */
+unsigned long netlinklogs_async_dropped(void)
+{
+	struct netlinklogs_async *lg = __atomic_load_n(&netlinklogs_async, __ATOMIC_ACQUIRE);
+
+	return lg ? __atomic_load_n(&lg->dropped, __ATOMIC_RELAXED) : 0;
+}
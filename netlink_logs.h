@@ -29,6 +29,7 @@
 #ifndef NETLINK_LOGS_H_
 #define NETLINK_LOGS_H_
 
+#include <errno.h>
 #include <syslog.h>
 
 /**
@@ -46,10 +47,36 @@ extern int netlinklogs_level;
  */
 extern int netlinklogs_detailed;
 
+/**
+ * @brief	asynchronous log backend, NULL while logging synchronously
+ */
+extern struct netlinklogs_async *netlinklogs_async;
+
+/**
+ * @brief	highest level compiled in, entries above it are removed by the
+ * 		compiler.  Build with -DNLLOG_MAXLEVEL=NLLOG_INFO to drop the
+ * 		debug entries from the event path entirely.
+ */
+#ifndef NLLOG_MAXLEVEL
+#define NLLOG_MAXLEVEL	NLLOG_DEBUG
+#endif
+
+/**
+ * @brief	text kept of an entry of the asynchronous backend, longer entries are cut
+ */
+#define NETLINKLOGS_TEXTSIZE	240
+
 /**
  * @brief	condition true if detailed debug logging enabled
  */
-#define LOG_DETAILS	netlinklogs_detailed && (netlinklogs_level == NLLOG_DEBUG)
+#define LOG_DETAILS	(NLLOG_MAXLEVEL >= NLLOG_DEBUG && netlinklogs_detailed && (netlinklogs_level == NLLOG_DEBUG))
+
+/**
+ * @brief	condition true if an entry of the given level is logged, checked
+ * 		before the arguments are evaluated or anything is formatted
+ * @param[in]	_level		log level of the entry
+ */
+#define NL_LOG_ENABLED(_level)	((_level) <= NLLOG_MAXLEVEL && (_level) <= netlinklogs_level)
  
 /**
  * @brief	macro for opening logs to syslog
@@ -60,7 +87,7 @@ extern int netlinklogs_detailed;
 /**
  * @brief	macro for closing logs to syslog
  */
-#define NL_LOG_CLOSE()	if (running_daemon) { closelog(); }
+#define NL_LOG_CLOSE()	{ netlinklogs_async_stop(); if (running_daemon) { closelog(); } }
 
 /**
  * @brief	macro for setting log level in syslog
@@ -69,13 +96,18 @@ extern int netlinklogs_detailed;
 #define NL_LOG_LEVEL(__loglevel)	{ netlinklogs_level=__loglevel; if (running_daemon) { setlogmask(LOG_UPTO(__loglevel)); } }
 
 /**
- * @brief	macro for logging a log entry to syslog
+ * @brief	macro for logging a log entry to syslog, or to the ring of the
+ * 		asynchronous backend when it is started.  errno is left as it
+ * 		was, so an error path can log before returning -errno.
  * @param[in]	_level		log level for this log entry
  * @param[in]	_fmt		format of log entry
  * @param[in]	_arg		argument list for log entry
  */
-#define NL_LOG(_level, _fmt, _args...)  { if (running_daemon) { syslog(_level, _fmt, ## _args); } else \
-					  { if (_level <= netlinklogs_level ) { fprintf(stdout, _fmt, ## _args); fprintf(stdout, "\n"); } } }
+#define NL_LOG(_level, _fmt, _args...)  { if (NL_LOG_ENABLED(_level)) { int _nl_errno = errno; \
+					  if (netlinklogs_async) { netlinklogs_push(_level, _fmt, ## _args); } \
+					  else if (running_daemon) { syslog(_level, _fmt, ## _args); } \
+					  else { fprintf(stdout, _fmt "\n", ## _args); } \
+					  errno = _nl_errno; } }
 
 /**
  * @brief	log levels translated to syslog levels
@@ -87,5 +119,12 @@ extern int netlinklogs_detailed;
 #define NLLOG_INFO	LOG_INFO
 #define NLLOG_DEBUG	LOG_DEBUG
 
+struct netlinklogs_async;
+
+void netlinklogs_push(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+int netlinklogs_async_start(unsigned int size);
+void netlinklogs_async_stop(void);
+unsigned long netlinklogs_async_dropped(void);
+
 #endif
 
@@ -0,0 +1,331 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink event loop driving the netlink and uevent sockets
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_loop.c
+ * @brief	Single epoll event loop for the netlink and uevent sockets.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/epoll.h>
+
+#include "netlink_logs.h"
+#include "netlink_devices.h"
+#include "uevent_devices.h"
+#include "netlink_stats.h"
+#include "netlink_loop.h"
+
+/**
+ * @brief	maximum number of ready sources handled per epoll wakeup
+ */
+#define NETLINKDEV_LOOP_MAXEVENTS	16
+
+/**
+ * @brief	loop handler for the netlink cache manager socket
+ * @param[in]	fd		ready file descriptor
+ * @param[in]	events		epoll events reported
+ * @param[in]	arg		pointer to netlink context
+ * @return	result of the dispatch
+ */
+static int netlinkdev_loop_netlinkcb(int fd, unsigned int events, void *arg)
+{
+	return netlinkdev_dispatch((struct netlinkdev_info *)arg);
+}
+
+/**
+ * @brief	loop handler for the netlink debounce timer
+ * @param[in]	fd		ready file descriptor
+ * @param[in]	events		epoll events reported
+ * @param[in]	arg		pointer to netlink context
+ * @return	result of the timer processing
+ */
+static int netlinkdev_loop_timercb(int fd, unsigned int events, void *arg)
+{
+	return netlinkdev_timer((struct netlinkdev_info *)arg);
+}
+
+/**
+ * @brief	loop handler for the stats sampling timer
+ * @param[in]	fd		ready file descriptor
+ * @param[in]	events		epoll events reported
+ * @param[in]	arg		pointer to stats sampler context
+ * @return	result of the timer processing
+ */
+static int netlinkdev_loop_statstimercb(int fd, unsigned int events, void *arg)
+{
+	return netlinkdev_stats_timer((struct netlinkdev_stats *)arg);
+}
+
+/**
+ * @brief	loop handler for the stats dump socket
+ * @param[in]	fd		ready file descriptor
+ * @param[in]	events		epoll events reported
+ * @param[in]	arg		pointer to stats sampler context
+ * @return	result of the dispatch
+ */
+static int netlinkdev_loop_statscb(int fd, unsigned int events, void *arg)
+{
+	return netlinkdev_stats_dispatch((struct netlinkdev_stats *)arg);
+}
+
+/**
+ * @brief	loop handler for the uevent socket
+ * @param[in]	fd		ready file descriptor
+ * @param[in]	events		epoll events reported
+ * @param[in]	arg		pointer to uevent context
+ * @return	result of the dispatch
+ */
+static int netlinkdev_loop_ueventcb(int fd, unsigned int events, void *arg)
+{
+	return ueventdev_poll((struct ueventdev_info *)arg);
+}
+
+/**
+ * @brief	Initialize an event loop
+ * @param[in]	loop		event loop context
+ * @return	result of init
+ */
+int netlinkdev_loop_init(struct netlinkdev_loop *loop)
+{
+	memset(loop, 0, sizeof(struct netlinkdev_loop));
+	loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epfd < 0) {
+		NL_LOG(NLLOG_ERROR, "loop: can't create epoll instance (%d)", errno);
+		return -errno;
+	}
+	return 0;
+}
+
+/**
+ * @brief	Release an event loop and all registered sources
+ * @param[in]	loop		event loop context
+ * @return	result of free
+ */
+int netlinkdev_loop_free(struct netlinkdev_loop *loop)
+{
+	struct netlinkdev_loop_source *src;
+
+	while ((src = loop->sources) != NULL) {
+		loop->sources = src->next;
+		free(src);
+	}
+	if (loop->epfd >= 0)
+		close(loop->epfd);
+	loop->epfd = -1;
+	loop->running = 0;
+	return 0;
+}
+
+/**
+ * @brief	Register a file descriptor with the event loop
+ * @param[in]	loop		event loop context
+ * @param[in]	fd		file descriptor to watch for input
+ * @param[in]	handler		called when the fd becomes readable
+ * @param[in]	arg		context passed to the handler
+ * @return	result of add
+ */
+int netlinkdev_loop_add(struct netlinkdev_loop *loop, int fd,
+			netlinkdev_loop_handler_t handler, void *arg)
+{
+	struct netlinkdev_loop_source *src;
+	struct epoll_event ev;
+
+	if (fd < 0 || !handler)
+		return -EINVAL;
+
+	src = malloc(sizeof(struct netlinkdev_loop_source));
+	if (!src)
+		return -ENOMEM;
+	src->fd = fd;
+	src->handler = handler;
+	src->arg = arg;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = src;
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		int err = errno;
+		NL_LOG(NLLOG_ERROR, "loop: can't watch fd %d (%d)", fd, err);
+		free(src);
+		return -err;
+	}
+	src->next = loop->sources;
+	loop->sources = src;
+	return 0;
+}
+
+/**
+ * @brief	Remove a file descriptor from the event loop
+ * @param[in]	loop		event loop context
+ * @param[in]	fd		file descriptor previously added
+ * @return	result of delete
+ */
+int netlinkdev_loop_del(struct netlinkdev_loop *loop, int fd)
+{
+	struct netlinkdev_loop_source **pp, *src;
+
+	for (pp = &loop->sources; (src = *pp) != NULL; pp = &src->next) {
+		if (src->fd == fd) {
+			epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+			*pp = src->next;
+			free(src);
+			return 0;
+		}
+	}
+	return -ENOENT;
+}
+
+/**
+ * @brief	Also wait for a registered file descriptor to become writable,
+ * 		for sources with output pending
+ * @param[in]	loop		event loop context
+ * @param[in]	fd		file descriptor previously added
+ * @param[in]	on		non-zero to wait for output too, 0 for input only
+ * @return	result of modify
+ */
+int netlinkdev_loop_setout(struct netlinkdev_loop *loop, int fd, int on)
+{
+	struct netlinkdev_loop_source *src;
+	struct epoll_event ev;
+
+	for (src = loop->sources; src; src = src->next) {
+		if (src->fd == fd)
+			break;
+	}
+	if (!src)
+		return -ENOENT;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | (on ? EPOLLOUT : 0);
+	ev.data.ptr = src;
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_MOD, fd, &ev) < 0)
+		return -errno;
+	return 0;
+}
+
+/**
+ * @brief	Register the netlink cache manager socket with the loop, the
+ * 		debounce timer if debouncing has been enabled and the socket and
+ * 		timer of the stats sampler if counters are sampled
+ * @param[in]	loop		event loop context
+ * @param[in]	nl		started netlink context
+ * @return	result of add
+ */
+int netlinkdev_loop_add_netlink(struct netlinkdev_loop *loop, struct netlinkdev_info *nl)
+{
+	int stat;
+
+	stat = netlinkdev_loop_add(loop, netlinkdev_getfd(nl), netlinkdev_loop_netlinkcb, nl);
+	if (!stat && netlinkdev_gettimerfd(nl) >= 0)
+		stat = netlinkdev_loop_add(loop, netlinkdev_gettimerfd(nl), netlinkdev_loop_timercb, nl);
+	if (!stat && nl->stats)
+		stat = netlinkdev_loop_add(loop, nl->stats->timerfd, netlinkdev_loop_statstimercb, nl->stats);
+	if (!stat && nl->stats)
+		stat = netlinkdev_loop_add(loop, nl->stats->fd, netlinkdev_loop_statscb, nl->stats);
+	return stat;
+}
+
+/**
+ * @brief	Register the uevent socket with the loop
+ * @param[in]	loop		event loop context
+ * @param[in]	ul		started uevent context
+ * @return	result of add
+ */
+int netlinkdev_loop_add_uevent(struct netlinkdev_loop *loop, struct ueventdev_info *ul)
+{
+	return netlinkdev_loop_add(loop, ueventdev_getfd(ul), netlinkdev_loop_ueventcb, ul);
+}
+
+/**
+ * @brief	Wait once for any source to become ready and dispatch it
+ * @param[in]	loop		event loop context
+ * @param[in]	timeout		milliseconds to wait, -1 to block until an event
+ * @return	number of sources dispatched, 0 on timeout, negative on error
+ */
+int netlinkdev_loop_poll(struct netlinkdev_loop *loop, int timeout)
+{
+	return netlinkdev_loop_pwait(loop, timeout, NULL);
+}
+
+/**
+ * @brief	Wait once like netlinkdev_loop_poll() with the signal mask replaced
+ * 		while waiting, so signals kept blocked otherwise can only arrive
+ * 		during the wait and are never missed between a check and the wait
+ * @param[in]	loop		event loop context
+ * @param[in]	timeout		milliseconds to wait, -1 to block until an event
+ * @param[in]	sigmask		signal mask while waiting, NULL keeps the current one
+ * @return	number of sources dispatched, 0 on timeout or signal, negative on error
+ */
+int netlinkdev_loop_pwait(struct netlinkdev_loop *loop, int timeout, const sigset_t *sigmask)
+{
+	struct epoll_event events[NETLINKDEV_LOOP_MAXEVENTS];
+	int n, i;
+
+	n = epoll_pwait(loop->epfd, events, NETLINKDEV_LOOP_MAXEVENTS, timeout, sigmask);
+	if (n < 0) {
+		if (errno == EINTR)
+			return 0;
+		NL_LOG(NLLOG_ERROR, "loop: epoll wait failed (%d)", errno);
+		return -errno;
+	}
+	for (i = 0; i < n; i++) {
+		struct netlinkdev_loop_source *src = events[i].data.ptr;
+		src->handler(src->fd, events[i].events, src->arg);
+	}
+	return n;
+}
+
+/**
+ * @brief	Dispatch events until netlinkdev_loop_stop() is called
+ * @param[in]	loop		event loop context
+ * @return	0 when stopped, negative on error
+ */
+int netlinkdev_loop_run(struct netlinkdev_loop *loop)
+{
+	int stat = 0;
+
+	loop->running = 1;
+	while (loop->running) {
+		stat = netlinkdev_loop_poll(loop, -1);
+		if (stat < 0)
+			break;
+	}
+	loop->running = 0;
+	return stat < 0 ? stat : 0;
+}
+
+/**
+ * @brief	Make netlinkdev_loop_run() return after the current dispatch
+ * @param[in]	loop		event loop context
+ * @return	None
+ */
+void netlinkdev_loop_stop(struct netlinkdev_loop *loop)
+{
+	loop->running = 0;
+}
+
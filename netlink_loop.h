@@ -0,0 +1,76 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink event loop driving the netlink and uevent sockets
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_loop.h
+ * @brief	Single epoll event loop for the netlink and uevent sockets.
+ *
+ */
+
+
+#ifndef NETLINK_LOOP_H_
+#define NETLINK_LOOP_H_
+
+#include <signal.h>
+
+struct netlinkdev_info;
+struct ueventdev_info;
+
+/**
+ * @brief	handler called when a loop source becomes readable
+*/
+typedef int (*netlinkdev_loop_handler_t)(int fd, unsigned int events, void *arg);
+
+/**
+ * @brief	file descriptor registered with the event loop
+*/
+struct netlinkdev_loop_source {
+	int				fd;		/**< file descriptor being watched */
+	netlinkdev_loop_handler_t	handler;	/**< called when fd is ready */
+	void				*arg;		/**< context passed to the handler */
+	struct netlinkdev_loop_source	*next;		/**< next registered source */
+};
+
+/**
+ * @brief	event loop context structure
+*/
+struct netlinkdev_loop {
+	int				epfd;		/**< epoll instance */
+	int				running;	/**< cleared by netlinkdev_loop_stop() */
+	struct netlinkdev_loop_source	*sources;	/**< list of registered sources */
+};
+
+int netlinkdev_loop_init(struct netlinkdev_loop *loop);
+int netlinkdev_loop_free(struct netlinkdev_loop *loop);
+int netlinkdev_loop_add(struct netlinkdev_loop *loop, int fd,
+			netlinkdev_loop_handler_t handler, void *arg);
+int netlinkdev_loop_del(struct netlinkdev_loop *loop, int fd);
+int netlinkdev_loop_setout(struct netlinkdev_loop *loop, int fd, int on);
+int netlinkdev_loop_add_netlink(struct netlinkdev_loop *loop, struct netlinkdev_info *nl);
+int netlinkdev_loop_add_uevent(struct netlinkdev_loop *loop, struct ueventdev_info *ul);
+int netlinkdev_loop_poll(struct netlinkdev_loop *loop, int timeout);
+int netlinkdev_loop_pwait(struct netlinkdev_loop *loop, int timeout, const sigset_t *sigmask);
+int netlinkdev_loop_run(struct netlinkdev_loop *loop);
+void netlinkdev_loop_stop(struct netlinkdev_loop *loop);
+
+#endif
+
@@ -0,0 +1,145 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink and uevent processing counters and latency histograms
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_metrics.c
+ * @brief	Counters and log-linear latency histograms of the route and
+ * 		uevent sockets, kept only when instrumentation is enabled.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "netlink_metrics.h"
+
+/**
+ * @brief	Current monotonic time
+ * @return	time in nanoseconds
+ */
+unsigned long long netlinkdev_metrics_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief	bucket of a value, the values below 2^SUBBITS get one each and
+ * 		every power of 2 above is split in 2^SUBBITS equal parts
+ * @param[in]	value		value recorded
+ * @return	bucket number
+ */
+static unsigned int netlinkdev_hist_bucket(unsigned long long value)
+{
+	unsigned int e;
+
+	if (value < (1ULL << NETLINKDEV_HIST_SUBBITS))
+		return value;
+	e = 63 - __builtin_clzll(value);
+	return ((e - NETLINKDEV_HIST_SUBBITS + 1) << NETLINKDEV_HIST_SUBBITS) +
+	       ((value >> (e - NETLINKDEV_HIST_SUBBITS)) & ((1U << NETLINKDEV_HIST_SUBBITS) - 1));
+}
+
+/**
+ * @brief	largest value that falls in a bucket
+ * @param[in]	bucket		bucket number
+ * @return	value
+ */
+static unsigned long long netlinkdev_hist_upper(unsigned int bucket)
+{
+	unsigned int e, shift;
+
+	if (bucket < (1U << NETLINKDEV_HIST_SUBBITS))
+		return bucket;
+	e = (bucket >> NETLINKDEV_HIST_SUBBITS) + NETLINKDEV_HIST_SUBBITS - 1;
+	shift = e - NETLINKDEV_HIST_SUBBITS;
+	return ((((1ULL << NETLINKDEV_HIST_SUBBITS) | (bucket & ((1U << NETLINKDEV_HIST_SUBBITS) - 1))) + 1) << shift) - 1;
+}
+
+/**
+ * @brief	Forget every value recorded
+ * @param[in]	h		histogram
+ * @return	nothing
+ */
+void netlinkdev_hist_reset(struct netlinkdev_hist *h)
+{
+	memset(h, 0, sizeof(struct netlinkdev_hist));
+}
+
+/**
+ * @brief	Record one value
+ * @param[in]	h		histogram
+ * @param[in]	value		value recorded
+ * @return	nothing
+ */
+void netlinkdev_hist_record(struct netlinkdev_hist *h, unsigned long long value)
+{
+	if (!h->count || value < h->min)
+		h->min = value;
+	if (value > h->max)
+		h->max = value;
+	h->count++;
+	h->sum += value;
+	h->buckets[netlinkdev_hist_bucket(value)]++;
+}
+
+/**
+ * @brief	Value below which the given share of the values recorded fall
+ * @param[in]	h		histogram
+ * @param[in]	percent		share from 0 to 100
+ * @return	upper end of the bucket holding the percentile, never past the
+ * 		largest value recorded, 0 if the histogram is empty
+ */
+unsigned long long netlinkdev_hist_percentile(const struct netlinkdev_hist *h, double percent)
+{
+	unsigned long long target, seen = 0, value;
+	unsigned int i;
+
+	if (!h->count)
+		return 0;
+	target = (unsigned long long)(h->count * percent / 100.0 + 0.5);
+	if (target < 1)
+		target = 1;
+	for (i = 0; i < NETLINKDEV_HIST_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= target) {
+			value = netlinkdev_hist_upper(i);
+			return value < h->max ? value : h->max;
+		}
+	}
+	return h->max;
+}
+
+/**
+ * @brief	Zero every counter and histogram
+ * @param[in]	mt		instrumentation context
+ * @return	nothing
+ */
+void netlinkdev_metrics_reset(struct netlinkdev_metrics *mt)
+{
+	memset(mt, 0, sizeof(struct netlinkdev_metrics));
+}
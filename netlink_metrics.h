@@ -0,0 +1,97 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink and uevent processing counters and latency histograms
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_metrics.h
+ * @brief	Counters and log-linear latency histograms of the route and
+ * 		uevent sockets, kept only when instrumentation is enabled.
+ *
+ */
+
+
+#ifndef NETLINK_METRICS_H_
+#define NETLINK_METRICS_H_
+
+/**
+ * @brief	sub-buckets per power of 2 as a power of 2, values are kept
+ * 		to within 1/8 (12.5%)
+ */
+#define NETLINKDEV_HIST_SUBBITS		3
+
+/**
+ * @brief	buckets covering every 64 bit value
+ */
+#define NETLINKDEV_HIST_BUCKETS		((64 - NETLINKDEV_HIST_SUBBITS + 1) << NETLINKDEV_HIST_SUBBITS)
+
+/**
+ * @brief	histogram with buckets of constant relative width (HDR style)
+*/
+struct netlinkdev_hist {
+	unsigned long long	count;		/**< values recorded */
+	unsigned long long	sum;		/**< sum of the values recorded */
+	unsigned long long	min;		/**< smallest value recorded */
+	unsigned long long	max;		/**< largest value recorded */
+	unsigned long long	buckets[NETLINKDEV_HIST_BUCKETS];	/**< values recorded per bucket */
+};
+
+/**
+ * @brief	instrumentation of a netlink and a uevent context.  Times are
+ * 		in ns, the cache sizes are filled in by netlinkdev_get_stats().
+*/
+struct netlinkdev_metrics {
+	unsigned long		nl_polls;	/**< route socket dispatches that read messages */
+	unsigned long		nl_msgs;	/**< route socket messages handled */
+	unsigned long		nl_events;	/**< netlink events reported */
+	struct netlinkdev_hist	nl_latency;	/**< datagram read to event callback */
+	struct netlinkdev_hist	nl_callback;	/**< time handling one message, the event
+						     callbacks it made included */
+	struct netlinkdev_hist	nl_batch;	/**< events reported per dispatch */
+	unsigned long long	nl_rxstamp;	/**< read time of the datagrams being handled, 0 if none */
+
+	unsigned long		ue_polls;	/**< uevent socket polls that read datagrams */
+	unsigned long		ue_msgs;	/**< uevent datagrams received */
+	unsigned long		ue_truncated;	/**< uevent datagrams too large for the buffer */
+	unsigned long		ue_discarded;	/**< uevents parsed but not reported */
+	unsigned long		ue_events;	/**< uevents reported */
+	struct netlinkdev_hist	ue_latency;	/**< datagram read to uevent callback */
+	struct netlinkdev_hist	ue_callback;	/**< time parsing and reporting one uevent */
+	struct netlinkdev_hist	ue_batch;	/**< uevents reported per poll */
+	unsigned long long	ue_rxstamp;	/**< read time of the datagrams being handled */
+
+	unsigned int		links;		/**< interfaces indexed */
+	unsigned int		addrs;		/**< addresses indexed */
+	unsigned int		routes;		/**< routes tracked */
+	unsigned int		neighs;		/**< neighbours tracked */
+	unsigned int		queued;		/**< events waiting in the queue */
+	unsigned long		dropped;	/**< events overwritten in the queue */
+	unsigned long		overflows;	/**< route socket overflows (ENOBUFS) */
+	unsigned long		resyncs;	/**< resyncs done after overflows */
+	unsigned long		collapsed;	/**< link transitions collapsed by debouncing */
+};
+
+unsigned long long netlinkdev_metrics_now(void);
+void netlinkdev_hist_reset(struct netlinkdev_hist *h);
+void netlinkdev_hist_record(struct netlinkdev_hist *h, unsigned long long value);
+unsigned long long netlinkdev_hist_percentile(const struct netlinkdev_hist *h, double percent);
+void netlinkdev_metrics_reset(struct netlinkdev_metrics *mt);
+
+#endif
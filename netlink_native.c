@@ -0,0 +1,631 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * rtnetlink decoding without libnl objects
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_native.c
+ * @brief	Route socket read directly, link, address, route, neighbour and
+ * 		statistics messages decoded in place without libnl.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+#include <linux/if_addr.h>
+#include <linux/neighbour.h>
+#include <linux/if.h>
+#include <linux/net_namespace.h>
+
+#include "netlink_logs.h"
+#include "netlink_native.h"
+
+#ifndef SOL_NETLINK
+#define SOL_NETLINK		270
+#endif
+#ifndef NETLINK_GET_STRICT_CHK
+#define NETLINK_GET_STRICT_CHK	12
+#endif
+#ifndef NETLINK_LISTEN_ALL_NSID
+#define NETLINK_LISTEN_ALL_NSID	8
+#endif
+
+/**
+ * @brief	time to wait for the reply of a namespace id request in ms
+ */
+#define NETLINKDEV_NATIVE_REPLY_TIMEOUT	1000
+
+/**
+ * @brief	Open a non blocking route socket subscribed to the given groups
+ * @param[in]	groups		RTMGRP_* multicast groups
+ * @return	socket, negative errno on error
+ */
+int netlinkdev_native_open(unsigned int groups)
+{
+	struct sockaddr_nl sa;
+	int fd;
+
+	fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (fd < 0) {
+		NL_LOG(NLLOG_ERROR, "native: could not open route socket (%d)", errno);
+		return -errno;
+	}
+	memset(&sa, 0, sizeof(sa));
+	sa.nl_family = AF_NETLINK;
+	sa.nl_groups = groups;
+	if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+		int err = errno;
+		NL_LOG(NLLOG_ERROR, "native: could not bind route socket (%d)", err);
+		close(fd);
+		return -err;
+	}
+	return fd;
+}
+
+/**
+ * @brief	Have the kernel check dump requests strictly, which makes it
+ * 		honour the filters in the request header (Linux 4.20+)
+ * @param[in]	fd		route socket
+ * @return	0 on success, negative errno if not supported
+ */
+int netlinkdev_native_strict(int fd)
+{
+	int one = 1;
+
+	if (setsockopt(fd, SOL_NETLINK, NETLINK_GET_STRICT_CHK, &one, sizeof(one)) < 0)
+		return -errno;
+	return 0;
+}
+
+/**
+ * @brief	Subscribe an open route socket to one more multicast group
+ * @param[in]	fd		route socket
+ * @param[in]	group		RTNLGRP_* group
+ * @return	0 on success, negative errno on error
+ */
+int netlinkdev_native_join(int fd, int group)
+{
+	if (setsockopt(fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group, sizeof(group)) < 0) {
+		NL_LOG(NLLOG_ERROR, "native: could not join group %d (%d)", group, errno);
+		return -errno;
+	}
+	return 0;
+}
+
+/**
+ * @brief	Receive the notifications of every namespace that has an id in
+ * 		the namespace of the socket, each datagram tagged with the id
+ * 		(Linux 4.7+, needs CAP_NET_BROADCAST over the other namespaces)
+ * @param[in]	fd		route socket
+ * @return	0 on success, negative errno if not supported
+ */
+int netlinkdev_native_listenall(int fd)
+{
+	int one = 1;
+
+	if (setsockopt(fd, SOL_NETLINK, NETLINK_LISTEN_ALL_NSID, &one, sizeof(one)) < 0)
+		return -errno;
+	return 0;
+}
+
+/**
+ * @brief	send a namespace id request and wait for its answer
+ * @param[in]	fd		route socket
+ * @param[in]	type		RTM_GETNSID or RTM_NEWNSID
+ * @param[in]	nsfd		namespace file descriptor
+ * @param[in,out]	nsid		id asked for with RTM_NEWNSID (-1 to have one
+ * 				allocated), id returned by RTM_GETNSID
+ * @param[in]	seq		sequence number of the request
+ * @return	0 on success, negative errno on error
+ */
+static int netlinkdev_native_nsidrequest(int fd, int type, int nsfd, int *nsid, unsigned int seq)
+{
+	struct {
+		struct nlmsghdr		h;
+		struct rtgenmsg		g;
+		char			attrs[2 * RTA_SPACE(sizeof(int))];
+	} req;
+	char buf[1024];
+	struct rtattr *rta;
+	struct pollfd pfd = { fd, POLLIN, 0 };
+	const struct nlmsghdr *h;
+	int len;
+
+	memset(&req, 0, sizeof(req));
+	req.h.nlmsg_len = NLMSG_LENGTH(NLMSG_ALIGN(sizeof(struct rtgenmsg)));
+	req.h.nlmsg_type = type;
+	req.h.nlmsg_flags = NLM_F_REQUEST | (type == RTM_NEWNSID ? NLM_F_ACK : 0);
+	req.h.nlmsg_seq = seq;
+	req.g.rtgen_family = AF_UNSPEC;
+	rta = (struct rtattr *)((char *)&req + req.h.nlmsg_len);
+	rta->rta_type = NETNSA_FD;
+	rta->rta_len = RTA_LENGTH(sizeof(int));
+	memcpy(RTA_DATA(rta), &nsfd, sizeof(int));
+	req.h.nlmsg_len += RTA_SPACE(sizeof(int));
+	if (type == RTM_NEWNSID) {
+		rta = (struct rtattr *)((char *)&req + req.h.nlmsg_len);
+		rta->rta_type = NETNSA_NSID;
+		rta->rta_len = RTA_LENGTH(sizeof(int));
+		memcpy(RTA_DATA(rta), nsid, sizeof(int));
+		req.h.nlmsg_len += RTA_SPACE(sizeof(int));
+	}
+	if (send(fd, &req, req.h.nlmsg_len, 0) < 0)
+		return -errno;
+
+	for (;;) {
+		if (poll(&pfd, 1, NETLINKDEV_NATIVE_REPLY_TIMEOUT) <= 0)
+			return -ETIMEDOUT;
+		if ((len = recv(fd, buf, sizeof(buf), 0)) < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			return -errno;
+		}
+		for (h = (struct nlmsghdr *)buf; NLMSG_OK(h, len); h = NLMSG_NEXT(h, len)) {
+			if (h->nlmsg_seq != seq)
+				continue;
+			if (h->nlmsg_type == NLMSG_ERROR) {
+				if (h->nlmsg_len < NLMSG_LENGTH(sizeof(struct nlmsgerr)))
+					return -EINVAL;
+				return ((const struct nlmsgerr *)NLMSG_DATA(h))->error;
+			}
+			if (h->nlmsg_type == RTM_NEWNSID) {
+				int alen = h->nlmsg_len - NLMSG_LENGTH(NLMSG_ALIGN(sizeof(struct rtgenmsg)));
+				rta = (struct rtattr *)((char *)NLMSG_DATA(h) + NLMSG_ALIGN(sizeof(struct rtgenmsg)));
+				for (; RTA_OK(rta, alen); rta = RTA_NEXT(rta, alen)) {
+					if (rta->rta_type == NETNSA_NSID && RTA_PAYLOAD(rta) >= sizeof(int)) {
+						memcpy(nsid, RTA_DATA(rta), sizeof(int));
+						return 0;
+					}
+				}
+				return -ENOENT;
+			}
+		}
+	}
+}
+
+/**
+ * @brief	Get the id of a namespace as seen from the namespace of the
+ * 		socket, having one allocated if it has none yet
+ * @param[in]	fd		route socket
+ * @param[in]	nsfd		namespace file descriptor
+ * @param[in]	seq		sequence number of the first request, the
+ * 				NETLINKDEV_NATIVE_NSIDSEQS from it are used
+ * @return	namespace id, negative errno on error
+ */
+int netlinkdev_native_nsid(int fd, int nsfd, unsigned int seq)
+{
+	int nsid, stat;
+
+	if ((stat = netlinkdev_native_nsidrequest(fd, RTM_GETNSID, nsfd, &nsid, seq)) < 0)
+		return stat;
+	if (nsid != NETNSA_NSID_NOT_ASSIGNED)
+		return nsid;
+	nsid = NETNSA_NSID_NOT_ASSIGNED;
+	stat = netlinkdev_native_nsidrequest(fd, RTM_NEWNSID, nsfd, &nsid, seq + 1);
+	if (stat < 0 && stat != -EEXIST)
+		return stat;
+	/* allocated, or another process got there first */
+	if ((stat = netlinkdev_native_nsidrequest(fd, RTM_GETNSID, nsfd, &nsid, seq + 2)) < 0)
+		return stat;
+	return nsid < 0 ? -ENOENT : nsid;
+}
+
+/**
+ * @brief	Ask the kernel for links or addresses.  The full header is sent
+ * 		so the request is also valid on a strictly checked socket.
+ * @param[in]	fd		route socket
+ * @param[in]	type		RTM_GETLINK, RTM_GETADDR, RTM_GETROUTE or RTM_GETNEIGH
+ * @param[in]	family		address family, AF_UNSPEC for all
+ * @param[in]	if_index	0 to dump all, else the one link, or the addresses
+ * 				of one link if the socket is strictly checked,
+ * 				ignored for routes and neighbours
+ * @param[in]	seq		sequence number of the request
+ * @return	0 on success, negative errno on error
+ */
+int netlinkdev_native_request(int fd, int type, int family, int if_index, unsigned int seq)
+{
+	struct {
+		struct nlmsghdr		h;
+		union {
+			struct ifinfomsg	ifi;
+			struct ifaddrmsg	ifa;
+			struct rtmsg		rtm;
+			struct ndmsg		ndm;
+		} u;
+	} req;
+
+	memset(&req, 0, sizeof(req));
+	req.h.nlmsg_type = type;
+	req.h.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.h.nlmsg_seq = seq;
+	if (type == RTM_GETLINK) {
+		req.h.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+		req.u.ifi.ifi_family = family;
+		req.u.ifi.ifi_index = if_index;
+		if (if_index)
+			req.h.nlmsg_flags = NLM_F_REQUEST;
+	}
+	else if (type == RTM_GETNEIGH) {
+		req.h.nlmsg_len = NLMSG_LENGTH(sizeof(struct ndmsg));
+		req.u.ndm.ndm_family = family;
+	}
+	else if (type == RTM_GETROUTE) {
+		req.h.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+		req.u.rtm.rtm_family = family;
+	}
+	else {
+		req.h.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+		req.u.ifa.ifa_family = family;
+		req.u.ifa.ifa_index = if_index;
+	}
+	if (send(fd, &req, req.h.nlmsg_len, 0) < 0) {
+		NL_LOG(NLLOG_ERROR, "native: dump request %d failed (%d)", type, errno);
+		return -errno;
+	}
+	return 0;
+}
+
+/**
+ * @brief	Ask the kernel for one link by name
+ * @param[in]	fd		route socket
+ * @param[in]	name		interface name
+ * @param[in]	seq		sequence number of the request
+ * @return	0 on success, negative errno on error
+ */
+int netlinkdev_native_getlink(int fd, const char *name, unsigned int seq)
+{
+	struct {
+		struct nlmsghdr		h;
+		struct ifinfomsg	ifi;
+		char			attr[RTA_SPACE(IFNAMSIZ)];
+	} req;
+	struct rtattr *rta;
+	int len = strlen(name) + 1;
+
+	if (len > IFNAMSIZ)
+		return -EINVAL;
+	memset(&req, 0, sizeof(req));
+	req.h.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg)) + RTA_SPACE(len);
+	req.h.nlmsg_type = RTM_GETLINK;
+	req.h.nlmsg_flags = NLM_F_REQUEST;
+	req.h.nlmsg_seq = seq;
+	rta = (struct rtattr *)req.attr;
+	rta->rta_type = IFLA_IFNAME;
+	rta->rta_len = RTA_LENGTH(len);
+	memcpy(RTA_DATA(rta), name, len);
+	if (send(fd, &req, req.h.nlmsg_len, 0) < 0) {
+		NL_LOG(NLLOG_ERROR, "native: link request for %s failed (%d)", name, errno);
+		return -errno;
+	}
+	return 0;
+}
+
+/**
+ * @brief	Dump the 64 bit counters of every link (RTM_GETSTATS, Linux 4.7+)
+ * @param[in]	fd		route socket
+ * @param[in]	seq		sequence number of the request
+ * @return	0 on success, negative errno on error
+ */
+int netlinkdev_native_getstats(int fd, unsigned int seq)
+{
+	struct {
+		struct nlmsghdr		h;
+		struct if_stats_msg	ifsm;
+	} req;
+
+	memset(&req, 0, sizeof(req));
+	req.h.nlmsg_len = NLMSG_LENGTH(sizeof(struct if_stats_msg));
+	req.h.nlmsg_type = RTM_GETSTATS;
+	req.h.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.h.nlmsg_seq = seq;
+	req.ifsm.family = AF_UNSPEC;
+	req.ifsm.filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64);
+	if (send(fd, &req, req.h.nlmsg_len, 0) < 0) {
+		NL_LOG(NLLOG_ERROR, "native: stats request failed (%d)", errno);
+		return -errno;
+	}
+	return 0;
+}
+
+/**
+ * @brief	takes the output interface and gateway of a multipath route from
+ * 		its first nexthop
+ * @param[in]	nh		first nexthop
+ * @param[in]	size		payload of RTA_MULTIPATH
+ * @param[out]	m		decoded route
+ * @return	nothing
+ */
+static void netlinkdev_native_nexthop(const struct rtnexthop *nh, int size, struct netlinkdev_rtmsg *m)
+{
+	const struct rtattr *rta;
+	int len = MIN(nh->rtnh_len, size) - (int)RTNH_LENGTH(0);
+
+	m->if_index = nh->rtnh_ifindex;
+	for (rta = RTNH_DATA(nh); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type == RTA_GATEWAY) {
+			m->gateway = RTA_DATA(rta);
+			m->gw_len = RTA_PAYLOAD(rta);
+		}
+	}
+}
+
+/**
+ * @brief	Decode one link, address, route, neighbour or statistics message.
+ * 		Only the attributes that end up in struct netlinkdev_data are looked at,
+ * 		nothing is copied.
+ * @param[in]	h		netlink message
+ * @param[out]	m		decoded message
+ * @return	1 if decoded, 0 if of no interest, -EINVAL if truncated
+ */
+int netlinkdev_native_decode(const struct nlmsghdr *h, struct netlinkdev_rtmsg *m)
+{
+	const struct rtattr *rta;
+	int len;
+
+	memset(m, 0, sizeof(struct netlinkdev_rtmsg));
+	m->type = h->nlmsg_type;
+	m->multi = (h->nlmsg_flags & NLM_F_MULTI) != 0;
+
+	switch (h->nlmsg_type) {
+		case NLMSG_DONE:
+			return 1;
+		case NLMSG_ERROR:
+			if (h->nlmsg_len < NLMSG_LENGTH(sizeof(struct nlmsgerr)))
+				return -EINVAL;
+			m->error = ((const struct nlmsgerr *)NLMSG_DATA(h))->error;
+			return 1;
+		case RTM_NEWLINK:
+		case RTM_DELLINK: {
+			const struct ifinfomsg *ifi = NLMSG_DATA(h);
+
+			len = h->nlmsg_len - NLMSG_LENGTH(sizeof(*ifi));
+			if (len < 0)
+				return -EINVAL;
+			m->if_index = ifi->ifi_index;
+			m->flags = ifi->ifi_flags;
+			for (rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+				switch (rta->rta_type) {
+					case IFLA_IFNAME:
+						/* the kernel always terminates it, don't trust that */
+						if (memchr(RTA_DATA(rta), '\0', RTA_PAYLOAD(rta)))
+							m->name = RTA_DATA(rta);
+						break;
+					case IFLA_ADDRESS:
+						m->link_addr = RTA_DATA(rta);
+						m->link_len = RTA_PAYLOAD(rta);
+						break;
+				}
+			}
+			return 1;
+		}
+		case RTM_NEWADDR:
+		case RTM_DELADDR: {
+			const struct ifaddrmsg *ifa = NLMSG_DATA(h);
+			const struct rtattr *local = NULL, *address = NULL;
+
+			len = h->nlmsg_len - NLMSG_LENGTH(sizeof(*ifa));
+			if (len < 0)
+				return -EINVAL;
+			m->if_index = ifa->ifa_index;
+			m->family = ifa->ifa_family;
+			m->prefixlen = ifa->ifa_prefixlen;
+			for (rta = IFA_RTA(ifa); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+				if (rta->rta_type == IFA_LOCAL)
+					local = rta;
+				else if (rta->rta_type == IFA_ADDRESS)
+					address = rta;
+			}
+			/* IPv4 point to point has the peer in IFA_ADDRESS, IPv6 has no IFA_LOCAL */
+			if (!local)
+				local = address;
+			if (local) {
+				m->addr = RTA_DATA(local);
+				m->addr_len = RTA_PAYLOAD(local);
+			}
+			return 1;
+		}
+		case RTM_NEWROUTE:
+		case RTM_DELROUTE: {
+			const struct rtmsg *rtm = NLMSG_DATA(h);
+
+			len = h->nlmsg_len - NLMSG_LENGTH(sizeof(*rtm));
+			if (len < 0)
+				return -EINVAL;
+			m->family = rtm->rtm_family;
+			m->prefixlen = rtm->rtm_dst_len;
+			m->table = rtm->rtm_table;
+			m->tos = rtm->rtm_tos;
+			m->rtype = rtm->rtm_type;
+			m->flags = rtm->rtm_flags;
+			for (rta = RTM_RTA(rtm); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+				switch (rta->rta_type) {
+					case RTA_DST:
+						m->addr = RTA_DATA(rta);
+						m->addr_len = RTA_PAYLOAD(rta);
+						break;
+					case RTA_OIF:
+						if (RTA_PAYLOAD(rta) >= sizeof(int))
+							memcpy(&m->if_index, RTA_DATA(rta), sizeof(int));
+						break;
+					case RTA_GATEWAY:
+						m->gateway = RTA_DATA(rta);
+						m->gw_len = RTA_PAYLOAD(rta);
+						break;
+					case RTA_PRIORITY:
+						if (RTA_PAYLOAD(rta) >= sizeof(unsigned int))
+							memcpy(&m->priority, RTA_DATA(rta), sizeof(unsigned int));
+						break;
+					case RTA_TABLE:
+						/* tables past 255 only fit here */
+						if (RTA_PAYLOAD(rta) >= sizeof(unsigned int))
+							memcpy(&m->table, RTA_DATA(rta), sizeof(unsigned int));
+						break;
+					case RTA_MULTIPATH:
+						/* multipath routes are reported by their first nexthop */
+						if (!m->if_index && RTA_PAYLOAD(rta) >= sizeof(struct rtnexthop))
+							netlinkdev_native_nexthop(RTA_DATA(rta), RTA_PAYLOAD(rta), m);
+						break;
+				}
+			}
+			return 1;
+		}
+		case RTM_NEWSTATS: {
+			const struct if_stats_msg *ifsm = NLMSG_DATA(h);
+
+			len = h->nlmsg_len - NLMSG_LENGTH(sizeof(*ifsm));
+			if (len < 0)
+				return -EINVAL;
+			m->if_index = ifsm->ifindex;
+			for (rta = (const struct rtattr *)((const char *)ifsm + NLMSG_ALIGN(sizeof(*ifsm)));
+			     RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+				if (rta->rta_type == IFLA_STATS_LINK_64 &&
+				    RTA_PAYLOAD(rta) >= sizeof(struct rtnl_link_stats64))
+					m->stats64 = RTA_DATA(rta);
+			}
+			return 1;
+		}
+		case RTM_NEWNEIGH:
+		case RTM_DELNEIGH: {
+			const struct ndmsg *ndm = NLMSG_DATA(h);
+
+			len = h->nlmsg_len - NLMSG_LENGTH(sizeof(*ndm));
+			if (len < 0)
+				return -EINVAL;
+			m->family = ndm->ndm_family;
+			m->if_index = ndm->ndm_ifindex;
+			m->state = ndm->ndm_state;
+			m->flags = ndm->ndm_flags;
+			for (rta = (const struct rtattr *)((const char *)ndm + NLMSG_ALIGN(sizeof(*ndm)));
+			     RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+				if (rta->rta_type == NDA_DST) {
+					m->addr = RTA_DATA(rta);
+					m->addr_len = RTA_PAYLOAD(rta);
+				}
+				else if (rta->rta_type == NDA_LLADDR) {
+					m->link_addr = RTA_DATA(rta);
+					m->link_len = RTA_PAYLOAD(rta);
+				}
+			}
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief	Decode every message of a datagram
+ * @param[in]	buf		datagram
+ * @param[in]	len		length of the datagram
+ * @param[in]	nsid		namespace the datagram came from, -1 if not known
+ * @param[in]	cb		called for each decoded message
+ * @param[in]	arg		passed to cb
+ * @return	number of messages in the datagram
+ */
+int netlinkdev_native_parse(const void *buf, int len, int nsid, netlinkdev_native_cb_t cb, void *arg)
+{
+	const struct nlmsghdr *h;
+	struct netlinkdev_rtmsg m;
+	int n = 0;
+
+	for (h = buf; NLMSG_OK(h, len); h = NLMSG_NEXT(h, len)) {
+		n++;
+		if (netlinkdev_native_decode(h, &m) > 0) {
+			m.nsid = nsid;
+			cb(&m, arg);
+		}
+		else if (LOG_DETAILS)
+			NL_LOG(NLLOG_DEBUG, "native: message %d skipped", h->nlmsg_type);
+	}
+	return n;
+}
+
+/**
+ * @brief	Receive one datagram without decoding it
+ * @param[in]	fd		route socket
+ * @param[in]	buf		receive buffer
+ * @param[in]	size		size of the receive buffer
+ * @param[out]	nsid		namespace the datagram came from, -1 if not known
+ * @return	length of the datagram, 0 if nothing is pending, negative errno on error
+ */
+int netlinkdev_native_read(int fd, void *buf, int size, int *nsid)
+{
+	struct sockaddr_nl sa;
+	struct iovec iov = { buf, size };
+	char control[CMSG_SPACE(sizeof(int))];
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	int n;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_name = &sa;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	do {
+		msg.msg_namelen = sizeof(sa);
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		n = recvmsg(fd, &msg, 0);
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				return 0;
+			NL_LOG(NLLOG_WARN, "native: recvmsg error %d", errno);
+			return -errno;
+		}
+		/* only the kernel talks to us */
+	} while (sa.nl_pid != 0);
+	if (msg.msg_flags & MSG_TRUNC) {
+		NL_LOG(NLLOG_WARN, "native: datagram truncated to %d bytes", n);
+	}
+	/* tagged with the namespace when listening to all of them */
+	*nsid = -1;
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_NETLINK && cmsg->cmsg_type == NETLINK_LISTEN_ALL_NSID)
+			memcpy(nsid, CMSG_DATA(cmsg), sizeof(int));
+	}
+	return n;
+}
+
+/**
+ * @brief	Receive one datagram and decode its messages
+ * @param[in]	fd		route socket
+ * @param[in]	buf		receive buffer
+ * @param[in]	size		size of the receive buffer
+ * @param[in]	cb		called for each decoded message
+ * @param[in]	arg		passed to cb
+ * @return	number of messages, 0 if nothing is pending, negative errno on error
+ */
+int netlinkdev_native_recv(int fd, void *buf, int size, netlinkdev_native_cb_t cb, void *arg)
+{
+	int n, nsid;
+
+	if ((n = netlinkdev_native_read(fd, buf, size, &nsid)) <= 0)
+		return n;
+	return netlinkdev_native_parse(buf, n, nsid, cb, arg);
+}
@@ -0,0 +1,101 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * rtnetlink decoding without libnl objects
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_native.h
+ * @brief	Route socket read directly, link, address, route, neighbour and
+ * 		statistics messages decoded in place without libnl.
+ *
+ */
+
+
+#ifndef NETLINK_NATIVE_H_
+#define NETLINK_NATIVE_H_
+
+struct nlmsghdr;
+
+/**
+ * @brief	receive buffer size, large enough for any dump datagram
+ */
+#define NETLINKDEV_NATIVE_BUFSIZE	32768
+
+/**
+ * @brief	sequence numbers taken by netlinkdev_native_nsid(), which asks
+ * 		for the id, has one allocated and asks again
+ */
+#define NETLINKDEV_NATIVE_NSIDSEQS	3
+
+/**
+ * @brief	decoded link or address message, pointers refer into the message
+*/
+struct netlinkdev_rtmsg {
+	int			type;		/**< RTM_NEWLINK, RTM_DELLINK, RTM_NEWADDR, RTM_DELADDR,
+						     RTM_NEWROUTE, RTM_DELROUTE, RTM_NEWNEIGH, RTM_DELNEIGH,
+						     RTM_NEWSTATS, NLMSG_DONE or NLMSG_ERROR */
+	int			multi;		/**< part of a dump rather than a notification */
+	int			error;		/**< error of an NLMSG_ERROR, negative errno */
+	int			if_index;	/**< interface index, output interface of a route */
+	unsigned int		flags;		/**< interface flags of a link, RTM_F_* of a route,
+						     NTF_* of a neighbour */
+	const char		*name;		/**< IFLA_IFNAME of a link, NULL if not sent */
+	const unsigned char	*link_addr;	/**< IFLA_ADDRESS of a link or NDA_LLADDR of a
+						     neighbour, NULL if not sent */
+	int			link_len;	/**< length of the link address */
+	int			family;		/**< address family */
+	int			prefixlen;	/**< address or route destination prefix length */
+	const unsigned char	*addr;		/**< IFA_LOCAL, or IFA_ADDRESS if no local address,
+						     RTA_DST of a route, NULL for a default route,
+						     NDA_DST of a neighbour */
+	int			addr_len;	/**< length of the address */
+	unsigned int		table;		/**< routing table of a route */
+	int			tos;		/**< type of service of a route */
+	int			rtype;		/**< RTN_* type of a route */
+	unsigned int		priority;	/**< RTA_PRIORITY of a route */
+	const unsigned char	*gateway;	/**< RTA_GATEWAY of a route or of its first nexthop,
+						     NULL if directly connected */
+	int			gw_len;		/**< length of the gateway */
+	int			state;		/**< NUD_* state of a neighbour */
+	const void		*stats64;	/**< IFLA_STATS_LINK_64 of a stats message, a struct
+						     rtnl_link_stats64, NULL if not sent */
+	int			nsid;		/**< namespace the notification came from when listening
+						     to all of them, -1 if not known */
+};
+
+/**
+ * @brief	called for every decoded message of a datagram
+*/
+typedef void (*netlinkdev_native_cb_t)(const struct netlinkdev_rtmsg *m, void *arg);
+
+int netlinkdev_native_open(unsigned int groups);
+int netlinkdev_native_strict(int fd);
+int netlinkdev_native_request(int fd, int type, int family, int if_index, unsigned int seq);
+int netlinkdev_native_getlink(int fd, const char *name, unsigned int seq);
+int netlinkdev_native_getstats(int fd, unsigned int seq);
+int netlinkdev_native_decode(const struct nlmsghdr *h, struct netlinkdev_rtmsg *m);
+int netlinkdev_native_join(int fd, int group);
+int netlinkdev_native_listenall(int fd);
+int netlinkdev_native_nsid(int fd, int nsfd, unsigned int seq);
+int netlinkdev_native_parse(const void *buf, int len, int nsid, netlinkdev_native_cb_t cb, void *arg);
+int netlinkdev_native_read(int fd, void *buf, int size, int *nsid);
+int netlinkdev_native_recv(int fd, void *buf, int size, netlinkdev_native_cb_t cb, void *arg);
+
+#endif
@@ -0,0 +1,266 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink neighbour tables hashed by interface and address
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_neigh.c
+ * @brief	Hash index of neighbour (ARP/NDP) entries keyed by ifindex and
+ * 		address.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "netlink_neigh.h"
+
+/**
+ * @brief	initial number of hash buckets, grows as entries are added
+ */
+#define NETLINKDEV_NEIGHS_MINSIZE	256
+
+/**
+ * @brief	hash an interface index and address into a bucket (FNV-1a)
+ * @param[in]	nt		neighbour index context
+ * @param[in]	if_index	interface index
+ * @param[in]	addr		binary address
+ * @param[in]	len		address length
+ * @return	bucket number
+ */
+static unsigned int netlinkdev_neighs_hash(struct netlinkdev_neighs *nt, int if_index,
+					   const unsigned char *addr, int len)
+{
+	unsigned int h = 2166136261u ^ ((unsigned int)if_index * 2654435761u);
+	int i;
+
+	for (i = 0; i < len; i++) {
+		h ^= addr[i];
+		h *= 16777619u;
+	}
+	return h & (nt->size - 1);
+}
+
+/**
+ * @brief	double the number of buckets and rehash every entry
+ * @param[in]	nt		neighbour index context
+ * @return	0 on success, -ENOMEM if the table could not grow
+ */
+static int netlinkdev_neighs_grow(struct netlinkdev_neighs *nt)
+{
+	struct netlinkdev_neigh **old = nt->buckets, *n, *next;
+	unsigned int oldsize = nt->size, i, h;
+
+	nt->buckets = calloc(oldsize * 2, sizeof(*nt->buckets));
+	if (!nt->buckets) {
+		nt->buckets = old;
+		return -ENOMEM;
+	}
+	nt->size = oldsize * 2;
+	for (i = 0; i < oldsize; i++) {
+		for (n = old[i]; n; n = next) {
+			next = n->next;
+			h = netlinkdev_neighs_hash(nt, n->if_index, n->addr, n->len);
+			n->next = nt->buckets[h];
+			nt->buckets[h] = n;
+		}
+	}
+	free(old);
+	return 0;
+}
+
+/**
+ * @brief	Initialize an empty neighbour index
+ * @param[in]	nt		neighbour index context
+ * @return	result of init
+ */
+int netlinkdev_neighs_init(struct netlinkdev_neighs *nt)
+{
+	memset(nt, 0, sizeof(struct netlinkdev_neighs));
+	nt->size = NETLINKDEV_NEIGHS_MINSIZE;
+	nt->buckets = calloc(nt->size, sizeof(*nt->buckets));
+	if (!nt->buckets)
+		return -ENOMEM;
+	return 0;
+}
+
+/**
+ * @brief	Release every entry held in the index
+ * @param[in]	nt		neighbour index context
+ * @return	nothing
+ */
+void netlinkdev_neighs_free(struct netlinkdev_neighs *nt)
+{
+	struct netlinkdev_neigh *n, *next;
+	unsigned int i;
+
+	for (i = 0; nt->buckets && i < nt->size; i++) {
+		for (n = nt->buckets[i]; n; n = next) {
+			next = n->next;
+			free(n);
+		}
+	}
+	free(nt->buckets);
+	memset(nt, 0, sizeof(struct netlinkdev_neighs));
+}
+
+/**
+ * @brief	Find the entry of an address on an interface
+ * @param[in]	nt		neighbour index context
+ * @param[in]	if_index	interface index
+ * @param[in]	family		AF_INET or AF_INET6
+ * @param[in]	addr		binary address
+ * @param[in]	len		address length
+ * @return	entry, NULL if not known
+ */
+struct netlinkdev_neigh *netlinkdev_neighs_lookup(struct netlinkdev_neighs *nt, int if_index,
+						  int family, const void *addr, int len)
+{
+	struct netlinkdev_neigh *n;
+
+	if (len > (int)sizeof(n->addr))
+		return NULL;
+	for (n = nt->buckets[netlinkdev_neighs_hash(nt, if_index, addr, len)]; n; n = n->next) {
+		if (n->if_index == if_index && n->family == family && n->len == len &&
+		    memcmp(n->addr, addr, len) == 0)
+			return n;
+	}
+	return NULL;
+}
+
+/**
+ * @brief	Add an entry or update the state and link layer address of the
+ * 		entry with the same interface and address
+ * @param[in]	nt		neighbour index context
+ * @param[in]	n		entry
+ * @param[out]	old		entry before the change, may be NULL
+ * @return	NETLINKDEV_NEIGH_ADDED, NETLINKDEV_NEIGH_CHANGED, 0 if neither
+ * 		state nor link layer address changed, negative errno on error
+ */
+int netlinkdev_neighs_update(struct netlinkdev_neighs *nt, const struct netlinkdev_neigh *n,
+			     struct netlinkdev_neigh *old)
+{
+	struct netlinkdev_neigh *e;
+	unsigned int h;
+
+	if (n->len > (int)sizeof(e->addr))
+		return -EINVAL;
+	e = netlinkdev_neighs_lookup(nt, n->if_index, n->family, n->addr, n->len);
+	if (e) {
+		e->stale = 0;
+		e->flags = n->flags;
+		if (e->state == n->state && memcmp(e->lladdr, n->lladdr, sizeof(e->lladdr)) == 0)
+			return 0;
+		if (old)
+			*old = *e;
+		e->state = n->state;
+		memcpy(e->lladdr, n->lladdr, sizeof(e->lladdr));
+		return NETLINKDEV_NEIGH_CHANGED;
+	}
+	if (nt->count >= nt->size)
+		netlinkdev_neighs_grow(nt);
+	if (!(e = malloc(sizeof(struct netlinkdev_neigh))))
+		return -ENOMEM;
+	*e = *n;
+	e->stale = 0;
+	h = netlinkdev_neighs_hash(nt, e->if_index, e->addr, e->len);
+	e->next = nt->buckets[h];
+	nt->buckets[h] = e;
+	nt->count++;
+	return NETLINKDEV_NEIGH_ADDED;
+}
+
+/**
+ * @brief	Remove the entry with the same interface and address
+ * @param[in]	nt		neighbour index context
+ * @param[in]	n		entry
+ * @param[out]	old		entry removed, may be NULL
+ * @return	0 on success, -ENOENT if not found
+ */
+int netlinkdev_neighs_delete(struct netlinkdev_neighs *nt, const struct netlinkdev_neigh *n,
+			     struct netlinkdev_neigh *old)
+{
+	struct netlinkdev_neigh **pp, *e;
+
+	if (n->len > (int)sizeof(n->addr))
+		return -ENOENT;
+	pp = &nt->buckets[netlinkdev_neighs_hash(nt, n->if_index, n->addr, n->len)];
+	for (; (e = *pp); pp = &e->next) {
+		if (e->if_index != n->if_index || e->family != n->family || e->len != n->len ||
+		    memcmp(e->addr, n->addr, n->len) != 0)
+			continue;
+		*pp = e->next;
+		if (old)
+			*old = *e;
+		free(e);
+		nt->count--;
+		return 0;
+	}
+	return -ENOENT;
+}
+
+/**
+ * @brief	Mark every entry as stale before a resync, entries seen again
+ * 		are unmarked by netlinkdev_neighs_update()
+ * @param[in]	nt		neighbour index context
+ * @return	nothing
+ */
+void netlinkdev_neighs_mark(struct netlinkdev_neighs *nt)
+{
+	struct netlinkdev_neigh *n;
+	unsigned int i;
+
+	for (i = 0; i < nt->size; i++) {
+		for (n = nt->buckets[i]; n; n = n->next)
+			n->stale = 1;
+	}
+}
+
+/**
+ * @brief	Remove the entries a resync did not see again
+ * @param[in]	nt		neighbour index context
+ * @param[in]	fn		called with each entry before it is removed, may be NULL
+ * @param[in]	arg		passed to fn
+ * @return	nothing
+ */
+void netlinkdev_neighs_sweep(struct netlinkdev_neighs *nt,
+			     void (*fn)(const struct netlinkdev_neigh *, void *), void *arg)
+{
+	struct netlinkdev_neigh **pp, *n;
+	unsigned int i;
+
+	for (i = 0; i < nt->size; i++) {
+		for (pp = &nt->buckets[i]; (n = *pp); ) {
+			if (!n->stale) {
+				pp = &n->next;
+				continue;
+			}
+			*pp = n->next;
+			nt->count--;
+			if (fn)
+				fn(n, arg);
+			free(n);
+		}
+	}
+}
@@ -0,0 +1,76 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink neighbour tables hashed by interface and address
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_neigh.h
+ * @brief	Hash index of neighbour (ARP/NDP) entries keyed by ifindex and
+ * 		address.
+ *
+ */
+
+
+#ifndef NETLINK_NEIGH_H_
+#define NETLINK_NEIGH_H_
+
+/**
+ * @brief	netlinkdev_neighs_update() results
+ */
+#define NETLINKDEV_NEIGH_ADDED		1
+#define NETLINKDEV_NEIGH_CHANGED	2
+
+/**
+ * @brief	one neighbour entry
+*/
+struct netlinkdev_neigh {
+	struct netlinkdev_neigh		*next;		/**< hash chain */
+	int				if_index;	/**< interface index */
+	int				family;		/**< AF_INET or AF_INET6 */
+	int				len;		/**< address length */
+	unsigned char			addr[16];	/**< neighbour address */
+	unsigned char			lladdr[6];	/**< link layer address, zero if not resolved */
+	int				state;		/**< NUD_* state */
+	int				flags;		/**< NTF_* flags */
+	int				stale;		/**< not seen again since the resync started */
+};
+
+/**
+ * @brief	neighbour index context
+*/
+struct netlinkdev_neighs {
+	struct netlinkdev_neigh		**buckets;	/**< buckets keyed by ifindex and address */
+	unsigned int			size;		/**< number of buckets, power of 2 */
+	unsigned int			count;		/**< number of entries */
+};
+
+int netlinkdev_neighs_init(struct netlinkdev_neighs *nt);
+void netlinkdev_neighs_free(struct netlinkdev_neighs *nt);
+struct netlinkdev_neigh *netlinkdev_neighs_lookup(struct netlinkdev_neighs *nt, int if_index,
+						  int family, const void *addr, int len);
+int netlinkdev_neighs_update(struct netlinkdev_neighs *nt, const struct netlinkdev_neigh *n,
+			     struct netlinkdev_neigh *old);
+int netlinkdev_neighs_delete(struct netlinkdev_neighs *nt, const struct netlinkdev_neigh *n,
+			     struct netlinkdev_neigh *old);
+void netlinkdev_neighs_mark(struct netlinkdev_neighs *nt);
+void netlinkdev_neighs_sweep(struct netlinkdev_neighs *nt,
+			     void (*fn)(const struct netlinkdev_neigh *, void *), void *arg);
+
+#endif
@@ -0,0 +1,332 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink interfaces of several network namespaces monitored from one loop
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_netns.c
+ * @brief	Netlink contexts attached to other network namespaces, driven
+ * 		from one event loop and told apart by namespace id.
+ *
+ * Each namespace gets its own netlink context with its sockets opened
+ * inside the namespace and its own interface index. With listen all,
+ * the notifications of every namespace arrive on one socket of the
+ * caller's namespace tagged with the namespace id, and are handed to
+ * the context of that id; the per namespace sockets only dump.
+ */
+
+
+#define _GNU_SOURCE	/* setns */
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <linux/rtnetlink.h>
+
+#include "netlink_logs.h"
+#include "netlink_devices.h"
+#include "netlink_native.h"
+#include "netlink_loop.h"
+#include "netlink_netns.h"
+
+/**
+ * @brief	Switch the calling thread to a network namespace
+ * @param[in]	nsfd		namespace file descriptor
+ * @return	descriptor of the namespace switched from for
+ * 		netlinkdev_netns_leave(), negative errno on error
+ */
+int netlinkdev_netns_enter(int nsfd)
+{
+	int saved, stat;
+
+	saved = open("/proc/thread-self/ns/net", O_RDONLY | O_CLOEXEC);
+	if (saved < 0)
+		saved = open("/proc/self/ns/net", O_RDONLY | O_CLOEXEC);
+	if (saved < 0)
+		return -errno;
+	if (setns(nsfd, CLONE_NEWNET) < 0) {
+		stat = -errno;
+		close(saved);
+		NL_LOG(NLLOG_ERROR, "netns: could not enter namespace, error %d", -stat);
+		return stat;
+	}
+	return saved;
+}
+
+/**
+ * @brief	Switch the calling thread back after netlinkdev_netns_enter()
+ * @param[in]	saved		descriptor returned by netlinkdev_netns_enter()
+ * @return	result of leave
+ */
+int netlinkdev_netns_leave(int saved)
+{
+	int stat = 0;
+
+	if (setns(saved, CLONE_NEWNET) < 0) {
+		stat = -errno;
+		NL_LOG(NLLOG_ERROR, "netns: could not return to namespace, error %d", -stat);
+	}
+	close(saved);
+	return stat;
+}
+
+/**
+ * @brief	finds the context of a namespace id
+ * @param[in]	ns		namespaces context
+ * @param[in]	nsid		namespace id
+ * @return	context of the namespace, NULL if not attached
+ */
+static struct netlinkdev_nsentry *netlinkdev_netns_find(struct netlinkdev_netns *ns, int nsid)
+{
+	struct netlinkdev_nsentry *e;
+
+	for (e = ns->buckets[nsid & (NETLINKDEV_NETNS_BUCKETS - 1)]; e; e = e->next) {
+		if (e->nl.nsid == nsid)
+			return e;
+	}
+	return NULL;
+}
+
+/**
+ * @brief	hands a tagged notification to the context of its namespace
+ * @param[in]	m		decoded message, tagged with the namespace id
+ * @param[in]	arg		namespaces context
+ * @return	nothing
+ */
+static void netlinkdev_netns_msg(const struct netlinkdev_rtmsg *m, void *arg)
+{
+	struct netlinkdev_netns *ns = arg;
+	struct netlinkdev_nsentry *e;
+
+	if (m->multi || m->nsid < 0)
+		return;
+	if ((e = netlinkdev_netns_find(ns, m->nsid)))
+		netlinkdev_deliver(&e->nl, m);
+}
+
+/**
+ * @brief	reads the socket listening to all namespaces
+ * @param[in]	fd		socket listening to all namespaces
+ * @param[in]	events		ready events, unused
+ * @param[in]	arg		namespaces context
+ * @return	0 once drained, negative errno on error
+ */
+static int netlinkdev_netns_allcb(int fd, unsigned int events, void *arg)
+{
+	struct netlinkdev_netns *ns = arg;
+	struct netlinkdev_nsentry *e;
+	int n, i;
+
+	while ((n = netlinkdev_native_recv(fd, ns->rxbuf, NETLINKDEV_NATIVE_BUFSIZE,
+					   netlinkdev_netns_msg, ns)) != 0) {
+		if (n == -ENOBUFS) {
+			/* unknown which namespaces lost notifications */
+			ns->overflows++;
+			NL_LOG(NLLOG_WARN, "netns: socket overflowed, resyncing %u namespaces", ns->count);
+			for (i = 0; i < NETLINKDEV_NETNS_BUCKETS; i++) {
+				for (e = ns->buckets[i]; e; e = e->next)
+					netlinkdev_resync(&e->nl);
+			}
+		}
+		else if (n < 0)
+			return n;
+	}
+	return 0;
+}
+
+/**
+ * @brief	Initialize the namespaces context
+ * @param[in]	ns			namespaces context
+ * @param[in]	loop			loop the namespaces are added to
+ * @param[in]	engine			engine and start flags of every namespace
+ * @param[in]	listenall		receive the notifications of all namespaces on
+ * 					one socket, native engine only
+ * @param[in]	netlink_event_cb	callback to report netlink events
+ * @param[in]	caller_context		callers context to pass into callback
+ * @return	result of init
+ */
+int netlinkdev_netns_init(struct netlinkdev_netns *ns, struct netlinkdev_loop *loop,
+			  int engine, int listenall,
+			  void (*netlink_event_cb)(int, struct netlinkdev_data *, void *),
+			  void *caller_context)
+{
+	memset(ns, 0, sizeof(struct netlinkdev_netns));
+	ns->loop = loop;
+	ns->engine = engine;
+	ns->allfd = -1;
+	ns->event = netlink_event_cb;
+	ns->context = caller_context;
+	ns->ctlfd = netlinkdev_native_open(0);
+	if (ns->ctlfd < 0)
+		return ns->ctlfd;
+	if (!listenall || (engine & ~NETLINKDEV_START_FAST) != NETLINKDEV_ENGINE_NATIVE)
+		return 0;
+
+	ns->allfd = netlinkdev_native_open(RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR);
+	if (ns->allfd >= 0 && netlinkdev_native_listenall(ns->allfd) == 0 &&
+	    (ns->rxbuf = malloc(NETLINKDEV_NATIVE_BUFSIZE)) &&
+	    netlinkdev_loop_add(loop, ns->allfd, netlinkdev_netns_allcb, ns) == 0)
+		return 0;
+	NL_LOG(NLLOG_WARN, "netns: cannot listen to all namespaces, one socket each");
+	if (ns->allfd >= 0)
+		close(ns->allfd);
+	ns->allfd = -1;
+	free(ns->rxbuf);
+	ns->rxbuf = NULL;
+	return 0;
+}
+
+/**
+ * @brief	Detach every namespace and release the context
+ * @param[in]	ns		namespaces context
+ * @return	result of free
+ */
+int netlinkdev_netns_free(struct netlinkdev_netns *ns)
+{
+	struct netlinkdev_nsentry *e;
+	int i;
+
+	for (i = 0; i < NETLINKDEV_NETNS_BUCKETS; i++) {
+		while ((e = ns->buckets[i]))
+			netlinkdev_netns_detach(ns, e->nl.nsid);
+	}
+	if (ns->allfd >= 0) {
+		netlinkdev_loop_del(ns->loop, ns->allfd);
+		close(ns->allfd);
+	}
+	ns->allfd = -1;
+	if (ns->ctlfd >= 0)
+		close(ns->ctlfd);
+	ns->ctlfd = -1;
+	free(ns->rxbuf);
+	ns->rxbuf = NULL;
+	return 0;
+}
+
+/**
+ * @brief	Attach a namespace and start monitoring it
+ * @param[in]	ns		namespaces context
+ * @param[in]	nsfd		namespace file descriptor, duplicated
+ * @return	namespace id the events are tagged with, negative errno on error
+ */
+int netlinkdev_netns_attachfd(struct netlinkdev_netns *ns, int nsfd)
+{
+	struct netlinkdev_nsentry *e;
+	int nsid, stat;
+
+	nsid = netlinkdev_native_nsid(ns->ctlfd, nsfd, ns->seq + 1);
+	ns->seq += NETLINKDEV_NATIVE_NSIDSEQS;
+	if (nsid < 0) {
+		NL_LOG(NLLOG_ERROR, "netns: no id for namespace, error %d", -nsid);
+		return nsid;
+	}
+	if (netlinkdev_netns_find(ns, nsid))
+		return -EEXIST;
+	e = malloc(sizeof(struct netlinkdev_nsentry));
+	if (!e)
+		return -ENOMEM;
+	stat = netlinkdev_startnetns(&e->nl, nsfd, nsid,
+				     ns->engine | (ns->allfd >= 0 ? NETLINKDEV_START_NOLISTEN : 0),
+				     ns->event, ns->context);
+	if (stat < 0) {
+		free(e);
+		return stat;
+	}
+	if (!e->nl.booted)
+		stat = netlinkdev_boot(&e->nl);
+	if (!stat && ns->allfd < 0)
+		stat = netlinkdev_loop_add_netlink(ns->loop, &e->nl);
+	if (stat < 0) {
+		netlinkdev_stop(&e->nl);
+		free(e);
+		return stat;
+	}
+	e->next = ns->buckets[nsid & (NETLINKDEV_NETNS_BUCKETS - 1)];
+	ns->buckets[nsid & (NETLINKDEV_NETNS_BUCKETS - 1)] = e;
+	ns->count++;
+	NL_LOG(NLLOG_INFO, "netns: attached namespace %d", nsid);
+	return nsid;
+}
+
+/**
+ * @brief	Attach a namespace by path and start monitoring it
+ * @param[in]	ns		namespaces context
+ * @param[in]	path		namespace path, as /var/run/netns/<name> or /proc/<pid>/ns/net
+ * @return	namespace id the events are tagged with, negative errno on error
+ */
+int netlinkdev_netns_attachpath(struct netlinkdev_netns *ns, const char *path)
+{
+	int nsfd, stat;
+
+	nsfd = open(path, O_RDONLY | O_CLOEXEC);
+	if (nsfd < 0) {
+		stat = -errno;
+		NL_LOG(NLLOG_ERROR, "netns: cannot open %s", path);
+		return stat;
+	}
+	stat = netlinkdev_netns_attachfd(ns, nsfd);
+	close(nsfd);
+	return stat;
+}
+
+/**
+ * @brief	Stop monitoring a namespace
+ * @param[in]	ns		namespaces context
+ * @param[in]	nsid		namespace id returned by attach
+ * @return	result of detach
+ */
+int netlinkdev_netns_detach(struct netlinkdev_netns *ns, int nsid)
+{
+	struct netlinkdev_nsentry **pe, *e;
+
+	for (pe = &ns->buckets[nsid & (NETLINKDEV_NETNS_BUCKETS - 1)]; (e = *pe); pe = &e->next) {
+		if (e->nl.nsid != nsid)
+			continue;
+		*pe = e->next;
+		if (ns->allfd < 0) {
+			netlinkdev_loop_del(ns->loop, netlinkdev_getfd(&e->nl));
+			if (netlinkdev_gettimerfd(&e->nl) >= 0)
+				netlinkdev_loop_del(ns->loop, netlinkdev_gettimerfd(&e->nl));
+		}
+		netlinkdev_stop(&e->nl);
+		free(e);
+		ns->count--;
+		return 0;
+	}
+	return -ENOENT;
+}
+
+/**
+ * @brief	Get the netlink context of a namespace, to watch interfaces or
+ * 		look up its addresses
+ * @param[in]	ns		namespaces context
+ * @param[in]	nsid		namespace id returned by attach
+ * @return	netlink context, NULL if not attached
+ */
+struct netlinkdev_info *netlinkdev_netns_get(struct netlinkdev_netns *ns, int nsid)
+{
+	struct netlinkdev_nsentry *e = netlinkdev_netns_find(ns, nsid);
+
+	return e ? &e->nl : NULL;
+}
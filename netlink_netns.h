@@ -0,0 +1,81 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink interfaces of several network namespaces monitored from one loop
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_netns.h
+ * @brief	Netlink contexts attached to other network namespaces, driven
+ * 		from one event loop and told apart by namespace id.
+ *
+ */
+
+
+#ifndef NETLINK_NETNS_H_
+#define NETLINK_NETNS_H_
+
+#include "netlink_devices.h"
+
+struct netlinkdev_loop;
+
+/**
+ * @brief	buckets of the namespace table, power of 2
+ */
+#define NETLINKDEV_NETNS_BUCKETS	64
+
+/**
+ * @brief	one attached namespace
+*/
+struct netlinkdev_nsentry {
+	struct netlinkdev_info		nl;		/**< netlink context of the namespace */
+	struct netlinkdev_nsentry	*next;		/**< next namespace in the bucket */
+};
+
+/**
+ * @brief	namespaces context structure
+*/
+struct netlinkdev_netns {
+	struct netlinkdev_loop		*loop;		/**< loop the namespaces are added to */
+	int				engine;		/**< engine of every namespace */
+	int				allfd;		/**< socket listening to all namespaces, -1 if
+							     each namespace listens on its own */
+	int				ctlfd;		/**< route socket asking for namespace ids */
+	void				*rxbuf;		/**< receive buffer of allfd */
+	unsigned int			seq;		/**< sequence number of the last id request */
+	struct netlinkdev_nsentry	*buckets[NETLINKDEV_NETNS_BUCKETS];	/**< namespaces keyed by id */
+	unsigned int			count;		/**< number of namespaces attached */
+	unsigned long			overflows;	/**< overflows of allfd */
+	void 				(*event)(int, struct netlinkdev_data *, void *);	/**< event callback */
+	void				*context;	/**< caller context reported back to caller */
+};
+
+int netlinkdev_netns_enter(int nsfd);
+int netlinkdev_netns_leave(int saved);
+int netlinkdev_netns_init(struct netlinkdev_netns *ns, struct netlinkdev_loop *loop,
+			  int engine, int listenall,
+			  void (*netlink_event_cb)(int, struct netlinkdev_data *, void *),
+			  void *caller_context);
+int netlinkdev_netns_free(struct netlinkdev_netns *ns);
+int netlinkdev_netns_attachfd(struct netlinkdev_netns *ns, int nsfd);
+int netlinkdev_netns_attachpath(struct netlinkdev_netns *ns, const char *path);
+int netlinkdev_netns_detach(struct netlinkdev_netns *ns, int nsid);
+struct netlinkdev_info *netlinkdev_netns_get(struct netlinkdev_netns *ns, int nsid);
+
+#endif
@@ -0,0 +1,425 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink and uevent events written as JSON lines or binary records
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_output.c
+ * @brief	Events written out as JSON lines or fixed-size binary records,
+ * 		collected over a poll and written with one writev.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <linux/if.h>
+
+#include "netlink_devices.h"
+#include "uevent_devices.h"
+#include "netlink_output.h"
+
+/**
+ * @brief	current wall clock time
+ * @return	time in ns
+ */
+static uint64_t netlinkdev_output_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief	makes room for one more record, writing out the batch when
+ * 		the buffer or the iovecs are used up
+ * @param[in]	out		output context
+ * @return	0 on success, negative errno on error
+ */
+static int netlinkdev_output_room(struct netlinkdev_output *out)
+{
+	if (out->fd < 0)
+		return -ENOTCONN;
+	if (out->niov < NETLINKDEV_OUTPUT_MAXIOV &&
+	    out->buflen + NETLINKDEV_OUTPUT_RECMAX <= NETLINKDEV_OUTPUT_BUFSIZE)
+		return 0;
+	return netlinkdev_output_flush(out);
+}
+
+/**
+ * @brief	adds the record formatted at the end of the buffer to the batch
+ * @param[in]	out		output context
+ * @param[in]	len		length of the record
+ * @return	nothing
+ */
+static void netlinkdev_output_push(struct netlinkdev_output *out, size_t len)
+{
+	out->iov[out->niov].iov_base = out->buf + out->buflen;
+	out->iov[out->niov].iov_len = len;
+	out->niov++;
+	out->buflen += len;
+}
+
+/**
+ * @brief	writes a JSON string, escaping quotes, backslashes and control characters
+ * @param[in]	p		where to write
+ * @param[in]	s		characters, not necessarily terminated
+ * @param[in]	n		number of characters
+ * @return	end of what was written
+ */
+static char *netlinkdev_output_str(char *p, const char *s, size_t n)
+{
+	static const char hex[] = "0123456789abcdef";
+	unsigned char c;
+	size_t i;
+
+	*p++ = '"';
+	for (i = 0; i < n; i++) {
+		c = s[i];
+		if (c == '"' || c == '\\') {
+			*p++ = '\\';
+			*p++ = c;
+		}
+		else if (c < 0x20) {
+			memcpy(p, "\\u00", 4);
+			p[4] = hex[c >> 4];
+			p[5] = hex[c & 0xf];
+			p += 6;
+		}
+		else
+			*p++ = c;
+	}
+	*p++ = '"';
+	return p;
+}
+
+/**
+ * @brief	writes a network address as a JSON string, null if it has none
+ * @param[in]	p		where to write
+ * @param[in]	family		AF_INET or AF_INET6
+ * @param[in]	addr		address
+ * @return	end of what was written
+ */
+static char *netlinkdev_output_addr(char *p, int family, const void *addr)
+{
+	if (!addr || !inet_ntop(family, addr, p + 1, INET6_ADDRSTRLEN)) {
+		memcpy(p, "null", 4);
+		return p + 4;
+	}
+	*p = '"';
+	p += 1 + strlen(p + 1);
+	*p++ = '"';
+	return p;
+}
+
+/**
+ * @brief	writes a link address as a JSON string
+ * @param[in]	p		where to write
+ * @param[in]	a		6 byte link address
+ * @return	end of what was written
+ */
+static char *netlinkdev_output_lladdr(char *p, const unsigned char *a)
+{
+	static const char hex[] = "0123456789abcdef";
+	int i;
+
+	*p++ = '"';
+	for (i = 0; i < 6; i++) {
+		if (i)
+			*p++ = ':';
+		*p++ = hex[a[i] >> 4];
+		*p++ = hex[a[i] & 0xf];
+	}
+	*p++ = '"';
+	return p;
+}
+
+/**
+ * @brief	name of an address family for the JSON records
+ * @param[in]	family		address family
+ * @return	name, "unspec" if not an internet family
+ */
+static const char *netlinkdev_output_family(int family)
+{
+	return family == AF_INET ? "inet" : family == AF_INET6 ? "inet6" : "unspec";
+}
+
+/**
+ * @brief	Write to a descriptor, stdout when run by nltest
+ * @param[in]	out		output context
+ * @param[in]	fd		descriptor written to, left open by stop
+ * @param[in]	format		NETLINKDEV_OUTPUT_JSON or NETLINKDEV_OUTPUT_BINARY
+ * @return	result of start
+ */
+int netlinkdev_output_start(struct netlinkdev_output *out, int fd, int format)
+{
+	memset(out, 0, sizeof(struct netlinkdev_output));
+	out->fd = -1;
+	if (fd < 0 || (format != NETLINKDEV_OUTPUT_JSON && format != NETLINKDEV_OUTPUT_BINARY))
+		return -EINVAL;
+	out->buf = malloc(NETLINKDEV_OUTPUT_BUFSIZE);
+	if (!out->buf)
+		return -ENOMEM;
+	out->fd = fd;
+	out->format = format;
+	return 0;
+}
+
+/**
+ * @brief	Write out what is left of the batch and release the buffer.  Called
+ * 		by the thread adding the records once it no longer does, never
+ * 		from a signal handler, which could tear a record being formatted
+ * 		or written.
+ * @param[in]	out		output context
+ * @return	result of the last write
+ */
+int netlinkdev_output_stop(struct netlinkdev_output *out)
+{
+	int stat = 0;
+
+	if (out->fd >= 0)
+		stat = netlinkdev_output_flush(out);
+	free(out->buf);
+	out->buf = NULL;
+	out->fd = -1;
+	return stat;
+}
+
+/**
+ * @brief	Add a netlink event to the batch
+ * @param[in]	out		output context
+ * @param[in]	event		NETLINKDEV_EVENT_* identifier
+ * @param[in]	nd		event data
+ * @return	0 on success, negative errno on error
+ */
+int netlinkdev_output_netlink(struct netlinkdev_output *out, int event, const struct netlinkdev_data *nd)
+{
+	static const char *types[] = { "addr", "link", "route", "neigh" };
+	struct netlinkdev_outnet *rec;
+	int up = (nd->status & IFF_LOWER_UP) && (nd->status & IFF_UP);
+	char *p;
+	int stat;
+
+	if (event < NETLINKDEV_EVENT_ADDR || event > NETLINKDEV_EVENT_NEIGH)
+		return -EINVAL;
+	if ((stat = netlinkdev_output_room(out)) < 0)
+		return stat;
+	out->seq++;
+
+	if (out->format == NETLINKDEV_OUTPUT_BINARY) {
+		rec = (struct netlinkdev_outnet *)(out->buf + out->buflen);
+		memset(rec, 0, sizeof(*rec));
+		rec->hdr.type = NETLINKDEV_OUTPUT_NETLINK;
+		rec->hdr.len = sizeof(*rec);
+		rec->hdr.seq = out->seq;
+		rec->hdr.ts_ns = netlinkdev_output_now();
+		rec->event = event;
+		rec->nsid = nd->nsid;
+		rec->if_index = nd->if_index;
+		rec->status = nd->status;
+		rec->collapsed = nd->collapsed;
+		memcpy(rec->if_name, nd->if_name, sizeof(rec->if_name));
+		rec->if_name[sizeof(rec->if_name) - 1] = '\0';
+		memcpy(rec->link_addr, nd->link_addr, sizeof(rec->link_addr));
+		rec->family = nd->net_family;
+		if (nd->net_len <= (int)sizeof(rec->addr)) {
+			rec->addr_len = nd->net_len;
+			memcpy(rec->addr, nd->net_addr, nd->net_len);
+		}
+		if (event == NETLINKDEV_EVENT_ROUTE) {
+			rec->route_action = nd->route_action;
+			rec->route_table = nd->route_table;
+			rec->dst_len = nd->route_dstlen;
+			rec->gw_len = nd->route_gwlen;
+			memcpy(rec->gw, nd->route_gw, sizeof(rec->gw));
+		}
+		else if (event == NETLINKDEV_EVENT_NEIGH) {
+			rec->neigh_state = nd->neigh_state;
+			rec->neigh_prevstate = nd->neigh_prevstate;
+		}
+		netlinkdev_output_push(out, sizeof(*rec));
+		return 0;
+	}
+
+	p = (char *)out->buf + out->buflen;
+	p += sprintf(p, "{\"seq\":%u,\"ts\":%llu,\"type\":\"%s\",\"ifindex\":%d,\"ifname\":",
+		     out->seq, (unsigned long long)netlinkdev_output_now(), types[event], nd->if_index);
+	p = netlinkdev_output_str(p, nd->if_name, strnlen(nd->if_name, sizeof(nd->if_name)));
+	p += sprintf(p, ",\"nsid\":%d", nd->nsid);
+	switch (event) {
+		case NETLINKDEV_EVENT_ADDR:
+			p += sprintf(p, ",\"flags\":%d,\"up\":%s,\"family\":\"%s\",\"addr\":",
+				     nd->status, up ? "true" : "false", netlinkdev_output_family(nd->net_family));
+			p = netlinkdev_output_addr(p, nd->net_family, nd->net_len ? nd->net_addr : NULL);
+			break;
+		case NETLINKDEV_EVENT_LINK:
+			p += sprintf(p, ",\"flags\":%d,\"up\":%s,\"lladdr\":", nd->status, up ? "true" : "false");
+			p = netlinkdev_output_lladdr(p, nd->link_addr);
+			p += sprintf(p, ",\"collapsed\":%d", nd->collapsed);
+			break;
+		case NETLINKDEV_EVENT_ROUTE:
+			p += sprintf(p, ",\"action\":\"%s\",\"family\":\"%s\",\"dst\":",
+				     nd->route_action == NETLINKDEV_ROUTE_ADD ? "add" :
+				     nd->route_action == NETLINKDEV_ROUTE_DEL ? "del" : "change",
+				     netlinkdev_output_family(nd->net_family));
+			p = netlinkdev_output_addr(p, nd->net_family, nd->net_addr);
+			p += sprintf(p, ",\"dstlen\":%d,\"table\":%u,\"gw\":", nd->route_dstlen, nd->route_table);
+			p = netlinkdev_output_addr(p, nd->net_family, nd->route_gwlen ? nd->route_gw : NULL);
+			break;
+		case NETLINKDEV_EVENT_NEIGH:
+			p += sprintf(p, ",\"family\":\"%s\",\"addr\":", netlinkdev_output_family(nd->net_family));
+			p = netlinkdev_output_addr(p, nd->net_family, nd->net_addr);
+			p += sprintf(p, ",\"lladdr\":");
+			p = netlinkdev_output_lladdr(p, nd->link_addr);
+			p += sprintf(p, ",\"state\":%d,\"prevstate\":%d", nd->neigh_state, nd->neigh_prevstate);
+			break;
+	}
+	*p++ = '}';
+	*p++ = '\n';
+	netlinkdev_output_push(out, p - (char *)(out->buf + out->buflen));
+	return 0;
+}
+
+/**
+ * @brief	Add a uevent to the batch with all its properties, the ones not
+ * 		fitting in NETLINKDEV_OUTPUT_PROPSIZE are left out
+ * @param[in]	out		output context
+ * @param[in]	ud		event data
+ * @return	0 on success, negative errno on error
+ */
+int netlinkdev_output_uevent(struct netlinkdev_output *out, const struct ueventdev_data *ud)
+{
+	struct netlinkdev_outuevent *rec;
+	const struct ueventdev_prop *prop;
+	const char *ifname = ueventdev_getprop(ud, "INTERFACE");
+	size_t used = 0, plen;
+	int i, truncated = 0;
+	char *p;
+	int stat;
+
+	if ((stat = netlinkdev_output_room(out)) < 0)
+		return stat;
+	out->seq++;
+
+	if (out->format == NETLINKDEV_OUTPUT_BINARY) {
+		rec = (struct netlinkdev_outuevent *)(out->buf + out->buflen);
+		memset(rec, 0, sizeof(*rec));
+		rec->hdr.type = NETLINKDEV_OUTPUT_UEVENT;
+		rec->hdr.len = sizeof(*rec);
+		rec->hdr.seq = out->seq;
+		rec->hdr.ts_ns = netlinkdev_output_now();
+		rec->action = ud->action;
+		if (ifname)
+			strncpy(rec->if_name, ifname, sizeof(rec->if_name) - 1);
+		strncpy(rec->devname, ud->devname, sizeof(rec->devname) - 1);
+		for (i = 0; i < ud->nprops; i++) {
+			prop = &ud->props[i];
+			plen = prop->keylen + 1 + prop->valuelen + 1;
+			if (used + plen > sizeof(rec->props)) {
+				rec->truncated = 1;
+				break;
+			}
+			memcpy(rec->props + used, prop->key, prop->keylen);
+			rec->props[used + prop->keylen] = '=';
+			memcpy(rec->props + used + prop->keylen + 1, prop->value, prop->valuelen);
+			used += plen;
+			rec->nprops++;
+		}
+		rec->propslen = used;
+		netlinkdev_output_push(out, sizeof(*rec));
+		return 0;
+	}
+
+	p = (char *)out->buf + out->buflen;
+	p += sprintf(p, "{\"seq\":%u,\"ts\":%llu,\"type\":\"uevent\",\"action\":\"%s\",\"ifname\":",
+		     out->seq, (unsigned long long)netlinkdev_output_now(),
+		     ud->action == UEVENTDEV_ACTION_ADD ? "add" :
+		     ud->action == UEVENTDEV_ACTION_REMOVE ? "remove" : "other");
+	p = netlinkdev_output_str(p, ifname ? ifname : "", ifname ? strnlen(ifname, 16) : 0);
+	p += sprintf(p, ",\"devname\":");
+	p = netlinkdev_output_str(p, ud->devname, strnlen(ud->devname, sizeof(ud->devname)));
+	p += sprintf(p, ",\"props\":{");
+	/* the same properties as a binary record would hold */
+	for (i = 0; i < ud->nprops; i++) {
+		prop = &ud->props[i];
+		plen = prop->keylen + 1 + prop->valuelen + 1;
+		if (used + plen > NETLINKDEV_OUTPUT_PROPSIZE) {
+			truncated = 1;
+			break;
+		}
+		if (i)
+			*p++ = ',';
+		p = netlinkdev_output_str(p, prop->key, prop->keylen);
+		*p++ = ':';
+		p = netlinkdev_output_str(p, prop->value, prop->valuelen);
+		used += plen;
+	}
+	p += sprintf(p, "},\"truncated\":%s}\n", truncated ? "true" : "false");
+	netlinkdev_output_push(out, p - (char *)(out->buf + out->buflen));
+	return 0;
+}
+
+/**
+ * @brief	Write out the records of the batch with one writev, once per poll
+ * 		so all the events of a cycle go out together.  The batch is
+ * 		discarded if the write fails.
+ * @param[in]	out		output context
+ * @return	0 on success, negative errno on error
+ */
+int netlinkdev_output_flush(struct netlinkdev_output *out)
+{
+	struct iovec *iov = out->iov;
+	int niov = out->niov;
+	int stat = 0;
+	ssize_t n;
+
+	while (niov) {
+		n = writev(out->fd, iov, niov);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			stat = -errno;
+			break;
+		}
+		out->writes++;
+		/* a short write carries on from the middle of a record */
+		while (niov && (size_t)n >= iov->iov_len) {
+			n -= iov->iov_len;
+			iov++;
+			niov--;
+		}
+		if (niov) {
+			iov->iov_base = (char *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+	if (!stat)
+		out->records += out->niov;
+	out->niov = 0;
+	out->buflen = 0;
+	return stat;
+}
@@ -0,0 +1,150 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink and uevent events written as JSON lines or binary records
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_output.h
+ * @brief	Events written out as JSON lines or fixed-size binary records,
+ * 		collected over a poll and written with one writev.
+ *
+ */
+
+
+#ifndef NETLINK_OUTPUT_H_
+#define NETLINK_OUTPUT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+struct netlinkdev_data;
+struct ueventdev_data;
+
+/**
+ * @brief	output formats
+*/
+enum {
+	NETLINKDEV_OUTPUT_JSON = 1,	/**< one JSON object per line */
+	NETLINKDEV_OUTPUT_BINARY	/**< fixed-size records in host byte order */
+};
+
+/**
+ * @brief	size of the buffer the records of a batch are collected in
+ */
+#define NETLINKDEV_OUTPUT_BUFSIZE	65536
+
+/**
+ * @brief	records per writev, a batch with more is written in several
+ */
+#define NETLINKDEV_OUTPUT_MAXIOV	256
+
+/**
+ * @brief	room for the KEY=value strings of a uevent record, the size of the
+ * 		buffer the kernel builds the environment in (UEVENT_BUFFER_SIZE).
+ * 		Properties past it are left out and the record marked truncated.
+ */
+#define NETLINKDEV_OUTPUT_PROPSIZE	2048
+
+/**
+ * @brief	longest record, a JSON uevent with every byte of its properties escaped
+ */
+#define NETLINKDEV_OUTPUT_RECMAX	(6 * NETLINKDEV_OUTPUT_PROPSIZE + 2048)
+
+/**
+ * @brief	binary record types
+ */
+enum {
+	NETLINKDEV_OUTPUT_NETLINK = 1,	/**< struct netlinkdev_outnet */
+	NETLINKDEV_OUTPUT_UEVENT	/**< struct netlinkdev_outuevent */
+};
+
+/**
+ * @brief	header of every binary record
+*/
+struct netlinkdev_outhdr {
+	uint16_t			type;		/**< record type */
+	uint16_t			len;		/**< length of the record including this header */
+	uint32_t			seq;		/**< sequence number of the record, from 1 */
+	uint64_t			ts_ns;		/**< wall clock time the event was written out in ns */
+};
+
+/**
+ * @brief	netlink event record, the fields not used by the event are 0
+*/
+struct netlinkdev_outnet {
+	struct netlinkdev_outhdr	hdr;		/**< NETLINKDEV_OUTPUT_NETLINK */
+	int32_t				event;		/**< NETLINKDEV_EVENT_* */
+	int32_t				nsid;		/**< namespace id, -1 for nltest's */
+	int32_t				if_index;	/**< interface index */
+	int32_t				status;		/**< interface flags */
+	int32_t				collapsed;	/**< link transitions collapsed into the event */
+	int32_t				route_action;	/**< NETLINKDEV_ROUTE_* of a route event */
+	uint32_t			route_table;	/**< routing table of a route event */
+	int32_t				neigh_state;	/**< NUD_* state of a neighbour event */
+	int32_t				neigh_prevstate;	/**< NUD_* state before a neighbour event */
+	char				if_name[16];	/**< interface name */
+	uint8_t				link_addr[6];	/**< link address of a link or neighbour event */
+	uint8_t				family;		/**< address family */
+	uint8_t				addr_len;	/**< address length, 0 if not set */
+	uint8_t				addr[16];	/**< address, route destination or neighbour */
+	uint8_t				dst_len;	/**< destination prefix length of a route event */
+	uint8_t				gw_len;		/**< gateway length of a route event, 0 if direct */
+	uint8_t				gw[16];		/**< gateway of a route event */
+	uint8_t				pad[2];
+};
+
+/**
+ * @brief	uevent record, props holds nprops "KEY=value" strings each
+ * 		terminated by a NUL like the kernel sends them
+*/
+struct netlinkdev_outuevent {
+	struct netlinkdev_outhdr	hdr;		/**< NETLINKDEV_OUTPUT_UEVENT */
+	uint8_t				action;		/**< UEVENTDEV_ACTION_ADD, _REMOVE or _OTHER */
+	uint8_t				truncated;	/**< properties left out for lack of room */
+	uint16_t			nprops;		/**< number of properties in props */
+	uint32_t			propslen;	/**< bytes used in props */
+	char				if_name[16];	/**< INTERFACE of a network device, empty otherwise */
+	char				devname[56];	/**< device name */
+	char				props[NETLINKDEV_OUTPUT_PROPSIZE];	/**< properties */
+};
+
+/**
+ * @brief	output context structure
+*/
+struct netlinkdev_output {
+	int				fd;		/**< descriptor written to, -1 if not started */
+	int				format;		/**< NETLINKDEV_OUTPUT_JSON or NETLINKDEV_OUTPUT_BINARY */
+	unsigned char			*buf;		/**< records of the batch */
+	size_t				buflen;		/**< bytes used in buf */
+	struct iovec			iov[NETLINKDEV_OUTPUT_MAXIOV];	/**< one entry per record */
+	int				niov;		/**< records in the batch */
+	uint32_t			seq;		/**< sequence number of the last record */
+	unsigned long			records;	/**< records written */
+	unsigned long			writes;		/**< writev calls made */
+};
+
+int netlinkdev_output_start(struct netlinkdev_output *out, int fd, int format);
+int netlinkdev_output_stop(struct netlinkdev_output *out);
+int netlinkdev_output_netlink(struct netlinkdev_output *out, int event, const struct netlinkdev_data *nd);
+int netlinkdev_output_uevent(struct netlinkdev_output *out, const struct ueventdev_data *ud);
+int netlinkdev_output_flush(struct netlinkdev_output *out);
+
+#endif
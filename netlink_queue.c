@@ -0,0 +1,113 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * bounded queue of netlink events drained by the caller
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_queue.c
+ * @brief	Bounded ring of netlink events waiting to be read by the caller.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+
+#include "netlink_logs.h"
+#include "netlink_devices.h"
+#include "netlink_queue.h"
+
+/**
+ * @brief	Allocate the queue
+ * @param[in]	q		queue context
+ * @param[in]	size		minimum number of events held, rounded up to a power of 2
+ * @return	0 on success, negative on error
+ */
+int netlinkdev_queue_init(struct netlinkdev_queue *q, unsigned int size)
+{
+	unsigned int n = 1;
+
+	memset(q, 0, sizeof(struct netlinkdev_queue));
+	if (size == 0 || size > (1u << 20))
+		return -EINVAL;
+	while (n < size)
+		n <<= 1;
+	q->entries = calloc(n, sizeof(struct netlinkdev_data));
+	if (!q->entries) {
+		NL_LOG(NLLOG_ERROR, "Could not allocate event queue");
+		return -ENOMEM;
+	}
+	q->size = n;
+	return 0;
+}
+
+/**
+ * @brief	Release the queue and any events still in it
+ * @param[in]	q		queue context
+ * @return	nothing
+ */
+void netlinkdev_queue_free(struct netlinkdev_queue *q)
+{
+	free(q->entries);
+	memset(q, 0, sizeof(struct netlinkdev_queue));
+}
+
+/**
+ * @brief	Append an event.  When the queue is full the oldest event is
+ * 		dropped, whatever interface it is for, and counted in dropped.
+ * @param[in]	q		queue context
+ * @param[in]	nd		event to copy into the queue
+ * @return	nothing
+ */
+void netlinkdev_queue_push(struct netlinkdev_queue *q, const struct netlinkdev_data *nd)
+{
+	if (q->count == q->size) {
+		q->head = (q->head + 1) & (q->size - 1);
+		q->count--;
+		q->dropped++;
+	}
+	q->entries[(q->head + q->count) & (q->size - 1)] = *nd;
+	q->count++;
+}
+
+/**
+ * @brief	Copy the oldest events out of the queue
+ * @param[in]	q		queue context
+ * @param[out]	buf		array filled with the events
+ * @param[in]	max		number of entries in buf
+ * @return	number of events copied
+ */
+unsigned int netlinkdev_queue_pop(struct netlinkdev_queue *q, struct netlinkdev_data *buf, unsigned int max)
+{
+	unsigned int n, chunk;
+
+	n = q->count < max ? q->count : max;
+	/* at most two copies, up to the end of the ring and from its start */
+	chunk = q->size - q->head;
+	if (chunk > n)
+		chunk = n;
+	memcpy(buf, &q->entries[q->head], chunk * sizeof(struct netlinkdev_data));
+	memcpy(buf + chunk, q->entries, (n - chunk) * sizeof(struct netlinkdev_data));
+	q->head = (q->head + n) & (q->size - 1);
+	q->count -= n;
+	return n;
+}
@@ -0,0 +1,51 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * bounded queue of netlink events drained by the caller
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_queue.h
+ * @brief	Bounded ring of netlink events waiting to be read by the caller.
+ *
+ */
+
+
+#ifndef NETLINK_QUEUE_H_
+#define NETLINK_QUEUE_H_
+
+struct netlinkdev_data;
+
+/**
+ * @brief	event queue, the oldest events are dropped when it is full
+*/
+struct netlinkdev_queue {
+	struct netlinkdev_data		*entries;	/**< ring of queued events */
+	unsigned int			size;		/**< number of entries, power of 2 */
+	unsigned int			head;		/**< oldest queued event */
+	unsigned int			count;		/**< number of queued events */
+	unsigned long			dropped;	/**< events overwritten before being read */
+};
+
+int netlinkdev_queue_init(struct netlinkdev_queue *q, unsigned int size);
+void netlinkdev_queue_free(struct netlinkdev_queue *q);
+void netlinkdev_queue_push(struct netlinkdev_queue *q, const struct netlinkdev_data *nd);
+unsigned int netlinkdev_queue_pop(struct netlinkdev_queue *q, struct netlinkdev_data *buf, unsigned int max);
+
+#endif
@@ -0,0 +1,489 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink routing tables indexed for longest prefix match lookups
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_routes.c
+ * @brief	Routes kept in a path compressed binary trie per table and
+ * 		family, for longest prefix match lookups.
+ *
+ * Only nodes that hold routes or where two prefixes part exist, so a
+ * lookup visits at most one node per bit of the address and compares
+ * every bit once.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+
+#include "netlink_devices.h"
+#include "netlink_routes.h"
+
+/**
+ * @brief	address length in bytes of a family
+ * @param[in]	family		AF_INET or AF_INET6
+ * @return	16 for AF_INET6, 4 otherwise
+ */
+static int netlinkdev_routes_addrlen(int family)
+{
+	return family == AF_INET6 ? 16 : 4;
+}
+
+/**
+ * @brief	bit of a key, counted from the most significant bit
+ * @param[in]	key		key in network byte order
+ * @param[in]	i		bit number, 0 for the most significant bit
+ * @return	0 or 1
+ */
+static int netlinkdev_routes_bit(const unsigned char *key, int i)
+{
+	return (key[i >> 3] >> (7 - (i & 7))) & 1;
+}
+
+/**
+ * @brief	number of leading bits two keys have in common
+ * @param[in]	a		first key
+ * @param[in]	b		second key
+ * @param[in]	from		bits already known to be equal
+ * @param[in]	max		bits to compare at most
+ * @return	bits in common, at most max
+ */
+static int netlinkdev_routes_common(const unsigned char *a, const unsigned char *b, int from, int max)
+{
+	int i = from;
+	unsigned char x;
+
+	while (i < max) {
+		x = a[i >> 3] ^ b[i >> 3];
+		if (i & 7)
+			x &= 0xff >> (i & 7);
+		if (x) {
+			while (!(x & (0x80 >> (i & 7))))
+				i++;
+			return MIN(i, max);
+		}
+		i = (i | 7) + 1;
+	}
+	return max;
+}
+
+/**
+ * @brief	allocate a node for a prefix
+ * @param[in]	key		prefix, the bits past len are cleared in the node
+ * @param[in]	len		prefix length in bits
+ * @return	node, NULL if out of memory
+ */
+static struct netlinkdev_rtnode *netlinkdev_routes_node(const unsigned char *key, int len)
+{
+	struct netlinkdev_rtnode *n = calloc(1, sizeof(struct netlinkdev_rtnode));
+
+	if (!n)
+		return NULL;
+	n->len = len;
+	memcpy(n->key, key, (len + 7) / 8);
+	if (len & 7)
+		n->key[len >> 3] &= 0xff << (8 - (len & 7));
+	return n;
+}
+
+/**
+ * @brief	free a node and everything below it
+ * @param[in]	n		node, may be NULL
+ * @return	nothing
+ */
+static void netlinkdev_routes_freenode(struct netlinkdev_rtnode *n)
+{
+	struct netlinkdev_route *r;
+
+	if (!n)
+		return;
+	netlinkdev_routes_freenode(n->child[0]);
+	netlinkdev_routes_freenode(n->child[1]);
+	while ((r = n->routes)) {
+		n->routes = r->next;
+		free(r);
+	}
+	free(n);
+}
+
+/**
+ * @brief	find the trie of a table and family
+ * @param[in]	rt		route tables context
+ * @param[in]	table		routing table
+ * @param[in]	family		address family
+ * @param[in]	create		add the trie if there is none
+ * @return	trie, NULL if not found or out of memory
+ */
+static struct netlinkdev_rtrie *netlinkdev_routes_trie(struct netlinkdev_routes *rt, unsigned int table,
+						       int family, int create)
+{
+	struct netlinkdev_rtrie *t;
+
+	for (t = rt->tries; t; t = t->next) {
+		if (t->table == table && t->family == family)
+			return t;
+	}
+	if (!create || !(t = calloc(1, sizeof(struct netlinkdev_rtrie))))
+		return NULL;
+	t->table = table;
+	t->family = family;
+	t->next = rt->tries;
+	rt->tries = t;
+	return t;
+}
+
+/**
+ * @brief	find the node of a prefix, adding it and the branch above it
+ * 		if needed
+ * @param[in]	t		trie
+ * @param[in]	key		prefix
+ * @param[in]	len		prefix length
+ * @return	node, NULL if out of memory
+ */
+static struct netlinkdev_rtnode *netlinkdev_routes_insert(struct netlinkdev_rtrie *t,
+							  const unsigned char *key, int len)
+{
+	struct netlinkdev_rtnode **pn = &t->root, *n, *node, *branch;
+	int c = 0;
+
+	while ((n = *pn)) {
+		c = netlinkdev_routes_common(n->key, key, c, MIN(n->len, len));
+		if (c == n->len) {
+			if (n->len == len)
+				return n;
+			pn = &n->child[netlinkdev_routes_bit(key, n->len)];
+			continue;
+		}
+		/* the prefixes part before n, split there */
+		if (!(node = netlinkdev_routes_node(key, len)))
+			return NULL;
+		if (c == len) {
+			node->child[netlinkdev_routes_bit(n->key, len)] = n;
+			*pn = node;
+			return node;
+		}
+		if (!(branch = netlinkdev_routes_node(key, c))) {
+			free(node);
+			return NULL;
+		}
+		branch->child[netlinkdev_routes_bit(key, c)] = node;
+		branch->child[netlinkdev_routes_bit(n->key, c)] = n;
+		*pn = branch;
+		return node;
+	}
+	return *pn = netlinkdev_routes_node(key, len);
+}
+
+/**
+ * @brief	find the node of a prefix
+ * @param[in]	t		trie searched
+ * @param[in]	key		prefix
+ * @param[in]	len		prefix length in bits
+ * @return	node, NULL if the prefix has none
+ */
+static struct netlinkdev_rtnode *netlinkdev_routes_find(struct netlinkdev_rtrie *t,
+							const unsigned char *key, int len)
+{
+	struct netlinkdev_rtnode *n = t->root;
+	int c = 0;
+
+	while (n && n->len <= len) {
+		c = netlinkdev_routes_common(n->key, key, c, n->len);
+		if (c < n->len)
+			return NULL;
+		if (n->len == len)
+			return n;
+		n = n->child[netlinkdev_routes_bit(key, n->len)];
+	}
+	return NULL;
+}
+
+/**
+ * @brief	drop nodes left without routes on the path to a prefix, a node
+ * 		with one child is replaced by the child
+ * @param[in]	pn		link to the node
+ * @param[in]	key		prefix whose route was removed
+ * @param[in]	len		prefix length
+ * @return	nothing
+ */
+static void netlinkdev_routes_prune(struct netlinkdev_rtnode **pn, const unsigned char *key, int len)
+{
+	struct netlinkdev_rtnode *n = *pn;
+
+	if (!n || n->len > len)
+		return;
+	if (n->len < len)
+		netlinkdev_routes_prune(&n->child[netlinkdev_routes_bit(key, n->len)], key, len);
+	if (n->routes || (n->child[0] && n->child[1]))
+		return;
+	*pn = n->child[0] ? n->child[0] : n->child[1];
+	free(n);
+}
+
+/**
+ * @brief	checks if a route is the one identified by another, routes of
+ * 		a prefix are told apart by tos and priority
+ * @param[in]	a		route
+ * @param[in]	b		route compared with
+ * @return	non-zero if the same route
+ */
+static int netlinkdev_routes_same(const struct netlinkdev_route *a, const struct netlinkdev_route *b)
+{
+	return a->tos == b->tos && a->priority == b->priority;
+}
+
+/**
+ * @brief	Initialize the route tables
+ * @param[in]	rt		route tables context
+ * @return	always 0 as success
+ */
+int netlinkdev_routes_init(struct netlinkdev_routes *rt)
+{
+	memset(rt, 0, sizeof(struct netlinkdev_routes));
+	return 0;
+}
+
+/**
+ * @brief	Free every route and table
+ * @param[in]	rt		route tables context
+ * @return	nothing
+ */
+void netlinkdev_routes_free(struct netlinkdev_routes *rt)
+{
+	struct netlinkdev_rtrie *t;
+
+	while ((t = rt->tries)) {
+		rt->tries = t->next;
+		netlinkdev_routes_freenode(t->root);
+		free(t);
+	}
+	rt->count = 0;
+}
+
+/**
+ * @brief	Add a route or update the route with the same table, prefix,
+ * 		tos and priority
+ * @param[in]	rt		route tables context
+ * @param[in]	r		route
+ * @param[out]	old		route before the change, may be NULL
+ * @return	NETLINKDEV_ROUTE_ADD, NETLINKDEV_ROUTE_CHANGE, 0 if it did not
+ * 		change, negative errno on error
+ */
+int netlinkdev_routes_update(struct netlinkdev_routes *rt, const struct netlinkdev_route *r,
+			     struct netlinkdev_route *old)
+{
+	struct netlinkdev_rtrie *t;
+	struct netlinkdev_rtnode *n;
+	struct netlinkdev_route **pp, *e;
+	int len = netlinkdev_routes_addrlen(r->family);
+
+	if (r->dst_len < 0 || r->dst_len > len * 8)
+		return -EINVAL;
+	if (!(t = netlinkdev_routes_trie(rt, r->table, r->family, 1)))
+		return -ENOMEM;
+	if (!(n = netlinkdev_routes_insert(t, r->dst, r->dst_len)))
+		return -ENOMEM;
+	for (pp = &n->routes; (e = *pp); pp = &e->next) {
+		if (!netlinkdev_routes_same(e, r))
+			continue;
+		e->stale = 0;
+		if (e->type == r->type && e->if_index == r->if_index && e->gw_len == r->gw_len &&
+		    memcmp(e->gateway, r->gateway, r->gw_len) == 0)
+			return 0;
+		if (old)
+			*old = *e;
+		e->type = r->type;
+		e->if_index = r->if_index;
+		e->gw_len = MIN(r->gw_len, sizeof(e->gateway));
+		memcpy(e->gateway, r->gateway, e->gw_len);
+		return NETLINKDEV_ROUTE_CHANGE;
+	}
+	if (!(e = malloc(sizeof(struct netlinkdev_route)))) {
+		netlinkdev_routes_prune(&t->root, r->dst, r->dst_len);
+		return -ENOMEM;
+	}
+	*e = *r;
+	memcpy(e->dst, n->key, sizeof(e->dst));
+	e->gw_len = MIN(r->gw_len, sizeof(e->gateway));
+	e->stale = 0;
+	/* the preferred route of the prefix comes first */
+	for (pp = &n->routes; *pp && (*pp)->priority <= r->priority; pp = &(*pp)->next)
+		;
+	e->next = *pp;
+	*pp = e;
+	t->count++;
+	rt->count++;
+	return NETLINKDEV_ROUTE_ADD;
+}
+
+/**
+ * @brief	Remove the route with the same table, prefix, tos and priority
+ * @param[in]	rt		route tables context
+ * @param[in]	r		route
+ * @param[out]	old		route removed, may be NULL
+ * @return	0 on success, -ENOENT if not found
+ */
+int netlinkdev_routes_delete(struct netlinkdev_routes *rt, const struct netlinkdev_route *r,
+			     struct netlinkdev_route *old)
+{
+	struct netlinkdev_rtrie *t;
+	struct netlinkdev_rtnode *n;
+	struct netlinkdev_route **pp, *e;
+
+	if (!(t = netlinkdev_routes_trie(rt, r->table, r->family, 0)))
+		return -ENOENT;
+	if (!(n = netlinkdev_routes_find(t, r->dst, r->dst_len)))
+		return -ENOENT;
+	for (pp = &n->routes; (e = *pp); pp = &e->next) {
+		if (!netlinkdev_routes_same(e, r))
+			continue;
+		*pp = e->next;
+		if (old)
+			*old = *e;
+		free(e);
+		t->count--;
+		rt->count--;
+		if (!n->routes)
+			netlinkdev_routes_prune(&t->root, r->dst, r->dst_len);
+		return 0;
+	}
+	return -ENOENT;
+}
+
+/**
+ * @brief	Find the route an address is sent by, the preferred route of
+ * 		the longest matching prefix
+ * @param[in]	rt		route tables context
+ * @param[in]	table		routing table
+ * @param[in]	family		AF_INET or AF_INET6
+ * @param[in]	addr		binary address
+ * @return	route, NULL if no prefix matches
+ */
+const struct netlinkdev_route *netlinkdev_routes_lookup(struct netlinkdev_routes *rt, unsigned int table,
+							int family, const void *addr)
+{
+	struct netlinkdev_rtrie *t;
+	struct netlinkdev_rtnode *n;
+	const struct netlinkdev_route *best = NULL;
+	int bits = netlinkdev_routes_addrlen(family) * 8, c = 0;
+
+	if (!(t = netlinkdev_routes_trie(rt, table, family, 0)))
+		return NULL;
+	for (n = t->root; n; n = n->child[netlinkdev_routes_bit(addr, n->len)]) {
+		c = netlinkdev_routes_common(n->key, addr, c, n->len);
+		if (c < n->len)
+			break;
+		if (n->routes)
+			best = n->routes;
+		if (n->len >= bits)
+			break;
+	}
+	return best;
+}
+
+/**
+ * @brief	mark the routes of a node and below it as stale
+ * @param[in]	n		node, may be NULL
+ * @return	nothing
+ */
+static void netlinkdev_routes_marknode(struct netlinkdev_rtnode *n)
+{
+	struct netlinkdev_route *r;
+
+	for (; n; n = n->child[1]) {
+		for (r = n->routes; r; r = r->next)
+			r->stale = 1;
+		netlinkdev_routes_marknode(n->child[0]);
+	}
+}
+
+/**
+ * @brief	Mark every route as stale before a resync, routes seen again are
+ * 		unmarked by netlinkdev_routes_update()
+ * @param[in]	rt		route tables context
+ * @return	nothing
+ */
+void netlinkdev_routes_mark(struct netlinkdev_routes *rt)
+{
+	struct netlinkdev_rtrie *t;
+
+	for (t = rt->tries; t; t = t->next)
+		netlinkdev_routes_marknode(t->root);
+}
+
+/**
+ * @brief	remove the stale routes of a node and below it, dropping the
+ * 		nodes left without routes
+ * @param[in]	rt		route tables context
+ * @param[in]	t		trie of the node
+ * @param[in]	pn		link to the node
+ * @param[in]	fn		called with each route before it is removed, may be NULL
+ * @param[in]	arg		passed to fn
+ * @return	nothing
+ */
+static void netlinkdev_routes_sweepnode(struct netlinkdev_routes *rt, struct netlinkdev_rtrie *t,
+					struct netlinkdev_rtnode **pn,
+					void (*fn)(const struct netlinkdev_route *, void *), void *arg)
+{
+	struct netlinkdev_rtnode *n = *pn;
+	struct netlinkdev_route **pp, *r;
+
+	if (!n)
+		return;
+	netlinkdev_routes_sweepnode(rt, t, &n->child[0], fn, arg);
+	netlinkdev_routes_sweepnode(rt, t, &n->child[1], fn, arg);
+	for (pp = &n->routes; (r = *pp); ) {
+		if (!r->stale) {
+			pp = &r->next;
+			continue;
+		}
+		*pp = r->next;
+		t->count--;
+		rt->count--;
+		if (fn)
+			fn(r, arg);
+		free(r);
+	}
+	if (n->routes || (n->child[0] && n->child[1]))
+		return;
+	*pn = n->child[0] ? n->child[0] : n->child[1];
+	free(n);
+}
+
+/**
+ * @brief	Remove the routes a resync did not see again
+ * @param[in]	rt		route tables context
+ * @param[in]	fn		called with each route before it is removed, may be NULL
+ * @param[in]	arg		passed to fn
+ * @return	nothing
+ */
+void netlinkdev_routes_sweep(struct netlinkdev_routes *rt,
+			     void (*fn)(const struct netlinkdev_route *, void *), void *arg)
+{
+	struct netlinkdev_rtrie *t;
+
+	for (t = rt->tries; t; t = t->next)
+		netlinkdev_routes_sweepnode(rt, t, &t->root, fn, arg);
+}
@@ -0,0 +1,93 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink routing tables indexed for longest prefix match lookups
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_routes.h
+ * @brief	Routes kept in a path compressed binary trie per table and
+ * 		family, for longest prefix match lookups.
+ *
+ */
+
+
+#ifndef NETLINK_ROUTES_H_
+#define NETLINK_ROUTES_H_
+
+/**
+ * @brief	one route, the fields that identify it and where it sends to
+*/
+struct netlinkdev_route {
+	struct netlinkdev_route		*next;		/**< next route of the same prefix, by priority */
+	unsigned int			table;		/**< routing table */
+	int				family;		/**< AF_INET or AF_INET6 */
+	int				dst_len;	/**< destination prefix length */
+	unsigned char			dst[16];	/**< destination prefix */
+	int				tos;		/**< type of service */
+	unsigned int			priority;	/**< metric, lower is preferred */
+	int				type;		/**< RTN_UNICAST, RTN_LOCAL, RTN_UNREACHABLE, ... */
+	int				if_index;	/**< output interface, 0 if none */
+	int				gw_len;		/**< gateway length, 0 if directly connected */
+	unsigned char			gateway[16];	/**< gateway */
+	int				stale;		/**< not seen again since the resync started */
+};
+
+/**
+ * @brief	trie node, a prefix with the routes to it
+*/
+struct netlinkdev_rtnode {
+	struct netlinkdev_rtnode	*child[2];	/**< longer prefixes by their next bit */
+	int				len;		/**< prefix length in bits */
+	unsigned char			key[16];	/**< prefix, bits past len cleared */
+	struct netlinkdev_route		*routes;	/**< routes to the prefix, NULL for a branch */
+};
+
+/**
+ * @brief	trie of one table and family
+*/
+struct netlinkdev_rtrie {
+	struct netlinkdev_rtrie		*next;		/**< next table */
+	unsigned int			table;		/**< routing table */
+	int				family;		/**< AF_INET or AF_INET6 */
+	struct netlinkdev_rtnode	*root;		/**< shortest prefix */
+	unsigned int			count;		/**< routes in the trie */
+};
+
+/**
+ * @brief	route tables context
+*/
+struct netlinkdev_routes {
+	struct netlinkdev_rtrie		*tries;		/**< one trie per table and family */
+	unsigned int			count;		/**< routes in all tables */
+};
+
+int netlinkdev_routes_init(struct netlinkdev_routes *rt);
+void netlinkdev_routes_free(struct netlinkdev_routes *rt);
+int netlinkdev_routes_update(struct netlinkdev_routes *rt, const struct netlinkdev_route *r,
+			     struct netlinkdev_route *old);
+int netlinkdev_routes_delete(struct netlinkdev_routes *rt, const struct netlinkdev_route *r,
+			     struct netlinkdev_route *old);
+const struct netlinkdev_route *netlinkdev_routes_lookup(struct netlinkdev_routes *rt, unsigned int table,
+							int family, const void *addr);
+void netlinkdev_routes_mark(struct netlinkdev_routes *rt);
+void netlinkdev_routes_sweep(struct netlinkdev_routes *rt,
+			     void (*fn)(const struct netlinkdev_route *, void *), void *arg);
+
+#endif
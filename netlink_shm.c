@@ -0,0 +1,486 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink interface state table published in shared memory
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_shm.c
+ * @brief	Interface state table in shared memory, written by one process
+ * 		and read by others without locks through per-slot seqlocks.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+
+#include "netlink_logs.h"
+#include "netlink_devices.h"
+#include "netlink_shm.h"
+
+/**
+ * @brief	times a reader yields to a writer holding a slot before it
+ * 		checks the writer is still there
+ */
+#define NETLINKDEV_SHM_RETRIES	1000
+
+/**
+ * @brief	open the table, a name with a '/' past the first character is
+ * 		a file path, anything else a POSIX shared memory object
+ * @param[in]	name		table name
+ * @param[in]	flags		open flags
+ * @param[in]	mode		mode if created
+ * @return	file descriptor, negative errno on error
+ */
+static int netlinkdev_shm_fd(const char *name, int flags, mode_t mode)
+{
+	int fd;
+
+	if (name[0] && strchr(name + 1, '/'))
+		fd = open(name, flags, mode);
+	else
+		fd = shm_open(name, flags, mode);
+	return fd < 0 ? -errno : fd;
+}
+
+/**
+ * @brief	remove the table name, mappings still held stay valid
+ * @param[in]	name		table name
+ * @return	nothing
+ */
+static void netlinkdev_shm_unlink(const char *name)
+{
+	if (name[0] && strchr(name + 1, '/'))
+		unlink(name);
+	else
+		shm_unlink(name);
+}
+
+/**
+ * @brief	first slot probed for an interface index
+ * @param[in]	shm		table context
+ * @param[in]	if_index	interface index
+ * @return	slot number
+ */
+static unsigned int netlinkdev_shm_hash(struct netlinkdev_shm *shm, int if_index)
+{
+	return ((unsigned int)if_index * 2654435761u) & (shm->hdr->nslots - 1);
+}
+
+/**
+ * @brief	Create the table and publish it under a name, replacing any
+ * 		table left behind under the same name
+ * @param[in]	shm		table context
+ * @param[in]	name		shared memory name such as "/netlink-devices",
+ * 				or the path of a file to map
+ * @param[in]	nslots		number of interfaces held, rounded up to a power
+ * 				of 2, 0 for NETLINKDEV_SHM_SLOTS
+ * @return	0 on success, negative on error
+ */
+int netlinkdev_shm_create(struct netlinkdev_shm *shm, const char *name, unsigned int nslots)
+{
+	unsigned int n = 1;
+	void *map;
+	int fd;
+
+	memset(shm, 0, sizeof(struct netlinkdev_shm));
+	if (nslots == 0)
+		nslots = NETLINKDEV_SHM_SLOTS;
+	if (nslots > (1u << 20))
+		return -EINVAL;
+	while (n < nslots)
+		n <<= 1;
+
+	shm->size = sizeof(struct netlinkdev_shmhdr) + n * sizeof(struct netlinkdev_shmslot);
+	shm->name = strdup(name);
+	if (!shm->name)
+		return -ENOMEM;
+	if ((fd = netlinkdev_shm_fd(name, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+		NL_LOG(NLLOG_ERROR, "Could not create state table %s (%d)", name, fd);
+		free(shm->name);
+		shm->name = NULL;
+		return fd;
+	}
+	if (ftruncate(fd, shm->size) < 0 ||
+	    (map = mmap(NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		int err = -errno;
+		NL_LOG(NLLOG_ERROR, "Could not map state table %s (%d)", name, err);
+		close(fd);
+		netlinkdev_shm_unlink(name);
+		free(shm->name);
+		shm->name = NULL;
+		return err;
+	}
+	close(fd);
+
+	shm->hdr = map;
+	shm->slots = (struct netlinkdev_shmslot *)(shm->hdr + 1);
+	shm->hdr->version = NETLINKDEV_SHM_VERSION;
+	shm->hdr->nslots = n;
+	shm->hdr->slotsize = sizeof(struct netlinkdev_shmslot);
+	shm->hdr->pid = getpid();
+	/* readers only trust the table once the magic is there */
+	__atomic_store_n(&shm->hdr->magic, NETLINKDEV_SHM_MAGIC, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/**
+ * @brief	Map a table published by another process for reading
+ * @param[in]	shm		table context
+ * @param[in]	name		name the table was created with
+ * @return	0 on success, -ESTALE if the writer went away, negative on error
+ */
+int netlinkdev_shm_open(struct netlinkdev_shm *shm, const char *name)
+{
+	struct netlinkdev_shmhdr *hdr;
+	struct stat st;
+	void *map;
+	int fd, stat = 0;
+
+	memset(shm, 0, sizeof(struct netlinkdev_shm));
+	if ((fd = netlinkdev_shm_fd(name, O_RDONLY, 0)) < 0)
+		return fd;
+	if (fstat(fd, &st) < 0) {
+		stat = -errno;
+		close(fd);
+		return stat;
+	}
+	if ((size_t)st.st_size < sizeof(struct netlinkdev_shmhdr)) {
+		close(fd);
+		return -ESTALE;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -errno;
+
+	hdr = map;
+	if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != NETLINKDEV_SHM_MAGIC)
+		stat = -ESTALE;
+	else if (hdr->version != NETLINKDEV_SHM_VERSION ||
+		 hdr->slotsize != sizeof(struct netlinkdev_shmslot))
+		stat = -EPROTO;
+	else if ((size_t)st.st_size < sizeof(struct netlinkdev_shmhdr) +
+				     (size_t)hdr->nslots * sizeof(struct netlinkdev_shmslot))
+		stat = -EINVAL;
+	if (stat < 0) {
+		munmap(map, st.st_size);
+		return stat;
+	}
+	shm->hdr = hdr;
+	shm->slots = (struct netlinkdev_shmslot *)(hdr + 1);
+	shm->size = st.st_size;
+	return 0;
+}
+
+/**
+ * @brief	Unmap the table.  The writer withdraws it so readers still
+ * 		holding it get -ESTALE and can open the next one.
+ * @param[in]	shm		table context
+ * @return	nothing
+ */
+void netlinkdev_shm_close(struct netlinkdev_shm *shm)
+{
+	if (!shm->hdr)
+		return;
+	if (shm->name) {
+		__atomic_store_n(&shm->hdr->magic, 0, __ATOMIC_RELEASE);
+		netlinkdev_shm_unlink(shm->name);
+		free(shm->name);
+	}
+	munmap(shm->hdr, shm->size);
+	memset(shm, 0, sizeof(struct netlinkdev_shm));
+}
+
+/**
+ * @brief	find the slot of an interface index
+ * @param[in]	shm		table context
+ * @param[in]	if_index	interface index
+ * @param[in]	create		non-zero to return a free slot if not found
+ * @return	slot, NULL if not found or no slot is free
+ */
+static struct netlinkdev_shmslot *netlinkdev_shm_find(struct netlinkdev_shm *shm, int if_index, int create)
+{
+	unsigned int mask = shm->hdr->nslots - 1, h = netlinkdev_shm_hash(shm, if_index), i;
+	struct netlinkdev_shmslot *slot, *freed = NULL;
+
+	for (i = 0; i <= mask; i++) {
+		slot = &shm->slots[(h + i) & mask];
+		if (slot->iface.if_index == if_index)
+			return slot;
+		if (slot->iface.if_index == 0)
+			return !create ? NULL : freed ? freed : slot;
+		if (slot->iface.if_index < 0 && !freed)
+			freed = slot;
+	}
+	return create ? freed : NULL;
+}
+
+/**
+ * @brief	write a slot under its seqlock, unchanged slots are left alone
+ * 		so the generation only moves on real changes
+ * @param[in]	shm		table context
+ * @param[in]	slot		slot written
+ * @param[in]	si		new interface state
+ * @return	nothing
+ */
+static void netlinkdev_shm_write(struct netlinkdev_shm *shm, struct netlinkdev_shmslot *slot,
+				 const struct netlinkdev_shmiface *si)
+{
+	uint32_t seq = slot->seq;
+
+	if (memcmp(&slot->iface, si, sizeof(*si)) == 0)
+		return;
+	__atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(&slot->iface, si, sizeof(*si));
+	__atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&shm->hdr->generation, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief	Publish the current state of an interface
+ * @param[in]	shm		table context, created by this process
+ * @param[in]	iface		interface held in the index
+ * @return	nothing
+ */
+void netlinkdev_shm_publish(struct netlinkdev_shm *shm, const struct netlinkdev_iface *iface)
+{
+	struct netlinkdev_shmiface si;
+	struct netlinkdev_shmslot *slot;
+	struct netlinkdev_ifaddr *a;
+
+	memset(&si, 0, sizeof(si));
+	si.if_index = iface->if_index;
+	si.status = iface->status;
+	memcpy(si.name, iface->name, sizeof(si.name));
+	memcpy(si.link_addr, iface->link_addr, sizeof(si.link_addr));
+	for (a = iface->addrs; a && si.naddrs < NETLINKDEV_SHM_ADDRS; a = a->next) {
+		struct netlinkdev_shmaddr *sa = &si.addrs[si.naddrs++];
+		sa->family = a->family;
+		sa->len = a->len;
+		sa->prefixlen = a->prefixlen;
+		memcpy(sa->addr, a->addr, a->len);
+	}
+
+	slot = netlinkdev_shm_find(shm, iface->if_index, 1);
+	if (!slot) {
+		shm->hdr->full++;
+		return;
+	}
+	netlinkdev_shm_write(shm, slot, &si);
+}
+
+/**
+ * @brief	Withdraw an interface that went away
+ * @param[in]	shm		table context, created by this process
+ * @param[in]	if_index	interface index
+ * @return	nothing
+ */
+void netlinkdev_shm_remove(struct netlinkdev_shm *shm, int if_index)
+{
+	struct netlinkdev_shmslot *slot = netlinkdev_shm_find(shm, if_index, 0);
+	struct netlinkdev_shmiface si;
+
+	if (!slot)
+		return;
+	/* keep the slot in use so probing goes on past it */
+	memset(&si, 0, sizeof(si));
+	si.if_index = -1;
+	netlinkdev_shm_write(shm, slot, &si);
+}
+
+/**
+ * @brief	Get the generation of the table, which changes whenever any
+ * 		interface does, so readers can tell if what they hold is current
+ * @param[in]	shm		table context
+ * @return	generation
+ */
+unsigned int netlinkdev_shm_generation(struct netlinkdev_shm *shm)
+{
+	return __atomic_load_n(&shm->hdr->generation, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief	check the writer has not withdrawn the table
+ * @param[in]	shm		table context
+ * @return	0 if valid, -ESTALE otherwise
+ */
+static int netlinkdev_shm_valid(struct netlinkdev_shm *shm)
+{
+	if (!shm->hdr)
+		return -ENOTCONN;
+	if (__atomic_load_n(&shm->hdr->magic, __ATOMIC_ACQUIRE) != NETLINKDEV_SHM_MAGIC)
+		return -ESTALE;
+	return 0;
+}
+
+/**
+ * @brief	copy a slot out, retrying while the writer is in the middle of it.
+ * 		A writer which died in the middle of a slot leaves it locked, so
+ * 		the retries are bounded.
+ * @param[in]	shm		table context
+ * @param[in]	slot		slot read
+ * @param[out]	out		consistent copy of the interface state
+ * @return	0 on success, -ESTALE if the table was withdrawn or its writer
+ * 		is gone, -EAGAIN if the slot stayed locked
+ */
+static int netlinkdev_shm_read(struct netlinkdev_shm *shm, const struct netlinkdev_shmslot *slot,
+			       struct netlinkdev_shmiface *out)
+{
+	uint32_t s1, s2;
+	unsigned int tries = 0;
+	int stat;
+
+	for (;;) {
+		s1 = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if (!(s1 & 1)) {
+			memcpy(out, &slot->iface, sizeof(*out));
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			s2 = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+			if (s1 == s2)
+				return 0;
+		}
+		else if (++tries < NETLINKDEV_SHM_RETRIES)
+			sched_yield();
+		else {
+			if ((stat = netlinkdev_shm_valid(shm)) < 0)
+				return stat;
+			if (kill(shm->hdr->pid, 0) < 0 && errno == ESRCH)
+				return -ESTALE;
+			return -EAGAIN;
+		}
+	}
+}
+
+/**
+ * @brief	Read the state of an interface by index without locking
+ * @param[in]	shm		table context
+ * @param[in]	if_index	interface index
+ * @param[out]	out		interface state
+ * @return	0 if found, -ENODEV if not, -ESTALE if the table was withdrawn
+ * 		or its writer died, -EAGAIN if the writer holds the slot too long
+ */
+int netlinkdev_shm_byindex(struct netlinkdev_shm *shm, int if_index, struct netlinkdev_shmiface *out)
+{
+	unsigned int mask, h, gen, i;
+	int stat;
+
+	if ((stat = netlinkdev_shm_valid(shm)) < 0)
+		return stat;
+	if (if_index <= 0)
+		return -ENODEV;
+	mask = shm->hdr->nslots - 1;
+	h = netlinkdev_shm_hash(shm, if_index);
+	do {
+		/* a slot moving under the probe is caught by the generation */
+		gen = netlinkdev_shm_generation(shm);
+		for (i = 0; i <= mask; i++) {
+			const struct netlinkdev_shmslot *slot = &shm->slots[(h + i) & mask];
+			int idx = __atomic_load_n(&slot->iface.if_index, __ATOMIC_RELAXED);
+
+			if (idx == 0)
+				break;
+			if (idx != if_index)
+				continue;
+			if ((stat = netlinkdev_shm_read(shm, slot, out)) < 0)
+				return stat;
+			if (out->if_index == if_index)
+				return 0;
+			break;
+		}
+	} while (gen != netlinkdev_shm_generation(shm));
+	return -ENODEV;
+}
+
+/**
+ * @brief	Read the state of an interface by name without locking
+ * @param[in]	shm		table context
+ * @param[in]	name		interface name
+ * @param[out]	out		interface state
+ * @return	0 if found, -ENODEV if not, -ESTALE if the table was withdrawn
+ * 		or its writer died, -EAGAIN if the writer holds the slot too long
+ */
+int netlinkdev_shm_byname(struct netlinkdev_shm *shm, const char *name, struct netlinkdev_shmiface *out)
+{
+	unsigned int gen, i;
+	int stat;
+
+	if ((stat = netlinkdev_shm_valid(shm)) < 0)
+		return stat;
+	do {
+		gen = netlinkdev_shm_generation(shm);
+		for (i = 0; i < shm->hdr->nslots; i++) {
+			const struct netlinkdev_shmslot *slot = &shm->slots[i];
+
+			if (__atomic_load_n(&slot->iface.if_index, __ATOMIC_RELAXED) <= 0 ||
+			    strncmp(slot->iface.name, name, sizeof(slot->iface.name)) != 0)
+				continue;
+			if ((stat = netlinkdev_shm_read(shm, slot, out)) < 0)
+				return stat;
+			if (out->if_index > 0 && strncmp(out->name, name, sizeof(out->name)) == 0)
+				return 0;
+		}
+	} while (gen != netlinkdev_shm_generation(shm));
+	return -ENODEV;
+}
+
+/**
+ * @brief	Get the status of a network interface from the table, the same
+ * 		as netlinkdev_getnet() in the writing process
+ * @param[in]	shm		table context
+ * @param[in]	if_name		name of the interface
+ * @param[out]	nd		netlink data filled in by this function
+ * @return	result of get network status
+ */
+int netlinkdev_shm_getnet(struct netlinkdev_shm *shm, const char *if_name, struct netlinkdev_data *nd)
+{
+	struct netlinkdev_shmiface si;
+	int stat, i;
+
+	if ((stat = netlinkdev_shm_byname(shm, if_name, &si)) < 0)
+		return stat;
+
+	memset(nd, 0, sizeof(struct netlinkdev_data));
+	nd->if_index = si.if_index;
+	nd->status = si.status;
+	memcpy(nd->link_addr, si.link_addr, sizeof(nd->link_addr));
+
+	/* report the first IPv4 address of the interface */
+	for (i = 0; i < si.naddrs; i++) {
+		if (si.addrs[i].family == AF_INET) {
+			nd->net_family = si.addrs[i].family;
+			nd->net_len = MIN(si.addrs[i].len, sizeof(nd->net_addr));
+			memcpy(nd->net_addr, si.addrs[i].addr, nd->net_len);
+			break;
+		}
+	}
+	return 0;
+}
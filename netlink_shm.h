@@ -0,0 +1,128 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink interface state table published in shared memory
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_shm.h
+ * @brief	Interface state table in shared memory, written by one process
+ * 		and read by others without locks through per-slot seqlocks.
+ *
+ */
+
+
+#ifndef NETLINK_SHM_H_
+#define NETLINK_SHM_H_
+
+#include <stdint.h>
+
+#include "netlink_index.h"
+
+struct netlinkdev_data;
+
+/**
+ * @brief	default name of the table published by nltest
+ */
+#define NETLINKDEV_SHM_NAME	"/netlink-devices"
+
+/**
+ * @brief	table layout identification
+ */
+#define NETLINKDEV_SHM_MAGIC	0x4e4c4458	/**< "NLDX" */
+#define NETLINKDEV_SHM_VERSION	1
+
+/**
+ * @brief	default number of slots, power of 2
+ */
+#define NETLINKDEV_SHM_SLOTS	1024
+
+/**
+ * @brief	addresses kept per interface, the others are not published
+ */
+#define NETLINKDEV_SHM_ADDRS	8
+
+/**
+ * @brief	one address of a published interface
+*/
+struct netlinkdev_shmaddr {
+	uint8_t				family;		/**< AF_INET or AF_INET6 */
+	uint8_t				len;		/**< address length */
+	uint8_t				prefixlen;	/**< prefix length */
+	uint8_t				pad;
+	uint8_t				addr[16];	/**< local address */
+};
+
+/**
+ * @brief	published state of one interface
+*/
+struct netlinkdev_shmiface {
+	int32_t				if_index;	/**< interface index, 0 if the slot was never used, -1 if freed */
+	int32_t				status;		/**< interface flags */
+	char				name[NETLINKDEV_IFNAMSIZ];	/**< interface name */
+	uint8_t				link_addr[6];	/**< interface link address */
+	uint8_t				naddrs;		/**< number of addresses in addrs */
+	uint8_t				pad;
+	struct netlinkdev_shmaddr	addrs[NETLINKDEV_SHM_ADDRS];	/**< addresses in the order they were added */
+};
+
+/**
+ * @brief	slot of the table, odd sequence while it is being written
+*/
+struct netlinkdev_shmslot {
+	uint32_t			seq;		/**< slot seqlock */
+	uint32_t			pad;
+	struct netlinkdev_shmiface	iface;		/**< interface state */
+} __attribute__((aligned(64)));
+
+/**
+ * @brief	table header, followed by the slots.  Slots are placed by
+ * 		interface index with linear probing.
+*/
+struct netlinkdev_shmhdr {
+	uint32_t			magic;		/**< NETLINKDEV_SHM_MAGIC, cleared when the writer goes away */
+	uint32_t			version;	/**< NETLINKDEV_SHM_VERSION */
+	uint32_t			nslots;		/**< number of slots, power of 2 */
+	uint32_t			slotsize;	/**< size of a slot */
+	uint32_t			generation;	/**< bumped after every change of a slot */
+	uint32_t			full;		/**< interfaces not published because no slot was free */
+	int32_t				pid;		/**< writer process */
+} __attribute__((aligned(64)));
+
+/**
+ * @brief	shared memory table context, for the writer or a reader
+*/
+struct netlinkdev_shm {
+	struct netlinkdev_shmhdr	*hdr;		/**< mapped table */
+	struct netlinkdev_shmslot	*slots;		/**< slots following the header */
+	size_t				size;		/**< size of the mapping */
+	char				*name;		/**< table name, set for the writer only */
+};
+
+int netlinkdev_shm_create(struct netlinkdev_shm *shm, const char *name, unsigned int nslots);
+int netlinkdev_shm_open(struct netlinkdev_shm *shm, const char *name);
+void netlinkdev_shm_close(struct netlinkdev_shm *shm);
+void netlinkdev_shm_publish(struct netlinkdev_shm *shm, const struct netlinkdev_iface *iface);
+void netlinkdev_shm_remove(struct netlinkdev_shm *shm, int if_index);
+unsigned int netlinkdev_shm_generation(struct netlinkdev_shm *shm);
+int netlinkdev_shm_byindex(struct netlinkdev_shm *shm, int if_index, struct netlinkdev_shmiface *out);
+int netlinkdev_shm_byname(struct netlinkdev_shm *shm, const char *name, struct netlinkdev_shmiface *out);
+int netlinkdev_shm_getnet(struct netlinkdev_shm *shm, const char *if_name, struct netlinkdev_data *nd);
+
+#endif
@@ -0,0 +1,392 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink interface statistics sampled on a timer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_stats.c
+ * @brief	Interface counters sampled with RTM_GETSTATS dumps, the previous
+ * 		sample kept per ifindex to report deltas and rates.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <linux/rtnetlink.h>
+
+#include "netlink_logs.h"
+#include "netlink_native.h"
+#include "netlink_stats.h"
+
+/**
+ * @brief	current monotonic time
+ * @return	time in microseconds
+ */
+static unsigned long long netlinkdev_stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief	first slot probed for an interface index
+ * @param[in]	nslots		number of slots, power of 2
+ * @param[in]	if_index	interface index
+ * @return	slot number
+ */
+static unsigned int netlinkdev_stats_hash(unsigned int nslots, int if_index)
+{
+	return ((unsigned int)if_index * 2654435761u) & (nslots - 1);
+}
+
+/**
+ * @brief	find the slot of an interface index, or the free slot it goes in
+ * @param[in]	slots		table of previous samples
+ * @param[in]	nslots		number of slots, power of 2
+ * @param[in]	if_index	interface index
+ * @return	slot, NULL if the interface is not held and no slot is free
+ */
+static struct netlinkdev_statslot *netlinkdev_stats_probe(struct netlinkdev_statslot *slots,
+							  unsigned int nslots, int if_index)
+{
+	unsigned int mask = nslots - 1, h, i;
+	struct netlinkdev_statslot *slot;
+
+	if (!nslots)
+		return NULL;
+	h = netlinkdev_stats_hash(nslots, if_index);
+	for (i = 0; i <= mask; i++) {
+		slot = &slots[(h + i) & mask];
+		if (slot->if_index == if_index || slot->if_index == 0)
+			return slot;
+	}
+	return NULL;
+}
+
+/**
+ * @brief	rehash the previous samples into a table with room to add more.
+ * 		Interfaces missing from the last two dumps are gone and are
+ * 		left out, so the table does not fill with deleted interfaces.
+ * @param[in]	st		stats sampler context
+ * @return	0 on success, -ENOMEM if memory ran out
+ */
+static int netlinkdev_stats_rehash(struct netlinkdev_stats *st)
+{
+	struct netlinkdev_statslot *slots;
+	unsigned int i, n, kept = 0;
+
+	for (i = 0; i < st->nslots; i++) {
+		if (st->slots[i].if_index && st->slots[i].round + 1 >= st->round)
+			kept++;
+	}
+	n = st->nslots ? st->nslots : NETLINKDEV_STATS_SLOTS;
+	while (kept * 2 >= n)
+		n *= 2;
+	slots = calloc(n, sizeof(*slots));
+	if (!slots)
+		return -ENOMEM;
+	for (i = 0; i < st->nslots; i++) {
+		if (st->slots[i].if_index && st->slots[i].round + 1 >= st->round)
+			*netlinkdev_stats_probe(slots, n, st->slots[i].if_index) = st->slots[i];
+	}
+	free(st->slots);
+	st->slots = slots;
+	st->nslots = n;
+	st->nused = kept;
+	return 0;
+}
+
+/**
+ * @brief	get the slot of an interface, adding it to the table if new
+ * @param[in]	st		stats sampler context
+ * @param[in]	if_index	interface index
+ * @return	slot, NULL if the index is not valid or memory ran out
+ */
+static struct netlinkdev_statslot *netlinkdev_stats_slot(struct netlinkdev_stats *st, int if_index)
+{
+	struct netlinkdev_statslot *slot;
+
+	if (if_index <= 0)
+		return NULL;
+	slot = netlinkdev_stats_probe(st->slots, st->nslots, if_index);
+	if (slot && slot->if_index == if_index)
+		return slot;
+	/* keep the table at most 3/4 full so probes stay short */
+	if ((st->nused + 1) * 4 > st->nslots * 3) {
+		if (netlinkdev_stats_rehash(st) < 0) {
+			NL_LOG(NLLOG_WARN, "stats: no memory to sample interface %d", if_index);
+			return NULL;
+		}
+		slot = netlinkdev_stats_probe(st->slots, st->nslots, if_index);
+	}
+	slot->if_index = if_index;
+	st->nused++;
+	return slot;
+}
+
+/**
+ * @brief	rate of a counter over an interval
+ * @param[in]	delta		counter gained over the interval
+ * @param[in]	us		interval in microseconds
+ * @return	counter per second
+ */
+static unsigned long long netlinkdev_stats_rate(unsigned long long delta, unsigned long long us)
+{
+	return us ? delta * 1000000 / us : 0;
+}
+
+/**
+ * @brief	takes the counters of one interface out of the dump, computes
+ * 		the delta to its previous sample and reports it
+ * @param[in]	st		stats sampler context
+ * @param[in]	if_index	interface index
+ * @param[in]	stats64		struct rtnl_link_stats64, not necessarily aligned
+ * @return	nothing
+ */
+static void netlinkdev_stats_sample(struct netlinkdev_stats *st, int if_index, const void *stats64)
+{
+	struct netlinkdev_statslot *slot = netlinkdev_stats_slot(st, if_index);
+	struct rtnl_link_stats64 cur;
+	struct netlinkdev_ifstats *s;
+	const __u64 *now, *prev;
+	__u64 *delta;
+	unsigned int i;
+
+	if (!slot)
+		return;
+	memcpy(&cur, stats64, sizeof(cur));
+	if (!slot->round) {
+		/* first sight only sets the baseline */
+		slot->last = cur;
+		slot->last_us = st->round_us;
+		slot->round = st->round;
+		return;
+	}
+
+	s = &slot->sample;
+	memset(s, 0, sizeof(*s));
+	s->if_index = if_index;
+	s->interval_us = st->round_us - slot->last_us;
+	/* every member is a __u64 counter, a counter that went back was reset */
+	now = (const __u64 *)&cur;
+	prev = (const __u64 *)&slot->last;
+	delta = (__u64 *)&s->delta;
+	for (i = 0; i < sizeof(cur) / sizeof(__u64); i++)
+		delta[i] = now[i] >= prev[i] ? now[i] - prev[i] : now[i];
+	s->rx_bps = netlinkdev_stats_rate(s->delta.rx_bytes, s->interval_us);
+	s->tx_bps = netlinkdev_stats_rate(s->delta.tx_bytes, s->interval_us);
+	s->rx_pps = netlinkdev_stats_rate(s->delta.rx_packets, s->interval_us);
+	s->tx_pps = netlinkdev_stats_rate(s->delta.tx_packets, s->interval_us);
+	slot->last = cur;
+	slot->last_us = st->round_us;
+	slot->round = st->round;
+	slot->valid = 1;
+
+	if (st->filter && !st->filter(s, st->filterarg))
+		return;
+	if (st->event)
+		st->event(s, st->context);
+}
+
+/**
+ * @brief	handles one decoded message of the dump
+ * @param[in]	m		decoded message
+ * @param[in]	arg		stats sampler context
+ * @return	nothing
+ */
+static void netlinkdev_stats_msg(const struct netlinkdev_rtmsg *m, void *arg)
+{
+	struct netlinkdev_stats *st = arg;
+
+	switch (m->type) {
+		case RTM_NEWSTATS:
+			if (m->stats64)
+				netlinkdev_stats_sample(st, m->if_index, m->stats64);
+			break;
+		case NLMSG_ERROR:
+			if (m->error)
+				NL_LOG(NLLOG_WARN, "stats: dump failed (%d)", m->error);
+			st->busy = 0;
+			break;
+		case NLMSG_DONE:
+			st->busy = 0;
+			break;
+	}
+}
+
+/**
+ * @brief	Start sampling the counters of every interface
+ * @param[in]	st		stats sampler context
+ * @param[in]	interval_ms	sampling interval in milliseconds
+ * @param[in]	stats_cb	called with the delta of each interface every
+ * 				interval, NULL to only pull them with
+ * 				netlinkdev_stats_get()
+ * @param[in]	caller_context	callers context to pass into callback
+ * @return	result of start
+ */
+int netlinkdev_stats_start(struct netlinkdev_stats *st, unsigned int interval_ms,
+			   void (*stats_cb)(const struct netlinkdev_ifstats *, void *),
+			   void *caller_context)
+{
+	struct itimerspec its;
+	int err;
+
+	if (!interval_ms)
+		return -EINVAL;
+	memset(st, 0, sizeof(struct netlinkdev_stats));
+	st->timerfd = -1;
+	st->interval = interval_ms;
+	st->event = stats_cb;
+	st->context = caller_context;
+	st->rxbuf = malloc(NETLINKDEV_NATIVE_BUFSIZE);
+	if (!st->rxbuf)
+		return -ENOMEM;
+	st->fd = netlinkdev_native_open(0);
+	if (st->fd < 0) {
+		err = st->fd;
+		goto fail;
+	}
+	st->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (st->timerfd < 0) {
+		err = -errno;
+		NL_LOG(NLLOG_ERROR, "stats: could not create timer (%d)", errno);
+		goto fail;
+	}
+	memset(&its, 0, sizeof(its));
+	its.it_interval.tv_sec = interval_ms / 1000;
+	its.it_interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+	/* the first tick takes the baseline */
+	its.it_value.tv_nsec = 1;
+	if (timerfd_settime(st->timerfd, 0, &its, NULL) < 0) {
+		err = -errno;
+		NL_LOG(NLLOG_ERROR, "stats: could not arm timer (%d)", errno);
+		goto fail;
+	}
+	return 0;
+
+fail:
+	netlinkdev_stats_stop(st);
+	return err;
+}
+
+/**
+ * @brief	Stop sampling and free the previous samples
+ * @param[in]	st		stats sampler context
+ * @return	always 0 as success
+ */
+int netlinkdev_stats_stop(struct netlinkdev_stats *st)
+{
+	if (st->timerfd >= 0)
+		close(st->timerfd);
+	if (st->fd >= 0)
+		close(st->fd);
+	free(st->slots);
+	free(st->rxbuf);
+	st->fd = -1;
+	st->timerfd = -1;
+	st->slots = NULL;
+	st->nslots = 0;
+	st->nused = 0;
+	st->rxbuf = NULL;
+	return 0;
+}
+
+/**
+ * @brief	Ask for the next sample, called when the timer file descriptor
+ * 		is readable.  A tick is skipped while the previous dump has not
+ * 		been read yet.
+ * @param[in]	st		stats sampler context
+ * @return	0 on success, negative errno if the dump could not be asked for
+ */
+int netlinkdev_stats_timer(struct netlinkdev_stats *st)
+{
+	unsigned long long expirations;
+	int stat;
+
+	if (read(st->timerfd, &expirations, sizeof(expirations)) < 0) {
+		if (errno != EAGAIN)
+			NL_LOG(NLLOG_WARN, "stats: timer read failed (%d)", errno);
+		return 0;
+	}
+	if (st->busy) {
+		st->overruns++;
+		return 0;
+	}
+	st->round++;
+	st->round_us = netlinkdev_stats_now();
+	if ((stat = netlinkdev_native_getstats(st->fd, ++st->seq)) < 0)
+		return stat;
+	st->busy = 1;
+	return 0;
+}
+
+/**
+ * @brief	Read the dump in progress, called when the socket is readable.
+ * 		At most NETLINKDEV_STATS_BATCH datagrams are read per call, the
+ * 		rest is left for the next wakeup of the loop.
+ * @param[in]	st		stats sampler context
+ * @return	number of messages read, negative errno on error
+ */
+int netlinkdev_stats_dispatch(struct netlinkdev_stats *st)
+{
+	int i, n, total = 0;
+
+	for (i = 0; i < NETLINKDEV_STATS_BATCH; i++) {
+		n = netlinkdev_native_recv(st->fd, st->rxbuf, NETLINKDEV_NATIVE_BUFSIZE,
+					   netlinkdev_stats_msg, st);
+		if (n < 0) {
+			/* the dump is lost, the next tick starts over */
+			st->busy = 0;
+			return n;
+		}
+		if (!n)
+			break;
+		total += n;
+	}
+	return total;
+}
+
+/**
+ * @brief	Get the latest delta and rates of an interface
+ * @param[in]	st		stats sampler context
+ * @param[in]	if_index	interface index
+ * @param[out]	out		latest sample
+ * @return	0 on success, -ENOENT if no interval has been sampled yet
+ */
+int netlinkdev_stats_get(struct netlinkdev_stats *st, int if_index, struct netlinkdev_ifstats *out)
+{
+	struct netlinkdev_statslot *slot;
+
+	if (if_index <= 0)
+		return -ENOENT;
+	slot = netlinkdev_stats_probe(st->slots, st->nslots, if_index);
+	if (!slot || slot->if_index != if_index || !slot->valid)
+		return -ENOENT;
+	*out = slot->sample;
+	return 0;
+}
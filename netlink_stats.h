@@ -0,0 +1,104 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink interface statistics sampled on a timer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_stats.h
+ * @brief	Interface counters sampled with RTM_GETSTATS dumps, the previous
+ * 		sample kept per ifindex to report deltas and rates.
+ *
+ */
+
+
+#ifndef NETLINK_STATS_H_
+#define NETLINK_STATS_H_
+
+#include <linux/if_link.h>
+
+/**
+ * @brief	initial number of slots of the previous samples table, power of 2
+ */
+#define NETLINKDEV_STATS_SLOTS		64
+
+/**
+ * @brief	datagrams of a dump read per wakeup, so that a long dump does
+ * 		not hold up the other sources of the loop
+ */
+#define NETLINKDEV_STATS_BATCH		4
+
+/**
+ * @brief	counters of an interface over one sampling interval
+*/
+struct netlinkdev_ifstats {
+	int				if_index;	/**< interface index */
+	char				if_name[16];	/**< interface name (IFNAMSIZ), empty if not known */
+	unsigned long long		interval_us;	/**< time since the previous sample in us */
+	struct rtnl_link_stats64	delta;		/**< counters gained over the interval */
+	unsigned long long		rx_bps;		/**< received bytes per second */
+	unsigned long long		tx_bps;		/**< transmitted bytes per second */
+	unsigned long long		rx_pps;		/**< received packets per second */
+	unsigned long long		tx_pps;		/**< transmitted packets per second */
+};
+
+/**
+ * @brief	previous sample of one interface
+*/
+struct netlinkdev_statslot {
+	int				if_index;	/**< interface index, 0 if the slot is free */
+	struct rtnl_link_stats64	last;		/**< counters of the previous sample */
+	unsigned long long		last_us;	/**< monotonic time of the previous sample in us */
+	unsigned int			round;		/**< round the interface was last seen in, 0 if never */
+	int				valid;		/**< sample holds a delta */
+	struct netlinkdev_ifstats	sample;		/**< latest delta and rates */
+};
+
+/**
+ * @brief	stats sampler context structure
+*/
+struct netlinkdev_stats {
+	int				fd;		/**< route socket the dumps are read from */
+	int				timerfd;	/**< periodic sampling timer */
+	unsigned int			interval;	/**< sampling interval in ms */
+	unsigned int			seq;		/**< sequence number of the last dump */
+	int				busy;		/**< dump in progress */
+	unsigned int			round;		/**< dumps started */
+	unsigned long long		round_us;	/**< monotonic time the running dump was asked for */
+	struct netlinkdev_statslot	*slots;		/**< previous samples hashed by ifindex */
+	unsigned int			nslots;		/**< number of slots, power of 2 */
+	unsigned int			nused;		/**< slots holding an interface */
+	void				*rxbuf;		/**< receive buffer */
+	unsigned long			overruns;	/**< ticks skipped as the previous dump was still running */
+	int				(*filter)(struct netlinkdev_ifstats *, void *);	/**< decides if a sample is
+								     reported, may fill in the name */
+	void				*filterarg;	/**< passed to filter */
+	void				(*event)(const struct netlinkdev_ifstats *, void *);	/**< sample callback, may be NULL */
+	void				*context;	/**< caller context reported back to caller */
+};
+
+int netlinkdev_stats_start(struct netlinkdev_stats *st, unsigned int interval_ms,
+			   void (*stats_cb)(const struct netlinkdev_ifstats *, void *),
+			   void *caller_context);
+int netlinkdev_stats_stop(struct netlinkdev_stats *st);
+int netlinkdev_stats_timer(struct netlinkdev_stats *st);
+int netlinkdev_stats_dispatch(struct netlinkdev_stats *st);
+int netlinkdev_stats_get(struct netlinkdev_stats *st, int if_index, struct netlinkdev_ifstats *out);
+
+#endif
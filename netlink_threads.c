@@ -0,0 +1,446 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * threaded delivery of netlink and uevent events
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_threads.c
+ * @brief	Receiver thread owning the netlink sockets, handing events to
+ * 		a pool of worker threads through lock-free rings.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/prctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "netlink_logs.h"
+#include "netlink_devices.h"
+#include "uevent_devices.h"
+#include "netlink_loop.h"
+#include "netlink_threads.h"
+
+/**
+ * @brief	ring entries per worker when no size is given
+ */
+#define NETLINKDEV_THREADS_RINGSIZE	256
+
+/**
+ * @brief	hands an event to a worker, called by the receiver only
+ * @param[in]	ring		ring of the worker
+ * @param[in]	ev		event copied into the ring
+ * @return	0 on success, -ENOBUFS if the worker is too far behind
+ */
+static int netlinkdev_ring_push(struct netlinkdev_ring *ring, const struct netlinkdev_threadevent *ev)
+{
+	unsigned int tail = ring->tail;
+
+	if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->size) {
+		ring->dropped++;
+		return -ENOBUFS;
+	}
+	ring->entries[tail & (ring->size - 1)] = *ev;
+	__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+	sem_post(&ring->items);
+	return 0;
+}
+
+/**
+ * @brief	takes the oldest event, called by the worker only
+ * @param[in]	ring		ring of the worker
+ * @param[out]	ev		event copied out of the ring
+ * @return	1 if an event was taken, 0 if the ring is empty
+ */
+static int netlinkdev_ring_pop(struct netlinkdev_ring *ring, struct netlinkdev_threadevent *ev)
+{
+	unsigned int head = ring->head;
+
+	if (head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE))
+		return 0;
+	*ev = ring->entries[head & (ring->size - 1)];
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+/**
+ * @brief	worker for a key, the same interface always goes to the same
+ * 		worker so its events stay in order
+ * @param[in]	th		thread pool context
+ * @param[in]	key		interface index or device hash
+ * @return	ring of the worker
+ */
+static struct netlinkdev_ring *netlinkdev_threads_shard(struct netlinkdev_threads *th, unsigned int key)
+{
+	return &th->workers[key % th->nworkers];
+}
+
+/**
+ * @brief	netlink event callback installed while threaded, runs on the receiver
+ * @param[in]	event		event identifier
+ * @param[in]	nd		event data
+ * @param[in]	arg		thread pool context
+ * @return	nothing
+ */
+static void netlinkdev_threads_netlinkcb(int event, struct netlinkdev_data *nd, void *arg)
+{
+	struct netlinkdev_threads *th = arg;
+	struct netlinkdev_threadevent ev;
+
+	ev.ud = NULL;
+	ev.nd = *nd;
+	ev.nd.event = event;
+	if (netlinkdev_ring_push(netlinkdev_threads_shard(th, nd->if_index), &ev) < 0)
+		if (LOG_DETAILS) NL_LOG(NLLOG_DEBUG, "threads: netlink event dropped");
+}
+
+/**
+ * @brief	uevent callback installed while threaded, runs on the receiver.
+ * 		Network devices are sharded by IFINDEX like their netlink
+ * 		events, other devices by DEVPATH.
+ * @param[in]	ud		uevent data, only valid during the call
+ * @param[in]	arg		thread pool context
+ * @return	nothing
+ */
+static void netlinkdev_threads_ueventcb(struct ueventdev_data *ud, void *arg)
+{
+	struct netlinkdev_threads *th = arg;
+	struct netlinkdev_threadevent ev;
+	const char *p;
+	unsigned int key;
+
+	if ((p = ueventdev_getprop(ud, "IFINDEX")) != NULL) {
+		key = strtoul(p, NULL, 10);
+	}
+	else {
+		p = ueventdev_getprop(ud, "DEVPATH");
+		if (!p)
+			p = ud->devname;
+		for (key = 2166136261u; *p; p++)
+			key = (key ^ (unsigned char)*p) * 16777619u;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.ud = ueventdev_dup(ud);
+	if (!ev.ud) {
+		NL_LOG(NLLOG_WARN, "threads: could not copy uevent");
+		return;
+	}
+	if (netlinkdev_ring_push(netlinkdev_threads_shard(th, key), &ev) < 0) {
+		if (LOG_DETAILS) NL_LOG(NLLOG_DEBUG, "threads: uevent dropped");
+		free(ev.ud);
+	}
+}
+
+/**
+ * @brief	loop handler for the stop eventfd
+ * @param[in]	fd		eventfd
+ * @param[in]	events		epoll events
+ * @param[in]	arg		thread pool context
+ * @return	always 0
+ */
+static int netlinkdev_threads_stopcb(int fd, unsigned int events, void *arg)
+{
+	struct netlinkdev_threads *th = arg;
+	uint64_t val;
+
+	if (read(fd, &val, sizeof(val)) < 0 && errno != EAGAIN)
+		NL_LOG(NLLOG_WARN, "threads: stop read failed (%d)", errno);
+	netlinkdev_loop_stop(&th->loop);
+	return 0;
+}
+
+/**
+ * @brief	receiver thread, reads both sockets and does nothing else so
+ * 		the kernel buffers are drained however long the callbacks take
+ * @param[in]	arg		thread pool context
+ * @return	NULL
+ */
+static void *netlinkdev_threads_receive(void *arg)
+{
+	struct netlinkdev_threads *th = arg;
+	struct epoll_event ev;
+	int n;
+
+	prctl(PR_SET_NAME, "nlreceiver");
+	while (th->loop.running) {
+		/* wait without the lock, the sources are level triggered
+		 * so they are still ready when dispatched below */
+		n = epoll_wait(th->loop.epfd, &ev, 1, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			NL_LOG(NLLOG_ERROR, "threads: epoll wait failed (%d)", errno);
+			break;
+		}
+		pthread_mutex_lock(&th->lock);
+		netlinkdev_loop_poll(&th->loop, 0);
+		pthread_mutex_unlock(&th->lock);
+	}
+	return NULL;
+}
+
+/**
+ * @brief	worker thread, runs the callbacks for its share of the interfaces
+ * @param[in]	arg		ring of the worker
+ * @return	NULL
+ */
+static void *netlinkdev_threads_work(void *arg)
+{
+	struct netlinkdev_ring *ring = arg;
+	struct netlinkdev_threads *th = ring->th;
+	struct netlinkdev_threadevent ev;
+
+	prctl(PR_SET_NAME, "nlworker");
+	while (1) {
+		while (sem_wait(&ring->items) < 0 && errno == EINTR)
+			;
+		/* a post without an entry is the request to exit */
+		if (!netlinkdev_ring_pop(ring, &ev))
+			break;
+		if (ev.ud) {
+			if (th->uevent)
+				th->uevent(ev.ud, th->ucontext);
+			free(ev.ud);
+		}
+		else if (th->nlevent) {
+			th->nlevent(ev.nd.event, &ev.nd, th->nlcontext);
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief	stops and releases the workers that were started
+ * @param[in]	th		thread pool context
+ * @param[in]	started		number of running workers
+ * @return	nothing
+ */
+static void netlinkdev_threads_freeworkers(struct netlinkdev_threads *th, int started)
+{
+	struct netlinkdev_threadevent ev;
+	int i;
+
+	for (i = 0; i < started; i++)
+		sem_post(&th->workers[i].items);
+	for (i = 0; i < started; i++)
+		pthread_join(th->workers[i].thread, NULL);
+	for (i = 0; i < th->nworkers; i++) {
+		/* only left behind if the workers never ran */
+		while (netlinkdev_ring_pop(&th->workers[i], &ev))
+			free(ev.ud);
+		sem_destroy(&th->workers[i].items);
+		free(th->workers[i].entries);
+	}
+	free(th->workers);
+	th->workers = NULL;
+}
+
+/**
+ * @brief	Hand both netlink contexts to a receiver thread.  Events are
+ * 		queued to a pool of workers that run the callbacks installed at
+ * 		start, each interface always on the same worker.  The contexts
+ * 		must not be polled by the caller until the threads are stopped,
+ * 		and their state must only be read under netlinkdev_threads_lock().
+ * @param[in]	th		thread pool context
+ * @param[in]	nl		started netlink context
+ * @param[in]	ul		started uevent context, NULL for netlink only
+ * @param[in]	nworkers	number of worker threads
+ * @param[in]	ring_size	events queued per worker, 0 for the default
+ * @return	result of start
+ */
+int netlinkdev_threads_start(struct netlinkdev_threads *th, struct netlinkdev_info *nl,
+			     struct ueventdev_info *ul, int nworkers, unsigned int ring_size)
+{
+	unsigned int size = 1;
+	int stat, i;
+
+	if (nworkers < 1 || nworkers > NETLINKDEV_THREADS_MAXWORKERS)
+		return -EINVAL;
+	if (nl->queue)
+		return -EBUSY;
+	if (!ring_size)
+		ring_size = NETLINKDEV_THREADS_RINGSIZE;
+	while (size < ring_size)
+		size <<= 1;
+
+	memset(th, 0, sizeof(struct netlinkdev_threads));
+	th->nl = nl;
+	th->ul = ul;
+	th->stopfd = -1;
+	th->nworkers = nworkers;
+	th->workers = calloc(nworkers, sizeof(struct netlinkdev_ring));
+	if (!th->workers)
+		return -ENOMEM;
+	for (i = 0; i < nworkers; i++) {
+		th->workers[i].th = th;
+		th->workers[i].size = size;
+		th->workers[i].entries = calloc(size, sizeof(struct netlinkdev_threadevent));
+		sem_init(&th->workers[i].items, 0, 0);
+		if (!th->workers[i].entries) {
+			th->nworkers = i + 1;
+			netlinkdev_threads_freeworkers(th, 0);
+			return -ENOMEM;
+		}
+	}
+
+	if ((stat = netlinkdev_loop_init(&th->loop)) < 0) {
+		netlinkdev_threads_freeworkers(th, 0);
+		return stat;
+	}
+	th->stopfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (th->stopfd < 0)
+		stat = -errno;
+	if (!stat)
+		stat = netlinkdev_loop_add(&th->loop, th->stopfd, netlinkdev_threads_stopcb, th);
+	if (!stat)
+		stat = netlinkdev_loop_add_netlink(&th->loop, nl);
+	if (!stat && ul)
+		stat = netlinkdev_loop_add_uevent(&th->loop, ul);
+	if (stat < 0) {
+		NL_LOG(NLLOG_ERROR, "threads: could not set up the receiver loop");
+		goto failloop;
+	}
+
+	/* the receiver takes over the callbacks and the workers call the originals */
+	th->nlevent = nl->event;
+	th->nlcontext = nl->context;
+	if (ul) {
+		th->uevent = ul->event;
+		th->ucontext = ul->context;
+	}
+	pthread_mutex_init(&th->lock, NULL);
+
+	for (i = 0; i < nworkers; i++) {
+		if ((stat = pthread_create(&th->workers[i].thread, NULL, netlinkdev_threads_work, &th->workers[i])) != 0) {
+			NL_LOG(NLLOG_ERROR, "threads: could not create worker (%d)", stat);
+			netlinkdev_threads_freeworkers(th, i);
+			stat = -stat;
+			goto failmutex;
+		}
+	}
+
+	nl->event = netlinkdev_threads_netlinkcb;
+	nl->context = th;
+	if (ul) {
+		ul->event = netlinkdev_threads_ueventcb;
+		ul->context = th;
+	}
+	th->loop.running = 1;
+	if ((stat = pthread_create(&th->receiver, NULL, netlinkdev_threads_receive, th)) != 0) {
+		NL_LOG(NLLOG_ERROR, "threads: could not create receiver (%d)", stat);
+		nl->event = th->nlevent;
+		nl->context = th->nlcontext;
+		if (ul) {
+			ul->event = th->uevent;
+			ul->context = th->ucontext;
+		}
+		netlinkdev_threads_freeworkers(th, nworkers);
+		stat = -stat;
+		goto failmutex;
+	}
+	NL_LOG(NLLOG_DEBUG, "threads: receiver and %d workers started", nworkers);
+	return 0;
+
+failmutex:
+	pthread_mutex_destroy(&th->lock);
+failloop:
+	netlinkdev_loop_free(&th->loop);
+	if (th->stopfd >= 0)
+		close(th->stopfd);
+	th->stopfd = -1;
+	if (th->workers)
+		netlinkdev_threads_freeworkers(th, 0);
+	return stat;
+}
+
+/**
+ * @brief	Stop the receiver, let the workers finish the queued events and
+ * 		give the contexts and their callbacks back to the caller
+ * @param[in]	th		thread pool context
+ * @return	result of stop
+ */
+int netlinkdev_threads_stop(struct netlinkdev_threads *th)
+{
+	uint64_t one = 1;
+
+	if (!th->workers)
+		return -EINVAL;
+	if (write(th->stopfd, &one, sizeof(one)) < 0)
+		NL_LOG(NLLOG_WARN, "threads: stop write failed (%d)", errno);
+	pthread_join(th->receiver, NULL);
+	netlinkdev_threads_freeworkers(th, th->nworkers);
+
+	th->nl->event = th->nlevent;
+	th->nl->context = th->nlcontext;
+	if (th->ul) {
+		th->ul->event = th->uevent;
+		th->ul->context = th->ucontext;
+	}
+	pthread_mutex_destroy(&th->lock);
+	netlinkdev_loop_free(&th->loop);
+	close(th->stopfd);
+	th->stopfd = -1;
+	NL_LOG(NLLOG_DEBUG, "threads: stopped");
+	return 0;
+}
+
+/**
+ * @brief	Keep the receiver from updating the contexts, for example while
+ * 		calling netlinkdev_getnet() from another thread
+ * @param[in]	th		thread pool context
+ * @return	nothing
+ */
+void netlinkdev_threads_lock(struct netlinkdev_threads *th)
+{
+	pthread_mutex_lock(&th->lock);
+}
+
+/**
+ * @brief	Let the receiver continue
+ * @param[in]	th		thread pool context
+ * @return	nothing
+ */
+void netlinkdev_threads_unlock(struct netlinkdev_threads *th)
+{
+	pthread_mutex_unlock(&th->lock);
+}
+
+/**
+ * @brief	Number of events dropped because a worker fell too far behind
+ * @param[in]	th		thread pool context
+ * @return	dropped events across all workers
+ */
+unsigned long netlinkdev_threads_dropped(struct netlinkdev_threads *th)
+{
+	unsigned long dropped = 0;
+	int i;
+
+	for (i = 0; th->workers && i < th->nworkers; i++)
+		dropped += th->workers[i].dropped;
+	return dropped;
+}
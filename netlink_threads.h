@@ -0,0 +1,91 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * threaded delivery of netlink and uevent events
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_threads.h
+ * @brief	Receiver thread owning the netlink sockets, handing events to
+ * 		a pool of worker threads through lock-free rings.
+ *
+ */
+
+
+#ifndef NETLINK_THREADS_H_
+#define NETLINK_THREADS_H_
+
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "netlink_loop.h"
+
+/**
+ * @brief	maximum number of worker threads
+ */
+#define NETLINKDEV_THREADS_MAXWORKERS	64
+
+/**
+ * @brief	one event handed from the receiver to a worker
+*/
+struct netlinkdev_threadevent {
+	struct ueventdev_data		*ud;		/**< copied uevent, NULL for a netlink event */
+	struct netlinkdev_data		nd;		/**< netlink event, type in nd.event */
+};
+
+/**
+ * @brief	single producer single consumer ring feeding one worker
+*/
+struct netlinkdev_ring {
+	struct netlinkdev_threadevent	*entries;	/**< ring entries */
+	unsigned int			size;		/**< number of entries, power of 2 */
+	unsigned int			head;		/**< next entry read by the worker */
+	unsigned int			tail;		/**< next entry written by the receiver */
+	sem_t				items;		/**< counts entries for the worker to sleep on */
+	unsigned long			dropped;	/**< events dropped because the ring was full */
+	pthread_t			thread;		/**< worker thread */
+	struct netlinkdev_threads	*th;		/**< owning thread pool */
+};
+
+/**
+ * @brief	threaded mode context structure
+*/
+struct netlinkdev_threads {
+	struct netlinkdev_info		*nl;		/**< netlink context owned by the receiver */
+	struct ueventdev_info		*ul;		/**< uevent context owned by the receiver, may be NULL */
+	struct netlinkdev_loop		loop;		/**< receiver event loop */
+	pthread_t			receiver;	/**< receiver thread */
+	pthread_mutex_t			lock;		/**< held by the receiver while processing */
+	int				stopfd;		/**< eventfd waking the receiver to stop */
+	int				nworkers;	/**< number of workers */
+	struct netlinkdev_ring		*workers;	/**< one ring per worker */
+	void 				(*nlevent)(int, struct netlinkdev_data *, void *);	/**< netlink callback run by the workers */
+	void				*nlcontext;	/**< netlink caller context */
+	void 				(*uevent)(struct ueventdev_data *, void *);	/**< uevent callback run by the workers */
+	void				*ucontext;	/**< uevent caller context */
+};
+
+int netlinkdev_threads_start(struct netlinkdev_threads *th, struct netlinkdev_info *nl,
+			     struct ueventdev_info *ul, int nworkers, unsigned int ring_size);
+int netlinkdev_threads_stop(struct netlinkdev_threads *th);
+void netlinkdev_threads_lock(struct netlinkdev_threads *th);
+void netlinkdev_threads_unlock(struct netlinkdev_threads *th);
+unsigned long netlinkdev_threads_dropped(struct netlinkdev_threads *th);
+
+#endif
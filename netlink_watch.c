@@ -0,0 +1,303 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink interface watch list compiled into a route socket filter
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_watch.c
+ * @brief	Set of watched interfaces turned into a BPF filter on the
+ * 		rtnetlink socket.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <fnmatch.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include "netlink_logs.h"
+#include "netlink_bpf.h"
+#include "netlink_watch.h"
+
+/**
+ * @brief	offsets into a link or address notification seen by the filter
+ */
+#define NETLINKDEV_WATCH_OFF_TYPE	4	/**< nlmsghdr.nlmsg_type */
+#define NETLINKDEV_WATCH_OFF_FLAGS	6	/**< nlmsghdr.nlmsg_flags */
+#define NETLINKDEV_WATCH_OFF_INDEX	20	/**< ifinfomsg.ifi_index and ifaddrmsg.ifa_index */
+#define NETLINKDEV_WATCH_OFF_NLATYPE	34	/**< type of the first link attribute */
+#define NETLINKDEV_WATCH_OFF_IFNAME	36	/**< IFLA_IFNAME, always the first link attribute */
+
+/**
+ * @brief	Release the watch list
+ * @param[in]	w		watch list
+ * @return	nothing
+ */
+void netlinkdev_watch_free(struct netlinkdev_watch *w)
+{
+	unsigned int i;
+
+	for (i = 0; i < w->npatterns; i++)
+		free(w->patterns[i]);
+	free(w->patterns);
+	free(w->indexes);
+	memset(w, 0, sizeof(struct netlinkdev_watch));
+}
+
+/**
+ * @brief	Check if nothing is being watched, meaning every interface is
+ * @param[in]	w		watch list
+ * @return	non-zero if empty
+ */
+int netlinkdev_watch_empty(struct netlinkdev_watch *w)
+{
+	return w->nindexes == 0 && w->npatterns == 0;
+}
+
+/**
+ * @brief	binary search for an interface index
+ * @param[in]	w		watch list
+ * @param[in]	if_index	interface index
+ * @param[out]	pos		position found or where it would be inserted
+ * @return	non-zero if found
+ */
+static int netlinkdev_watch_find(struct netlinkdev_watch *w, int if_index, unsigned int *pos)
+{
+	unsigned int lo = 0, hi = w->nindexes;
+
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+		if (w->indexes[mid].if_index < if_index)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*pos = lo;
+	return lo < w->nindexes && w->indexes[lo].if_index == if_index;
+}
+
+/**
+ * @brief	Check if an interface index is watched
+ * @param[in]	w		watch list
+ * @param[in]	if_index	interface index
+ * @return	non-zero if watched
+ */
+int netlinkdev_watch_hasindex(struct netlinkdev_watch *w, int if_index)
+{
+	unsigned int pos;
+	return netlinkdev_watch_find(w, if_index, &pos);
+}
+
+/**
+ * @brief	Check if an interface name matches a watched pattern
+ * @param[in]	w		watch list
+ * @param[in]	name		interface name
+ * @return	non-zero if matched
+ */
+int netlinkdev_watch_matchname(struct netlinkdev_watch *w, const char *name)
+{
+	unsigned int i;
+
+	if (!name)
+		return 0;
+	for (i = 0; i < w->npatterns; i++)
+		if (fnmatch(w->patterns[i], name, 0) == 0)
+			return 1;
+	return 0;
+}
+
+/**
+ * @brief	Watch an interface index
+ * @param[in]	w		watch list
+ * @param[in]	if_index	interface index
+ * @param[in]	pinned		non-zero if asked for by index, such entries
+ * 				are kept when the interface goes away
+ * @return	1 if added, 0 if already watched, negative on error
+ */
+int netlinkdev_watch_addindex(struct netlinkdev_watch *w, int if_index, int pinned)
+{
+	unsigned int pos;
+
+	if (netlinkdev_watch_find(w, if_index, &pos)) {
+		w->indexes[pos].pinned |= pinned;
+		return 0;
+	}
+	if (w->nindexes == w->size) {
+		unsigned int size = w->size ? w->size * 2 : 16;
+		struct netlinkdev_watchindex *indexes = realloc(w->indexes, size * sizeof(*indexes));
+		if (!indexes)
+			return -ENOMEM;
+		w->indexes = indexes;
+		w->size = size;
+	}
+	memmove(&w->indexes[pos + 1], &w->indexes[pos], (w->nindexes - pos) * sizeof(*w->indexes));
+	w->indexes[pos].if_index = if_index;
+	w->indexes[pos].pinned = pinned;
+	w->nindexes++;
+	return 1;
+}
+
+/**
+ * @brief	Stop watching an interface index found by name.  Indexes asked
+ * 		for explicitly are kept.
+ * @param[in]	w		watch list
+ * @param[in]	if_index	interface index
+ * @return	1 if removed, 0 otherwise
+ */
+int netlinkdev_watch_delindex(struct netlinkdev_watch *w, int if_index)
+{
+	unsigned int pos;
+
+	if (!netlinkdev_watch_find(w, if_index, &pos) || w->indexes[pos].pinned)
+		return 0;
+	w->nindexes--;
+	memmove(&w->indexes[pos], &w->indexes[pos + 1], (w->nindexes - pos) * sizeof(*w->indexes));
+	return 1;
+}
+
+/**
+ * @brief	Watch interfaces whose name matches a pattern
+ * @param[in]	w		watch list
+ * @param[in]	pattern		shell wildcard pattern such as "eth*"
+ * @return	result of add
+ */
+int netlinkdev_watch_addpattern(struct netlinkdev_watch *w, const char *pattern)
+{
+	char **patterns = realloc(w->patterns, (w->npatterns + 1) * sizeof(char *));
+
+	if (!patterns)
+		return -ENOMEM;
+	w->patterns = patterns;
+	w->patterns[w->npatterns] = strdup(pattern);
+	if (!w->patterns[w->npatterns])
+		return -ENOMEM;
+	w->npatterns++;
+	return 0;
+}
+
+/**
+ * @brief	emits a check accepting the message if the loaded index is watched
+ * @param[in]	w		watch list
+ * @param[in]	b		program being built
+ * @return	nothing
+ */
+static void netlinkdev_watch_buildindexes(struct netlinkdev_watch *w, struct netlinkdev_bpf *b)
+{
+	unsigned int i;
+
+	netlinkdev_bpf_stmt(b, BPF_LD | BPF_W | BPF_ABS, NETLINKDEV_WATCH_OFF_INDEX);
+	for (i = 0; i < w->nindexes; i++) {
+		netlinkdev_bpf_jump(b, BPF_JMP | BPF_JEQ | BPF_K, htonl(w->indexes[i].if_index), 0, 1);
+		netlinkdev_bpf_stmt(b, BPF_RET | BPF_K, 0xffffffff);
+	}
+}
+
+/**
+ * @brief	builds the route socket filter.  Dump replies and anything other
+ * 		than link and address notifications are always accepted.  Names
+ * 		can only be matched in link messages, patterns other than a plain
+ * 		name or a prefix ending in '*' let every link message through.
+ * @param[in]	w		watch list
+ * @param[in]	b		program being built
+ * @return	nothing, errors are kept in b->err
+ */
+static void netlinkdev_watch_build(struct netlinkdev_watch *w, struct netlinkdev_bpf *b)
+{
+	unsigned int linkchk, i;
+
+	netlinkdev_bpf_stmt(b, BPF_LD | BPF_H | BPF_ABS, NETLINKDEV_WATCH_OFF_FLAGS);
+	netlinkdev_bpf_jump(b, BPF_JMP | BPF_JSET | BPF_K, htons(NLM_F_MULTI), 0, 1);
+	netlinkdev_bpf_stmt(b, BPF_RET | BPF_K, 0xffffffff);
+
+	netlinkdev_bpf_stmt(b, BPF_LD | BPF_H | BPF_ABS, NETLINKDEV_WATCH_OFF_TYPE);
+	netlinkdev_bpf_jump(b, BPF_JMP | BPF_JEQ | BPF_K, htons(RTM_NEWADDR), 2, 0);
+	netlinkdev_bpf_jump(b, BPF_JMP | BPF_JEQ | BPF_K, htons(RTM_DELADDR), 1, 0);
+	linkchk = b->len;
+	netlinkdev_bpf_stmt(b, BPF_JMP | BPF_JA, 0);
+
+	/* address messages: by index only */
+	netlinkdev_watch_buildindexes(w, b);
+	netlinkdev_bpf_stmt(b, BPF_RET | BPF_K, 0);
+
+	if (!b->err)
+		b->insns[linkchk].k = b->len - linkchk - 1;
+
+	/* link messages: by index or name, A still holds the message type */
+	netlinkdev_bpf_jump(b, BPF_JMP | BPF_JEQ | BPF_K, htons(RTM_NEWLINK), 2, 0);
+	netlinkdev_bpf_jump(b, BPF_JMP | BPF_JEQ | BPF_K, htons(RTM_DELLINK), 1, 0);
+	netlinkdev_bpf_stmt(b, BPF_RET | BPF_K, 0xffffffff);
+	netlinkdev_watch_buildindexes(w, b);
+	if (w->npatterns) {
+		netlinkdev_bpf_stmt(b, BPF_LD | BPF_H | BPF_ABS, NETLINKDEV_WATCH_OFF_NLATYPE);
+		netlinkdev_bpf_jump(b, BPF_JMP | BPF_JEQ | BPF_K, htons(IFLA_IFNAME), 1, 0);
+		netlinkdev_bpf_stmt(b, BPF_RET | BPF_K, 0xffffffff);
+	}
+	for (i = 0; i < w->npatterns; i++) {
+		const char *pattern = w->patterns[i];
+		int len = strcspn(pattern, "*?[\\");
+
+		if (pattern[len] == '\0')
+			len++;		/* exact name, compare the NUL too */
+		else if (pattern[len] != '*' || pattern[len + 1] != '\0') {
+			/* can't be expressed, leave it to userspace */
+			netlinkdev_bpf_stmt(b, BPF_RET | BPF_K, 0xffffffff);
+			break;
+		}
+		netlinkdev_bpf_cmpbytes(b, 0, NETLINKDEV_WATCH_OFF_IFNAME, pattern, len);
+		netlinkdev_bpf_stmt(b, BPF_RET | BPF_K, 0xffffffff);
+		netlinkdev_bpf_failhere(b);
+	}
+	netlinkdev_bpf_stmt(b, BPF_RET | BPF_K, 0);
+}
+
+/**
+ * @brief	Attach the watch list as a filter on the route socket, an empty
+ * 		list removes the filter.  When the list is too large for a BPF
+ * 		program the filter is removed and filtering is done in userspace.
+ * @param[in]	w		watch list
+ * @param[in]	fd		route socket file descriptor
+ * @return	result of attach
+ */
+int netlinkdev_watch_attach(struct netlinkdev_watch *w, int fd)
+{
+	struct netlinkdev_bpf b;
+	int stat;
+
+	if (netlinkdev_watch_empty(w))
+		return netlinkdev_bpf_detach(fd);
+
+	netlinkdev_bpf_init(&b);
+	netlinkdev_watch_build(w, &b);
+	stat = netlinkdev_bpf_attach(&b, fd);
+	netlinkdev_bpf_free(&b);
+	if (stat < 0) {
+		NL_LOG(NLLOG_WARN, "netlink: watch filter not installed (%d), filtering in userspace", stat);
+		netlinkdev_bpf_detach(fd);
+	}
+	return stat;
+}
+
@@ -0,0 +1,63 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * netlink interface watch list compiled into a route socket filter
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2014 Farnsworth Technology, Inc.
+ */
+
+/**
+ * @file	netlink_watch.h
+ * @brief	Set of watched interfaces turned into a BPF filter on the
+ * 		rtnetlink socket.
+ *
+ */
+
+
+#ifndef NETLINK_WATCH_H_
+#define NETLINK_WATCH_H_
+
+/**
+ * @brief	one watched interface index
+*/
+struct netlinkdev_watchindex {
+	int			if_index;	/**< interface index */
+	int			pinned;		/**< added by index rather than found by name */
+};
+
+/**
+ * @brief	watched interfaces, an empty watch list watches everything
+*/
+struct netlinkdev_watch {
+	struct netlinkdev_watchindex	*indexes;	/**< sorted watched interface indexes */
+	unsigned int			nindexes;	/**< number of watched indexes */
+	unsigned int			size;		/**< allocated indexes */
+	char				**patterns;	/**< watched name patterns (fnmatch) */
+	unsigned int			npatterns;	/**< number of name patterns */
+};
+
+void netlinkdev_watch_free(struct netlinkdev_watch *w);
+int netlinkdev_watch_empty(struct netlinkdev_watch *w);
+int netlinkdev_watch_hasindex(struct netlinkdev_watch *w, int if_index);
+int netlinkdev_watch_matchname(struct netlinkdev_watch *w, const char *name);
+int netlinkdev_watch_addindex(struct netlinkdev_watch *w, int if_index, int pinned);
+int netlinkdev_watch_delindex(struct netlinkdev_watch *w, int if_index);
+int netlinkdev_watch_addpattern(struct netlinkdev_watch *w, const char *pattern);
+int netlinkdev_watch_attach(struct netlinkdev_watch *w, int fd);
+
+#endif
+
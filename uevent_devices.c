@@ -27,6 +27,7 @@
  */
 
 
+#define _GNU_SOURCE	/* recvmmsg */
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
@@ -39,6 +40,8 @@
 #include <sys/socket.h>
 #include <linux/rtnetlink.h>
 #include <linux/if.h>
+#include <linux/filter.h>
+#include <sys/param.h>
 
 #include <netlink/netlink.h>
 #include <netlink/socket.h>
@@ -47,60 +50,164 @@
 
 #include "netlink_logs.h"
 #include "uevent_devices.h"
+#include "netlink_bpf.h"
+#include "netlink_metrics.h"
+#include "netlink_capture.h"
+
+/**
+ * @brief	longest action@devpath header the kernel filter can see past
+ * 		to find SUBSYSTEM, longer uevents are left to userspace
+ */
+#define UEVENTDEV_BPF_MAXHDR	256
 
 
 /**
- * @brief	utility to search string for particular key
- * @param[in]	searchkey	string representing key being searched
- * @param[in]	buf		pointer to buffer search area
- * @param[out]	buflen		length of buffer search area
- * @return	pointer to the data if found, NULL if not found
+ * @brief	splits the NUL separated uevent payload into the property table
+ * 		in a single pass, memchr does the scanning a word at a time
+ * @param[in]	p		pointer to start of event string
+ * @param[in]	len		length of the event string
+ * @param[out]	ud		pointer to uevent data structure
+ * @return	number of properties found
  */
-static char *ueventdev_searchkey(const char *searchkey, char *buf, int buflen)
+static int ueventdev_tokenize(char *p, int len, struct ueventdev_data *ud)
 {
-	int bufpos = 0;
-	int searchkeylen = strlen(searchkey);
-
-	while (bufpos < buflen) {
-		char *key;
-		int keylen;
-
-		key = &buf[bufpos];
-		keylen = strlen(key);
-		if (keylen == 0)
-			break;
-		 if ((strncmp(searchkey, key, searchkeylen) == 0) && key[searchkeylen] == '=')
-			return &key[searchkeylen + 1];
-		bufpos += keylen + 1;
+	char *end = p + len;
+	char *next, *eq;
+
+	ud->nprops = 0;
+	ud->header = p;
+	next = memchr(p, '\0', len);
+	if (!next)
+		return 0;
+	p = next + 1;	/* past header */
+
+	while (p < end) {
+		next = memchr(p, '\0', end - p);
+		if (!next)
+			next = end;
+		eq = memchr(p, '=', next - p);
+		if (eq && ud->nprops < UEVENTDEV_MAXPROPS) {
+			struct ueventdev_prop *prop = &ud->props[ud->nprops++];
+			prop->key = p;
+			prop->keylen = eq - p;
+			prop->value = eq + 1;
+			prop->valuelen = next - eq - 1;
+		}
+		p = next + 1;
+	}
+	return ud->nprops;
+}
+
+/**
+ * @brief	Find a property of the uevent being reported
+ * @param[in]	ud		uevent data passed to the callback
+ * @param[in]	key		property name such as "SUBSYSTEM"
+ * @return	pointer to the value, NULL if not present
+ */
+const char *ueventdev_getprop(const struct ueventdev_data *ud, const char *key)
+{
+	int keylen = strlen(key);
+	int i;
+
+	for (i = 0; i < ud->nprops; i++) {
+		if (ud->props[i].keylen == keylen && memcmp(ud->props[i].key, key, keylen) == 0)
+			return ud->props[i].value;
 	}
 	return NULL;
 }
 
+/**
+ * @brief	Copy a uevent being reported so it outlives the callback.  The
+ * 		properties of the copy point into its own copy of the payload.
+ * @param[in]	ud		uevent data passed to the callback
+ * @return	copy to be released with free(), NULL if out of memory
+ */
+struct ueventdev_data *ueventdev_dup(const struct ueventdev_data *ud)
+{
+	struct ueventdev_data *copy;
+	const char *end;
+	char *payload;
+	int i;
+
+	/* the payload runs from the header to the end of the last value */
+	if (ud->nprops)
+		end = ud->props[ud->nprops - 1].value + ud->props[ud->nprops - 1].valuelen + 1;
+	else
+		end = ud->header + strlen(ud->header) + 1;
+	copy = malloc(sizeof(struct ueventdev_data) + (end - ud->header));
+	if (!copy)
+		return NULL;
+	payload = (char *)(copy + 1);
+	memcpy(copy, ud, sizeof(struct ueventdev_data));
+	memcpy(payload, ud->header, end - ud->header);
+	copy->header = payload;
+	for (i = 0; i < copy->nprops; i++) {
+		copy->props[i].key = payload + (ud->props[i].key - ud->header);
+		copy->props[i].value = payload + (ud->props[i].value - ud->header);
+	}
+	return copy;
+}
+
+/**
+ * @brief	checks a uevent against the installed match rules
+ * @param[in]	ul		pointer to our uevent context
+ * @param[in]	action		ACTION of the uevent
+ * @param[in]	subsystem	SUBSYSTEM of the uevent, may be NULL
+ * @return	1 if any rule matches, 0 otherwise
+ */
+static int ueventdev_matchrules(struct ueventdev_info *ul, const char *action, const char *subsystem)
+{
+	int i;
+
+	for (i = 0; i < ul->nrules; i++) {
+		struct ueventdev_match *rule = &ul->rules[i];
+		if (rule->action && strcmp(rule->action, action))
+			continue;
+		if (rule->subsystem && (!subsystem || strcmp(rule->subsystem, subsystem)))
+			continue;
+		return 1;
+	}
+	return 0;
+}
+
 /**
  * @brief	parses uevent looking for device state change events
+ * @param[in]	ul		pointer to our uevent context
  * @param[in]	p		pointer to start of event string
  * @param[in]	len		length of the event string
  * @param[out]	ud		pointer to uevent data structure
- * @return	1 if interface add or remove found, 0 otherwise
+ * @return	1 if interface add or remove found, or a match rule hit, 0 otherwise
  */
-static int ueventdev_parseuevent(unsigned char *p, int len, struct ueventdev_data *ud)
+static int ueventdev_parseuevent(struct ueventdev_info *ul, unsigned char *p, int len,
+				 struct ueventdev_data *ud)
 {
-	char *payptr = (char *)p;
-	char *end = (char *)p + len;
-	int paylen;
-	char *action, *devname;
+	const char *action, *devname;
 
-	payptr += strlen(payptr)+1;	/* past header */
-	if (payptr>=end)
+	if (!ueventdev_tokenize((char *)p, len, ud))
 		return 0;
-	paylen = end-payptr;
-	action = ueventdev_searchkey("ACTION", payptr, paylen);
-	devname = ueventdev_searchkey("DEVNAME", payptr, paylen);
+	action = ueventdev_getprop(ud, "ACTION");
+	devname = ueventdev_getprop(ud, "DEVNAME");
+	if (action && ul->nrules) {
+		/* the kernel filter did most of the work, this catches what it could not */
+		if (!ueventdev_matchrules(ul, action, ueventdev_getprop(ud, "SUBSYSTEM")))
+			return 0;
+		NL_LOG(NLLOG_DEBUG, "uevent: %s device %s", action, devname ? devname : ud->header);
+		if (!strcmp(action,"add"))
+			ud->action = UEVENTDEV_ACTION_ADD;
+		else if (!strcmp(action,"remove"))
+			ud->action = UEVENTDEV_ACTION_REMOVE;
+		else
+			ud->action = UEVENTDEV_ACTION_OTHER;
+		strncpy(ud->devname, devname ? devname : "", sizeof(ud->devname));
+		ud->devname[sizeof(ud->devname)-1] = '\0';
+		return 1;
+	}
 	if (action && devname) {
 		if (!strcmp(action,"add") || !strcmp(action,"remove")) {
 			NL_LOG(NLLOG_DEBUG, "uevent: %s device %s", action, devname);
 			ud->action = !strcmp(action,"add") ? UEVENTDEV_ACTION_ADD : UEVENTDEV_ACTION_REMOVE;
 			strncpy(ud->devname, devname, sizeof(ud->devname));
+			ud->devname[sizeof(ud->devname)-1] = '\0';
 			return 1;
 		}
 	}
@@ -108,98 +215,263 @@ static int ueventdev_parseuevent(unsigned char *p, int len, struct ueventdev_dat
 }
 
 /**
- * @brief	custom callback for parsing special UEVENT not handled by netlink library
- * @param[in]	nl_msg		incoming netlink message
- * @param[in]	arg		pointer to our netlink context
- * @return	result of parse reported back to netlink library
+ * @brief	parses a received uevent and reports it to the installed callback
+ * @param[in]	ul		pointer to our uevent context
+ * @param[in]	buf		receive buffer holding the uevent
+ * @return	nothing
  */
-static int ueventdev_customcb(struct nl_msg *msg, void *arg)
+static void ueventdev_handlemsg(struct ueventdev_info *ul, struct ueventdev_buf *buf)
 {
-	struct ueventdev_info *ul = (struct ueventdev_info *)arg;
+	struct netlinkdev_metrics *mt = ul->metrics;
 	struct ueventdev_data uevent;
-	struct nlmsghdr *hdr;
+	unsigned long long start = 0;
 
 	if (LOG_DETAILS) NL_LOG(NLLOG_DEBUG, "uevent cb msg");
 
-	if (!msg)
-		return NL_STOP;
-	
-	if (nlmsg_get_proto(msg) == NETLINK_KOBJECT_UEVENT) {
-		hdr = nlmsg_hdr(msg);
-		
-		if (ueventdev_parseuevent(nlmsg_data(hdr), nlmsg_datalen(hdr), &uevent)) {
-			if (ul && ul->event)
-				ul->event (&uevent, ul->context);
-			else
-				NL_LOG(NLLOG_ERROR, "could not send uevent msg");
+	if (ul->capture)
+		netlinkdev_capture_record(ul->capture, NETLINKDEV_CAPTURE_UEVENT, -1, buf->data, buf->len);
+	if (mt)
+		start = netlinkdev_metrics_now();
+	if (ueventdev_parseuevent(ul, buf->data, buf->len, &uevent)) {
+		if (mt) {
+			mt->ue_events++;
+			netlinkdev_hist_record(&mt->ue_latency, netlinkdev_metrics_now() - mt->ue_rxstamp);
 		}
-		return NL_OK;
+		if (ul->event)
+			ul->event (&uevent, ul->context);
+		else
+			NL_LOG(NLLOG_ERROR, "could not send uevent msg");
 	}
-	return NL_SKIP;
+	else if (mt)
+		mt->ue_discarded++;
+	if (mt)
+		netlinkdev_hist_record(&mt->ue_callback, netlinkdev_metrics_now() - start);
 }
 
 /**
- * @brief	callback parses incoming uevent messages
- * @param[in]	nl_sock	netlink socket structure
- * @param[in]	nla		socket address for the incoming message
- * @param[in]	buf		message payload
- * @param[in]	creds		message credentials (ignored)
- * @return	result of parse reported back to netlink library
+ * @brief	make sure a ring buffer can hold a datagram of the given size
+ * @param[in]	buf		ring buffer slot
+ * @param[in]	size		bytes needed
+ * @return	0 on success, -NLE_NOMEM if the buffer could not grow
  */
-static int ueventdev_recvcb(struct nl_sock *sk, struct sockaddr_nl *nla,
-					unsigned char **buf, struct ucred **creds)
+static int ueventdev_bufreserve(struct ueventdev_buf *buf, size_t size)
 {
-	int err=0, n;
+	unsigned char *data;
+	size_t newsize;
+
+	if (size < buf->size)
+		return 0;
+	/* keep room for a terminating NUL so the payload can be parsed as strings */
+	for (newsize = buf->size ? buf->size : UEVENTDEV_BUFSIZE; newsize <= size; newsize *= 2)
+		;
+	data = realloc(buf->data, newsize);
+	if (!data)
+		return -NLE_NOMEM;
+	buf->data = data;
+	buf->size = newsize;
+	return 0;
+}
+
+/**
+ * @brief	receives one uevent datagram into the next ring buffer
+ * @param[in]	ul		pointer to our uevent context
+ * @param[out]	bufp		ring buffer holding the datagram
+ * @return	length received, 0 if nothing is pending, negative on error
+ */
+static int ueventdev_recv(struct ueventdev_info *ul, struct ueventdev_buf **bufp)
+{
+	struct ueventdev_buf *buf = &ul->ring[ul->ring_next];
+	struct sockaddr_nl nla;
 	struct iovec iov;
 	struct msghdr msg;
-	struct nlmsghdr *hdr;
+	int fd = nl_socket_get_fd(ul->socket);
+	int n;
+
+	/* peek at the real datagram length so the buffer is never too short */
+	n = recv(fd, buf->data, 0, MSG_PEEK | MSG_TRUNC);
+	if (n < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return 0;
+		NL_LOG(NLLOG_WARN, "uevent recvmsg rtnd error %d", errno);
+		return -nl_syserr2nlerr(errno);
+	}
+	if (ueventdev_bufreserve(buf, n) < 0) {
+		NL_LOG(NLLOG_WARN, "uevent recvmsg can't grow buffer to %d bytes.", n);
+		recv(fd, buf->data, 0, 0);	/* drop it */
+		return -NLE_NOMEM;
+	}
 
-	msg.msg_name = (void *) nla;
+	memset(&nla, 0, sizeof(nla));
+	iov.iov_base = buf->data;
+	iov.iov_len = buf->size - 1;
+	msg.msg_name = (void *) &nla;
 	msg.msg_namelen = sizeof(struct sockaddr_nl);
 	msg.msg_iov = &iov;
 	msg.msg_iovlen = 1;
 	msg.msg_control = NULL;
 	msg.msg_controllen = 0;
 	msg.msg_flags = 0;
-	memset(nla, 0, sizeof(*nla));
-
-	iov.iov_len = 1024;
-	*buf = malloc(iov.iov_len + sizeof(struct nlmsghdr));
-	if (!*buf)
-		return NLE_NOMEM;
-	iov.iov_base = *buf + sizeof(struct nlmsghdr); 
-
-	do {
-		n = recvmsg(nl_socket_get_fd(sk), &msg, 0);
-		if (LOG_DETAILS) NL_LOG(NLLOG_DEBUG, "uevent recvmsg n=%d.", n);
-		if (!n)
-			break;
-		if (n < 0) {
-			if (errno != EAGAIN) {
-				NL_LOG(NLLOG_WARN, "uevent recvmsg rtnd error %d", errno);
-			}
-			err = -nl_syserr2nlerr(errno);
-			break;
-		}
-		else if (iov.iov_len < n ||
-		    msg.msg_flags & MSG_TRUNC ||
-		    msg.msg_flags & MSG_CTRUNC) {
-			err = -NLE_MSG_TRUNC;
-			NL_LOG(NLLOG_WARN, "uevent recvmsg buffer not big enough.");
-			break;
+
+	n = recvmsg(fd, &msg, 0);
+	ul->recv_calls++;
+	if (LOG_DETAILS) NL_LOG(NLLOG_DEBUG, "uevent recvmsg n=%d.", n);
+	if (n < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return 0;
+		NL_LOG(NLLOG_WARN, "uevent recvmsg rtnd error %d", errno);
+		return -nl_syserr2nlerr(errno);
+	}
+	if (ul->metrics) {
+		ul->metrics->ue_msgs++;
+		ul->metrics->ue_rxstamp = netlinkdev_metrics_now();
+	}
+	if (msg.msg_flags & MSG_TRUNC) {
+		NL_LOG(NLLOG_WARN, "uevent recvmsg buffer not big enough.");
+		if (ul->metrics)
+			ul->metrics->ue_truncated++;
+		return -NLE_MSG_TRUNC;
+	}
+	buf->len = n;
+	buf->data[n] = '\0';
+	ul->recv_msgs++;
+	ul->ring_next = (ul->ring_next + 1) % UEVENTDEV_RING_SLOTS;
+	*bufp = buf;
+	return n;
+}
+
+/**
+ * @brief	receives up to a batch of uevent datagrams with one recvmmsg call
+ * 		and reports each of them
+ * @param[in]	ul		pointer to our uevent context
+ * @return	number of datagrams received, 0 if nothing is pending, negative on error
+ */
+static int ueventdev_recvbatch(struct ueventdev_info *ul)
+{
+	struct mmsghdr msgs[UEVENTDEV_RING_SLOTS];
+	struct iovec iovs[UEVENTDEV_RING_SLOTS];
+	int fd = nl_socket_get_fd(ul->socket);
+	int i, n;
+
+	memset(msgs, 0, sizeof(msgs[0]) * ul->batch);
+	for (i = 0; i < ul->batch; i++) {
+		iovs[i].iov_base = ul->ring[i].data;
+		iovs[i].iov_len = ul->ring[i].size - 1;
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	n = recvmmsg(fd, msgs, ul->batch, 0, NULL);
+	ul->recv_calls++;
+	if (LOG_DETAILS) NL_LOG(NLLOG_DEBUG, "uevent recvmmsg n=%d.", n);
+	if (n < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return 0;
+		NL_LOG(NLLOG_WARN, "uevent recvmmsg rtnd error %d", errno);
+		return -nl_syserr2nlerr(errno);
+	}
+	ul->recv_msgs += n;
+	if (ul->metrics) {
+		ul->metrics->ue_msgs += n;
+		ul->metrics->ue_rxstamp = netlinkdev_metrics_now();
+	}
+
+	/* parse the whole batch in one pass */
+	for (i = 0; i < n; i++) {
+		struct ueventdev_buf *buf = &ul->ring[i];
+
+		if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+			/* larger than any kernel uevent, so not sent by the kernel */
+			NL_LOG(NLLOG_WARN, "uevent recvmmsg buffer not big enough.");
+			if (ul->metrics)
+				ul->metrics->ue_truncated++;
+			ueventdev_bufreserve(buf, buf->size);
+			continue;
 		}
-		/* fill in the nlmsghdr info so it can be processed by libnl */
-		hdr = (struct nlmsghdr *)(*buf);
-		hdr->nlmsg_len = n + sizeof(struct nlmsghdr);
-		hdr->nlmsg_type = 0;
-		hdr->nlmsg_flags = 0;
-		hdr->nlmsg_seq = 0;
-		hdr->nlmsg_pid = nla->nl_pid;
-		err = hdr->nlmsg_len;
-	} while (0);
-	if ( (err <= 0) && *buf)
-		free(*buf);
-	return err;
+		buf->len = msgs[i].msg_len;
+		buf->data[buf->len] = '\0';
+		ueventdev_handlemsg(ul, buf);
+	}
+	return n;
+}
+
+/**
+ * @brief	Set how many uevents are pulled from the socket per receive call
+ * @param[in]	ul		uevent info context ptr
+ * @param[in]	batch		datagrams per recvmmsg call, 1 to receive one at a time
+ * @return	result of set
+ */
+int ueventdev_setbatch(struct ueventdev_info *ul, int batch)
+{
+	if (batch < 1 || batch > UEVENTDEV_RING_SLOTS)
+		return -EINVAL;
+	ul->batch = batch;
+	return 0;
+}
+
+/**
+ * @brief	Enable the instrumentation of the uevent socket.  Datagrams,
+ * 		truncated datagrams, uevents discarded by the parser and uevents
+ * 		reported are counted, the time from reading a datagram to the
+ * 		callback, the time handling each uevent and the uevents per poll
+ * 		are recorded in histograms.
+ * @param[in]	ul		uevent info context ptr
+ * @param[in]	mt		instrumentation context, NULL to disable
+ * @return	always 0 as success
+ */
+int ueventdev_setmetrics(struct ueventdev_info *ul, struct netlinkdev_metrics *mt)
+{
+	ul->metrics = mt;
+	return 0;
+}
+
+/**
+ * @brief	Record every datagram read on the uevent socket into a capture,
+ * 		with the time it was read, so the sequence can be replayed with
+ * 		ueventdev_feed()
+ * @param[in]	ul		uevent info context ptr
+ * @param[in]	cap		capture opened for writing, NULL to stop recording
+ * @return	0 on success, -ENOTCONN if not started on a socket
+ */
+int ueventdev_setcapture(struct ueventdev_info *ul, struct netlinkdev_capture *cap)
+{
+	/* fed datagrams were not read here */
+	if (!ul->socket)
+		return -ENOTCONN;
+	ul->capture = cap;
+	return 0;
+}
+
+/**
+ * @brief	allocates the receive buffer ring, every buffer large enough for
+ * 		any uevent the kernel sends
+ * @param[in]	ul		pointer to our uevent context
+ * @return	0 on success, -1 if out of memory
+ */
+static int ueventdev_ringinit(struct ueventdev_info *ul)
+{
+	int i;
+
+	for (i = 0; i < UEVENTDEV_RING_SLOTS; i++) {
+		if (ueventdev_bufreserve(&ul->ring[i], UEVENTDEV_MSGMAX) < 0)
+			return -1;
+	}
+	ul->ring_next = 0;
+	return 0;
+}
+
+/**
+ * @brief	frees the receive buffer ring
+ * @param[in]	ul		pointer to our uevent context
+ * @return	nothing
+ */
+static void ueventdev_ringfree(struct ueventdev_info *ul)
+{
+	int i;
+
+	for (i = 0; i < UEVENTDEV_RING_SLOTS; i++) {
+		free(ul->ring[i].data);
+		memset(&ul->ring[i], 0, sizeof(ul->ring[i]));
+	}
 }
 
 /**
@@ -230,18 +502,15 @@ static int ueventdev_init(struct ueventdev_info *ul)
 		return - 1;
 	}
 
-	/* get msg uevents directly from callback as libnl does not
- 	 * really support it */
-	ul->cb = nl_cb_clone(nl_socket_get_cb(ul->socket));
-	if (!ul->cb) {
+	/* uevents are read straight into our own recycled buffers as 
+	 * libnl does not really support them and frees every message */
+	if (ueventdev_ringinit(ul) < 0) {
+		ueventdev_ringfree(ul);
 		nl_socket_free(ul->socket);
 		ul->socket = 0;
-		NL_LOG(NLLOG_ERROR, "uevent: can't set new callback");
+		NL_LOG(NLLOG_ERROR, "uevent: can't allocate receive buffers");
 		return - 1;
 	}
-	nl_cb_overwrite_recv(ul->cb, ueventdev_recvcb);
-	nl_cb_set(ul->cb, NL_CB_MSG_IN, NL_CB_CUSTOM, ueventdev_customcb, ul);
-	nl_socket_set_cb(ul->socket, ul->cb);
 
 	return 0;
 }
@@ -254,14 +523,162 @@ static int ueventdev_init(struct ueventdev_info *ul)
 int ueventdev_poll(struct ueventdev_info *ul)
 {
 	if (ul->socket) {
+		struct netlinkdev_metrics *mt = ul->metrics;
+		unsigned long msgs = mt ? mt->ue_msgs : 0;
+		unsigned long events = mt ? mt->ue_events : 0;
+		struct ueventdev_buf *buf;
 		int result;
 		do {
-			result = nl_recvmsgs_report(ul->socket, ul->cb);
-		} while (result > 0);
+			if (ul->batch > 1) {
+				/* a short batch means the socket has been drained */
+				result = ueventdev_recvbatch(ul);
+				if (result < ul->batch)
+					break;
+			}
+			else {
+				result = ueventdev_recv(ul, &buf);
+				if (result > 0)
+					ueventdev_handlemsg(ul, buf);
+			}
+		} while (result > 0 || result == -NLE_MSG_TRUNC);
+		if (mt && mt->ue_msgs != msgs) {
+			mt->ue_polls++;
+			netlinkdev_hist_record(&mt->ue_batch, mt->ue_events - events);
+		}
 	}
 	return 0;
 }
 
+/**
+ * @brief	builds the socket filter accepting only uevents matching the rules
+ * 		The kernel sends "action@devpath" followed by ACTION=, DEVPATH= and
+ * 		SUBSYSTEM= in that order, so once the header length H is known the
+ * 		subsystem starts at 2H+17 bytes.  No loops in classic BPF, so the
+ * 		scan for the end of the header is unrolled.
+ * @param[in]	b		program being built
+ * @param[in]	rules		match rules
+ * @param[in]	nrules		number of match rules
+ * @return	nothing, errors are kept in b->err
+ */
+static void ueventdev_buildfilter(struct netlinkdev_bpf *b, const struct ueventdev_match *rules, int nrules)
+{
+	char match[128];
+	int i, k, needsubsys = 0;
+
+	for (i = 0; i < nrules; i++)
+		if (rules[i].subsystem)
+			needsubsys = 1;
+
+	if (needsubsys) {
+		unsigned int rulesstart = 4 * (UEVENTDEV_BPF_MAXHDR - 1) + 1;
+		for (k = 1; k < UEVENTDEV_BPF_MAXHDR; k++) {
+			netlinkdev_bpf_stmt(b, BPF_LD | BPF_B | BPF_ABS, k);
+			netlinkdev_bpf_jump(b, BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 2);
+			netlinkdev_bpf_stmt(b, BPF_LDX | BPF_W | BPF_IMM, 2 * k + 17);
+			netlinkdev_bpf_stmt(b, BPF_JMP | BPF_JA, rulesstart - b->len - 1);
+		}
+		/* header too long to find SUBSYSTEM, leave it to userspace */
+		netlinkdev_bpf_stmt(b, BPF_RET | BPF_K, 0xffffffff);
+	}
+
+	for (i = 0; i < nrules; i++) {
+		if (rules[i].action) {
+			k = snprintf(match, sizeof(match), "%s@", rules[i].action);
+			netlinkdev_bpf_cmpbytes(b, 0, 0, match, MIN(k, sizeof(match)-1));
+		}
+		if (rules[i].subsystem) {
+			/* include the terminating NUL so "usb" does not match "usbmisc" */
+			k = snprintf(match, sizeof(match), "SUBSYSTEM=%s", rules[i].subsystem);
+			netlinkdev_bpf_cmpbytes(b, 1, 0, match, MIN(k + 1, sizeof(match)));
+		}
+		netlinkdev_bpf_stmt(b, BPF_RET | BPF_K, 0xffffffff);
+		netlinkdev_bpf_failhere(b);
+	}
+	netlinkdev_bpf_stmt(b, BPF_RET | BPF_K, 0);
+}
+
+/**
+ * @brief	frees the installed match rules
+ * @param[in]	ul		pointer to our uevent context
+ * @return	nothing
+ */
+static void ueventdev_freerules(struct ueventdev_info *ul)
+{
+	int i;
+
+	for (i = 0; i < ul->nrules; i++) {
+		free((char *)ul->rules[i].action);
+		free((char *)ul->rules[i].subsystem);
+	}
+	free(ul->rules);
+	ul->rules = NULL;
+	ul->nrules = 0;
+}
+
+/**
+ * @brief	Only report uevents matching one of the rules.  The rules are
+ * 		compiled into a socket filter so other uevents are dropped by the
+ * 		kernel before they are copied to userspace.  Offline contexts
+ * 		only match in userspace.
+ * @param[in]	ul		uevent info context ptr
+ * @param[in]	rules		match rules, copied
+ * @param[in]	nrules		number of match rules, 0 to report add/remove of devices again
+ * @return	result of set filter, -ENOMEM leaves no rules set
+ */
+int ueventdev_setfilter(struct ueventdev_info *ul,
+			const struct ueventdev_match *rules, int nrules)
+{
+	struct netlinkdev_bpf b;
+	int i, stat;
+
+	/* a context started offline has its ring but no socket */
+	if (!ul->socket && !ul->ring[0].data)
+		return -ENOTCONN;
+
+	ueventdev_freerules(ul);
+	if (nrules <= 0)
+		return ul->socket ? netlinkdev_bpf_detach(nl_socket_get_fd(ul->socket)) : 0;
+
+	ul->rules = calloc(nrules, sizeof(struct ueventdev_match));
+	if (!ul->rules)
+		return -ENOMEM;
+	ul->nrules = nrules;
+	for (i = 0; i < nrules; i++) {
+		if ((rules[i].action && !(ul->rules[i].action = strdup(rules[i].action))) ||
+		    (rules[i].subsystem && !(ul->rules[i].subsystem = strdup(rules[i].subsystem)))) {
+			/* a NULL string would match anything, keep no rules at all
+			 * and take the previous filter off the socket too */
+			ueventdev_freerules(ul);
+			if (ul->socket)
+				netlinkdev_bpf_detach(nl_socket_get_fd(ul->socket));
+			return -ENOMEM;
+		}
+	}
+	if (!ul->socket)
+		return 0;
+
+	netlinkdev_bpf_init(&b);
+	ueventdev_buildfilter(&b, rules, nrules);
+	stat = netlinkdev_bpf_attach(&b, nl_socket_get_fd(ul->socket));
+	netlinkdev_bpf_free(&b);
+	if (stat < 0)
+		NL_LOG(NLLOG_WARN, "uevent: kernel filter not installed (%d), filtering in userspace", stat);
+	return 0;
+}
+
+/**
+ * @brief	Get the file descriptor of the uevent socket so it can be
+ * 		waited on by an event loop
+ * @param[in]	ul		uevent info context ptr
+ * @return	file descriptor, negative if not started
+ */
+int ueventdev_getfd(struct ueventdev_info *ul)
+{
+	if (!ul->socket)
+		return -ENOTCONN;
+	return nl_socket_get_fd(ul->socket);
+}
+
 /**
  * @brief	Start a uevent session
  * @param[in]	ul			uevent info context ptr
@@ -279,6 +696,7 @@ int ueventdev_start(struct ueventdev_info *ul,
 
 	ul->event = ueventdev_cb;
 	ul->context = caller_context;
+	ul->batch = 1;
 
 	stat = ueventdev_init(ul);
 	if (stat < 0) {
@@ -290,6 +708,59 @@ int ueventdev_start(struct ueventdev_info *ul,
 }
 
 
+/**
+ * @brief	Start uevent processing without a socket, the datagrams are
+ * 		handed in with ueventdev_feed()
+ * @param[in]	ul		uevent info context ptr
+ * @param[in]	ueventdev_cb	callback to report uevents
+ * @param[in]	caller_context	callers context to pass into callback
+ * @return	result of start
+ */
+int ueventdev_startoffline(struct ueventdev_info *ul,
+			   void (*ueventdev_cb)(struct ueventdev_data *, void *),
+			   void *caller_context)
+{
+	memset(ul, 0, sizeof(struct ueventdev_info));
+
+	ul->event = ueventdev_cb;
+	ul->context = caller_context;
+	ul->batch = 1;
+	if (ueventdev_ringinit(ul) < 0) {
+		ueventdev_ringfree(ul);
+		NL_LOG(NLLOG_ERROR, "uevent: can't allocate receive buffers");
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+/**
+ * @brief	Hand in a raw uevent datagram.  It is copied into the receive
+ * 		ring and goes through the same parsing and reporting as if it
+ * 		had been read from the socket.
+ * @param[in]	ul		uevent info context ptr
+ * @param[in]	data		datagram
+ * @param[in]	len		length of the datagram
+ * @return	0 on success, -ENOMEM if the buffer could not grow
+ */
+int ueventdev_feed(struct ueventdev_info *ul, const void *data, size_t len)
+{
+	struct ueventdev_buf *buf = &ul->ring[ul->ring_next];
+
+	if (ueventdev_bufreserve(buf, len) < 0)
+		return -ENOMEM;
+	memcpy(buf->data, data, len);
+	buf->len = len;
+	buf->data[len] = '\0';
+	ul->recv_msgs++;
+	if (ul->metrics) {
+		ul->metrics->ue_msgs++;
+		ul->metrics->ue_rxstamp = netlinkdev_metrics_now();
+	}
+	ul->ring_next = (ul->ring_next + 1) % UEVENTDEV_RING_SLOTS;
+	ueventdev_handlemsg(ul, buf);
+	return 0;
+}
+
 /**
  * @brief	Remove connections to uevent interface
  * @param[in]	nl		netlink context
@@ -300,6 +771,9 @@ int ueventdev_stop(struct ueventdev_info *ul)
 	if (ul->socket)
 		nl_socket_free(ul->socket);
 	ul->socket = 0;
+	ul->capture = NULL;
+	ueventdev_ringfree(ul);
+	ueventdev_freerules(ul);
 
 	ul->event = NULL;
 	ul->context = NULL;
@@ -30,14 +30,70 @@
 #ifndef UEVENT_DEVICES_H_
 #define UEVENT_DEVICES_H_
 
+/**
+ * @brief	maximum number of properties kept per uevent (kernel UEVENT_NUM_ENVP)
+ */
+#define UEVENTDEV_MAXPROPS	64
+
+/**
+ * @brief	one KEY=value property of a uevent, pointing into the receive buffer
+*/
+struct ueventdev_prop {
+	const char	*key;		/**< start of the key, not terminated */
+	int		keylen;		/**< length of the key */
+	const char	*value;		/**< NUL terminated value */
+	int		valuelen;	/**< length of the value */
+};
+
 /**
  * @brief	represents the interface info for the hotplug event being reported
 */
 struct ueventdev_data {
 #define UEVENTDEV_ACTION_ADD	1
 #define UEVENTDEV_ACTION_REMOVE	2
+#define UEVENTDEV_ACTION_OTHER	3
 	int		action;		/**< change action that just occured for the device */
 	char		devname[50];	/**< interface device name */
+	const char	*header;	/**< action@devpath header of the uevent */
+	int		nprops;		/**< number of properties in props */
+	struct ueventdev_prop	props[UEVENTDEV_MAXPROPS];	/**< every property sent by the kernel,
+								     only valid during the callback */
+};
+
+/**
+ * @brief	uevent match rule, a uevent is reported if it matches any rule
+*/
+struct ueventdev_match {
+	const char	*action;	/**< action such as "add" or "remove", NULL matches any */
+	const char	*subsystem;	/**< subsystem such as "block" or "net", NULL matches any */
+};
+
+/**
+ * @brief	number of receive buffers kept in the uevent ring
+ */
+#define UEVENTDEV_RING_SLOTS	16
+
+/**
+ * @brief	initial size of each receive buffer, grown when a larger uevent is seen.
+ * 		The kernel limits the uevent environment to 2048 bytes plus the header.
+ */
+#define UEVENTDEV_BUFSIZE	4096
+
+/**
+ * @brief	largest datagram the kernel sends: the action@devpath header with
+ * 		a devpath of up to PATH_MAX and an environment of up to
+ * 		UEVENT_BUFFER_SIZE (2048) bytes.  Ring buffers are reserved for
+ * 		it up front since a batch can't peek at each datagram's length.
+ */
+#define UEVENTDEV_MSGMAX	(sizeof("offline@") + 4096 + 2048)
+
+/**
+ * @brief	one recycled receive buffer
+*/
+struct ueventdev_buf {
+	unsigned char		*data;		/**< buffer memory */
+	size_t			size;		/**< allocated size of the buffer */
+	size_t			len;		/**< length of the datagram held */
 };
 
 /**
@@ -45,17 +101,40 @@ struct ueventdev_data {
 */
 struct ueventdev_info {
 	struct nl_sock		*socket;	/**< uevent netlink socket */
-	struct nl_cb		*cb;		/**< callback for reporting uevents */
+	struct ueventdev_buf	ring[UEVENTDEV_RING_SLOTS];	/**< preallocated receive buffers */
+	unsigned int		ring_next;	/**< next ring slot to receive into */
+	int			batch;		/**< datagrams per receive call, 1 disables recvmmsg */
+	unsigned long		recv_calls;	/**< number of receive system calls made */
+	unsigned long		recv_msgs;	/**< number of datagrams received */
+	struct ueventdev_match	*rules;		/**< installed match rules, NULL for add/remove of devices */
+	int			nrules;		/**< number of match rules */
+	struct netlinkdev_metrics *metrics;	/**< instrumentation, NULL when disabled */
+	struct netlinkdev_capture *capture;	/**< datagrams read are recorded here, NULL if not recording */
 
 	void 			(*event)(struct ueventdev_data *, void *);	/**< installed event callback */
 	void			*context;	/**< caller context reported back to caller */
 };
 
+struct netlinkdev_metrics;
+struct netlinkdev_capture;
+
 int ueventdev_start(struct ueventdev_info *ul,
 		    void (*ueventdev_cb)(struct ueventdev_data *, void *),
 		    void *caller_context);
+int ueventdev_startoffline(struct ueventdev_info *ul,
+			   void (*ueventdev_cb)(struct ueventdev_data *, void *),
+			   void *caller_context);
+int ueventdev_feed(struct ueventdev_info *ul, const void *data, size_t len);
 int ueventdev_stop(struct ueventdev_info *ul);
 int ueventdev_poll(struct ueventdev_info *ul);
+int ueventdev_getfd(struct ueventdev_info *ul);
+int ueventdev_setbatch(struct ueventdev_info *ul, int batch);
+int ueventdev_setfilter(struct ueventdev_info *ul,
+			const struct ueventdev_match *rules, int nrules);
+int ueventdev_setmetrics(struct ueventdev_info *ul, struct netlinkdev_metrics *mt);
+int ueventdev_setcapture(struct ueventdev_info *ul, struct netlinkdev_capture *cap);
+const char *ueventdev_getprop(const struct ueventdev_data *ud, const char *key);
+struct ueventdev_data *ueventdev_dup(const struct ueventdev_data *ud);
 
 #endif
 